@@ -20,6 +20,9 @@
 #ifndef CERES_COST_FUNCTIONS_H
 #define CERES_COST_FUNCTIONS_H
 
+// STD
+#include <algorithm>
+#include <cmath>
 // EIGEN
 #include <Eigen/Dense>
 
@@ -272,6 +275,166 @@ private:
   double lambda;
 };
 
+/**
+* \class EulerAngleRotation
+* \brief Rotation R(rx, ry, rz) = Rz(rz) * Ry(ry) * Rx(rx) of the 6-DoF parameters
+*        w = (rx, ry, rz, tx, ty, tz) and its partial derivatives with respect to
+*        the three angles, computed once for all the residuals evaluated at w
+*/
+//-----------------------------------------------------------------------------
+struct EulerAngleRotation
+{
+public:
+  explicit EulerAngleRotation(const double* w)
+  {
+    // store sin / cos values for this angle
+    double crx = std::cos(w[0]); double srx = std::sin(w[0]);
+    double cry = std::cos(w[1]); double sry = std::sin(w[1]);
+    double crz = std::cos(w[2]); double srz = std::sin(w[2]);
+
+    this->R << cry*crz, (srx*sry*crz-crx*srz), (crx*sry*crz+srx*srz),
+               cry*srz, (srx*sry*srz+crx*crz), (crx*sry*srz-srx*crz),
+                  -sry,               srx*cry,               crx*cry;
+
+    // dR / drx = Rz * Ry * dRx / drx
+    this->dR[0] << 0, (crx*sry*crz+srx*srz), (-srx*sry*crz+crx*srz),
+                   0, (crx*sry*srz-srx*crz), (-srx*sry*srz-crx*crz),
+                   0,               crx*cry,              -srx*cry;
+
+    // dR / dry = Rz * dRy / dry * Rx
+    this->dR[1] << -sry*crz, srx*cry*crz, crx*cry*crz,
+                   -sry*srz, srx*cry*srz, crx*cry*srz,
+                       -cry,    -srx*sry,    -crx*sry;
+
+    // dR / drz = dRz / drz * Ry * Rx
+    this->dR[2] << -cry*srz, (-srx*sry*srz-crx*crz), (-crx*sry*srz+srx*crz),
+                    cry*crz,  (srx*sry*crz-crx*srz),  (crx*sry*crz+srx*srz),
+                          0,                      0,                      0;
+  }
+
+  Eigen::Matrix3d R;
+  Eigen::Matrix3d dR[3];
+};
+
+/**
+* \class MahalanobisDistanceAnalyticResidual
+* \brief Residual of MahalanobisDistanceAffineIsometryResidual and of
+*        MahalanobisDistanceLinearDistortionResidual, with its jacobian computed
+*        analytically instead of with the automatic differentiation.
+*
+* The residual is sqrt(lambda * Y' * A * Y) with Y = R * X + (1 - t) * T0 + t * T - C,
+* (R, T) being the transform of the parameters. t is 1 for the affine isometry, and
+* the acquisition time of X for the linear distortion, the rotation applied being
+* the one of the parameters as in MahalanobisDistanceLinearDistortionResidual.
+*/
+//-----------------------------------------------------------------------------
+struct MahalanobisDistanceAnalyticResidual
+{
+public:
+  //! Residual of the affine isometry, as MahalanobisDistanceAffineIsometryResidual
+  MahalanobisDistanceAnalyticResidual(const Eigen::Matrix3d& argA,
+                                      const Eigen::Vector3d& argC,
+                                      const Eigen::Vector3d& argX,
+                                      double argLambda)
+  {
+    this->A = argA;
+    this->C = argC;
+    this->X = argX;
+    this->T0 = Eigen::Vector3d::Zero();
+    this->time = 1.0;
+    this->lambda = argLambda;
+  }
+
+  //! Residual of the linear distortion, as MahalanobisDistanceLinearDistortionResidual
+  MahalanobisDistanceAnalyticResidual(const Eigen::Matrix3d& argA,
+                                      const Eigen::Vector3d& argC,
+                                      const Eigen::Vector3d& argX,
+                                      const Eigen::Vector3d& argT0,
+                                      double argTime,
+                                      double argLambda)
+  {
+    this->A = argA;
+    this->C = argC;
+    this->X = argX;
+    this->T0 = argT0;
+    this->time = argTime;
+    this->lambda = argLambda;
+  }
+
+  /**
+   * @brief Evaluate the residual at the parameters w, of rotation R
+   * @param jacobian if not null, filled with the 6 partial derivatives of the residual
+   */
+  double Evaluate(const EulerAngleRotation& rotation, const double* w, double* jacobian) const
+  {
+    Eigen::Vector3d T(w[3], w[4], w[5]);
+    Eigen::Vector3d Y = rotation.R * this->X + (1.0 - this->time) * this->T0 + this->time * T - this->C;
+    Eigen::Vector3d AY = this->A * Y;
+    double squaredResidual = this->lambda * Y.dot(AY);
+
+    // t -> sqrt(t) is not differentiable in 0, the
+    // residual and its derivatives are set to 0 close
+    // to it as the automatic differentiation does
+    if (squaredResidual < 1e-6)
+    {
+      if (jacobian)
+      {
+        std::fill(jacobian, jacobian + 6, 0.0);
+      }
+      return 0.0;
+    }
+    double residual = std::sqrt(squaredResidual);
+
+    if (jacobian)
+    {
+      // d(sqrt(lambda * Y' * A * Y)) = lambda / residual * (A * Y)' * dY
+      // since A is symmetric
+      Eigen::Vector3d gradientY = (this->lambda / residual) * AY;
+      for (int k = 0; k < 3; ++k)
+      {
+        jacobian[k] = gradientY.dot(rotation.dR[k] * this->X);
+        jacobian[k + 3] = this->time * gradientY(k);
+      }
+    }
+    return residual;
+  }
+
+private:
+  Eigen::Matrix3d A;
+  Eigen::Vector3d C;
+  Eigen::Vector3d X;
+  Eigen::Vector3d T0;
+  double time;
+  double lambda;
+};
+
+/**
+* \class AnalyticCostFunction
+* \brief Ceres cost function of a residual of the 6-DoF parameters whose jacobian
+*        is computed analytically, such as MahalanobisDistanceAnalyticResidual
+*/
+//-----------------------------------------------------------------------------
+template <typename Residual>
+class AnalyticCostFunction : public ceres::SizedCostFunction<1, 6>
+{
+public:
+  explicit AnalyticCostFunction(const Residual& argResidual)
+    : ResidualFunction(argResidual)
+  {
+  }
+
+  virtual bool Evaluate(double const* const* parameters, double* residuals, double** jacobians) const
+  {
+    EulerAngleRotation rotation(parameters[0]);
+    double* jacobian = (jacobians != nullptr) ? jacobians[0] : nullptr;
+    residuals[0] = this->ResidualFunction.Evaluate(rotation, parameters[0], jacobian);
+    return true;
+  }
+
+private:
+  Residual ResidualFunction;
+};
+
 /**
 * \class FrobeniusDistanceRotationCalibrationResidual
 * \brief Cost function to minimize to estimate the calibration rotation between two sensors
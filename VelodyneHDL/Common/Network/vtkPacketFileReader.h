@@ -27,13 +27,20 @@
 =========================================================================*/
 // .NAME vtkPacketFileReader -
 // .SECTION Description
-//
+// Reads the UDP packets of a pcap file, with libpcap, or of a pcap file compressed
+// with the zstd seekable format (see vtkZstdSeekableFile), with the same positions
+// available to come back to a packet.
 
 #ifndef __vtkPacketFileReader_h
 #define __vtkPacketFileReader_h
 
+#include "vtkZstdSeekableFile.h"
+
 #include <pcap.h>
+#include <cstdint>
+#include <cstring>
 #include <string>
+#include <vector>
 
 // Some versions of libpcap do not have PCAP_NETMASK_UNKNOWN
 #if !defined(PCAP_NETMASK_UNKNOWN)
@@ -43,7 +50,14 @@
 class vtkPacketFileReader
 {
 public:
-  vtkPacketFileReader() { this->PCAPFile = 0; }
+  //! Largest packet of a compressed file, as the snapshot length of the pcap files
+  static const uint32_t MaxPacketLength = 65535;
+
+  vtkPacketFileReader()
+  {
+    this->PCAPFile = 0;
+    this->CompressedFile = 0;
+  }
 
   ~vtkPacketFileReader() { this->Close(); }
 
@@ -54,6 +68,11 @@ public:
   // 3- The compiled filter is then associate to the capture
   bool Open(const std::string& filename)
   {
+    if (vtkZstdSeekableReader::IsCompressedFile(filename))
+    {
+      return this->OpenCompressed(filename);
+    }
+
     char errbuff[PCAP_ERRBUF_SIZE];
     pcap_t* pcapFile = pcap_open_offline(filename.c_str(), errbuff);
     if (!pcapFile)
@@ -98,7 +117,7 @@ public:
     return true;
   }
 
-  bool IsOpen() { return (this->PCAPFile != 0); }
+  bool IsOpen() { return (this->PCAPFile != 0 || this->CompressedFile != 0); }
 
   void Close()
   {
@@ -108,6 +127,12 @@ public:
       this->PCAPFile = 0;
       this->FileName.clear();
     }
+    if (this->CompressedFile)
+    {
+      delete this->CompressedFile;
+      this->CompressedFile = 0;
+      this->FileName.clear();
+    }
   }
 
   const std::string& GetLastError() { return this->LastError; }
@@ -116,6 +141,11 @@ public:
 
   void GetFilePosition(fpos_t* position)
   {
+    if (this->CompressedFile)
+    {
+      this->EncodeOffset(this->CompressedFile->Tell(), position);
+      return;
+    }
 #ifdef _MSC_VER
     pcap_fgetpos(this->PCAPFile, position);
 #else
@@ -126,6 +156,13 @@ public:
 
   void SetFilePosition(fpos_t* position)
   {
+    if (this->CompressedFile)
+    {
+      uint64_t offset = 0;
+      std::memcpy(&offset, position, sizeof(offset));
+      this->CompressedFile->Seek(offset);
+      return;
+    }
 #ifdef _MSC_VER
     pcap_fsetpos(this->PCAPFile, position);
 #else
@@ -134,20 +171,50 @@ public:
 #endif
   }
 
+  // Convert an offset in bytes from the beginning of the file to a position
+  // usable by SetFilePosition. The current position is not preserved.
+  bool GetFilePositionAtOffset(long long offset, fpos_t* position)
+  {
+    if (this->CompressedFile)
+    {
+      // the offsets are the ones of the decompressed file
+      this->EncodeOffset(static_cast<uint64_t>(offset), position);
+      return true;
+    }
+#ifdef _MSC_VER
+    *position = static_cast<fpos_t>(offset);
+    return true;
+#else
+    FILE* f = pcap_file(this->PCAPFile);
+    return fseeko(f, static_cast<off_t>(offset), SEEK_SET) == 0 && fgetpos(f, position) == 0;
+#endif
+  }
+
   bool NextPacket(const unsigned char*& data, unsigned int& dataLength, double& timeSinceStart,
     pcap_pkthdr** headerReference = NULL, unsigned int* dataHeaderLength = NULL)
   {
-    if (!this->PCAPFile)
+    if (!this->IsOpen())
     {
       return false;
     }
 
     struct pcap_pkthdr* header;
-    int returnValue = pcap_next_ex(this->PCAPFile, &header, &data);
-    if (returnValue < 0)
+    if (this->CompressedFile)
     {
-      this->Close();
-      return false;
+      if (!this->NextCompressedPacket(header, data))
+      {
+        this->Close();
+        return false;
+      }
+    }
+    else
+    {
+      int returnValue = pcap_next_ex(this->PCAPFile, &header, &data);
+      if (returnValue < 0)
+      {
+        this->Close();
+        return false;
+      }
     }
 
     // Only return the payload.
@@ -171,6 +238,98 @@ public:
   }
 
 protected:
+  bool OpenCompressed(const std::string& filename)
+  {
+    vtkZstdSeekableReader* file = new vtkZstdSeekableReader;
+    unsigned char globalHeader[24];
+    if (!file->Open(filename) || file->Read(globalHeader, sizeof(globalHeader)) != sizeof(globalHeader))
+    {
+      this->LastError = file->GetLastError().empty() ? "Not a compressed pcap file" : file->GetLastError();
+      delete file;
+      return false;
+    }
+
+    uint32_t magic = 0;
+    uint32_t linktype = 0;
+    std::memcpy(&magic, globalHeader, sizeof(magic));
+    std::memcpy(&linktype, globalHeader + 20, sizeof(linktype));
+    if (magic != 0xa1b2c3d4 && magic != 0xa1b23c4d)
+    {
+      this->LastError = "Unsupported pcap format in compressed file, only native byte order is read";
+      delete file;
+      return false;
+    }
+    this->IsNanosecond = magic == 0xa1b23c4d;
+
+    switch (linktype)
+    {
+      case DLT_EN10MB:
+        this->FrameHeaderLength = 14;
+        break;
+      case DLT_NULL:
+        this->FrameHeaderLength = 4;
+        break;
+      default:
+        this->LastError = "Unknown link type in pcap file. Cannot tell where the payload is.";
+        delete file;
+        return false;
+    }
+
+    this->FileName = filename;
+    this->CompressedFile = file;
+    this->StartTime.tv_sec = this->StartTime.tv_usec = 0;
+    return true;
+  }
+
+  // Read the next UDP packet of a compressed file, as pcap_next_ex with the "udp" filter
+  bool NextCompressedPacket(struct pcap_pkthdr*& header, const unsigned char*& data)
+  {
+    while (true)
+    {
+      uint32_t record[4];
+      if (this->CompressedFile->Read(record, sizeof(record)) != sizeof(record))
+      {
+        return false;
+      }
+      // a record longer than the largest UDP packet is a corrupted one, its
+      // length can't be trusted to find the next record nor to allocate it
+      if (record[2] > MaxPacketLength)
+      {
+        this->LastError = "Corrupted packet record in compressed file";
+        return false;
+      }
+      this->PacketData.resize(record[2]);
+      if (this->CompressedFile->Read(this->PacketData.data(), record[2]) != record[2])
+      {
+        return false;
+      }
+
+      const unsigned char* packet = this->PacketData.data();
+      const unsigned char* ip = packet + this->FrameHeaderLength;
+      const bool isIPv4 = this->FrameHeaderLength != 14 || (packet[12] == 0x08 && packet[13] == 0x00);
+      if (record[2] < this->FrameHeaderLength + 28 || !isIPv4 || (ip[0] >> 4) != 4 || ip[9] != 17)
+      {
+        continue;
+      }
+
+      this->PacketHeader.ts.tv_sec = record[0];
+      this->PacketHeader.ts.tv_usec = this->IsNanosecond ? record[1] / 1000 : record[1];
+      this->PacketHeader.caplen = record[2];
+      this->PacketHeader.len = record[3];
+      header = &this->PacketHeader;
+      data = packet;
+      return true;
+    }
+  }
+
+  // The positions in a compressed file are offsets in the decompressed file
+  void EncodeOffset(uint64_t offset, fpos_t* position)
+  {
+    static_assert(sizeof(fpos_t) >= sizeof(uint64_t), "fpos_t can't hold an offset");
+    std::memset(position, 0, sizeof(fpos_t));
+    std::memcpy(position, &offset, sizeof(offset));
+  }
+
   double GetElapsedTime(const struct timeval& end, const struct timeval& start)
   {
     return (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.00;
@@ -181,6 +340,11 @@ protected:
   std::string LastError;
   struct timeval StartTime;
   unsigned int FrameHeaderLength;
+
+  vtkZstdSeekableReader* CompressedFile;
+  std::vector<unsigned char> PacketData;
+  struct pcap_pkthdr PacketHeader;
+  bool IsNanosecond;
 };
 
 #endif
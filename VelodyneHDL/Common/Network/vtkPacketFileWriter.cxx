@@ -139,8 +139,18 @@ const std::string& vtkPacketFileWriter::GetFileName()
 }
 
 //--------------------------------------------------------------------------------
-// Write an UDP packet from the data (without providing a header, so we construct it)
+// Write an UDP packet received now
 bool vtkPacketFileWriter::WritePacket(const unsigned char* data, unsigned int dataLength)
+{
+  struct timeval currentTime;
+  gettimeofday(&currentTime, NULL);
+  return this->WritePacket(data, dataLength, currentTime.tv_sec + 1e-6 * currentTime.tv_usec);
+}
+
+//--------------------------------------------------------------------------------
+// Write an UDP packet from the data (without providing a header, so we construct it)
+bool vtkPacketFileWriter::WritePacket(
+  const unsigned char* data, unsigned int dataLength, double time, int port)
 {
   if (!this->PCAPFile)
   {
@@ -163,9 +173,9 @@ bool vtkPacketFileWriter::WritePacket(const unsigned char* data, unsigned int da
   header.len = dataLength + 42;
   packetBuffer.resize(header.len);
 
-  struct timeval currentTime;
-  gettimeofday(&currentTime, NULL);
-  header.ts = currentTime;
+  const long long microseconds = static_cast<long long>(time * 1e6 + 0.5);
+  header.ts.tv_sec = static_cast<long>(microseconds / 1000000);
+  header.ts.tv_usec = static_cast<long>(microseconds % 1000000);
 
   memcpy(&(packetBuffer[0]), headerData, 42);
   memcpy(&(packetBuffer[0]) + 42, data, dataLength);
@@ -177,6 +187,12 @@ bool vtkPacketFileWriter::WritePacket(const unsigned char* data, unsigned int da
   // Set UDP-frame length (which is 8 + dataLength), in Network (Big) Endian
   packetBuffer[2 * 19] = ((dataLength + 8) & 0xFF00) >> 8;
   packetBuffer[2 * 19 + 1] = ((dataLength + 8) & 0x00FF) >> 0;
+  // Set UDP destination port, in Network (Big) Endian
+  if (port > 0)
+  {
+    packetBuffer[2 * 18] = (port & 0xFF00) >> 8;
+    packetBuffer[2 * 18 + 1] = (port & 0x00FF) >> 0;
+  }
 
   pcap_dump((u_char*)this->PCAPDump, &header, &(packetBuffer[0]));
   return true;
@@ -61,6 +61,11 @@ public:
 
   bool WritePacket(const unsigned char* data, unsigned int dataLength);
 
+  // Same as above, with the time the packet was received in seconds since the epoch,
+  // and the port it was received on if it is not the default one of its kind
+  bool WritePacket(const unsigned char* data, unsigned int dataLength, double time,
+    int port = 0);
+
   bool WritePacket(pcap_pkthdr* packetHeader, unsigned char* packetData);
 
 protected:
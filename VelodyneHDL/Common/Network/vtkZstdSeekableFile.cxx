@@ -0,0 +1,453 @@
+//=========================================================================
+//
+// Copyright 2018 Kitware, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//=========================================================================
+
+#include "vtkZstdSeekableFile.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef VV_ENABLE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace
+{
+const uint32_t FrameMagic = 0xFD2FB528;
+const uint32_t SkippableMagic = 0x184D2A5E;
+const uint32_t SkippableMagicMask = 0xFFFFFFF0;
+const uint32_t SeekableMagic = 0x8F92EAB1;
+const std::size_t SeekTableFooterSize = 9;
+const std::size_t SkippableHeaderSize = 8;
+// ZSTD_FRAMEHEADERSIZE_MAX, which is not part of the stable API
+const std::size_t MaxFrameHeaderSize = 18;
+const uint8_t ChecksumFlag = 0x80;
+
+// Larger frames can't be read at random positions in a reasonable time
+const uint64_t MaxDecompressedFrameSize = 256 << 20;
+
+//--------------------------------------------------------------------------------
+void AppendUInt32(std::string& buffer, uint32_t value)
+{
+  // the seek table is little endian
+  for (int i = 0; i < 4; ++i)
+  {
+    buffer.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+  }
+}
+
+//--------------------------------------------------------------------------------
+uint32_t ReadUInt32(const unsigned char* data)
+{
+  return data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<uint32_t>(data[3]) << 24);
+}
+
+//--------------------------------------------------------------------------------
+bool SeekFile(std::FILE* file, uint64_t offset, int origin = SEEK_SET)
+{
+#ifdef _WIN32
+  return _fseeki64(file, static_cast<long long>(offset), origin) == 0;
+#else
+  return fseeko(file, static_cast<off_t>(offset), origin) == 0;
+#endif
+}
+
+//--------------------------------------------------------------------------------
+uint64_t TellFile(std::FILE* file)
+{
+#ifdef _WIN32
+  return static_cast<uint64_t>(_ftelli64(file));
+#else
+  return static_cast<uint64_t>(ftello(file));
+#endif
+}
+}
+
+//--------------------------------------------------------------------------------
+vtkZstdSeekableWriter::vtkZstdSeekableWriter()
+  : Context(nullptr)
+  , Level(3)
+{
+#ifdef VV_ENABLE_ZSTD
+  this->Context = ZSTD_createCCtx();
+#endif
+}
+
+//--------------------------------------------------------------------------------
+vtkZstdSeekableWriter::~vtkZstdSeekableWriter()
+{
+#ifdef VV_ENABLE_ZSTD
+  ZSTD_freeCCtx(static_cast<ZSTD_CCtx*>(this->Context));
+#endif
+}
+
+//--------------------------------------------------------------------------------
+bool vtkZstdSeekableWriter::IsAvailable()
+{
+#ifdef VV_ENABLE_ZSTD
+  return true;
+#else
+  return false;
+#endif
+}
+
+//--------------------------------------------------------------------------------
+std::size_t vtkZstdSeekableWriter::GetFrameBound(std::size_t size)
+{
+#ifdef VV_ENABLE_ZSTD
+  return ZSTD_compressBound(size);
+#else
+  return size;
+#endif
+}
+
+//--------------------------------------------------------------------------------
+int vtkZstdSeekableWriter::GetMinimumLevel()
+{
+  // the fastest levels, below -5, hardly compress lidar packets
+  return -5;
+}
+
+//--------------------------------------------------------------------------------
+int vtkZstdSeekableWriter::GetMaximumLevel()
+{
+#ifdef VV_ENABLE_ZSTD
+  return ZSTD_maxCLevel();
+#else
+  return 0;
+#endif
+}
+
+//--------------------------------------------------------------------------------
+void vtkZstdSeekableWriter::SetLevel(int level)
+{
+  this->Level = std::max(GetMinimumLevel(), std::min(GetMaximumLevel(), level));
+}
+
+//--------------------------------------------------------------------------------
+std::size_t vtkZstdSeekableWriter::CompressFrame(const char* data, std::size_t size, char* output)
+{
+#ifdef VV_ENABLE_ZSTD
+  if (!this->Context || size == 0)
+  {
+    return 0;
+  }
+  const std::size_t frameSize = ZSTD_compressCCtx(static_cast<ZSTD_CCtx*>(this->Context),
+    output, ZSTD_compressBound(size), data, size, this->Level);
+  if (ZSTD_isError(frameSize))
+  {
+    return 0;
+  }
+  this->Frames.push_back(
+    std::make_pair(static_cast<uint32_t>(frameSize), static_cast<uint32_t>(size)));
+  return frameSize;
+#else
+  (void)data;
+  (void)size;
+  (void)output;
+  return 0;
+#endif
+}
+
+//--------------------------------------------------------------------------------
+std::string vtkZstdSeekableWriter::GetSeekTable() const
+{
+  std::string table;
+  AppendUInt32(table, SkippableMagic);
+  AppendUInt32(table, static_cast<uint32_t>(8 * this->Frames.size() + SeekTableFooterSize));
+  for (const auto& frame : this->Frames)
+  {
+    AppendUInt32(table, frame.first);
+    AppendUInt32(table, frame.second);
+  }
+  AppendUInt32(table, static_cast<uint32_t>(this->Frames.size()));
+  table.push_back(0); // no checksums
+  AppendUInt32(table, SeekableMagic);
+  return table;
+}
+
+//--------------------------------------------------------------------------------
+vtkZstdSeekableReader::vtkZstdSeekableReader()
+  : File(nullptr)
+  , Context(nullptr)
+  , Position(0)
+  , LoadedFrame(-1)
+{
+}
+
+//--------------------------------------------------------------------------------
+vtkZstdSeekableReader::~vtkZstdSeekableReader()
+{
+  this->Close();
+}
+
+//--------------------------------------------------------------------------------
+bool vtkZstdSeekableReader::IsCompressedFile(const std::string& filename)
+{
+  std::FILE* file = std::fopen(filename.c_str(), "rb");
+  if (!file)
+  {
+    return false;
+  }
+  unsigned char magic[4];
+  const bool isRead = std::fread(magic, 1, sizeof(magic), file) == sizeof(magic);
+  std::fclose(file);
+  return isRead && ReadUInt32(magic) == FrameMagic;
+}
+
+//--------------------------------------------------------------------------------
+bool vtkZstdSeekableReader::Open(const std::string& filename)
+{
+  this->Close();
+#ifdef VV_ENABLE_ZSTD
+  this->File = std::fopen(filename.c_str(), "rb");
+  if (!this->File)
+  {
+    this->LastError = "Failed to open " + filename;
+    return false;
+  }
+  this->Context = ZSTD_createDCtx();
+
+  if (!this->ReadSeekTable() && !this->ScanFrames())
+  {
+    this->Close();
+    return false;
+  }
+  return true;
+#else
+  this->LastError = "Compressed recordings require VeloView to be built with zstd";
+  (void)filename;
+  return false;
+#endif
+}
+
+//--------------------------------------------------------------------------------
+void vtkZstdSeekableReader::Close()
+{
+  if (this->File)
+  {
+    std::fclose(this->File);
+    this->File = nullptr;
+  }
+#ifdef VV_ENABLE_ZSTD
+  ZSTD_freeDCtx(static_cast<ZSTD_DCtx*>(this->Context));
+#endif
+  this->Context = nullptr;
+  this->Frames.clear();
+  this->Position = 0;
+  this->LoadedFrame = -1;
+}
+
+//--------------------------------------------------------------------------------
+bool vtkZstdSeekableReader::ReadSeekTable()
+{
+  unsigned char footer[SeekTableFooterSize];
+  if (!SeekFile(this->File, 0, SEEK_END))
+  {
+    return false;
+  }
+  const uint64_t fileSize = TellFile(this->File);
+  if (fileSize < SkippableHeaderSize + SeekTableFooterSize ||
+    !SeekFile(this->File, fileSize - SeekTableFooterSize) ||
+    std::fread(footer, 1, SeekTableFooterSize, this->File) != SeekTableFooterSize ||
+    ReadUInt32(footer + 5) != SeekableMagic)
+  {
+    return false;
+  }
+
+  const uint64_t nFrames = ReadUInt32(footer);
+  const std::size_t entrySize = (footer[4] & ChecksumFlag) ? 12 : 8;
+  const uint64_t tableSize = SkippableHeaderSize + nFrames * entrySize + SeekTableFooterSize;
+  if (tableSize > fileSize)
+  {
+    return false;
+  }
+  std::vector<unsigned char> table(static_cast<std::size_t>(tableSize));
+  if (!SeekFile(this->File, fileSize - tableSize) ||
+    std::fread(table.data(), 1, table.size(), this->File) != table.size() ||
+    (ReadUInt32(table.data()) & SkippableMagicMask) != SkippableMagic ||
+    ReadUInt32(table.data() + 4) != tableSize - SkippableHeaderSize)
+  {
+    return false;
+  }
+
+  uint64_t compressedOffset = 0;
+  uint64_t decompressedOffset = 0;
+  for (uint64_t i = 0; i < nFrames; ++i)
+  {
+    const unsigned char* entry = table.data() + SkippableHeaderSize + i * entrySize;
+    Frame frame;
+    frame.CompressedOffset = compressedOffset;
+    frame.DecompressedOffset = decompressedOffset;
+    frame.CompressedSize = ReadUInt32(entry);
+    frame.DecompressedSize = ReadUInt32(entry + 4);
+    compressedOffset += frame.CompressedSize;
+    decompressedOffset += frame.DecompressedSize;
+    if (frame.DecompressedSize > MaxDecompressedFrameSize)
+    {
+      this->LastError = "Compressed frames are too large to be read";
+      this->Frames.clear();
+      return false;
+    }
+    this->Frames.push_back(frame);
+  }
+  return compressedOffset + tableSize <= fileSize;
+}
+
+//--------------------------------------------------------------------------------
+bool vtkZstdSeekableReader::ScanFrames()
+{
+#ifdef VV_ENABLE_ZSTD
+  this->Frames.clear();
+  uint64_t compressedOffset = 0;
+  uint64_t decompressedOffset = 0;
+  while (SeekFile(this->File, compressedOffset))
+  {
+    unsigned char header[MaxFrameHeaderSize];
+    const std::size_t headerSize = std::fread(header, 1, sizeof(header), this->File);
+    if (headerSize < SkippableHeaderSize)
+    {
+      break;
+    }
+    if ((ReadUInt32(header) & SkippableMagicMask) == SkippableMagic)
+    {
+      compressedOffset += SkippableHeaderSize + ReadUInt32(header + 4);
+      continue;
+    }
+
+    // frames without their size can't be located without decompressing them
+    const unsigned long long decompressedSize = ZSTD_getFrameContentSize(header, headerSize);
+    if (decompressedSize == ZSTD_CONTENTSIZE_UNKNOWN ||
+      decompressedSize == ZSTD_CONTENTSIZE_ERROR || decompressedSize > MaxDecompressedFrameSize)
+    {
+      break;
+    }
+    this->CompressedData.resize(ZSTD_compressBound(static_cast<std::size_t>(decompressedSize)));
+    if (!SeekFile(this->File, compressedOffset))
+    {
+      break;
+    }
+    const std::size_t available =
+      std::fread(this->CompressedData.data(), 1, this->CompressedData.size(), this->File);
+    const std::size_t compressedSize =
+      ZSTD_findFrameCompressedSize(this->CompressedData.data(), available);
+    if (ZSTD_isError(compressedSize))
+    {
+      // last frame of an interrupted recording
+      break;
+    }
+
+    Frame frame;
+    frame.CompressedOffset = compressedOffset;
+    frame.DecompressedOffset = decompressedOffset;
+    frame.CompressedSize = static_cast<uint32_t>(compressedSize);
+    frame.DecompressedSize = static_cast<uint32_t>(decompressedSize);
+    this->Frames.push_back(frame);
+    compressedOffset += compressedSize;
+    decompressedOffset += decompressedSize;
+  }
+
+  if (this->Frames.empty())
+  {
+    this->LastError = "No complete zstd frame with a known size in the file";
+    return false;
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+//--------------------------------------------------------------------------------
+bool vtkZstdSeekableReader::LoadFrame()
+{
+#ifdef VV_ENABLE_ZSTD
+  // last frame starting at or before Position
+  auto next = std::upper_bound(this->Frames.begin(), this->Frames.end(), this->Position,
+    [](uint64_t position, const Frame& frame) { return position < frame.DecompressedOffset; });
+  if (next == this->Frames.begin())
+  {
+    return false;
+  }
+  const long long index = (next - this->Frames.begin()) - 1;
+  const Frame& frame = this->Frames[index];
+  if (this->Position >= frame.DecompressedOffset + frame.DecompressedSize)
+  {
+    return false;
+  }
+  if (index == this->LoadedFrame)
+  {
+    return true;
+  }
+
+  this->LoadedFrame = -1;
+  this->CompressedData.resize(frame.CompressedSize);
+  this->FrameData.resize(frame.DecompressedSize);
+  if (!SeekFile(this->File, frame.CompressedOffset) ||
+    std::fread(this->CompressedData.data(), 1, frame.CompressedSize, this->File) !=
+      frame.CompressedSize)
+  {
+    this->LastError = "Failed to read a compressed frame";
+    return false;
+  }
+  const std::size_t size = ZSTD_decompressDCtx(static_cast<ZSTD_DCtx*>(this->Context),
+    this->FrameData.data(), this->FrameData.size(), this->CompressedData.data(),
+    this->CompressedData.size());
+  if (ZSTD_isError(size) || size != frame.DecompressedSize)
+  {
+    this->LastError = "Failed to decompress a frame";
+    return false;
+  }
+  this->LoadedFrame = index;
+  return true;
+#else
+  return false;
+#endif
+}
+
+//--------------------------------------------------------------------------------
+std::size_t vtkZstdSeekableReader::Read(void* data, std::size_t size)
+{
+  char* output = static_cast<char*>(data);
+  std::size_t nRead = 0;
+  while (nRead < size && this->LoadFrame())
+  {
+    const Frame& frame = this->Frames[this->LoadedFrame];
+    const std::size_t offset = static_cast<std::size_t>(this->Position - frame.DecompressedOffset);
+    const std::size_t nBytes = std::min<std::size_t>(size - nRead, frame.DecompressedSize - offset);
+    std::memcpy(output + nRead, this->FrameData.data() + offset, nBytes);
+    nRead += nBytes;
+    this->Position += nBytes;
+  }
+  return nRead;
+}
+
+//--------------------------------------------------------------------------------
+bool vtkZstdSeekableReader::Seek(uint64_t offset)
+{
+  if (!this->IsOpen())
+  {
+    return false;
+  }
+  const uint64_t size =
+    this->Frames.empty() ? 0 : this->Frames.back().DecompressedOffset + this->Frames.back().DecompressedSize;
+  if (offset > size)
+  {
+    return false;
+  }
+  this->Position = offset;
+  return true;
+}
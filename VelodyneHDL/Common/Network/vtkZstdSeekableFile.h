@@ -0,0 +1,142 @@
+//=========================================================================
+//
+// Copyright 2018 Kitware, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//=========================================================================
+// .NAME vtkZstdSeekableFile -
+// .SECTION Description
+// Files compressed with the zstd seekable format: a series of independent zstd
+// frames followed by a skippable frame holding the compressed and decompressed
+// size of each frame (the seek table). Any zstd decompressor restores the
+// original file, and a given offset of the original file is read by only
+// decompressing the frame containing it.
+// The compression is only available if VeloView is built with ENABLE_ZSTD.
+
+#ifndef __vtkZstdSeekableFile_h
+#define __vtkZstdSeekableFile_h
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+class vtkZstdSeekableWriter
+{
+public:
+  vtkZstdSeekableWriter();
+
+  ~vtkZstdSeekableWriter();
+
+  //! false if VeloView was built without zstd
+  static bool IsAvailable();
+
+  //! maximum size of a compressed frame of the given size
+  static std::size_t GetFrameBound(std::size_t size);
+
+  //! levels accepted by SetLevel, negative levels are the fastest ones
+  static int GetMinimumLevel();
+  static int GetMaximumLevel();
+
+  int GetLevel() const { return this->Level; }
+  void SetLevel(int level);
+
+  /**
+   * @brief CompressFrame compress data in a new independent frame
+   * @param data bytes to compress
+   * @param size number of bytes to compress
+   * @param output where the frame is written, of at least GetFrameBound(size) bytes
+   * @return size of the frame, 0 on error
+   */
+  std::size_t CompressFrame(const char* data, std::size_t size, char* output);
+
+  //! skippable frame to write after the last frame, listing all the frames
+  std::string GetSeekTable() const;
+
+  //! forget the frames, to start a new file
+  void Reset() { this->Frames.clear(); }
+
+private:
+  vtkZstdSeekableWriter(const vtkZstdSeekableWriter&) = delete;
+  vtkZstdSeekableWriter& operator=(const vtkZstdSeekableWriter&) = delete;
+
+  void* Context;
+  int Level;
+  //! compressed and decompressed size of each frame
+  std::vector<std::pair<uint32_t, uint32_t> > Frames;
+};
+
+class vtkZstdSeekableReader
+{
+public:
+  vtkZstdSeekableReader();
+
+  ~vtkZstdSeekableReader();
+
+  //! true if the file starts with a zstd frame
+  static bool IsCompressedFile(const std::string& filename);
+
+  /**
+   * @brief Open read the seek table of the file. If the file has none, because its
+   * recording was interrupted, the table is rebuilt from the frame headers and the
+   * incomplete last frame is ignored.
+   */
+  bool Open(const std::string& filename);
+
+  bool IsOpen() const { return this->File != nullptr; }
+
+  void Close();
+
+  const std::string& GetLastError() const { return this->LastError; }
+
+  //! read size bytes of the decompressed file, return the number of bytes read
+  std::size_t Read(void* data, std::size_t size);
+
+  //! move to an offset of the decompressed file
+  bool Seek(uint64_t offset);
+
+  uint64_t Tell() const { return this->Position; }
+
+private:
+  vtkZstdSeekableReader(const vtkZstdSeekableReader&) = delete;
+  vtkZstdSeekableReader& operator=(const vtkZstdSeekableReader&) = delete;
+
+  bool ReadSeekTable();
+
+  bool ScanFrames();
+
+  //! decompress the frame containing Position if needed
+  bool LoadFrame();
+
+  struct Frame
+  {
+    uint64_t CompressedOffset;
+    uint64_t DecompressedOffset;
+    uint32_t CompressedSize;
+    uint32_t DecompressedSize;
+  };
+
+  std::FILE* File;
+  void* Context;
+  std::string LastError;
+  std::vector<Frame> Frames;
+
+  uint64_t Position;
+  //! index of the frame held by FrameData, -1 if none
+  long long LoadedFrame;
+  std::vector<char> CompressedData;
+  std::vector<char> FrameData;
+};
+
+#endif
@@ -0,0 +1,316 @@
+//=========================================================================
+//
+// Copyright 2018 Kitware, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//=========================================================================
+
+#include "vvPacketReplayer.h"
+#include "vtkPacketFileReader.h"
+
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <thread>
+
+namespace
+{
+//! size of the position packets, sent to the position port
+const unsigned int PositionPacketLength = 512;
+
+//-----------------------------------------------------------------------------
+double GetPercentile(std::vector<double>& values, double percentile)
+{
+  if (values.empty())
+  {
+    return 0.0;
+  }
+  size_t rank = static_cast<size_t>(percentile * (values.size() - 1) + 0.5);
+  std::nth_element(values.begin(), values.begin() + rank, values.end());
+  return values[rank];
+}
+}
+
+//-----------------------------------------------------------------------------
+vvPacketReplayer::vvPacketReplayer(const std::string& pcapfile)
+  : PositionPort(8308)
+  , KeepRecordedPorts(false)
+  , Speed(1.0)
+  , BatchSize(64)
+  , SpinDuration(200e-6)
+  , Socket(this->IOService)
+{
+  vtkPacketFileReader reader;
+  if (!reader.Open(pcapfile))
+  {
+    throw std::runtime_error("Unable to open packet file " + pcapfile);
+  }
+
+  const unsigned char* data = 0;
+  unsigned int dataLength = 0;
+  double timeSinceStart = 0;
+  while (reader.NextPacket(data, dataLength, timeSinceStart))
+  {
+    Packet packet;
+    packet.Offset = this->Data.size();
+    packet.Length = dataLength;
+    packet.Time = timeSinceStart;
+    // the payload directly follows the UDP header, whose bytes 2-3 are the destination port
+    packet.Port = (data[-6] << 8) | data[-5];
+    this->Data.insert(this->Data.end(), data, data + dataLength);
+    this->Packets.push_back(packet);
+  }
+  if (this->Packets.empty())
+  {
+    throw std::runtime_error("No packet in file " + pcapfile);
+  }
+  // the pace is given by the time since the first packet sent
+  const double firstTime = this->Packets.front().Time;
+  for (Packet& packet : this->Packets)
+  {
+    packet.Time -= firstTime;
+  }
+
+  this->Socket.open(boost::asio::ip::udp::v4());
+  this->Socket.set_option(boost::asio::ip::udp::socket::reuse_address(true));
+  // Allow to send the packet on the same machine
+  this->Socket.set_option(boost::asio::ip::multicast::enable_loopback(true));
+
+  this->SetDestination("127.0.0.1", std::vector<int>(1, 2368), 8308);
+}
+
+//-----------------------------------------------------------------------------
+vvPacketReplayer::~vvPacketReplayer()
+{
+}
+
+//-----------------------------------------------------------------------------
+void vvPacketReplayer::SetDestination(
+  const std::string& destinationIp, const std::vector<int>& lidarPorts, int positionPort)
+{
+  // throws if the address is not valid
+  boost::asio::ip::address_v4::from_string(destinationIp);
+  this->DestinationIp = destinationIp;
+  this->LidarPorts = lidarPorts;
+  this->PositionPort = positionPort;
+}
+
+//-----------------------------------------------------------------------------
+double vvPacketReplayer::GetRecordingDuration() const
+{
+  return this->Packets.empty() ? 0.0 : this->Packets.back().Time;
+}
+
+//-----------------------------------------------------------------------------
+void vvPacketReplayer::ResolveDestinations()
+{
+  const boost::asio::ip::address address =
+    boost::asio::ip::address_v4::from_string(this->DestinationIp);
+
+  this->Endpoints.clear();
+  std::map<int, uint32_t> endpointOfPort;
+  auto getEndpoint = [&](int port) {
+    auto it = endpointOfPort.find(port);
+    if (it == endpointOfPort.end())
+    {
+      it = endpointOfPort.insert(std::make_pair(port, this->Endpoints.size())).first;
+      this->Endpoints.push_back(boost::asio::ip::udp::endpoint(address, port));
+    }
+    return it->second;
+  };
+
+  this->DestinationIndices.clear();
+  this->DestinationRanges.assign(1, 0);
+  for (const Packet& packet : this->Packets)
+  {
+    if (this->KeepRecordedPorts)
+    {
+      this->DestinationIndices.push_back(getEndpoint(packet.Port));
+    }
+    else if (packet.Length == PositionPacketLength)
+    {
+      this->DestinationIndices.push_back(getEndpoint(this->PositionPort));
+    }
+    else
+    {
+      for (int port : this->LidarPorts)
+      {
+        this->DestinationIndices.push_back(getEndpoint(port));
+      }
+    }
+    this->DestinationRanges.push_back(static_cast<uint32_t>(this->DestinationIndices.size()));
+  }
+}
+
+//-----------------------------------------------------------------------------
+void vvPacketReplayer::WaitUntil(const Clock::time_point& time) const
+{
+  const Clock::duration spinDuration = std::chrono::duration_cast<Clock::duration>(
+    std::chrono::duration<double>(this->SpinDuration));
+  while (true)
+  {
+    const Clock::duration remaining = time - Clock::now();
+    if (remaining <= Clock::duration::zero())
+    {
+      return;
+    }
+    if (remaining > spinDuration)
+    {
+      std::this_thread::sleep_for(remaining - spinDuration);
+    }
+  }
+}
+
+//-----------------------------------------------------------------------------
+size_t vvPacketReplayer::Send(size_t first, size_t last)
+{
+  size_t errors = 0;
+#ifdef __linux__
+  // the buffers must all be set before the messages point to them
+  this->Buffers.resize(last - first);
+  for (size_t i = first; i < last; ++i)
+  {
+    iovec& buffer = this->Buffers[i - first];
+    buffer.iov_base = &this->Data[this->Packets[i].Offset];
+    buffer.iov_len = this->Packets[i].Length;
+  }
+  this->Messages.clear();
+  for (size_t i = first; i < last; ++i)
+  {
+    for (uint32_t j = this->DestinationRanges[i]; j < this->DestinationRanges[i + 1]; ++j)
+    {
+      boost::asio::ip::udp::endpoint& endpoint = this->Endpoints[this->DestinationIndices[j]];
+      mmsghdr message;
+      std::memset(&message, 0, sizeof(message));
+      message.msg_hdr.msg_name = endpoint.data();
+      message.msg_hdr.msg_namelen = endpoint.size();
+      message.msg_hdr.msg_iov = &this->Buffers[i - first];
+      message.msg_hdr.msg_iovlen = 1;
+      this->Messages.push_back(message);
+    }
+  }
+
+  const int socket = this->Socket.native_handle();
+  size_t sent = 0;
+  while (sent < this->Messages.size())
+  {
+    int result = sendmmsg(socket, &this->Messages[sent],
+      static_cast<unsigned int>(this->Messages.size() - sent), 0);
+    if (result < 0)
+    {
+      if (errno != EINTR)
+      {
+        // the first datagram failed, skip it and go on with the others
+        ++errors;
+        ++sent;
+      }
+      continue;
+    }
+    sent += result;
+  }
+#else
+  for (size_t i = first; i < last; ++i)
+  {
+    const Packet& packet = this->Packets[i];
+    for (uint32_t j = this->DestinationRanges[i]; j < this->DestinationRanges[i + 1]; ++j)
+    {
+      boost::system::error_code error;
+      this->Socket.send_to(boost::asio::buffer(&this->Data[packet.Offset], packet.Length),
+        this->Endpoints[this->DestinationIndices[j]], 0, error);
+      if (error)
+      {
+        ++errors;
+      }
+    }
+  }
+#endif
+  return errors;
+}
+
+//-----------------------------------------------------------------------------
+vvPacketReplayer::Report vvPacketReplayer::Replay(
+  const std::function<void(const Report&)>& progress, size_t progressInterval)
+{
+  this->ResolveDestinations();
+
+  const bool paced = this->Speed > 0;
+  const size_t numberOfPackets = this->Packets.size();
+  const size_t batchSize = static_cast<size_t>(this->BatchSize);
+  std::vector<double> lateness;
+  if (paced)
+  {
+    lateness.reserve(numberOfPackets);
+  }
+
+  Report report;
+  double latenessSum = 0;
+  size_t nextProgress = progressInterval;
+
+  const Clock::time_point start = Clock::now();
+  auto dueTime = [&](size_t i) {
+    return start + std::chrono::duration_cast<Clock::duration>(
+                     std::chrono::duration<double>(this->Packets[i].Time / this->Speed));
+  };
+  auto updateReport = [&]() {
+    report.Duration = std::chrono::duration<double>(Clock::now() - start).count();
+    report.PacketRate = report.Duration > 0 ? report.PacketCount / report.Duration : 0.0;
+    report.MeanLateness = lateness.empty() ? 0.0 : latenessSum / lateness.size();
+  };
+
+  size_t first = 0;
+  while (first < numberOfPackets)
+  {
+    size_t last = std::min(numberOfPackets, first + batchSize);
+    if (paced)
+    {
+      this->WaitUntil(dueTime(first));
+      // send along the packets that are due too, within the limit of a batch
+      const Clock::time_point now = Clock::now();
+      size_t due = first + 1;
+      while (due < last && dueTime(due) <= now)
+      {
+        ++due;
+      }
+      last = due;
+    }
+
+    report.SendErrors += this->Send(first, last);
+
+    if (paced)
+    {
+      const Clock::time_point sentTime = Clock::now();
+      for (size_t i = first; i < last; ++i)
+      {
+        const double packetLateness = std::chrono::duration<double>(sentTime - dueTime(i)).count();
+        lateness.push_back(packetLateness);
+        latenessSum += packetLateness;
+        report.MaxLateness = std::max(report.MaxLateness, packetLateness);
+      }
+    }
+    report.PacketCount = last;
+    first = last;
+
+    if (progress && progressInterval > 0 && report.PacketCount >= nextProgress)
+    {
+      updateReport();
+      progress(report);
+      nextProgress = (report.PacketCount / progressInterval + 1) * progressInterval;
+    }
+  }
+
+  updateReport();
+  report.MedianLateness = GetPercentile(lateness, 0.5);
+  report.P99Lateness = GetPercentile(lateness, 0.99);
+  return report;
+}
@@ -0,0 +1,183 @@
+//=========================================================================
+//
+// Copyright 2018 Kitware, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//=========================================================================
+
+#ifndef VV_PACKET_REPLAYER_H
+#define VV_PACKET_REPLAYER_H
+
+#include <vtkSystemIncludes.h>
+
+#include <boost/asio.hpp>
+
+#ifdef __linux__
+#include <sys/socket.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * \class vvPacketReplayer
+ * \brief Sends the packets of a recording on the network at the pace they were recorded,
+ *        or at a multiple of it.
+ *
+ *        Unlike vvPacketSender, all the packets are loaded in memory beforehand, so that
+ *        no file access happens while sending, and a recording can be replayed several
+ *        times. The packets are paced against a monotonic clock: the thread sleeps until
+ *        shortly before the next packet is due, then spins until it is. All the packets
+ *        due are then sent at once, with a single sendmmsg call per batch on Linux.
+ */
+class VTK_EXPORT vvPacketReplayer
+{
+public:
+  //! Summary of a replay
+  struct Report
+  {
+    //! number of packets sent, a packet sent to several ports being counted once
+    size_t PacketCount = 0;
+    //! number of datagrams the system failed to send
+    size_t SendErrors = 0;
+    //! seconds since the start of the replay
+    double Duration = 0;
+    //! packets sent per second
+    double PacketRate = 0;
+    /**
+     * Lateness in seconds of the packets, i.e. the difference between the time a packet
+     * was handed over to the system and the time it was due. Always 0 when replaying
+     * as fast as possible. The median and the 99th percentile are only computed for
+     * the report returned by Replay.
+     */
+    double MeanLateness = 0;
+    double MedianLateness = 0;
+    double P99Lateness = 0;
+    double MaxLateness = 0;
+  };
+
+  /**
+   * @brief vvPacketReplayer load all the UDP packets of a recording
+   * @param pcapfile pcap file, possibly compressed (see vtkZstdSeekableFile)
+   * @throw std::runtime_error if the file cannot be read
+   */
+  explicit vvPacketReplayer(const std::string& pcapfile);
+  ~vvPacketReplayer();
+
+  /**
+   * @brief SetDestination set where the packets are sent
+   * @param destinationIp IPv4 address, possibly a multicast one
+   * @param lidarPorts ports each lidar packet is sent to
+   * @param positionPort port of the position packets (the 512 bytes ones)
+   */
+  void SetDestination(const std::string& destinationIp, const std::vector<int>& lidarPorts,
+    int positionPort);
+
+  /**
+   * @brief SetKeepRecordedPorts send each packet to the port it was recorded on,
+   * instead of the ports given to SetDestination
+   */
+  void SetKeepRecordedPorts(bool value) { this->KeepRecordedPorts = value; }
+  bool GetKeepRecordedPorts() const { return this->KeepRecordedPorts; }
+
+  /**
+   * @brief SetSpeed set the playback speed, as a multiple of the recording pace
+   * @param speed 0 or less to send the packets as fast as possible
+   */
+  void SetSpeed(double speed) { this->Speed = speed; }
+  double GetSpeed() const { return this->Speed; }
+
+  //! Largest number of packets sent with a single system call
+  void SetBatchSize(int size) { this->BatchSize = std::max(1, size); }
+  int GetBatchSize() const { return this->BatchSize; }
+
+  /**
+   * @brief SetSpinDuration set how long before a packet is due the thread stops
+   * sleeping and spins, to make up for the coarse wake up time of the scheduler
+   * @param seconds 0 to only sleep
+   */
+  void SetSpinDuration(double seconds) { this->SpinDuration = seconds; }
+  double GetSpinDuration() const { return this->SpinDuration; }
+
+  size_t GetNumberOfPackets() const { return this->Packets.size(); }
+
+  //! Duration of the recording in seconds
+  double GetRecordingDuration() const;
+
+  /**
+   * @brief Replay send all the packets of the recording once
+   * @param progress called with the state of the replay every progressInterval packets
+   * @param progressInterval 0 to never call progress
+   * @return the report of the replay
+   */
+  Report Replay(const std::function<void(const Report&)>& progress = nullptr,
+    size_t progressInterval = 0);
+
+private:
+  typedef std::chrono::steady_clock Clock;
+
+  //! A packet of the recording, whose payload is in Data
+  struct Packet
+  {
+    size_t Offset;
+    unsigned int Length;
+    //! seconds since the first packet of the recording
+    double Time;
+    //! destination port it was recorded with
+    int Port;
+  };
+
+  //! Compute the addresses each packet is sent to
+  void ResolveDestinations();
+
+  //! Sleep, then spin, until a given time
+  void WaitUntil(const Clock::time_point& time) const;
+
+  /**
+   * @brief Send send the packets [first, last) to their destinations
+   * @return the number of datagrams that failed to be sent
+   */
+  size_t Send(size_t first, size_t last);
+
+  std::vector<unsigned char> Data;
+  std::vector<Packet> Packets;
+
+  std::string DestinationIp;
+  std::vector<int> LidarPorts;
+  int PositionPort;
+  bool KeepRecordedPorts;
+  double Speed;
+  int BatchSize;
+  double SpinDuration;
+
+  //! Destinations of the packets: those of packet i are
+  //! DestinationIndices[DestinationRanges[i], DestinationRanges[i + 1])
+  std::vector<boost::asio::ip::udp::endpoint> Endpoints;
+  std::vector<uint32_t> DestinationIndices;
+  std::vector<uint32_t> DestinationRanges;
+
+  boost::asio::io_service IOService;
+  boost::asio::ip::udp::socket Socket;
+
+#ifdef __linux__
+  //! Reused by Send to avoid allocations while replaying
+  std::vector<iovec> Buffers;
+  std::vector<mmsghdr> Messages;
+#endif
+};
+
+#endif // VV_PACKET_REPLAYER_H
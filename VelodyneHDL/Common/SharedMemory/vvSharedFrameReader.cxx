@@ -0,0 +1,196 @@
+//=========================================================================
+//
+// Copyright 2018 Kitware, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//=========================================================================
+
+#include "vvSharedFrameReader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+namespace
+{
+//! interval between two checks of WaitForNextFrame
+const std::chrono::microseconds PollInterval(100);
+}
+
+//-----------------------------------------------------------------------------
+const vvSharedFrameReader::Array* vvSharedFrameReader::Frame::GetArray(
+  const std::string& name) const
+{
+  for (const Array& array : this->Arrays)
+  {
+    if (name == array.Name)
+    {
+      return &array;
+    }
+  }
+  return nullptr;
+}
+
+//-----------------------------------------------------------------------------
+vvSharedFrameReader::vvSharedFrameReader()
+  : NextIndex(0)
+  , NumberOfFramesLost(0)
+{
+}
+
+//-----------------------------------------------------------------------------
+bool vvSharedFrameReader::Open(const std::string& name)
+{
+  if (!this->Ring.Open(name))
+  {
+    return false;
+  }
+  const uint64_t published = this->GetNumberOfFramesPublished();
+  this->NextIndex = published > 0 ? published - 1 : 0;
+  this->NumberOfFramesLost = 0;
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+void vvSharedFrameReader::Close()
+{
+  this->Ring.Close();
+}
+
+//-----------------------------------------------------------------------------
+bool vvSharedFrameReader::IsWriterClosed() const
+{
+  return !this->IsOpen() || this->Ring.GetHeader()->IsClosed.load(std::memory_order_acquire);
+}
+
+//-----------------------------------------------------------------------------
+uint64_t vvSharedFrameReader::GetNumberOfFramesPublished() const
+{
+  return this->IsOpen()
+    ? this->Ring.GetHeader()->NumberOfFramesPublished.load(std::memory_order_acquire)
+    : 0;
+}
+
+//-----------------------------------------------------------------------------
+uint64_t vvSharedFrameReader::GetNumberOfFramesDropped() const
+{
+  return this->IsOpen()
+    ? this->Ring.GetHeader()->NumberOfFramesDropped.load(std::memory_order_relaxed)
+    : 0;
+}
+
+//-----------------------------------------------------------------------------
+uint32_t vvSharedFrameReader::GetNumberOfSlots() const
+{
+  return this->IsOpen() ? this->Ring.GetHeader()->NumberOfSlots : 0;
+}
+
+//-----------------------------------------------------------------------------
+bool vvSharedFrameReader::GetNextFrame(Frame& frame)
+{
+  if (!this->IsOpen())
+  {
+    return false;
+  }
+  const uint64_t published = this->GetNumberOfFramesPublished();
+  const uint64_t nSlots = this->GetNumberOfSlots();
+  while (this->NextIndex < published)
+  {
+    // the slot of the oldest frame may already be overwritten by the next one
+    if (published - this->NextIndex >= nSlots)
+    {
+      const uint64_t oldest = published - nSlots + 1;
+      this->NumberOfFramesLost += oldest - this->NextIndex;
+      this->NextIndex = oldest;
+    }
+    if (this->MapFrame(this->NextIndex, frame))
+    {
+      ++this->NextIndex;
+      return true;
+    }
+    // overwritten meanwhile
+    ++this->NumberOfFramesLost;
+    ++this->NextIndex;
+  }
+  return false;
+}
+
+//-----------------------------------------------------------------------------
+bool vvSharedFrameReader::WaitForNextFrame(Frame& frame, double timeout)
+{
+  const auto deadline = std::chrono::steady_clock::now() +
+    std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                          std::chrono::duration<double>(timeout));
+  while (!this->GetNextFrame(frame))
+  {
+    if (this->IsWriterClosed() || std::chrono::steady_clock::now() >= deadline)
+    {
+      return false;
+    }
+    std::this_thread::sleep_for(PollInterval);
+  }
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+bool vvSharedFrameReader::IsValid(const Frame& frame) const
+{
+  if (!this->IsOpen())
+  {
+    return false;
+  }
+  const vvSharedFrame::SlotHeader* slot =
+    reinterpret_cast<const vvSharedFrame::SlotHeader*>(this->Ring.GetSlot(frame.Index));
+  // the reads of the frame must not be moved after the check
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return slot->Sequence.load(std::memory_order_relaxed) == frame.Sequence;
+}
+
+//-----------------------------------------------------------------------------
+bool vvSharedFrameReader::MapFrame(uint64_t index, Frame& frame) const
+{
+  const unsigned char* slotData = this->Ring.GetSlot(index);
+  const vvSharedFrame::SlotHeader* slot =
+    reinterpret_cast<const vvSharedFrame::SlotHeader*>(slotData);
+  const uint64_t sequence = slot->Sequence.load(std::memory_order_acquire);
+  if (sequence != 2 * (index + 1))
+  {
+    return false;
+  }
+
+  const uint64_t slotSize = this->Ring.GetHeader()->SlotSize;
+  frame.Index = index;
+  frame.Sequence = sequence;
+  frame.Time = slot->Time;
+  frame.ReceptionTime = slot->ReceptionTime;
+  frame.PublicationTime = slot->PublicationTime;
+  frame.SensorId = slot->SensorId;
+  frame.NumberOfPoints = slot->NumberOfPoints;
+  const uint32_t nArrays = std::min(slot->NumberOfArrays, vvSharedFrame::MaxNumberOfArrays);
+  frame.Arrays.resize(nArrays);
+  bool isConsistent = true;
+  for (uint32_t i = 0; i < nArrays; ++i)
+  {
+    const vvSharedFrame::ArrayHeader& header = slot->Arrays[i];
+    Array& array = frame.Arrays[i];
+    array.Name = header.Name;
+    array.DataType = header.DataType;
+    array.NumberOfComponents = header.NumberOfComponents;
+    array.Data = slotData + header.Offset;
+    // a torn read could point outside of the slot
+    isConsistent =
+      isConsistent && header.Offset <= slotSize && header.Size <= slotSize - header.Offset;
+  }
+
+  return isConsistent && this->IsValid(frame);
+}
@@ -0,0 +1,146 @@
+//=========================================================================
+//
+// Copyright 2018 Kitware, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//=========================================================================
+
+#ifndef VV_SHARED_FRAME_READER_H
+#define VV_SHARED_FRAME_READER_H
+
+#include "vvSharedFrameRing.h"
+
+// STD
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * \class vvSharedFrameReader
+ * \brief Reads from another process the frames a vtkLidarStream publishes in shared
+ *        memory (see SharedFramePublisher), without copying them: the arrays of a
+ *        frame point directly into the ring.
+ *
+ *        The writer never waits for the readers. A frame therefore stays valid until
+ *        the writer comes back to its slot, NumberOfSlots frames later. Once done with
+ *        a frame, a reader must call IsValid to know whether what it read is consistent,
+ *        and copy the data it wants to keep beyond that.
+ *
+ * \code
+ * vvSharedFrameReader reader;
+ * reader.Open("/veloview");
+ * vvSharedFrameReader::Frame frame;
+ * while (reader.WaitForNextFrame(frame, 1.0))
+ * {
+ *   const vvSharedFrameReader::Array* points = frame.GetArray("Points");
+ *   ... use static_cast<const float*>(points->Data) ...
+ *   if (!reader.IsValid(frame)) { ... discard the result ... }
+ * }
+ * \endcode
+ */
+class vvSharedFrameReader
+{
+public:
+  //! An array of a frame, mapped in the ring
+  struct Array
+  {
+    const char* Name;
+    uint32_t DataType; /*!< one of vvSharedFrame::DATA_TYPE */
+    uint32_t NumberOfComponents;
+    const void* Data;  /*!< NumberOfPoints * NumberOfComponents values */
+  };
+
+  //! A frame mapped in the ring, see IsValid
+  struct Frame
+  {
+    uint64_t Index;
+    double Time;
+    double ReceptionTime;
+    double PublicationTime;
+    uint32_t SensorId;
+    uint64_t NumberOfPoints;
+    //! "Points" first, then the point data arrays
+    std::vector<Array> Arrays;
+
+    //! Return the array of the given name, null if the frame has none
+    const Array* GetArray(const std::string& name) const;
+
+    //! sequence number of the slot when the frame was mapped
+    uint64_t Sequence;
+  };
+
+  vvSharedFrameReader();
+
+  /**
+   * @brief Open map the ring of a writer. The first frame returned by GetNextFrame is
+   * the last one published, if any.
+   * @param name name of the shared memory region, the one given to the writer
+   */
+  bool Open(const std::string& name);
+
+  void Close();
+
+  bool IsOpen() const { return this->Ring.IsOpen(); }
+
+  //! Reason of the last failure of Open
+  const std::string& GetLastError() const { return this->Ring.GetLastError(); }
+
+  //! Whether the writer has closed the ring, no frame will come anymore
+  bool IsWriterClosed() const;
+
+  /**
+   * @brief GetNextFrame map the frame following the last one returned, or the oldest
+   * one still available if the reader is late, the frames skipped being counted as lost
+   * @return false if there is no new frame
+   */
+  bool GetNextFrame(Frame& frame);
+
+  /**
+   * @brief WaitForNextFrame wait for a new frame, see GetNextFrame
+   * @param timeout in seconds
+   * @return false if no frame came in time, or if the writer closed the ring
+   */
+  bool WaitForNextFrame(Frame& frame, double timeout);
+
+  /**
+   * @brief IsValid return whether a frame has not been overwritten since it was mapped.
+   * To be called after using its arrays: if it returns false, what was read from them
+   * may be mixed with another frame.
+   */
+  bool IsValid(const Frame& frame) const;
+
+  //! Number of frames published by the writer
+  uint64_t GetNumberOfFramesPublished() const;
+
+  //! Number of frames too large for a slot, which the writer did not publish
+  uint64_t GetNumberOfFramesDropped() const;
+
+  //! Number of frames overwritten before this reader got them
+  uint64_t GetNumberOfFramesLost() const { return this->NumberOfFramesLost; }
+
+  uint32_t GetNumberOfSlots() const;
+
+private:
+  /**
+   * @brief MapFrame fill a frame with the content of the slot of the given index
+   * @return false if the slot does not hold this frame, or if it has been overwritten
+   */
+  bool MapFrame(uint64_t index, Frame& frame) const;
+
+  vvSharedFrameRing Ring;
+  //! index of the frame GetNextFrame looks for
+  uint64_t NextIndex;
+  uint64_t NumberOfFramesLost;
+};
+
+#endif // VV_SHARED_FRAME_READER_H
@@ -0,0 +1,233 @@
+//=========================================================================
+//
+// Copyright 2018 Kitware, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//=========================================================================
+
+#include "vvSharedFrameRing.h"
+
+#include <cerrno>
+#include <cstring>
+#include <new>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//-----------------------------------------------------------------------------
+size_t vvSharedFrame::GetDataTypeSize(uint32_t dataType)
+{
+  switch (dataType)
+  {
+    case Int8:
+    case UInt8:
+      return 1;
+    case Int16:
+    case UInt16:
+      return 2;
+    case Int32:
+    case UInt32:
+    case Float32:
+      return 4;
+    case Int64:
+    case UInt64:
+    case Float64:
+      return 8;
+    default:
+      return 0;
+  }
+}
+
+//-----------------------------------------------------------------------------
+vvSharedFrameRing::vvSharedFrameRing()
+  : Data(nullptr)
+  , Size(0)
+  , IsOwner(false)
+{
+}
+
+//-----------------------------------------------------------------------------
+vvSharedFrameRing::~vvSharedFrameRing()
+{
+  this->Close();
+}
+
+//-----------------------------------------------------------------------------
+uint64_t vvSharedFrameRing::GetRegionSize(uint32_t nSlots, uint64_t slotSize)
+{
+  return vvSharedFrame::AlignUp(sizeof(vvSharedFrame::RingHeader)) +
+    nSlots * vvSharedFrame::AlignUp(slotSize);
+}
+
+#ifdef _WIN32
+//-----------------------------------------------------------------------------
+bool vvSharedFrameRing::Create(const std::string&, uint32_t, uint64_t)
+{
+  this->LastError = "shared memory frames are only available on POSIX systems";
+  return false;
+}
+
+//-----------------------------------------------------------------------------
+bool vvSharedFrameRing::Open(const std::string&)
+{
+  this->LastError = "shared memory frames are only available on POSIX systems";
+  return false;
+}
+
+//-----------------------------------------------------------------------------
+bool vvSharedFrameRing::Map(int, uint64_t, bool)
+{
+  return false;
+}
+
+//-----------------------------------------------------------------------------
+void vvSharedFrameRing::Close()
+{
+}
+#else
+//-----------------------------------------------------------------------------
+bool vvSharedFrameRing::Create(const std::string& name, uint32_t nSlots, uint64_t slotSize)
+{
+  this->Close();
+  if (nSlots == 0 || slotSize <= sizeof(vvSharedFrame::SlotHeader))
+  {
+    this->LastError = "the ring needs at least one slot larger than its header";
+    return false;
+  }
+
+  // a new region, so that the readers of a previous one are not mixed up
+  shm_unlink(name.c_str());
+  const int fileDescriptor = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fileDescriptor < 0)
+  {
+    this->LastError = "failed to create " + name + ": " + std::strerror(errno);
+    return false;
+  }
+  const uint64_t size = GetRegionSize(nSlots, slotSize);
+  if (ftruncate(fileDescriptor, static_cast<off_t>(size)) != 0)
+  {
+    this->LastError = "failed to allocate " + name + ": " + std::strerror(errno);
+    close(fileDescriptor);
+    shm_unlink(name.c_str());
+    return false;
+  }
+  const bool isMapped = this->Map(fileDescriptor, size, true);
+  close(fileDescriptor);
+  if (!isMapped)
+  {
+    shm_unlink(name.c_str());
+    return false;
+  }
+  this->Name = name;
+  this->IsOwner = true;
+
+  // ftruncate fills the region with zeros, which is a valid state for all the atomics
+  vvSharedFrame::RingHeader* header = new (this->Data) vvSharedFrame::RingHeader;
+  header->Version = vvSharedFrame::Version;
+  header->NumberOfSlots = nSlots;
+  header->IsClosed.store(0, std::memory_order_relaxed);
+  header->SlotSize = vvSharedFrame::AlignUp(slotSize);
+  header->FirstSlotOffset = vvSharedFrame::AlignUp(sizeof(vvSharedFrame::RingHeader));
+  header->NumberOfFramesPublished.store(0, std::memory_order_relaxed);
+  header->NumberOfFramesDropped.store(0, std::memory_order_relaxed);
+  for (uint32_t i = 0; i < nSlots; ++i)
+  {
+    vvSharedFrame::SlotHeader* slot = new (this->GetSlot(i)) vvSharedFrame::SlotHeader;
+    slot->Sequence.store(0, std::memory_order_relaxed);
+  }
+  header->Magic.store(vvSharedFrame::Magic, std::memory_order_release);
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+bool vvSharedFrameRing::Open(const std::string& name)
+{
+  this->Close();
+  const int fileDescriptor = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fileDescriptor < 0)
+  {
+    this->LastError = "failed to open " + name + ": " + std::strerror(errno);
+    return false;
+  }
+  struct stat status;
+  if (fstat(fileDescriptor, &status) != 0 ||
+    static_cast<uint64_t>(status.st_size) < sizeof(vvSharedFrame::RingHeader))
+  {
+    this->LastError = name + " is not a frame ring";
+    close(fileDescriptor);
+    return false;
+  }
+  const bool isMapped = this->Map(fileDescriptor, static_cast<uint64_t>(status.st_size), false);
+  close(fileDescriptor);
+  if (!isMapped)
+  {
+    return false;
+  }
+
+  const vvSharedFrame::RingHeader* header = this->GetHeader();
+  if (header->Magic.load(std::memory_order_acquire) != vvSharedFrame::Magic)
+  {
+    this->LastError = name + " is not a frame ring, or is not initialized yet";
+    this->Close();
+    return false;
+  }
+  if (header->Version != vvSharedFrame::Version ||
+    this->Size < GetRegionSize(header->NumberOfSlots, header->SlotSize))
+  {
+    this->LastError = name + " is a frame ring of another version";
+    this->Close();
+    return false;
+  }
+  this->Name = name;
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+bool vvSharedFrameRing::Map(int fileDescriptor, uint64_t size, bool writable)
+{
+  void* data = mmap(nullptr, static_cast<size_t>(size),
+    writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fileDescriptor, 0);
+  if (data == MAP_FAILED)
+  {
+    this->LastError = std::string("failed to map the frame ring: ") + std::strerror(errno);
+    return false;
+  }
+  this->Data = static_cast<unsigned char*>(data);
+  this->Size = size;
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+void vvSharedFrameRing::Close()
+{
+  if (!this->Data)
+  {
+    return;
+  }
+  if (this->IsOwner)
+  {
+    // the readers mapping it keep it alive, but no frame comes anymore
+    this->GetHeader()->IsClosed.store(1, std::memory_order_release);
+    shm_unlink(this->Name.c_str());
+  }
+  munmap(this->Data, static_cast<size_t>(this->Size));
+  this->Data = nullptr;
+  this->Size = 0;
+  this->IsOwner = false;
+  this->Name.clear();
+}
+#endif
@@ -0,0 +1,180 @@
+//=========================================================================
+//
+// Copyright 2018 Kitware, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//=========================================================================
+
+#ifndef VV_SHARED_FRAME_RING_H
+#define VV_SHARED_FRAME_RING_H
+
+// STD
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * Layout of the shared memory ring the frames of a live stream are published in,
+ * see vvSharedFrameRing. It only depends on the standard library, so that other
+ * processes can read the frames with vvSharedFrameReader without VTK.
+ *
+ * The region starts with a RingHeader, followed by NumberOfSlots slots of SlotSize
+ * bytes. Frame i is written in slot i % NumberOfSlots: a SlotHeader followed by
+ * one contiguous array per attribute (structure of arrays), the points first.
+ *
+ * There is a single writer and any number of readers, which never block it. Each
+ * slot is protected by a sequence lock: its Sequence is odd while the frame is being
+ * written, and 2 * (frame index + 1) once it is complete. A reader checks it before
+ * and after using the frame to know whether the frame has been overwritten meanwhile.
+ */
+namespace vvSharedFrame
+{
+const uint32_t Magic = 0x46535656; // "VVSF"
+const uint32_t Version = 1;
+//! alignment of the slots and of the arrays in a slot
+const uint64_t Alignment = 64;
+const uint32_t MaxNumberOfArrays = 32;
+const uint32_t MaxArrayNameLength = 48;
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "the ring needs address-free 64 bits atomics");
+
+/**
+ * @brief The DATA_TYPE enum type of the values of an array
+ */
+enum DATA_TYPE
+{
+  Int8 = 0,
+  UInt8 = 1,
+  Int16 = 2,
+  UInt16 = 3,
+  Int32 = 4,
+  UInt32 = 5,
+  Int64 = 6,
+  UInt64 = 7,
+  Float32 = 8,
+  Float64 = 9,
+};
+
+//! Size in bytes of a value of the given DATA_TYPE, 0 if unknown
+size_t GetDataTypeSize(uint32_t dataType);
+
+//! Round up a size to a multiple of Alignment
+inline uint64_t AlignUp(uint64_t size)
+{
+  return (size + Alignment - 1) / Alignment * Alignment;
+}
+
+//! An array of a frame, the points being the first one
+struct ArrayHeader
+{
+  char Name[MaxArrayNameLength]; /*!< null terminated */
+  uint32_t DataType;             /*!< one of DATA_TYPE */
+  uint32_t NumberOfComponents;
+  uint64_t Offset; /*!< from the start of the slot, a multiple of Alignment */
+  uint64_t Size;   /*!< in bytes */
+};
+
+//! Header of a slot, followed by the arrays of the frame
+struct SlotHeader
+{
+  std::atomic<uint64_t> Sequence;
+  uint64_t FrameIndex;
+  double Time;            /*!< time of the frame, in seconds since the epoch */
+  double ReceptionTime;   /*!< when its last packet was received, see StreamStatistics::Now */
+  double PublicationTime; /*!< when it was written in the ring, same clock */
+  uint32_t SensorId;
+  uint32_t NumberOfArrays;
+  uint64_t NumberOfPoints;
+  ArrayHeader Arrays[MaxNumberOfArrays];
+};
+
+//! Header of the region
+struct RingHeader
+{
+  std::atomic<uint32_t> Magic; /*!< set last once the region is initialized */
+  uint32_t Version;
+  uint32_t NumberOfSlots;
+  std::atomic<uint32_t> IsClosed; /*!< set when the writer goes away */
+  uint64_t SlotSize;
+  uint64_t FirstSlotOffset;
+  std::atomic<uint64_t> NumberOfFramesPublished;
+  std::atomic<uint64_t> NumberOfFramesDropped; /*!< too large for a slot */
+};
+}
+
+/**
+ * \class vvSharedFrameRing
+ * \brief Maps the POSIX shared memory region of a frame ring, see vvSharedFrame.
+ *        The writer creates it, the readers map it read only.
+ */
+class vvSharedFrameRing
+{
+public:
+  vvSharedFrameRing();
+
+  ~vvSharedFrameRing();
+
+  /**
+   * @brief Create create the region, replacing any region of the same name, which the
+   * readers still mapping it see as closed
+   * @param name name of the region, e.g. "/veloview", see shm_open
+   * @param nSlots number of frames kept, readers have this many frame periods to use one
+   * @param slotSize size in bytes of a slot, larger frames are dropped
+   */
+  bool Create(const std::string& name, uint32_t nSlots, uint64_t slotSize);
+
+  //! Map read only the region created by a writer
+  bool Open(const std::string& name);
+
+  //! Unmap the region. The writer marks it closed and removes its name.
+  void Close();
+
+  bool IsOpen() const { return this->Data != nullptr; }
+
+  const std::string& GetName() const { return this->Name; }
+
+  //! Reason of the last failure of Create or Open
+  const std::string& GetLastError() const { return this->LastError; }
+
+  vvSharedFrame::RingHeader* GetHeader() const
+  {
+    return reinterpret_cast<vvSharedFrame::RingHeader*>(this->Data);
+  }
+
+  //! Slot where the frame of the given index is written
+  unsigned char* GetSlot(uint64_t frameIndex) const
+  {
+    const vvSharedFrame::RingHeader* header = this->GetHeader();
+    return this->Data + header->FirstSlotOffset +
+      (frameIndex % header->NumberOfSlots) * header->SlotSize;
+  }
+
+  //! Size of the region needed by a ring
+  static uint64_t GetRegionSize(uint32_t nSlots, uint64_t slotSize);
+
+private:
+  vvSharedFrameRing(const vvSharedFrameRing&) = delete;
+  vvSharedFrameRing& operator=(const vvSharedFrameRing&) = delete;
+
+  bool Map(int fileDescriptor, uint64_t size, bool writable);
+
+  std::string Name;
+  std::string LastError;
+  unsigned char* Data;
+  uint64_t Size;
+  //! whether this is the writer, which removes the region when closing
+  bool IsOwner;
+};
+
+#endif // VV_SHARED_FRAME_RING_H
@@ -0,0 +1,121 @@
+//=========================================================================
+//
+// Copyright 2018 Kitware, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//=========================================================================
+
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+// STD
+#include <algorithm>
+#include <deque>
+// BOOST
+#include <boost/thread.hpp>
+
+/**
+ * \class BoundedQueue
+ * \brief First-in first-out queue of limited capacity between a producer
+ *        thread and a consumer thread.
+ *
+ *        Push blocks while the queue is full, so that the producer can not get
+ *        ahead of the consumer by more than the capacity, and Pop blocks while it
+ *        is empty. The consumer calls TaskDone once an item popped is processed,
+ *        so that Join waits until all the items pushed are processed. Close
+ *        releases the consumer, Pop returning false once the queue is empty.
+ */
+template <typename T>
+class BoundedQueue
+{
+public:
+  explicit BoundedQueue(size_t capacity = 2) : Capacity(std::max(static_cast<size_t>(1), capacity)) {}
+
+  //! Add an item, waiting for a free slot. Return false if the queue is closed
+  bool Push(const T& item)
+  {
+    boost::unique_lock<boost::mutex> lock(this->Mutex);
+    while (this->Items.size() >= this->Capacity && !this->Closed)
+    {
+      this->NotFull.wait(lock);
+    }
+    if (this->Closed)
+    {
+      return false;
+    }
+    this->Items.push_back(item);
+    this->UnfinishedTasks++;
+    this->NotEmpty.notify_one();
+    return true;
+  }
+
+  //! Remove the oldest item, waiting for one. Return false if the queue is closed and empty
+  bool Pop(T& item)
+  {
+    boost::unique_lock<boost::mutex> lock(this->Mutex);
+    while (this->Items.empty() && !this->Closed)
+    {
+      this->NotEmpty.wait(lock);
+    }
+    if (this->Items.empty())
+    {
+      return false;
+    }
+    item = this->Items.front();
+    this->Items.pop_front();
+    this->NotFull.notify_one();
+    return true;
+  }
+
+  //! Indicate that an item popped has been processed
+  void TaskDone()
+  {
+    boost::unique_lock<boost::mutex> lock(this->Mutex);
+    if (--this->UnfinishedTasks == 0)
+    {
+      this->AllTasksDone.notify_all();
+    }
+  }
+
+  //! Wait until all the items pushed have been popped and processed
+  void Join()
+  {
+    boost::unique_lock<boost::mutex> lock(this->Mutex);
+    while (this->UnfinishedTasks > 0)
+    {
+      this->AllTasksDone.wait(lock);
+    }
+  }
+
+  //! Refuse new items and release the threads waiting for the queue
+  void Close()
+  {
+    boost::unique_lock<boost::mutex> lock(this->Mutex);
+    this->Closed = true;
+    this->NotEmpty.notify_all();
+    this->NotFull.notify_all();
+  }
+
+private:
+  const size_t Capacity;
+  std::deque<T> Items;
+  size_t UnfinishedTasks = 0;
+  bool Closed = false;
+
+  boost::mutex Mutex;
+  boost::condition_variable NotEmpty;
+  boost::condition_variable NotFull;
+  boost::condition_variable AllTasksDone;
+};
+
+#endif // BOUNDED_QUEUE_H
@@ -0,0 +1,470 @@
+//=========================================================================
+//
+// Copyright 2018 Kitware, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//=========================================================================
+
+#ifndef INCREMENTAL_KDTREE_H
+#define INCREMENTAL_KDTREE_H
+
+// STD
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+/**
+ * \class IncrementalKDTree
+ * \brief Nearest neighbors index of a set of points which changes over time,
+ *        such as the local map of the slam. Adding or removing a point does not
+ *        rebuild the whole index.
+ *
+ *        The points are stored in a forest of static kd-trees of decreasing sizes.
+ *        The points added wait in a small buffer searched linearly, which becomes a
+ *        new tree once full. A tree is merged with the previous one while it is not
+ *        twice smaller, so that there are O(log(n)) trees and a point is moved
+ *        O(log(n)) times. The points removed are only marked as such, and dropped
+ *        when their tree is rebuilt, which happens once half of it is removed.
+ *
+ *        T is any point type with x, y and z members, e.g. a pcl point, which needs
+ *        Eigen::aligned_allocator as Allocator. The queries can be made from several
+ *        threads, as long as the index is not modified.
+ */
+template <typename T, typename Allocator = std::allocator<T> >
+class IncrementalKDTree
+{
+public:
+  //! Add a point, return its id. The ids of the points removed are reused.
+  int Add(const T& point)
+  {
+    const int id = this->NewId(point);
+    this->Location[id] = InBuffer;
+    this->Buffer.push_back(id);
+    if (this->Buffer.size() >= static_cast<size_t>(BufferSize))
+    {
+      std::vector<int> ids;
+      ids.swap(this->Buffer);
+      this->AddTree(ids);
+    }
+    return id;
+  }
+
+  //! Add several points at once in a new tree, append their ids to ids if not null
+  template <typename Iterator>
+  void Add(Iterator begin, Iterator end, std::vector<int>* ids = nullptr)
+  {
+    std::vector<int> newIds;
+    newIds.reserve(std::distance(begin, end));
+    for (Iterator it = begin; it != end; ++it)
+    {
+      newIds.push_back(this->NewId(*it));
+    }
+    if (ids)
+    {
+      ids->insert(ids->end(), newIds.begin(), newIds.end());
+    }
+    if (!newIds.empty())
+    {
+      this->AddTree(newIds);
+    }
+  }
+
+  //! Remove a point, its id must not be used anymore
+  void Remove(int id)
+  {
+    if (id < 0 || id >= static_cast<int>(this->Points.size()) || this->IsRemoved[id] ||
+      this->Location[id] == IsFree)
+    {
+      return;
+    }
+    this->NumberOfPoints--;
+    if (this->Location[id] == InBuffer)
+    {
+      std::vector<int>::iterator it = std::find(this->Buffer.begin(), this->Buffer.end(), id);
+      *it = this->Buffer.back();
+      this->Buffer.pop_back();
+      this->FreeId(id);
+      return;
+    }
+
+    // the point stays in its tree until half of it is removed
+    const int treeIndex = this->Location[id];
+    Tree& tree = this->Trees[treeIndex];
+    this->IsRemoved[id] = 1;
+    tree.NumberOfRemoved++;
+    if (2 * tree.NumberOfRemoved > tree.Ids.size())
+    {
+      std::vector<int> ids;
+      this->TakeValidIds(tree, ids);
+      if (ids.empty())
+      {
+        this->Trees.erase(this->Trees.begin() + treeIndex);
+        this->UpdateLocations(treeIndex, this->Trees.size());
+      }
+      else
+      {
+        this->Build(tree, ids);
+        this->UpdateLocations(treeIndex, treeIndex + 1);
+      }
+    }
+  }
+
+  //! Point of an id which has not been removed
+  const T& GetPoint(int id) const { return this->Points[id]; }
+
+  //! Number of points in the index
+  size_t GetNumberOfPoints() const { return this->NumberOfPoints; }
+
+  //! Number of trees of the forest, O(log(number of points))
+  size_t GetNumberOfTrees() const { return this->Trees.size(); }
+
+  //! Memory used by the index, in bytes
+  size_t GetMemoryUsage() const
+  {
+    size_t memory = sizeof(*this) + this->Points.capacity() * sizeof(T) +
+      this->IsRemoved.capacity() * sizeof(char) +
+      (this->Location.capacity() + this->FreeIds.capacity() + this->Buffer.capacity()) * sizeof(int) +
+      this->Trees.capacity() * sizeof(Tree);
+    for (size_t i = 0; i < this->Trees.size(); ++i)
+    {
+      const Tree& tree = this->Trees[i];
+      memory += tree.Nodes.capacity() * sizeof(Node) + tree.Ids.capacity() * sizeof(int) +
+        tree.Coordinates.capacity() * sizeof(float);
+    }
+    return memory;
+  }
+
+  //! Remove all the points
+  void Clear()
+  {
+    this->Points.clear();
+    this->IsRemoved.clear();
+    this->Location.clear();
+    this->FreeIds.clear();
+    this->Buffer.clear();
+    this->Trees.clear();
+    this->NumberOfPoints = 0;
+  }
+
+  /**
+   * @brief KNearestSearch search the k nearest points of a query point, same as
+   * pcl::KdTreeFLANN::nearestKSearch
+   * @param query the point whose neighbors are searched, it does not need to be in the index
+   * @param k number of neighbors
+   * @param ids ids of the neighbors found, from the closest to the farthest
+   * @param squaredDistances squared distances of the neighbors to the query point
+   * @param searched if not null, only the points whose id has a non zero value
+   * in it are searched, the ids beyond its size are not searched
+   * @return the number of neighbors found, less than k if the index is smaller
+   *
+   * The neighbors are sorted directly in ids and squaredDistances, so that
+   * no memory is allocated when they are reused for several queries.
+   */
+  int KNearestSearch(const T& query, unsigned int k,
+                     std::vector<int>& ids, std::vector<float>& squaredDistances,
+                     const std::vector<char>* searched = nullptr) const
+  {
+    Neighbors neighbors = { ids, squaredDistances, k, searched };
+    ids.clear();
+    squaredDistances.clear();
+    if (k > 0)
+    {
+      const float q[3] = { query.x, query.y, query.z };
+      for (size_t i = 0; i < this->Buffer.size(); ++i)
+      {
+        if (!IsSearched(neighbors, this->Buffer[i]))
+        {
+          continue;
+        }
+        const T& point = this->Points[this->Buffer[i]];
+        const float p[3] = { point.x, point.y, point.z };
+        InsertNeighbor(neighbors, SquaredDistance(q, p), this->Buffer[i]);
+      }
+      for (size_t i = 0; i < this->Trees.size(); ++i)
+      {
+        this->SearchNode(this->Trees[i], 0, q, neighbors);
+      }
+    }
+    return static_cast<int>(ids.size());
+  }
+
+private:
+  enum
+  {
+    BufferSize = 64, /*!< number of points added to the buffer before it becomes a tree */
+    LeafSize = 16    /*!< maximal number of points of a leaf of a tree */
+  };
+  //! Location of the ids which are not in a tree
+  enum
+  {
+    InBuffer = -1,
+    IsFree = -2
+  };
+
+  //! Node of a kd-tree. The points of a node lower than Split along Axis are in its
+  //! first child, the others in the second one. A leaf has no axis.
+  struct Node
+  {
+    float Split;
+    int Axis;
+    int Children; /*!< index of the first child, the second one follows */
+    int Begin;    /*!< range of the points of a leaf in Ids */
+    int End;
+  };
+
+  //! A static kd-tree
+  struct Tree
+  {
+    std::vector<Node> Nodes;
+    std::vector<int> Ids;
+    std::vector<float> Coordinates; /*!< x, y, z of the points of Ids, in the same order */
+    size_t NumberOfRemoved;
+  };
+
+  //! Neighbors found so far sorted by distance, at most K
+  struct Neighbors
+  {
+    std::vector<int>& Ids;
+    std::vector<float>& SquaredDistances;
+    unsigned int K;
+    const std::vector<char>* Searched;
+  };
+
+  static bool IsSearched(const Neighbors& neighbors, int id)
+  {
+    const std::vector<char>* searched = neighbors.Searched;
+    return !searched || (static_cast<size_t>(id) < searched->size() && (*searched)[id]);
+  }
+
+  static float GetCoordinate(const T& point, int axis)
+  {
+    return axis == 0 ? point.x : (axis == 1 ? point.y : point.z);
+  }
+
+  static float SquaredDistance(const float q[3], const float p[3])
+  {
+    const float dx = p[0] - q[0];
+    const float dy = p[1] - q[1];
+    const float dz = p[2] - q[2];
+    return dx * dx + dy * dy + dz * dz;
+  }
+
+  static void InsertNeighbor(Neighbors& neighbors, float squaredDistance, int id)
+  {
+    std::vector<float>& distances = neighbors.SquaredDistances;
+    if (neighbors.Ids.size() == neighbors.K)
+    {
+      if (squaredDistance >= distances.back())
+      {
+        return;
+      }
+      neighbors.Ids.pop_back();
+      distances.pop_back();
+    }
+    // after the neighbors at the same distance, so that the first found stays first
+    const size_t position =
+      std::upper_bound(distances.begin(), distances.end(), squaredDistance) - distances.begin();
+    distances.insert(distances.begin() + position, squaredDistance);
+    neighbors.Ids.insert(neighbors.Ids.begin() + position, id);
+  }
+
+  int NewId(const T& point)
+  {
+    this->NumberOfPoints++;
+    if (!this->FreeIds.empty())
+    {
+      const int id = this->FreeIds.back();
+      this->FreeIds.pop_back();
+      this->Points[id] = point;
+      this->IsRemoved[id] = 0;
+      return id;
+    }
+    this->Points.push_back(point);
+    this->IsRemoved.push_back(0);
+    this->Location.push_back(InBuffer);
+    return static_cast<int>(this->Points.size()) - 1;
+  }
+
+  void FreeId(int id)
+  {
+    this->IsRemoved[id] = 0;
+    this->Location[id] = IsFree;
+    this->FreeIds.push_back(id);
+  }
+
+  //! Move the ids of a tree which are not removed to ids, free the others
+  void TakeValidIds(Tree& tree, std::vector<int>& ids)
+  {
+    for (size_t i = 0; i < tree.Ids.size(); ++i)
+    {
+      const int id = tree.Ids[i];
+      if (this->IsRemoved[id])
+      {
+        this->FreeId(id);
+      }
+      else
+      {
+        ids.push_back(id);
+      }
+    }
+    tree.Ids.clear();
+  }
+
+  //! Set the location of the points of the trees [firstTree, endTree)
+  void UpdateLocations(size_t firstTree, size_t endTree)
+  {
+    for (size_t i = firstTree; i < endTree; ++i)
+    {
+      const std::vector<int>& ids = this->Trees[i].Ids;
+      for (size_t j = 0; j < ids.size(); ++j)
+      {
+        this->Location[ids[j]] = static_cast<int>(i);
+      }
+    }
+  }
+
+  //! Add a tree made of the given points, and merge the last trees while
+  //! they are of similar sizes
+  void AddTree(std::vector<int>& ids)
+  {
+    while (!this->Trees.empty())
+    {
+      Tree& last = this->Trees.back();
+      if (last.Ids.size() - last.NumberOfRemoved > 2 * ids.size())
+      {
+        break;
+      }
+      this->TakeValidIds(last, ids);
+      this->Trees.pop_back();
+    }
+    this->Trees.push_back(Tree());
+    this->Build(this->Trees.back(), ids);
+    this->UpdateLocations(this->Trees.size() - 1, this->Trees.size());
+  }
+
+  //! Build a tree over the given points, which are moved into the tree
+  void Build(Tree& tree, std::vector<int>& ids)
+  {
+    tree.Ids.swap(ids);
+    tree.NumberOfRemoved = 0;
+    tree.Nodes.clear();
+    tree.Nodes.reserve(2 * (tree.Ids.size() / LeafSize + 1));
+    tree.Nodes.push_back(Node());
+    this->BuildNode(tree, 0, 0, static_cast<int>(tree.Ids.size()));
+
+    tree.Coordinates.resize(3 * tree.Ids.size());
+    for (size_t i = 0; i < tree.Ids.size(); ++i)
+    {
+      const T& point = this->Points[tree.Ids[i]];
+      tree.Coordinates[3 * i] = point.x;
+      tree.Coordinates[3 * i + 1] = point.y;
+      tree.Coordinates[3 * i + 2] = point.z;
+    }
+  }
+
+  void BuildNode(Tree& tree, int node, int begin, int end)
+  {
+    if (end - begin <= LeafSize)
+    {
+      Node& leaf = tree.Nodes[node];
+      leaf.Split = 0;
+      leaf.Axis = -1;
+      leaf.Children = -1;
+      leaf.Begin = begin;
+      leaf.End = end;
+      return;
+    }
+
+    // split along the axis of largest extent, at the median point
+    float bounds[3][2];
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      bounds[axis][0] = bounds[axis][1] = GetCoordinate(this->Points[tree.Ids[begin]], axis);
+    }
+    for (int i = begin + 1; i < end; ++i)
+    {
+      const T& point = this->Points[tree.Ids[i]];
+      for (int axis = 0; axis < 3; ++axis)
+      {
+        const float value = GetCoordinate(point, axis);
+        bounds[axis][0] = std::min(bounds[axis][0], value);
+        bounds[axis][1] = std::max(bounds[axis][1], value);
+      }
+    }
+    int splitAxis = 0;
+    for (int axis = 1; axis < 3; ++axis)
+    {
+      if (bounds[axis][1] - bounds[axis][0] > bounds[splitAxis][1] - bounds[splitAxis][0])
+      {
+        splitAxis = axis;
+      }
+    }
+    const int middle = begin + (end - begin) / 2;
+    const std::vector<T, Allocator>& points = this->Points;
+    std::nth_element(tree.Ids.begin() + begin, tree.Ids.begin() + middle, tree.Ids.begin() + end,
+      [&points, splitAxis](int a, int b) {
+        return GetCoordinate(points[a], splitAxis) < GetCoordinate(points[b], splitAxis);
+      });
+
+    const int children = static_cast<int>(tree.Nodes.size());
+    tree.Nodes.resize(children + 2);
+    Node& split = tree.Nodes[node];
+    split.Split = GetCoordinate(this->Points[tree.Ids[middle]], splitAxis);
+    split.Axis = splitAxis;
+    split.Children = children;
+    split.Begin = begin;
+    split.End = end;
+    this->BuildNode(tree, children, begin, middle);
+    this->BuildNode(tree, children + 1, middle, end);
+  }
+
+  void SearchNode(const Tree& tree, int nodeIndex, const float q[3], Neighbors& neighbors) const
+  {
+    const Node& node = tree.Nodes[nodeIndex];
+    if (node.Axis < 0)
+    {
+      for (int i = node.Begin; i < node.End; ++i)
+      {
+        const int id = tree.Ids[i];
+        if (!this->IsRemoved[id] && IsSearched(neighbors, id))
+        {
+          InsertNeighbor(neighbors, SquaredDistance(q, &tree.Coordinates[3 * i]), id);
+        }
+      }
+      return;
+    }
+
+    // the side of the query point first, the other one only if it may be closer
+    const float diff = q[node.Axis] - node.Split;
+    const int nearChild = node.Children + (diff < 0 ? 0 : 1);
+    const int farChild = node.Children + (diff < 0 ? 1 : 0);
+    this->SearchNode(tree, nearChild, q, neighbors);
+    if (neighbors.Ids.size() < neighbors.K || diff * diff < neighbors.SquaredDistances.back())
+    {
+      this->SearchNode(tree, farChild, q, neighbors);
+    }
+  }
+
+  std::vector<T, Allocator> Points;
+  std::vector<char> IsRemoved;
+  //! Index of the tree of each point, or InBuffer, or IsFree
+  std::vector<int> Location;
+  std::vector<int> FreeIds;
+  std::vector<int> Buffer;
+  std::vector<Tree> Trees;
+  size_t NumberOfPoints = 0;
+};
+
+#endif // INCREMENTAL_KDTREE_H
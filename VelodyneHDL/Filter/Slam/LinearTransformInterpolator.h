@@ -0,0 +1,136 @@
+//=========================================================================
+//
+// Copyright 2018 Kitware, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//=========================================================================
+
+#ifndef LINEAR_TRANSFORM_INTERPOLATOR_H
+#define LINEAR_TRANSFORM_INTERPOLATOR_H
+
+// STD
+#include <algorithm>
+#include <cmath>
+// EIGEN
+#include <Eigen/Dense>
+
+/**
+ * \class LinearTransformInterpolator
+ * \brief Interpolation of a rigid transform between two poses, at times 0 and 1,
+ *        assuming a constant angular velocity and velocity in between.
+ *
+ *        The translation is interpolated linearly and the rotation with a slerp,
+ *        as vtkVelodyneTransformInterpolator does in its linear mode, the time
+ *        being clamped to [0, 1]. The angle between the two rotations is computed
+ *        once, so that a point is transformed with two sines and a rotation by a
+ *        quaternion. The interpolator is not modified by the interpolation, and
+ *        can be shared by several threads.
+ */
+class LinearTransformInterpolator
+{
+public:
+  LinearTransformInterpolator() { this->SetTransforms(Eigen::Matrix3d::Identity(), Eigen::Vector3d::Zero(),
+                                                      Eigen::Matrix3d::Identity(), Eigen::Vector3d::Zero()); }
+
+  //! Set the rotations and translations of the poses at times 0 and 1
+  void SetTransforms(const Eigen::Matrix3d& R0, const Eigen::Vector3d& T0,
+                     const Eigen::Matrix3d& R1, const Eigen::Vector3d& T1)
+  {
+    this->Q0 = Eigen::Quaterniond(R0).normalized();
+    this->Q1 = Eigen::Quaterniond(R1).normalized();
+    this->T0 = T0;
+    this->T1 = T1;
+
+    // take the closest of the two quaternions representing
+    // the second rotation, for the slerp to take the short path
+    double cosAngle = this->Q0.dot(this->Q1);
+    if (cosAngle < 0.0)
+    {
+      this->Q1.coeffs() = -this->Q1.coeffs();
+      cosAngle = -cosAngle;
+    }
+
+    // the slerp is a linear interpolation for close rotations,
+    // the division by the sine of the angle being ill-conditioned
+    this->IsLinear = cosAngle > 1.0 - 1e-9;
+    this->Angle = std::acos(std::min(cosAngle, 1.0));
+    this->InverseSinAngle = this->IsLinear ? 0.0 : 1.0 / std::sin(this->Angle);
+  }
+
+  //! Interpolate the rotation at time t
+  Eigen::Quaterniond InterpolateRotation(double t) const
+  {
+    t = std::min(std::max(t, 0.0), 1.0);
+    double w0, w1;
+    if (this->IsLinear)
+    {
+      w0 = 1.0 - t;
+      w1 = t;
+    }
+    else
+    {
+      w0 = std::sin((1.0 - t) * this->Angle) * this->InverseSinAngle;
+      w1 = std::sin(t * this->Angle) * this->InverseSinAngle;
+    }
+    Eigen::Quaterniond q;
+    q.coeffs() = w0 * this->Q0.coeffs() + w1 * this->Q1.coeffs();
+    if (this->IsLinear)
+    {
+      q.normalize();
+    }
+    return q;
+  }
+
+  //! Interpolate the translation at time t
+  Eigen::Vector3d InterpolateTranslation(double t) const
+  {
+    t = std::min(std::max(t, 0.0), 1.0);
+    return (1.0 - t) * this->T0 + t * this->T1;
+  }
+
+  //! Transform X by the transform interpolated at time t
+  Eigen::Vector3d TransformPoint(double t, const Eigen::Vector3d& X) const
+  {
+    return this->InterpolateRotation(t) * X + this->InterpolateTranslation(t);
+  }
+
+  /**
+   * @brief Transform the points [first, last) into out, each one by the transform
+   * interpolated at its time of acquisition relatively to the two poses, stored
+   * in its time as the slam does. out can be first.
+   */
+  template <typename InputIt, typename OutputIt>
+  void TransformPoints(InputIt first, InputIt last, OutputIt out) const
+  {
+    for (; first != last; ++first, ++out)
+    {
+      const Eigen::Vector3d X(first->x, first->y, first->z);
+      const Eigen::Vector3d Y = this->TransformPoint(first->time, X);
+      *out = *first;
+      out->x = Y(0);
+      out->y = Y(1);
+      out->z = Y(2);
+    }
+  }
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+  Eigen::Quaterniond Q0, Q1;
+  Eigen::Vector3d T0, T1;
+  double Angle;
+  double InverseSinAngle;
+  bool IsLinear;
+};
+
+#endif // LINEAR_TRANSFORM_INTERPOLATOR_H
@@ -0,0 +1,86 @@
+//=========================================================================
+//
+// Copyright 2018 Kitware, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//=========================================================================
+
+#ifndef NEIGHBORHOOD_PCA_H
+#define NEIGHBORHOOD_PCA_H
+
+// STD
+#include <cstddef>
+#include <vector>
+// EIGEN
+#include <Eigen/Dense>
+
+/**
+ * \class NeighborhoodPCA
+ * \brief Principal component analysis of a small set of 3D points, such as the
+ *        neighborhood of a keypoint, used to fit a line, a plane or an ellipsoid.
+ *
+ *        Only fixed-size matrices are used, and the 3x3 covariance is diagonalized
+ *        in closed form, so that no memory is allocated for each neighborhood.
+ */
+class NeighborhoodPCA
+{
+public:
+  //! Compute the mean and the covariance of the first n points
+  void ComputeMeanAndCovariance(const std::vector<Eigen::Vector3d>& points, size_t n)
+  {
+    this->Mean = Eigen::Vector3d::Zero();
+    for (size_t k = 0; k < n; ++k)
+    {
+      this->Mean += points[k];
+    }
+    this->Mean /= static_cast<double>(n);
+
+    // centered before the accumulation, the points of
+    // the map being far from the origin of the world
+    this->Covariance = Eigen::Matrix3d::Zero();
+    for (size_t k = 0; k < n; ++k)
+    {
+      const Eigen::Vector3d centered = points[k] - this->Mean;
+      this->Covariance += centered * centered.transpose();
+    }
+  }
+
+  //! Compute the mean, the covariance and its eigen decomposition of the first n points
+  void Compute(const std::vector<Eigen::Vector3d>& points, size_t n)
+  {
+    this->ComputeMeanAndCovariance(points, n);
+    this->Solver.computeDirect(this->Covariance);
+  }
+
+  //! Compute the mean, the covariance and its eigen decomposition of all the points
+  void Compute(const std::vector<Eigen::Vector3d>& points) { this->Compute(points, points.size()); }
+
+  //! Eigen values of the covariance, in increasing order
+  const Eigen::Vector3d& GetEigenValues() const { return this->Solver.eigenvalues(); }
+
+  //! Eigen vectors of the covariance, in the columns, in the order of the eigen values
+  const Eigen::Matrix3d& GetEigenVectors() const { return this->Solver.eigenvectors(); }
+
+  //! Mean of the points
+  Eigen::Vector3d Mean;
+
+  //! Sum of the outer products of the centered points
+  Eigen::Matrix3d Covariance;
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+  Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> Solver;
+};
+
+#endif // NEIGHBORHOOD_PCA_H
@@ -0,0 +1,265 @@
+//=========================================================================
+//
+// Copyright 2018 Kitware, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//=========================================================================
+
+#ifndef POSE_SOLVER_H
+#define POSE_SOLVER_H
+
+// LOCAL
+#include "CeresCostFunctions.h"
+#include "ThreadPool.h"
+// STD
+#include <algorithm>
+#include <cmath>
+#include <vector>
+// EIGEN
+#include <Eigen/Dense>
+#include <Eigen/StdVector>
+
+/**
+ * \class PoseSolver
+ * \brief Robust Levenberg-Marquardt solver of a least square problem whose
+ *        only parameter block is the 6-DoF pose w = (rx, ry, rz, tx, ty, tz).
+ *
+ *        It minimizes 1/2 * sum(rho(r_k^2)) with rho the arctangent loss of
+ *        ceres::ArctanLoss, and r_k the residuals added, whose jacobians are
+ *        computed analytically (see CostFunctions::MahalanobisDistanceAnalyticResidual).
+ *        The 6x6 normal equations are accumulated directly instead of building a
+ *        ceres::Problem, by contiguous blocks of residuals summed in their order, so
+ *        that the result does not depend on the number of threads, the threads
+ *        being those of a pool so that they are not started at each evaluation
+ *        of the cost. A problem too small to amortize the synchronization of the
+ *        threads is evaluated by the calling thread only. The loss is
+ *        applied to the jacobians as ceres does for a loss whose second derivative
+ *        is negative, so that the normal matrix at the solution gives the covariance.
+ */
+template <typename Residual>
+class PoseSolver
+{
+public:
+  typedef Eigen::Matrix<double, 6, 1> Vector6d;
+  typedef Eigen::Matrix<double, 6, 6> Matrix6d;
+
+  //! Progress of a call to Solve
+  struct Summary
+  {
+    unsigned int Iterations = 0;       /*!< Number of steps tried */
+    unsigned int SuccessfulSteps = 0;  /*!< Number of steps that decreased the cost */
+    double InitialCost = 0;
+    double FinalCost = 0;
+  };
+
+  //! Remove all the residuals
+  void Clear() { this->Residuals.clear(); }
+
+  //! Add a residual to the cost
+  void AddResidual(const Residual& residual) { this->Residuals.push_back(residual); }
+
+  size_t GetNumberOfResiduals() const { return this->Residuals.size(); }
+
+  /**
+   * @brief Minimize the cost starting from w, with at most maxIterations steps
+   * and the threads of pool to evaluate the residuals.
+   * @return the summary of the minimization, w being set to the solution
+   */
+  Summary Solve(Vector6d& w, unsigned int maxIterations, ThreadPool& pool)
+  {
+    this->Pool = &pool;
+    Summary summary;
+    Vector6d gradient;
+    double cost = this->Linearize(w, this->NormalMatrix, gradient);
+    summary.InitialCost = cost;
+
+    // trust region as in ceres::LEVENBERG_MARQUARDT,
+    // with the same default convergence tolerances
+    double radius = 1e4;
+    double decreaseFactor = 2.0;
+    for (; summary.Iterations < maxIterations; ++summary.Iterations)
+    {
+      if (gradient.template lpNorm<Eigen::Infinity>() <= 1e-10)
+      {
+        break;
+      }
+
+      Matrix6d damped = this->NormalMatrix;
+      damped.diagonal() += this->NormalMatrix.diagonal().cwiseMax(1e-6).cwiseMin(1e32) / radius;
+      Vector6d step = -damped.ldlt().solve(gradient);
+      if (step.norm() <= 1e-8 * (w.norm() + 1e-8))
+      {
+        break;
+      }
+
+      // decrease of the cost predicted by the linearized model
+      double predictedDecrease = -(gradient.dot(step) + 0.5 * step.dot(this->NormalMatrix * step));
+      Vector6d candidate = w + step;
+      double candidateCost = this->ComputeCost(candidate);
+      double ratio = (cost - candidateCost) / predictedDecrease;
+      if (!(predictedDecrease > 0.0) || !(ratio > 1e-3))
+      {
+        radius /= decreaseFactor;
+        decreaseFactor *= 2.0;
+        continue;
+      }
+
+      w = candidate;
+      summary.SuccessfulSteps++;
+      bool hasConverged = std::abs(cost - candidateCost) <= 1e-6 * cost;
+      radius /= std::max(1.0 / 3.0, 1.0 - std::pow(2.0 * ratio - 1.0, 3));
+      decreaseFactor = 2.0;
+      cost = this->Linearize(w, this->NormalMatrix, gradient);
+      if (hasConverged)
+      {
+        summary.Iterations++;
+        break;
+      }
+    }
+    summary.FinalCost = cost;
+    return summary;
+  }
+
+  /**
+   * @brief Covariance of the parameters at the solution of the last call to Solve,
+   * the pseudo-inverse of the normal matrix, as ceres::Covariance computes it
+   * with the loss function applied
+   */
+  Matrix6d GetCovariance() const
+  {
+    Eigen::SelfAdjointEigenSolver<Matrix6d> eig(this->NormalMatrix);
+    const Vector6d& D = eig.eigenvalues();
+    Vector6d inverseD = Vector6d::Zero();
+    for (int k = 0; k < 6; ++k)
+    {
+      if (D(k) > 1e-14 * D(5))
+      {
+        inverseD(k) = 1.0 / D(k);
+      }
+    }
+    return eig.eigenvectors() * inverseD.asDiagonal() * eig.eigenvectors().transpose();
+  }
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+  //! Number of residuals accumulated together before being summed with the others
+  enum { BlockSize = 256 };
+
+  //! Minimum number of blocks evaluated by a thread, below which waking up a thread costs more than it saves
+  enum { MinimumBlocksPerThread = 4 };
+
+  //! Sums of a block of residuals
+  struct BlockSums
+  {
+    Matrix6d NormalMatrix;
+    Vector6d Gradient;
+    double Cost;
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  };
+
+  //-----------------------------------------------------------------------------
+  //! Arctangent loss rho(s) = a * atan(s / a) and its derivative, as ceres::ArctanLoss(2.0)
+  static double Loss(double s, double* derivative)
+  {
+    const double a = 2.0;
+    if (derivative)
+    {
+      *derivative = 1.0 / (1.0 + s * s / (a * a));
+    }
+    return a * std::atan2(s, a);
+  }
+
+  //-----------------------------------------------------------------------------
+  //! Accumulate the cost of a block of residuals, and its normal equations if withNormalEquations
+  void SumBlock(const CostFunctions::EulerAngleRotation& rotation, const Vector6d& w, size_t block,
+                BlockSums& sums, bool withNormalEquations) const
+  {
+    sums.Cost = 0;
+    if (withNormalEquations)
+    {
+      sums.NormalMatrix.setZero();
+      sums.Gradient.setZero();
+    }
+    const size_t end = std::min(this->Residuals.size(), (block + 1) * BlockSize);
+    Vector6d J;
+    for (size_t k = block * BlockSize; k < end; ++k)
+    {
+      double r = this->Residuals[k].Evaluate(rotation, w.data(), withNormalEquations ? J.data() : nullptr);
+      double weight;
+      sums.Cost += 0.5 * Loss(r * r, withNormalEquations ? &weight : nullptr);
+      if (withNormalEquations)
+      {
+        sums.NormalMatrix.template selfadjointView<Eigen::Lower>().rankUpdate(J, weight);
+        sums.Gradient += (weight * r) * J;
+      }
+    }
+  }
+
+  //-----------------------------------------------------------------------------
+  //! Sum the blocks of residuals in their order, the blocks being shared by the threads
+  double Sum(const Vector6d& w, Matrix6d* normalMatrix, Vector6d* gradient)
+  {
+    const CostFunctions::EulerAngleRotation rotation(w.data());
+    const bool withNormalEquations = (normalMatrix != nullptr);
+    const size_t nBlocks = (this->Residuals.size() + BlockSize - 1) / BlockSize;
+    this->Blocks.resize(nBlocks);
+    const size_t nThreads = std::max(static_cast<size_t>(1),
+      std::min(static_cast<size_t>(this->Pool->GetNumberOfThreads()), nBlocks / MinimumBlocksPerThread));
+    this->Pool->ParallelFor(nThreads, [&](size_t thread) {
+      for (size_t block = nBlocks * thread / nThreads; block < nBlocks * (thread + 1) / nThreads; ++block)
+      {
+        this->SumBlock(rotation, w, block, this->Blocks[block], withNormalEquations);
+      }
+    });
+
+    double cost = 0;
+    if (withNormalEquations)
+    {
+      normalMatrix->setZero();
+      gradient->setZero();
+    }
+    for (size_t block = 0; block < nBlocks; ++block)
+    {
+      cost += this->Blocks[block].Cost;
+      if (withNormalEquations)
+      {
+        *normalMatrix += this->Blocks[block].NormalMatrix;
+        *gradient += this->Blocks[block].Gradient;
+      }
+    }
+    if (withNormalEquations)
+    {
+      *normalMatrix = normalMatrix->template selfadjointView<Eigen::Lower>();
+    }
+    return cost;
+  }
+
+  //-----------------------------------------------------------------------------
+  double Linearize(const Vector6d& w, Matrix6d& normalMatrix, Vector6d& gradient)
+  {
+    return this->Sum(w, &normalMatrix, &gradient);
+  }
+
+  //-----------------------------------------------------------------------------
+  double ComputeCost(const Vector6d& w) { return this->Sum(w, nullptr, nullptr); }
+
+  std::vector<Residual> Residuals;
+  std::vector<BlockSums, Eigen::aligned_allocator<BlockSums> > Blocks;
+  ThreadPool* Pool = nullptr; /*!< threads of the current call to Solve */
+
+  //! Loss weighted J' * J at the last parameters linearized
+  Matrix6d NormalMatrix = Matrix6d::Zero();
+};
+
+#endif // POSE_SOLVER_H
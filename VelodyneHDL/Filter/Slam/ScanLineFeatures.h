@@ -0,0 +1,84 @@
+//=========================================================================
+//
+// Copyright 2018 Kitware, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//=========================================================================
+
+#ifndef SCAN_LINE_FEATURES_H
+#define SCAN_LINE_FEATURES_H
+
+// STD
+#include <vector>
+
+/**
+ * \class ScanLineFeatures
+ * \brief Features of the points of a frame used to pick its keypoints, with
+ *        one contiguous array per feature instead of one vector per scan line.
+ *
+ *        The points of a scan line follow each other in the arrays, from the
+ *        offset of the line, so that the lines can be processed by different
+ *        threads without sharing anything but the arrays. The arrays keep their
+ *        capacity from one frame to the next one.
+ */
+class ScanLineFeatures
+{
+public:
+  //! Allocate the features of scan lines of the given numbers of points, set to their initial value
+  void Reset(const std::vector<size_t>& lineSizes)
+  {
+    this->Offsets.resize(lineSizes.size() + 1);
+    this->Offsets[0] = 0;
+    for (size_t line = 0; line < lineSizes.size(); ++line)
+    {
+      this->Offsets[line + 1] = this->Offsets[line] + lineSizes[line];
+    }
+    const size_t nPoints = this->Offsets.back();
+    this->Angles.assign(nPoints, 0.0);
+    this->LengthResolution.assign(nPoints, 0.0);
+    this->SaillantPoint.assign(nPoints, 0.0);
+    this->DepthGap.assign(nPoints, 0.0);
+    this->IntensityGap.assign(nPoints, 0.0);
+    this->BlobScore.assign(nPoints, 0.0);
+    this->IsPointValid.assign(nPoints, 1);
+    this->Label.assign(nPoints, 0);
+  }
+
+  size_t GetNumberOfLines() const { return this->Offsets.empty() ? 0 : this->Offsets.size() - 1; }
+  size_t GetNumberOfPoints() const { return this->Offsets.empty() ? 0 : this->Offsets.back(); }
+  size_t GetLineSize(unsigned int line) const { return this->Offsets[line + 1] - this->Offsets[line]; }
+
+  //! Position in the arrays of the point index of the scan line
+  size_t GetIndex(unsigned int line, unsigned int index) const { return this->Offsets[line] + index; }
+
+  //! Values of a feature for the points of a scan line
+  template <typename T>
+  T* GetLine(std::vector<T>& feature, unsigned int line) const { return feature.data() + this->Offsets[line]; }
+  template <typename T>
+  const T* GetLine(const std::vector<T>& feature, unsigned int line) const { return feature.data() + this->Offsets[line]; }
+
+  std::vector<double> Angles;           /*!< sine of the angle between the lines fitting each side of the point */
+  std::vector<double> LengthResolution;
+  std::vector<double> SaillantPoint;    /*!< distance to the line fitting the neighbors beyond a depth gap */
+  std::vector<double> DepthGap;
+  std::vector<double> IntensityGap;
+  std::vector<double> BlobScore;
+  std::vector<int> IsPointValid;        /*!< can the point still be picked as an edge keypoint */
+  std::vector<int> Label;               /*!< 4 for an edge keypoint, 2 for a planar one, 0 otherwise */
+
+private:
+  //! Offsets of the scan lines in the arrays, followed by the number of points
+  std::vector<size_t> Offsets;
+};
+
+#endif // SCAN_LINE_FEATURES_H
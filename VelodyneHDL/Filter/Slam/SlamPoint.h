@@ -0,0 +1,71 @@
+//=========================================================================
+//
+// Copyright 2018 Kitware, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//=========================================================================
+
+#ifndef SLAM_POINT_H
+#define SLAM_POINT_H
+
+// PCL
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+/**
+ * \struct SlamPoint
+ * \brief Point of a frame, a keypoint or a map of the slam, with only the
+ *        fields the slam uses: 24 bytes instead of the 48 bytes of a padded
+ *        pcl::PointXYZINormal, so that twice as many points fit in the cache
+ *        during the neighbors searches.
+ *
+ *        The laser id and the reflectivity are floats as the centroids of the
+ *        map average them, as all the other fields.
+ */
+struct SlamPoint
+{
+  float x = 0;
+  float y = 0;
+  float z = 0;
+  float time = 0;         /*!< time of acquisition relatively to the frame, in [0, 1] */
+  float laser_id = 0;     /*!< id of the laser, sorted by vertical angle */
+  float reflectivity = 0;
+};
+
+//-----------------------------------------------------------------------------
+/**
+ * @brief Convert points of the slam to pcl points, e.g. to use vtkPCLConversions,
+ * the time, the laser id and the reflectivity going to intensity, normal_y and
+ * normal_z as the slam stored them before
+ */
+inline pcl::PointCloud<pcl::PointXYZINormal>::Ptr ToPCLPointCloud(const pcl::PointCloud<SlamPoint>& cloud)
+{
+  pcl::PointCloud<pcl::PointXYZINormal>::Ptr pclCloud(new pcl::PointCloud<pcl::PointXYZINormal>);
+  pclCloud->header = cloud.header;
+  pclCloud->is_dense = cloud.is_dense;
+  pclCloud->resize(cloud.size());
+  for (size_t i = 0; i < cloud.size(); ++i)
+  {
+    const SlamPoint& p = cloud.points[i];
+    pcl::PointXYZINormal& q = pclCloud->points[i];
+    q.x = p.x;
+    q.y = p.y;
+    q.z = p.z;
+    q.intensity = p.time;
+    q.normal_y = p.laser_id;
+    q.normal_z = p.reflectivity;
+  }
+  return pclCloud;
+}
+
+#endif // SLAM_POINT_H
@@ -0,0 +1,178 @@
+//=========================================================================
+//
+// Copyright 2018 Kitware, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//=========================================================================
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+// STD
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+// BOOST
+#include <boost/thread.hpp>
+
+/**
+ * \class ThreadPool
+ * \brief Worker threads started once and shared by the parallel loops, instead
+ *        of starting threads at each loop.
+ *
+ *        ParallelFor calls a task for each index, the calling thread taking part,
+ *        and returns once all are done. Several threads can call it at the same
+ *        time, the workers taking the tasks of the loops in the order they were
+ *        started, so that the number of threads running is the number of workers
+ *        plus the number of calling threads. The tasks must not throw.
+ */
+class ThreadPool
+{
+public:
+  //! Start nWorkers worker threads, the loops being run by the calling thread only if 0
+  explicit ThreadPool(unsigned int nWorkers = 0) { this->SetNumberOfWorkers(nWorkers); }
+
+  ~ThreadPool() { this->SetNumberOfWorkers(0); }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  //! Stop the workers and start nWorkers new ones, no loop must be running
+  void SetNumberOfWorkers(unsigned int nWorkers)
+  {
+    if (nWorkers == this->Workers.size())
+    {
+      return;
+    }
+    {
+      boost::unique_lock<boost::mutex> lock(this->Mutex);
+      this->Stopped = true;
+    }
+    this->WorkAvailable.notify_all();
+    for (auto& worker : this->Workers)
+    {
+      worker->join();
+    }
+    this->Workers.clear();
+    this->Stopped = false;
+    for (unsigned int k = 0; k < nWorkers; ++k)
+    {
+      this->Workers.emplace_back(new boost::thread(&ThreadPool::RunWorker, this));
+    }
+  }
+
+  unsigned int GetNumberOfWorkers() const { return static_cast<unsigned int>(this->Workers.size()); }
+
+  //! Number of threads a loop can use, the workers and the calling thread
+  unsigned int GetNumberOfThreads() const { return this->GetNumberOfWorkers() + 1; }
+
+  //! Call task(k) for k in [0, nTasks) and wait for all the calls to return
+  void ParallelFor(size_t nTasks, const std::function<void(size_t)>& task)
+  {
+    if (nTasks == 0)
+    {
+      return;
+    }
+    if (nTasks == 1 || this->Workers.empty())
+    {
+      for (size_t k = 0; k < nTasks; ++k)
+      {
+        task(k);
+      }
+      return;
+    }
+
+    Loop loop(task, nTasks);
+    boost::unique_lock<boost::mutex> lock(this->Mutex);
+    this->Loops.push_back(&loop);
+    this->WorkAvailable.notify_all();
+    size_t k;
+    while (this->TakeTask(loop, k))
+    {
+      lock.unlock();
+      task(k);
+      lock.lock();
+      loop.NumberOfTasksDone++;
+    }
+    while (loop.NumberOfTasksDone < loop.NumberOfTasks)
+    {
+      this->LoopDone.wait(lock);
+    }
+  }
+
+private:
+  //! A call to ParallelFor, whose tasks are taken by the threads in the index order
+  struct Loop
+  {
+    Loop(const std::function<void(size_t)>& task, size_t nTasks) : Task(task), NumberOfTasks(nTasks) {}
+    const std::function<void(size_t)>& Task;
+    const size_t NumberOfTasks;
+    size_t NextTask = 0;
+    size_t NumberOfTasksDone = 0;
+  };
+
+  //-----------------------------------------------------------------------------
+  //! Take the next task of a loop, the mutex being locked
+  bool TakeTask(Loop& loop, size_t& k)
+  {
+    if (loop.NextTask == loop.NumberOfTasks)
+    {
+      return false;
+    }
+    k = loop.NextTask++;
+    if (loop.NextTask == loop.NumberOfTasks)
+    {
+      // the last task is taken, no other thread needs to see the loop
+      this->Loops.erase(std::find(this->Loops.begin(), this->Loops.end(), &loop));
+    }
+    return true;
+  }
+
+  //-----------------------------------------------------------------------------
+  void RunWorker()
+  {
+    boost::unique_lock<boost::mutex> lock(this->Mutex);
+    while (true)
+    {
+      while (this->Loops.empty() && !this->Stopped)
+      {
+        this->WorkAvailable.wait(lock);
+      }
+      if (this->Stopped)
+      {
+        return;
+      }
+      Loop& loop = *this->Loops.front();
+      size_t k;
+      this->TakeTask(loop, k);
+      lock.unlock();
+      loop.Task(k);
+      lock.lock();
+      if (++loop.NumberOfTasksDone == loop.NumberOfTasks)
+      {
+        this->LoopDone.notify_all();
+      }
+    }
+  }
+
+  std::vector<std::unique_ptr<boost::thread> > Workers;
+  std::deque<Loop*> Loops; /*!< loops with tasks not taken yet, the oldest first */
+  bool Stopped = false;
+  boost::mutex Mutex;
+  boost::condition_variable WorkAvailable;
+  boost::condition_variable LoopDone;
+};
+
+#endif // THREAD_POOL_H
@@ -70,15 +70,18 @@
 
 // LOCAL
 #include "vtkSlam.h"
-#include "vtkVelodyneTransformInterpolator.h"
 #include "vtkPCLConversions.h"
 #include "CeresCostFunctions.h"
+#include "NeighborhoodPCA.h"
 // STD
 #include <sstream>
 #include <algorithm>
 #include <cmath>
 #include <cfloat>
+#include <array>
 #include <ctime>
+#include <cstdint>
+#include <unordered_map>
 // VTK
 #include <vtkCellArray.h>
 #include <vtkCellData.h>
@@ -107,7 +110,8 @@
 #include <Eigen/Dense>
 // PCL
 #include <pcl/point_types.h>
-#include <pcl/filters/voxel_grid.h>
+// BOOST
+#include <boost/thread.hpp>
 // CERES
 #include <ceres/ceres.h>
 #include <glog/logging.h>
@@ -148,31 +152,14 @@ bool LineFitting::FitPCA(std::vector<Eigen::Vector3d >& points)
 {
   // Compute PCA to determine best line approximation
   // of the points distribution
-  Eigen::MatrixXd data(points.size(), 3);
-
-  for (unsigned int k = 0; k < points.size(); k++)
-  {
-    data.row(k) = points[k];
-  }
-
-  Eigen::Vector3d mean = data.colwise().mean();
-  Eigen::MatrixXd centered = data.rowwise() - mean.transpose();
-  Eigen::MatrixXd cov = centered.transpose() * centered;
-  Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eig(cov);
-
-  // Eigen values
-  Eigen::MatrixXd D(1,3);
-  // Eigen vectors
-  Eigen::MatrixXd V(3,3);
-
-  D = eig.eigenvalues();
-  V = eig.eigenvectors();
+  NeighborhoodPCA pca;
+  pca.Compute(points);
 
   // Direction
-  this->Direction = V.col(2).normalized();
+  this->Direction = pca.GetEigenVectors().col(2).normalized();
 
   // Position
-  this->Position = mean;
+  this->Position = pca.Mean;
 
   // Semi distance matrix
   // (polar form associated to
@@ -270,10 +257,10 @@ vtkSmartPointer<T> CreateDataArray(const char* name, vtkIdType np, vtkPolyData*
 
 //-----------------------------------------------------------------------------
 template <typename T>
-std::vector<size_t> sortIdx(const std::vector<T> &v)
+std::vector<size_t> sortIdx(const T* v, size_t n)
 {
   // initialize original index locations
-  std::vector<size_t> idx(v.size());
+  std::vector<size_t> idx(n);
   std::iota(idx.begin(), idx.end(), 0);
 
   // sort indexes based on comparing values in v
@@ -284,7 +271,31 @@ std::vector<size_t> sortIdx(const std::vector<T> &v)
 }
 
 //-----------------------------------------------------------------------------
-std::clock_t startTime;
+// one timer per thread, the front-end and the
+// back-end running concurrently in pipelined mode
+thread_local std::clock_t startTime;
+
+//-----------------------------------------------------------------------------
+// Report of the stage of a frame processed by the thread. In pipelined mode
+// the front-end and the back-end process different frames concurrently, so
+// each report is printed at once when its stage is over
+thread_local std::ostringstream report;
+
+//-----------------------------------------------------------------------------
+std::ostream& Report()
+{
+  return report;
+}
+
+//-----------------------------------------------------------------------------
+void PrintReport()
+{
+  static boost::mutex coutMutex;
+  boost::lock_guard<boost::mutex> lock(coutMutex);
+  std::cout << report.str() << std::flush;
+  report.str("");
+  report.clear();
+}
 
 //-----------------------------------------------------------------------------
 void InitTime()
@@ -297,7 +308,7 @@ void StopTimeAndDisplay(std::string functionName)
 {
   std::clock_t endTime = std::clock();
   double dt = static_cast<double>(endTime - startTime) / CLOCKS_PER_SEC;
-  std::cout << "  -time elapsed in function <" << functionName << "> : " << dt << " sec" << std::endl;
+  Report() << "  -time elapsed in function <" << functionName << "> : " << dt << " sec" << std::endl;
 }
 
 //-----------------------------------------------------------------------------
@@ -313,7 +324,16 @@ double Rad2Deg(double val)
 // optimization algorithm. Morevover, when a a region of the space is too far from
 // the current sensor position it is possible to remove the points stored in this region
 // and to move the voxel grid in a closest region of the sensor position. This is used
-// to decrease the memory used by the algorithm
+// to decrease the memory used by the algorithm.
+// The points of the grid are stored in a kd-tree which is updated as the grid is
+// rolled and as points are added, the voxels only store the ids of their points.
+// Only the voxels containing points are stored, in a hash map indexed by their
+// position in the world, so that rolling the grid only moves its position
+// and drops the voxels left outside.
+// The points added are downsampled as with pcl::VoxelGrid: a voxel is split in
+// leaves of LeafSize, and each leaf keeps the centroid of all its points. The
+// leaves accumulate the sum of their points, so that adding a point only updates
+// the centroid of its leaf.
 class RollingGrid {
 public:
   RollingGrid() {}
@@ -329,178 +349,116 @@ public:
   // roll the grid to enable adding new point cloud
   void Roll(Eigen::Matrix<double, 6, 1> &T)
   {
-    // Very basic implementation where the grid is not circular
+    const int previousPosition[3] = { this->VoxelGridPosition[0],
+                                      this->VoxelGridPosition[1],
+                                      this->VoxelGridPosition[2] };
 
-    // compute the position of the new frame center in the grid
-    int frameCenterX = std::floor(T[3] / this->VoxelSize) - this->VoxelGridPosition[0];
-    int frameCenterY = std::floor(T[4] / this->VoxelSize) - this->VoxelGridPosition[1];
-    int frameCenterZ = std::floor(T[5] / this->VoxelSize) - this->VoxelGridPosition[2];
-
-    // shift the voxel grid to the left
-    while (frameCenterX - std::ceil(this->PointCloudSize / 2) <= 0)
+    // shift the voxel grid so that the new frame center is
+    // at least at half a pointcloud size of its borders
+    for (int axis = 0; axis < 3; axis++)
     {
-      for (int j = 0; j < this->VoxelSize; j++)
-      {
-        for (int k = 0; k < this->VoxelSize; k++)
-        {
-          for (int i = this->VoxelSize - 1; i > 0; i--)
-          {
-            this->grid[i][j][k] = this->grid[i-1][j][k];
-          }
-          this->grid[0][j][k].reset(new pcl::PointCloud<Point>());
-        }
-      }
-      frameCenterX++;
-      this->VoxelGridPosition[0]--;
-    }
+      // compute the position of the new frame center in the grid
+      int frameCenter = std::floor(T[3 + axis] / this->VoxelSize) - this->VoxelGridPosition[axis];
 
-    // shift the voxel grid to the right
-    while (frameCenterX + std::ceil(this->PointCloudSize / 2) >= this->VoxelSize - 1)
-    {
-      for (int j = 0; j < this->VoxelSize; j++)
+      // shift the voxel grid to the left / bottom / "camera"
+      while (frameCenter - std::ceil(this->PointCloudSize / 2) <= 0)
       {
-        for (int k = 0; k < this->VoxelSize; k++)
-        {
-          for (int i = 0; i < this->VoxelSize - 1; i++)
-          {
-            this->grid[i][j][k] = this->grid[i+1][j][k];
-          }
-          this->grid[VoxelSize-1][j][k].reset(new pcl::PointCloud<Point>());
-        }
+        frameCenter++;
+        this->VoxelGridPosition[axis]--;
       }
-      frameCenterX--;
-      this->VoxelGridPosition[0]++;
-    }
 
-    // shift the voxel grid to the bottom
-    while (frameCenterY - std::ceil(this->PointCloudSize / 2) <= 0)
-    {
-      for (int i = 0; i < this->VoxelSize; i++)
+      // shift the voxel grid to the right / top / "horizon"
+      while (frameCenter + std::ceil(this->PointCloudSize / 2) >= this->VoxelSize - 1)
       {
-        for (int k = 0; k < this->VoxelSize; k++)
-        {
-          for (int j = this->VoxelSize - 1; j > 0; j--)
-          {
-            this->grid[i][j][k] = this->grid[i][j-1][k];
-          }
-          this->grid[i][0][k].reset(new pcl::PointCloud<Point>());
-        }
+        frameCenter--;
+        this->VoxelGridPosition[axis]++;
       }
-      frameCenterY++;
-      this->VoxelGridPosition[1]--;
-//      cout << "bottom";
     }
 
-    // shift the voxel grid to the top
-    while (frameCenterY + std::ceil(this->PointCloudSize / 2) >= this->VoxelSize - 1)
+    // remove the voxels which are not in the grid anymore
+    if (this->VoxelGridPosition[0] == previousPosition[0] &&
+        this->VoxelGridPosition[1] == previousPosition[1] &&
+        this->VoxelGridPosition[2] == previousPosition[2])
     {
-      for (int i = 0; i < this->VoxelSize; i++)
-      {
-        for (int k = 0; k < this->VoxelSize; k++)
-        {
-          for (int j = 0; j < this->VoxelSize - 1; j++)
-          {
-            this->grid[i][j][k] = this->grid[i][j+1][k];
-          }
-          this->grid[i][VoxelSize-1][k].reset(new pcl::PointCloud<Point>());
-        }
-      }
-      frameCenterY--;
-      this->VoxelGridPosition[1]++;
+      return;
     }
-
-    // shift the voxel grid to the "camera"
-    while (frameCenterZ - std::ceil(this->PointCloudSize / 2) <= 0)
+    for (VoxelMap::iterator it = this->Voxels.begin(); it != this->Voxels.end();)
     {
-      for (int i = 0; i < this->VoxelSize; i++)
+      if (this->IsInGrid(GetVoxelCoordinates(it->first)))
       {
-        for (int j = 0; j < this->VoxelSize; j++)
-        {
-          for (int k = this->VoxelSize - 1; k > 0; k--)
-          {
-            this->grid[i][j][k] = this->grid[i][j][k-1];
-          }
-          this->grid[i][j][0].reset(new pcl::PointCloud<Point>());
-        }
+        ++it;
+        continue;
       }
-      frameCenterZ++;
-      this->VoxelGridPosition[2]--;
-    }
-
-    // shift the voxel grid to the "horizon"
-    while (frameCenterZ + std::ceil(this->PointCloudSize  / 2) >= this->VoxelSize - 1)
-    {
-      for (int i = 0; i < this->VoxelSize; i++)
+      for (Voxel::const_iterator leaf = it->second.begin(); leaf != it->second.end(); ++leaf)
       {
-        for (int j = 0; j < this->VoxelSize; j++)
-        {
-          for (int k = 0; k < this->VoxelSize - 1; k++)
-          {
-            this->grid[i][j][k] = this->grid[i][j][k+1];
-          }
-          this->grid[i][j][VoxelSize-1].reset(new pcl::PointCloud<Point>());
-        }
+        this->Index.Remove(leaf->second.Id);
       }
-      frameCenterZ--;
-      this->VoxelGridPosition[2]++;
+      it = this->Voxels.erase(it);
     }
   }
 
-  // get points arround T
-  pcl::PointCloud<Point>::Ptr Get(Eigen::Matrix<double, 6, 1> &T)
+  // get all points
+  pcl::PointCloud<Point>::Ptr Get()
   {
-    // compute the position of the new frame center in the grid
-    int frameCenterX = std::floor(T[3] / this->VoxelSize) - this->VoxelGridPosition[0];
-    int frameCenterY = std::floor(T[4] / this->VoxelSize) - this->VoxelGridPosition[1];
-    int frameCenterZ = std::floor(T[5] / this->VoxelSize) - this->VoxelGridPosition[2];
-
     pcl::PointCloud<Point>::Ptr intersection(new pcl::PointCloud<Point>);
+    intersection->reserve(this->Index.GetNumberOfPoints());
 
-    // Get all voxel in intersection should use ceil here
-    for (int i = frameCenterX - std::ceil(this->PointCloudSize / 2); i <= frameCenterX + std::ceil(this->PointCloudSize / 2); i++)
+    for (VoxelMap::const_iterator it = this->Voxels.begin(); it != this->Voxels.end(); ++it)
     {
-      for (int j = frameCenterY - std::ceil(this->PointCloudSize / 2); j <= frameCenterY + std::ceil(this->PointCloudSize / 2); j++)
+      for (Voxel::const_iterator leaf = it->second.begin(); leaf != it->second.end(); ++leaf)
       {
-        for (int k = frameCenterZ - std::ceil(this->PointCloudSize / 2); k <= frameCenterZ + std::ceil(this->PointCloudSize / 2); k++)
-        {
-          if (i < 0 || i > (this->VoxelSize - 1) ||
-              j < 0 || j > (this->VoxelSize - 1) ||
-              k < 0 || k > (this->VoxelSize - 1))
-          {
-            continue;
-          }
-          pcl::PointCloud<Point>:: Ptr voxel = this->grid[i][j][k];
-          for (unsigned int l = 0; l < voxel->size(); l++)
-          {
-            intersection->push_back(voxel->at(l));
-          }
-        }
+        intersection->push_back(this->Index.GetPoint(leaf->second.Id));
       }
     }
     return intersection;
   }
 
-  // get all points
-  pcl::PointCloud<Point>::Ptr Get()
+  // kd-tree of all the points of the grid. Since the grid is
+  // rolled to stay around the sensor, it contains the neighborhood
+  // of the current frame
+  const KDTree& GetIndex() const { return this->Index; }
+
+  // mark in searched the ids in the index of the points of the voxels at most
+  // half a pointcloud size away from the voxel of the frame center, the ids
+  // of the other points are 0 or beyond its size. Return the number of points marked
+  size_t GetWindow(const Eigen::Matrix<double, 6, 1>& T, std::vector<char>& searched) const
   {
-    pcl::PointCloud<Point>::Ptr intersection(new pcl::PointCloud<Point>);
+    int windowMin[3], windowMax[3];
+    for (int axis = 0; axis < 3; axis++)
+    {
+      // compute the position of the frame center in the grid
+      const int frameCenter = std::floor(T[3 + axis] / this->VoxelSize) - this->VoxelGridPosition[axis];
+      windowMin[axis] = frameCenter - std::ceil(this->PointCloudSize / 2);
+      windowMax[axis] = frameCenter + std::ceil(this->PointCloudSize / 2);
+    }
 
-    // Get all voxel in intersection should use ceil here
-    for (int i = 0; i < VoxelSize; i++)
+    searched.clear();
+    size_t nPoints = 0;
+    for (VoxelMap::const_iterator it = this->Voxels.begin(); it != this->Voxels.end(); ++it)
     {
-      for (int j = 0; j < VoxelSize; j++)
+      const std::array<int, 3> voxel = GetVoxelCoordinates(it->first);
+      bool isInWindow = true;
+      for (int axis = 0; axis < 3; axis++)
+      {
+        const int index = voxel[axis] - this->VoxelGridPosition[axis];
+        isInWindow = isInWindow && index >= windowMin[axis] && index <= windowMax[axis];
+      }
+      if (!isInWindow)
       {
-        for (int k = 0; k < VoxelSize; k++)
+        continue;
+      }
+      for (Voxel::const_iterator leaf = it->second.begin(); leaf != it->second.end(); ++leaf)
+      {
+        const size_t id = static_cast<size_t>(leaf->second.Id);
+        if (id >= searched.size())
         {
-          pcl::PointCloud<Point>:: Ptr voxel = this->grid[i][j][k];
-          for (unsigned int l = 0; l < voxel->size(); l++)
-          {
-            intersection->push_back(voxel->at(l));
-          }
+          searched.resize(id + 1, 0);
         }
+        searched[id] = 1;
+        nPoints++;
       }
     }
-    return intersection;
+    return nPoints;
   }
 
   // add some points to the grid
@@ -512,54 +470,85 @@ public:
       return;
     }
 
-    // Voxel to filte because new points were add
-    std::vector<std::vector<std::vector<int> > > voxelToFilter(VoxelSize, std::vector<std::vector<int> >(VoxelSize, std::vector<int>(VoxelSize, 0)));
-
     // Add points in the rolling grid
+    std::vector<Leaf*> modifiedLeaves;
     int outlier = 0; // point who are not in the rolling grid
     for (unsigned int i = 0; i < pointcloud->size(); i++)
     {
-      Point pts = pointcloud->points[i];
+      const Point& pts = pointcloud->points[i];
       // find the closest coordinate
-      int cubeIdxX = std::floor(pts.x / this->VoxelSize) - this->VoxelGridPosition[0];
-      int cubeIdxY = std::floor(pts.y / this->VoxelSize) - this->VoxelGridPosition[1];
-      int cubeIdxZ = std::floor(pts.z / this->VoxelSize) - this->VoxelGridPosition[2];
-
-
-      if (cubeIdxX >= 0 && cubeIdxX < this->VoxelSize &&
-        cubeIdxY >= 0 && cubeIdxY < this->VoxelSize &&
-        cubeIdxZ >= 0 && cubeIdxZ < this->VoxelSize)
+      const int cubeIdx[3] = { static_cast<int>(std::floor(pts.x / this->VoxelSize)),
+                               static_cast<int>(std::floor(pts.y / this->VoxelSize)),
+                               static_cast<int>(std::floor(pts.z / this->VoxelSize)) };
+      if (!this->IsInGrid(cubeIdx))
       {
-        voxelToFilter[cubeIdxX][cubeIdxY][cubeIdxZ] = 1;
-        grid[cubeIdxX][cubeIdxY][cubeIdxZ]->push_back(pts);
+        outlier++;
+        continue;
       }
-      else
+
+      // same leaves as pcl::VoxelGrid, aligned on multiples of LeafSize
+      const int leafIdx[3] = { static_cast<int>(std::floor(pts.x * this->InverseLeafSize)),
+                               static_cast<int>(std::floor(pts.y * this->InverseLeafSize)),
+                               static_cast<int>(std::floor(pts.z * this->InverseLeafSize)) };
+      Leaf& leaf = this->Voxels[GetKey(cubeIdx)][GetKey(leafIdx)];
+      leaf.Sum[0] += pts.x;
+      leaf.Sum[1] += pts.y;
+      leaf.Sum[2] += pts.z;
+      leaf.Sum[3] += pts.time;
+      leaf.Sum[4] += pts.laser_id;
+      leaf.Sum[5] += pts.reflectivity;
+      leaf.Count++;
+      if (!leaf.IsModified)
       {
-        outlier++;
+        leaf.IsModified = true;
+        modifiedLeaves.push_back(&leaf);
       }
     }
 
-    // Filter the modified pointCloud
-    pcl::VoxelGrid<Point> downSizeFilter;
-    downSizeFilter.setLeafSize(this->LeafSize, this->LeafSize, this->LeafSize);
-    for (int i = 0; i < this->VoxelSize; i++)
+    // Replace the centroids of the modified leaves in the kd-tree
+    pcl::PointCloud<Point> centroids;
+    centroids.reserve(modifiedLeaves.size());
+    for (unsigned int i = 0; i < modifiedLeaves.size(); i++)
     {
-      for (int j = 0; j < this->VoxelSize; j++)
+      Leaf& leaf = *modifiedLeaves[i];
+      if (leaf.Id >= 0)
       {
-        for (int k = 0; k < this->VoxelSize; k++)
-        {
-          if (voxelToFilter[i][j][k] == 1)
-          {
-            pcl::PointCloud<Point>::Ptr tmp(new pcl::PointCloud<Point>());
-            downSizeFilter.setInputCloud(grid[i][j][k]);
-            downSizeFilter.filter(*tmp);
-            grid[i][j][k] = tmp;
-          }
-        }
+        this->Index.Remove(leaf.Id);
       }
+      Point centroid;
+      centroid.x = leaf.Sum[0] / leaf.Count;
+      centroid.y = leaf.Sum[1] / leaf.Count;
+      centroid.z = leaf.Sum[2] / leaf.Count;
+      centroid.time = leaf.Sum[3] / leaf.Count;
+      centroid.laser_id = leaf.Sum[4] / leaf.Count;
+      centroid.reflectivity = leaf.Sum[5] / leaf.Count;
+      centroids.push_back(centroid);
+      leaf.IsModified = false;
+    }
+
+    std::vector<int> ids;
+    this->Index.Add(centroids.begin(), centroids.end(), &ids);
+    for (unsigned int i = 0; i < ids.size(); i++)
+    {
+      modifiedLeaves[i]->Id = ids[i];
     }
   }
 
+  // Memory used by the voxels and the kd-tree, in bytes
+  size_t GetMemoryUsage() const
+  {
+    size_t memory = sizeof(RollingGrid) - sizeof(KDTree) + this->Index.GetMemoryUsage();
+    // a node of a hash map holds the next node, the hash and the value
+    const size_t nodeSize = sizeof(void*) + sizeof(size_t);
+    memory += this->Voxels.bucket_count() * sizeof(void*) +
+      this->Voxels.size() * (sizeof(VoxelMap::value_type) + nodeSize);
+    for (VoxelMap::const_iterator it = this->Voxels.begin(); it != this->Voxels.end(); ++it)
+    {
+      memory += it->second.bucket_count() * sizeof(void*) +
+        it->second.size() * (sizeof(Voxel::value_type) + nodeSize);
+    }
+    return memory;
+  }
 
   void SetPointCoudMaxRange(const double maxdist)
   {
@@ -569,26 +558,82 @@ public:
   void SetSize(int size)
   {
     this->VoxelSize = size;
-    grid.resize(this->VoxelSize);
-    for (int i = 0; i < this->VoxelSize; i++)
+    this->Voxels.clear();
+    this->Index.Clear();
+  }
+
+  void SetResolution(double resolution) { this->VoxelResolution = resolution; }
+
+  void SetLeafSize(double size)
+  {
+    if (size == this->LeafSize)
     {
-      grid[i].resize(this->VoxelSize);
-      for (int j = 0; j < this->VoxelSize; j++)
+      return;
+    }
+    // the centroids of the previous leaves are
+    // downsampled again as points of the new ones
+    pcl::PointCloud<Point>::Ptr points = this->Get();
+    this->Voxels.clear();
+    this->Index.Clear();
+    this->LeafSize = size;
+    this->InverseLeafSize = 1.0f / static_cast<float>(size);
+    if (points->size() > 0)
+    {
+      this->Add(points);
+    }
+  }
+
+private:
+  // Position of a voxel or a leaf in the world, in number of voxels or leaves,
+  // packed in 21 bits per coordinate. The leaves of a voxel are less than 2^21
+  // leaves apart, so that their keys are unique among the leaves of the voxel
+  typedef uint64_t Key;
+
+  // Accumulator of the points of a leaf
+  struct Leaf
+  {
+    // Sum of x, y, z, time, laser_id and reflectivity
+    double Sum[6] = {0, 0, 0, 0, 0, 0};
+    int Count = 0;
+    // Id of the centroid of the leaf in Index
+    int Id = -1;
+    bool IsModified = false;
+  };
+  typedef std::unordered_map<Key, Leaf> Voxel;
+  typedef std::unordered_map<Key, Voxel> VoxelMap;
+
+  static Key GetKey(const int position[3])
+  {
+    const Key mask = (1 << 21) - 1;
+    return ((static_cast<Key>(position[0] + (1 << 20)) & mask) << 42) |
+           ((static_cast<Key>(position[1] + (1 << 20)) & mask) << 21) |
+            (static_cast<Key>(position[2] + (1 << 20)) & mask);
+  }
+
+  static std::array<int, 3> GetVoxelCoordinates(Key key)
+  {
+    const Key mask = (1 << 21) - 1;
+    std::array<int, 3> voxel = { { static_cast<int>((key >> 42) & mask) - (1 << 20),
+                                   static_cast<int>((key >> 21) & mask) - (1 << 20),
+                                   static_cast<int>(key & mask) - (1 << 20) } };
+    return voxel;
+  }
+
+  bool IsInGrid(const int voxel[3]) const
+  {
+    for (int axis = 0; axis < 3; axis++)
+    {
+      const int index = voxel[axis] - this->VoxelGridPosition[axis];
+      if (index < 0 || index >= this->VoxelSize)
       {
-        grid[i][j].resize(this->VoxelSize);
-        for (int k = 0; k < this->VoxelSize; k++)
-        {
-          grid[i][j][k].reset(new pcl::PointCloud<Point>());
-        }
+        return false;
       }
     }
+    return true;
   }
 
-  void SetResolution(double resolution) { this->VoxelResolution = resolution; }
-
-  void SetLeafSize(double size) { this->LeafSize = size; }
+  bool IsInGrid(const std::array<int, 3>& voxel) const { return this->IsInGrid(voxel.data()); }
 
-private:
   //! Size of the voxel grid: n*n*n voxels
   int VoxelSize = 50;
 
@@ -600,9 +645,13 @@ private:
 
   //! Size of the leaf use to downsample the pointcloud
   double LeafSize = 0.2;
+  float InverseLeafSize = 1.0f / 0.2f;
+
+  //! Non empty leaves of the non empty voxels of the grid
+  VoxelMap Voxels;
 
-  //! VoxelGrid of pointcloud
-  std::vector<std::vector<std::vector<pcl::PointCloud<Point>::Ptr> > > grid;
+  //! Points of the grid
+  KDTree Index;
 
   // Position of the VoxelGrid
   int VoxelGridPosition[3] = {0,0,0};
@@ -611,6 +660,14 @@ private:
 //-----------------------------------------------------------------------------
 int vtkSlam::RequestData(vtkInformation *vtkNotUsed(request),
 vtkInformationVector **inputVector, vtkInformationVector *outputVector)
+{
+  this->AddInputFrame(inputVector);
+  this->FillOutputs(outputVector);
+  return 1;
+}
+
+//-----------------------------------------------------------------------------
+void vtkSlam::AddInputFrame(vtkInformationVector **inputVector)
 {
   if (this->LaserIdMapping.empty())
   {
@@ -622,6 +679,14 @@ vtkInformationVector **inputVector, vtkInformationVector *outputVector)
   vtkPolyData *input = vtkPolyData::GetData(inputVector[0]->GetInformationObject(0));
 
   this->AddFrame(input);
+}
+
+//-----------------------------------------------------------------------------
+void vtkSlam::FillOutputs(vtkInformationVector *outputVector)
+{
+  // Wait for the pose of the frames added to be estimated
+  this->Flush();
+
   // output 0 - Current Frame
   vtkInformation *outInfo0 = outputVector->GetInformationObject(0);
   vtkPolyData *output0 = vtkPolyData::SafeDownCast(
@@ -632,14 +697,14 @@ vtkInformationVector **inputVector, vtkInformationVector *outputVector)
     this->DisplayLaserIdMapping(this->vtkCurrentFrame);
     this->DisplayRelAdv(this->vtkCurrentFrame);
     this->DisplayUsedKeypoints(this->vtkCurrentFrame);
-    AddVectorToPolydataPoints<double, vtkDoubleArray>(this->Angles, "angles_line", this->vtkCurrentFrame);
-    AddVectorToPolydataPoints<double, vtkDoubleArray>(this->LengthResolution, "length_resolution", this->vtkCurrentFrame);
-    AddVectorToPolydataPoints<double, vtkDoubleArray>(this->SaillantPoint, "saillant_point", this->vtkCurrentFrame);
-    AddVectorToPolydataPoints<double, vtkDoubleArray>(this->DepthGap, "depth_gap", this->vtkCurrentFrame);
-    AddVectorToPolydataPoints<double, vtkDoubleArray>(this->IntensityGap, "intensity_gap", this->vtkCurrentFrame);
-    AddVectorToPolydataPoints<double, vtkDoubleArray>(this->BlobScore, "blob_score", this->vtkCurrentFrame);
-    AddVectorToPolydataPoints<int, vtkIntArray>(this->IsPointValid, "is_point_valid", this->vtkCurrentFrame);
-    AddVectorToPolydataPoints<int, vtkIntArray>(this->Label, "keypoint_label", this->vtkCurrentFrame);
+    AddVectorToPolydataPoints<double, vtkDoubleArray>(this->Features.Angles, "angles_line", this->vtkCurrentFrame);
+    AddVectorToPolydataPoints<double, vtkDoubleArray>(this->Features.LengthResolution, "length_resolution", this->vtkCurrentFrame);
+    AddVectorToPolydataPoints<double, vtkDoubleArray>(this->Features.SaillantPoint, "saillant_point", this->vtkCurrentFrame);
+    AddVectorToPolydataPoints<double, vtkDoubleArray>(this->Features.DepthGap, "depth_gap", this->vtkCurrentFrame);
+    AddVectorToPolydataPoints<double, vtkDoubleArray>(this->Features.IntensityGap, "intensity_gap", this->vtkCurrentFrame);
+    AddVectorToPolydataPoints<double, vtkDoubleArray>(this->Features.BlobScore, "blob_score", this->vtkCurrentFrame);
+    AddVectorToPolydataPoints<int, vtkIntArray>(this->Features.IsPointValid, "is_point_valid", this->vtkCurrentFrame);
+    AddVectorToPolydataPoints<int, vtkIntArray>(this->Features.Label, "keypoint_label", this->vtkCurrentFrame);
   }
   // get transform
   vtkSmartPointer<vtkTransform> transform = vtkSmartPointer<vtkTransform>::New();
@@ -660,20 +725,18 @@ vtkInformationVector **inputVector, vtkInformationVector *outputVector)
 
   // output 2 - Edges Points Map
   auto *output2 = vtkPolyData::GetData(outputVector->GetInformationObject(2));
-  auto EdgeMap = vtkPCLConversions::PolyDataFromPointCloud(this->EdgesPointsLocalMap->Get());
+  auto EdgeMap = vtkPCLConversions::PolyDataFromPointCloud(ToPCLPointCloud(*this->EdgesPointsLocalMap->Get()));
   output2->ShallowCopy(EdgeMap);
 
   // output 3 - Planar Points Map
   auto *output3 = vtkPolyData::GetData(outputVector->GetInformationObject(3));
-  auto PlanarMap = vtkPCLConversions::PolyDataFromPointCloud(this->PlanarPointsLocalMap->Get());
+  auto PlanarMap = vtkPCLConversions::PolyDataFromPointCloud(ToPCLPointCloud(*this->PlanarPointsLocalMap->Get()));
   output3->ShallowCopy(PlanarMap);
 
   // output 4 - Blob Points Map
   auto *output4 = vtkPolyData::GetData(outputVector->GetInformationObject(4));
-  auto BlobMap = vtkPCLConversions::PolyDataFromPointCloud(this->BlobsPointsLocalMap->Get());
+  auto BlobMap = vtkPCLConversions::PolyDataFromPointCloud(ToPCLPointCloud(*this->BlobsPointsLocalMap->Get()));
   output4->ShallowCopy(BlobMap);
-
-  return 1;
 }
 
 //-----------------------------------------------------------------------------
@@ -702,6 +765,9 @@ void vtkSlam::PrintSelf(ostream& os, vtkIndent indent)
   PrintParameter(EgoMotionMinimumLineNeighborRejection)
   PrintParameter(MappingMinimumLineNeighborRejection)
   PrintParameter(MappingLineMaxDistInlier)
+  PrintParameter(NumberOfThreads)
+  PrintParameter(BuiltInSolver)
+  PrintParameter(Pipelined)
 }
 
 //-----------------------------------------------------------------------------
@@ -709,12 +775,16 @@ vtkSlam::vtkSlam()
 {
   this->SetNumberOfInputPorts(2);
   this->SetNumberOfOutputPorts(5);
+  this->ResizeThreadPool();
   this->Reset();
 }
 
 //-----------------------------------------------------------------------------
 void vtkSlam::Reset()
 {
+  // Let the back-end finish with the frames it was given
+  this->Flush();
+
   this->EdgesPointsLocalMap = std::make_shared<RollingGrid>();
   this->PlanarPointsLocalMap = std::make_shared<RollingGrid>();
   this->BlobsPointsLocalMap = std::make_shared<RollingGrid>();
@@ -745,12 +815,17 @@ void vtkSlam::Reset()
   CreateDataArray<vtkIntArray>("EgoMotion: edges used", 0, this->Trajectory);
   CreateDataArray<vtkIntArray>("EgoMotion: planes used", 0, this->Trajectory);
   CreateDataArray<vtkIntArray>("EgoMotion: total keypoints used", 0, this->Trajectory);
+  CreateDataArray<vtkDoubleArray>("Map memory usage (MB)", 0, this->Trajectory);
 }
 
 //-----------------------------------------------------------------------------
 vtkSlam::~vtkSlam()
 {
-
+  this->KeypointsQueue.Close();
+  if (this->BackEndThread.joinable())
+  {
+    this->BackEndThread.join();
+  }
 }
 
 //-----------------------------------------------------------------------------
@@ -772,6 +847,8 @@ int vtkSlam::FillInputPortInformation(int port, vtkInformation *info)
 //-----------------------------------------------------------------------------
 void vtkSlam::GetWorldTransform(double* Tworld)
 {
+  this->Flush();
+
   // Rotation and translation relative
   Eigen::Matrix3d Rw;
 
@@ -804,36 +881,23 @@ void vtkSlam::PrepareDataForNextFrame()
     this->pclCurrentFrameByScan[k].reset(new pcl::PointCloud<Point>());
   }
 
-  this->CurrentEdgesPoints.reset(new pcl::PointCloud<Point>());
-  this->CurrentPlanarsPoints.reset(new pcl::PointCloud<Point>());
-  this->CurrentBlobsPoints.reset(new pcl::PointCloud<Point>());
+  // The keypoints extracted previously are kept
+  // by the back-end until it has registered them
+  this->ExtractedKeypoints.Edges.reset(new pcl::PointCloud<Point>());
+  this->ExtractedKeypoints.Planars.reset(new pcl::PointCloud<Point>());
+  this->ExtractedKeypoints.Blobs.reset(new pcl::PointCloud<Point>());
+  this->ExtractedKeypoints.Frame = this->pclCurrentFrame;
 
   // reset vtk <-> pcl id mapping
   this->FromVTKtoPCLMapping.clear();
   this->FromVTKtoPCLMapping.resize(0);
   this->FromPCLtoVTKMapping.clear();
   this->FromPCLtoVTKMapping.resize(this->NLasers);
-  this->Angles.clear();
-  this->Angles.resize(this->NLasers);
-  this->LengthResolution.clear();
-  this->LengthResolution.resize(this->NLasers);
-  this->SaillantPoint.clear();
-  this->SaillantPoint.resize(this->NLasers);
-  this->DepthGap.clear();
-  this->DepthGap.resize(this->NLasers);
-  this->IntensityGap.clear();
-  this->IntensityGap.resize(this->NLasers);
-  this->BlobScore.clear();
-  this->BlobScore.resize(this->NLasers);
-  this->IsPointValid.clear();
-  this->IsPointValid.resize(this->NLasers);
-  this->Label.clear();
-  this->Label.resize(this->NLasers);
 }
 
 //-----------------------------------------------------------------------------
 template <typename T, typename Tvtk>
-void vtkSlam::AddVectorToPolydataPoints(const std::vector<std::vector<T>>& vec, const char* name, vtkPolyData* pd)
+void vtkSlam::AddVectorToPolydataPoints(const std::vector<T>& feature, const char* name, vtkPolyData* pd)
 {
   vtkSmartPointer<Tvtk> array = vtkSmartPointer<Tvtk>::New();
   array->Allocate(pd->GetNumberOfPoints());
@@ -842,7 +906,7 @@ void vtkSlam::AddVectorToPolydataPoints(const std::vector<std::vector<T>>& vec,
   {
     unsigned int scan = this->FromVTKtoPCLMapping[k].first;
     unsigned int index = this->FromVTKtoPCLMapping[k].second;
-    array->InsertNextTuple1(vec[scan][index]);
+    array->InsertNextTuple1(feature[this->Features.GetIndex(scan, index)]);
   }
   pd->GetPointData()->AddArray(array);
 }
@@ -873,7 +937,7 @@ void vtkSlam::DisplayRelAdv(vtkSmartPointer<vtkPolyData> input)
   {
     unsigned int scan = this->FromVTKtoPCLMapping[k].first;
     unsigned int index = this->FromVTKtoPCLMapping[k].second;
-    relAdvArray->InsertNextTuple1(this->pclCurrentFrameByScan[scan]->points[index].intensity);
+    relAdvArray->InsertNextTuple1(this->pclCurrentFrameByScan[scan]->points[index].time);
   }
   input->GetPointData()->AddArray(relAdvArray);
 }
@@ -939,6 +1003,13 @@ void vtkSlam::AddFrame(vtkPolyData* newFrame)
     vtkGenericWarningMacro("Slam entry is a null pointer data");
     return;
   }
+
+  // The front-end members can not be reused while the
+  // back-end processes the frames in sequential mode
+  if (!this->Pipelined)
+  {
+    this->Flush();
+  }
   this->vtkCurrentFrame = newFrame;
 
   // Check if the number of lasers has been set
@@ -947,30 +1018,91 @@ void vtkSlam::AddFrame(vtkPolyData* newFrame)
     vtkGenericWarningMacro("Frame added without specifying the number of lasers");
   }
 
-  std::cout << "#########################################################" << std::endl
-            << "Processing frame : " << this->NbrFrameProcessed << std:: endl
-            << "#########################################################" << std::endl
-            << std::endl;
-
   // Reset the members variables used during the last
   // processed frame so that they can be used again
   PrepareDataForNextFrame();
 
   // Update the kalman filter time
-  double time = newFrame->GetPointData()->GetArray("adjustedtime")->GetTuple1(0) * 1e-6;
+  this->ExtractedKeypoints.Time = newFrame->GetPointData()->GetArray("adjustedtime")->GetTuple1(0) * 1e-6;
+  Report() << "Keypoints of the frame at time " << std::fixed << this->ExtractedKeypoints.Time
+           << std::defaultfloat << " s" << std::endl;
+
+  // Convert the new frame into pcl format and sort
+  // the laser scan-lines by vertical angle
+  InitTime();
+  this->ConvertAndSortScanLines(newFrame);
+  StopTimeAndDisplay("Sorting lines");
+
+  // Compute the edges and planars keypoints
+  InitTime();
+  this->ComputeKeyPoints();
+  StopTimeAndDisplay("Keypoints extraction");
+  PrintReport();
+
+  // Estimate the pose of the frame, or let the back-end
+  // thread do it while the next frame is processed
+  if (this->Pipelined)
+  {
+    if (!this->BackEndThread.joinable())
+    {
+      this->BackEndThread = boost::thread(&vtkSlam::RunBackEnd, this);
+    }
+    this->KeypointsQueue.Push(this->ExtractedKeypoints);
+  }
+  else
+  {
+    this->RegisterKeypoints(this->ExtractedKeypoints);
+    PrintReport();
+  }
+
+  // Indicate the filter has been modify
+  this->Modified();
+}
+
+//-----------------------------------------------------------------------------
+void vtkSlam::Flush()
+{
+  this->KeypointsQueue.Join();
+}
+
+//-----------------------------------------------------------------------------
+void vtkSlam::RunBackEnd()
+{
+  FrameKeypoints keypoints;
+  while (this->KeypointsQueue.Pop(keypoints))
+  {
+    this->RegisterKeypoints(keypoints);
+    PrintReport();
+    this->KeypointsQueue.TaskDone();
+  }
+}
+
+//-----------------------------------------------------------------------------
+void vtkSlam::RegisterKeypoints(const FrameKeypoints& keypoints)
+{
+  Report() << "#########################################################" << std::endl
+            << "Processing frame : " << this->NbrFrameProcessed << " at time "
+            << std::fixed << keypoints.Time << std::defaultfloat << " s" << std::endl
+            << "#########################################################" << std::endl
+            << std::endl;
+
+  this->CurrentEdgesPoints = keypoints.Edges;
+  this->CurrentPlanarsPoints = keypoints.Planars;
+  this->CurrentBlobsPoints = keypoints.Blobs;
+  this->pclRegisteredFrame = keypoints.Frame;
+  this->FarestKeypointDist = keypoints.FarestKeypointDist;
+
+  // Initialize the IsKeypointUsed vectors
+  this->EdgePointRejectionEgoMotion.clear(); this->EdgePointRejectionEgoMotion.resize(this->CurrentEdgesPoints->size());
+  this->PlanarPointRejectionEgoMotion.clear(); this->PlanarPointRejectionEgoMotion.resize(this->CurrentPlanarsPoints->size());
+  this->EdgePointRejectionMapping.clear(); this->EdgePointRejectionMapping.resize(this->CurrentEdgesPoints->size());
+  this->PlanarPointRejectionMapping.clear(); this->PlanarPointRejectionMapping.resize(this->CurrentPlanarsPoints->size());
 
   // If the new frame is the first one we just add the
   // extracted keypoints into the map without running
   // odometry and mapping steps
   if (this->NbrFrameProcessed == 0)
   {
-    // Convert the new frame into pcl format and sort
-    // the laser scan-lines by vertical angle
-    this->ConvertAndSortScanLines(newFrame);
-
-    // Compute the edges and planars keypoints
-    this->ComputeKeyPoints(newFrame);
-
     // update map using tworld
     this->UpdateMapsUsingTworld();
 
@@ -982,17 +1114,6 @@ void vtkSlam::AddFrame(vtkPolyData* newFrame)
     return;
   }
 
-  // Convert the new frame into pcl format and sort
-  // the laser scan-lines by vertical angle
-  InitTime();
-  this->ConvertAndSortScanLines(vtkCurrentFrame);
-  StopTimeAndDisplay("Sorting lines");
-
-  // Compute the edges and planars keypoints
-  InitTime();
-  this->ComputeKeyPoints(vtkCurrentFrame);
-  StopTimeAndDisplay("Keypoints extraction");
-
   // Perfom EgoMotion
   InitTime();
   this->ComputeEgoMotion();
@@ -1019,10 +1140,10 @@ void vtkSlam::AddFrame(vtkPolyData* newFrame)
   Eigen::Vector3d angles, trans;
   angles << Rad2Deg(this->Trelative(0)), Rad2Deg(this->Trelative(1)), Rad2Deg(this->Trelative(2));
   trans << this->Trelative(3), this->Trelative(4), this->Trelative(5);
-  std::cout << "Ego-Motion estimation: angles = [" << angles.transpose() << "] translation: [" << trans.transpose() << "]" << std::endl;
+  Report() << "Ego-Motion estimation: angles = [" << angles.transpose() << "] translation: [" << trans.transpose() << "]" << std::endl;
   angles << Rad2Deg(this->Tworld(0)), Rad2Deg(this->Tworld(1)), Rad2Deg(this->Tworld(2));
   trans << this->Tworld(3), this->Tworld(4), this->Tworld(5);
-  std::cout << "Localiazion estimation: angles = [" << angles.transpose() << "] translation: [" << trans.transpose() << "]"
+  Report() << "Localiazion estimation: angles = [" << angles.transpose() << "] translation: [" << trans.transpose() << "]"
             << std::endl << std::endl << std::endl;
 
   // Update Trajectory
@@ -1030,11 +1151,8 @@ void vtkSlam::AddFrame(vtkPolyData* newFrame)
       Eigen::AngleAxisd(this->Tworld[0], Eigen::Vector3d::UnitX())
       * Eigen::AngleAxisd(this->Tworld[1],  Eigen::Vector3d::UnitY())
       * Eigen::AngleAxisd(this->Tworld[2], Eigen::Vector3d::UnitZ()));
-  this->Trajectory->PushBack(time, orientation, Tworld.tail(3));
-
-  // Indicate the filter has been modify
-  this->Modified();
-  return;
+  this->Trajectory->PushBack(keypoints.Time, orientation, Tworld.tail(3));
+  static_cast<vtkDoubleArray*>(this->Trajectory->GetPointData()->GetArray("Map memory usage (MB)"))->InsertNextValue(this->GetMapMemoryUsage() / 1e6);
 }
 
 //-----------------------------------------------------------------------------
@@ -1065,9 +1183,9 @@ void vtkSlam::ConvertAndSortScanLines(vtkSmartPointer<vtkPolyData> input)
     unsigned int id = static_cast<int>(lasersId->GetTuple1(index));
     double reflec = static_cast<double>(reflectivity->GetTuple1(index));
     id = this->LaserIdMapping[id];
-    yL.intensity = relAdv;
-    yL.normal_y = id;
-    yL.normal_z = reflec;
+    yL.time = relAdv;
+    yL.laser_id = id;
+    yL.reflectivity = reflec;
 
     // add the current point to its corresponding laser scan
     this->pclCurrentFrame->push_back(yL);
@@ -1078,192 +1196,254 @@ void vtkSlam::ConvertAndSortScanLines(vtkSmartPointer<vtkPolyData> input)
 }
 
 //-----------------------------------------------------------------------------
-void vtkSlam::ComputeKeyPoints(vtkSmartPointer<vtkPolyData> input)
+void vtkSlam::ComputeKeyPoints()
 {
-  // Initialize the vectors with the correct length
+  // Initialize the features with the correct length,
+  // the points of each scan line being contiguous
+  std::vector<size_t> lineSizes(this->NLasers);
   for (unsigned int k = 0; k < this->NLasers; ++k)
   {
-    this->IsPointValid[k].resize(this->pclCurrentFrameByScan[k]->size(), 1);
-    this->Label[k].resize(this->pclCurrentFrameByScan[k]->size(), 0);
-    this->Angles[k].resize(this->pclCurrentFrameByScan[k]->size(),0);
-    this->LengthResolution[k].resize(this->pclCurrentFrameByScan[k]->size(),0);
-    this->SaillantPoint[k].resize(this->pclCurrentFrameByScan[k]->size(),0);
-    this->DepthGap[k].resize(this->pclCurrentFrameByScan[k]->size(), 0);
-    this->IntensityGap[k].resize(this->pclCurrentFrameByScan[k]->size(), 0);
-    this->BlobScore[k].resize(this->pclCurrentFrameByScan[k]->size(), 0);
+    lineSizes[k] = this->pclCurrentFrameByScan[k]->size();
   }
+  this->Features.Reset(lineSizes);
+  this->KeypointsByScan.resize(this->NLasers);
+
+  // The scan lines are independent. Each thread of the pool
+  // takes the next scan line to process until all are done,
+  // their number of points being uneven
+  this->Pool.ParallelFor(this->NLasers, [this](size_t scanLine) {
+    // compute keypoints scores
+    this->ComputeCurvature(scanLine);
 
-  // compute keypoints scores
-  this->ComputeCurvature(input);
+    // Invalid points with bad criteria
+    this->InvalidPointWithBadCriteria(scanLine);
 
-  // Invalid points with bad criteria
-  this->InvalidPointWithBadCriteria();
+    // labelize keypoints
+    this->SetKeyPointsLabels(scanLine);
+  });
 
-  // labelize keypoints
-  this->SetKeyPointsLabels(input);
+  // add keypoints in increasing scan id order
+  this->EdgesIndex.clear();
+  this->PlanarIndex.clear();
+  this->BlobIndex.clear();
+  for (unsigned int scanLine = 0; scanLine < this->NLasers; ++scanLine)
+  {
+    const ScanLineKeypoints& picked = this->KeypointsByScan[scanLine];
+    for (int index : picked.Edges)
+    {
+      this->EdgesIndex.push_back(std::pair<int, int>(scanLine, index));
+    }
+    for (int index : picked.Planars)
+    {
+      this->PlanarIndex.push_back(std::pair<int, int>(scanLine, index));
+    }
+    for (int index : picked.Blobs)
+    {
+      this->BlobIndex.push_back(std::pair<int, int>(scanLine, index));
+    }
+  }
+  std::sort(this->EdgesIndex.begin(), this->EdgesIndex.end());
+  std::sort(this->PlanarIndex.begin(), this->PlanarIndex.end());
+  std::sort(this->BlobIndex.begin(), this->BlobIndex.end());
+
+  // fill the keypoints vectors and compute the max dist keypoints
+  FrameKeypoints& keypoints = this->ExtractedKeypoints;
+  keypoints.FarestKeypointDist = 0.0;
+  Point p;
+  for (unsigned int k = 0; k < this->EdgesIndex.size(); ++k)
+  {
+    p = this->pclCurrentFrameByScan[this->EdgesIndex[k].first]->points[this->EdgesIndex[k].second];
+    keypoints.Edges->push_back(p);
+    keypoints.FarestKeypointDist = std::max(keypoints.FarestKeypointDist, static_cast<double>(std::sqrt(std::pow(p.x, 2) + std::pow(p.y, 2) + std::pow(p.z, 2))));
+  }
+  for (unsigned int k = 0; k < this->PlanarIndex.size(); ++k)
+  {
+    p = this->pclCurrentFrameByScan[this->PlanarIndex[k].first]->points[this->PlanarIndex[k].second];
+    keypoints.Planars->push_back(p);
+    keypoints.FarestKeypointDist = std::max(keypoints.FarestKeypointDist, static_cast<double>(std::sqrt(std::pow(p.x, 2) + std::pow(p.y, 2) + std::pow(p.z, 2))));
+  }
+  for (unsigned int k = 0; k < this->BlobIndex.size();  ++k)
+  {
+    p = this->pclCurrentFrameByScan[this->BlobIndex[k].first]->points[this->BlobIndex[k].second];
+    keypoints.Blobs->push_back(p);
+    keypoints.FarestKeypointDist = std::max(keypoints.FarestKeypointDist, static_cast<double>(std::sqrt(std::pow(p.x, 2) + std::pow(p.y, 2) + std::pow(p.z, 2))));
+  }
+
+  // keypoints extraction informations
+  Report() << "Extracted Edges: " << keypoints.Edges->size() << " Planars: "
+            << keypoints.Planars->size() << " Blobs: "
+            << keypoints.Blobs->size() << std::endl;
 }
 
 //-----------------------------------------------------------------------------
-void vtkSlam::ComputeCurvature(vtkSmartPointer<vtkPolyData> vtkNotUsed(input))
+void vtkSlam::ComputeCurvature(unsigned int scanLine)
 {
   Point currentPoint, nextPoint, previousPoint;
   Eigen::Vector3d X, centralPoint;
   LineFitting leftLine, rightLine, farNeighborsLine;
 
-  // loop over scans lines
-  for (unsigned int scanLine = 0; scanLine < this->NLasers; ++scanLine)
+  const pcl::PointCloud<Point>& scan = *this->pclCurrentFrameByScan[scanLine];
+  double* angles = this->Features.GetLine(this->Features.Angles, scanLine);
+  double* saillantPoint = this->Features.GetLine(this->Features.SaillantPoint, scanLine);
+  double* depthGap = this->Features.GetLine(this->Features.DepthGap, scanLine);
+  double* intensityGap = this->Features.GetLine(this->Features.IntensityGap, scanLine);
+  double* blobScore = this->Features.GetLine(this->Features.BlobScore, scanLine);
+
+  // loop over points in the current scan line
+  int Npts = scan.size();
+
+  // if the line is almost empty, skip it
+  if (Npts < 2 * this->NeighborWidth + 1)
   {
-    // loop over points in the current scan line
-    int Npts = this->pclCurrentFrameByScan[scanLine]->size();
+    return;
+  }
 
-    // if the line is almost empty, skip it
-    if (Npts < 2 * this->NeighborWidth + 1)
+  // We will compute the line that fit the neighbors located
+  // previously the current. We will do the same for the
+  // neighbors located after the current points. We will then
+  // compute the angle between these two lines as an approximation
+  // of the "sharpness" of the current point. The neighborhoods
+  // are cleared for each point without being reallocated
+  std::vector<Eigen::Vector3d > leftNeighbor;
+  std::vector<Eigen::Vector3d > rightNeighbor;
+  std::vector<Eigen::Vector3d > farNeighbors;
+
+  for (int index = this->NeighborWidth; (index + this->NeighborWidth) < Npts; ++index)
+  {
+    // central point
+    currentPoint = scan.points[index];
+    centralPoint << currentPoint.x, currentPoint.y, currentPoint.z;
+
+    // compute intensity gap
+    nextPoint = scan.points[index + 1];
+    previousPoint = scan.points[index - 1];
+    intensityGap[index] = std::abs(nextPoint.reflectivity - previousPoint.reflectivity);
+    leftNeighbor.clear();
+    rightNeighbor.clear();
+    farNeighbors.clear();
+
+    // Fill right and left neighborhood
+    // /!\ The way the neighbors are added
+    // to the vectors matters. Especially when
+    // computing the saillancy
+    for (int j = index - this->NeighborWidth; j <= index + this->NeighborWidth; ++j)
     {
-      continue;
+      currentPoint = scan.points[j];
+      X << currentPoint.x, currentPoint.y, currentPoint.z;
+      if (j < index)
+        leftNeighbor.push_back(X);
+      if (j > index)
+        rightNeighbor.push_back(X);
     }
 
-    for (int index = this->NeighborWidth; (index + this->NeighborWidth) < Npts; ++index)
-    {
-      // central point
-      currentPoint = this->pclCurrentFrameByScan[scanLine]->points[index];
-      centralPoint << currentPoint.x, currentPoint.y, currentPoint.z;
-
-      // compute intensity gap
-      nextPoint = this->pclCurrentFrameByScan[scanLine]->points[index + 1];
-      previousPoint = this->pclCurrentFrameByScan[scanLine]->points[index - 1];
-      this->IntensityGap[scanLine][index] = std::abs(nextPoint.normal_z - previousPoint.normal_z);
-      // We will compute the line that fit the neighbors located
-      // previously the current. We will do the same for the
-      // neighbors located after the current points. We will then
-      // compute the angle between these two lines as an approximation
-      // of the "sharpness" of the current point.
-      std::vector<Eigen::Vector3d > leftNeighbor;
-      std::vector<Eigen::Vector3d > rightNeighbor;
-      std::vector<Eigen::Vector3d > farNeighbors;
-
-      // Fill right and left neighborhood
-      // /!\ The way the neighbors are added
-      // to the vectors matters. Especially when
-      // computing the saillancy
-      for (int j = index - this->NeighborWidth; j <= index + this->NeighborWidth; ++j)
-      {
-        currentPoint = this->pclCurrentFrameByScan[scanLine]->points[j];
-        X << currentPoint.x, currentPoint.y, currentPoint.z;
-        if (j < index)
-          leftNeighbor.push_back(X);
-        if (j > index)
-          rightNeighbor.push_back(X);
-      }
-
-      // Fit line on the neighborhood and
-      // Indicate if the left and right side
-      // neighborhood of the current point is flat or not
-      bool leftFlat = leftLine.FitPCAAndCheckConsistency(leftNeighbor);
-      bool rightFlat = rightLine.FitPCAAndCheckConsistency(rightNeighbor);
+    // Fit line on the neighborhood and
+    // Indicate if the left and right side
+    // neighborhood of the current point is flat or not
+    bool leftFlat = leftLine.FitPCAAndCheckConsistency(leftNeighbor);
+    bool rightFlat = rightLine.FitPCAAndCheckConsistency(rightNeighbor);
 
-      // Measurement of the gap
-      double dist1 = 0; double dist2 = 0;
+    // Measurement of the gap
+    double dist1 = 0; double dist2 = 0;
 
-      // if both neighborhood are flat we can compute
-      // the angle between them as an approximation of the
-      // sharpness of the current point
-      if (rightFlat && leftFlat)
+    // if both neighborhood are flat we can compute
+    // the angle between them as an approximation of the
+    // sharpness of the current point
+    if (rightFlat && leftFlat)
+    {
+      // We check that the current point is not too far from its
+      // neighborhood lines. This is because we don't want a point
+      // to be considered as a angles point if it is due to gap
+      dist1 = std::sqrt((centralPoint - leftLine.Position).transpose() * leftLine.SemiDist * (centralPoint - leftLine.Position));
+      dist2 = std::sqrt((centralPoint - rightLine.Position).transpose() * rightLine.SemiDist * (centralPoint - rightLine.Position));
+
+      if ((dist1 < this->DistToLineThreshold) && (dist2 < this->DistToLineThreshold))
+        angles[index] = std::abs((leftLine.Direction.cross(rightLine.Direction)).norm()); // sin of angle actually
+    }
+    // Here one side of the neighborhood is non flat
+    // Hence it is not worth to estimate the sharpness.
+    // Only the gap will be considered here.
+    else if (rightFlat && !leftFlat)
+    {
+      dist1 = 1000.0;
+      for (unsigned int neighIndex = 0; neighIndex < leftNeighbor.size(); ++neighIndex)
       {
-        // We check that the current point is not too far from its
-        // neighborhood lines. This is because we don't want a point
-        // to be considered as a angles point if it is due to gap
-        dist1 = std::sqrt((centralPoint - leftLine.Position).transpose() * leftLine.SemiDist * (centralPoint - leftLine.Position));
-        dist2 = std::sqrt((centralPoint - rightLine.Position).transpose() * rightLine.SemiDist * (centralPoint - rightLine.Position));
-
-        if ((dist1 < this->DistToLineThreshold) && (dist2 < this->DistToLineThreshold))
-          this->Angles[scanLine][index] = std::abs((leftLine.Direction.cross(rightLine.Direction)).norm()); // sin of angle actually
+        dist1 = std::min(dist1,
+                std::sqrt((leftNeighbor[neighIndex] - rightLine.Position).transpose() * rightLine.SemiDist * (leftNeighbor[neighIndex] - rightLine.Position)));
       }
-      // Here one side of the neighborhood is non flat
-      // Hence it is not worth to estimate the sharpness.
-      // Only the gap will be considered here.
-      else if (rightFlat && !leftFlat)
+      dist1 = 0.5 * dist1;
+    }
+    else if (!rightFlat && leftFlat)
+    {
+      dist2 = 1000.0;
+      for (unsigned int neighIndex = 0; neighIndex < leftNeighbor.size(); ++neighIndex)
       {
-        dist1 = 1000.0;
-        for (unsigned int neighIndex = 0; neighIndex < leftNeighbor.size(); ++neighIndex)
-        {
-          dist1 = std::min(dist1,
-                  std::sqrt((leftNeighbor[neighIndex] - rightLine.Position).transpose() * rightLine.SemiDist * (leftNeighbor[neighIndex] - rightLine.Position)));
-        }
-        dist1 = 0.5 * dist1;
+        dist2 = std::min(dist2,
+                std::sqrt((rightNeighbor[neighIndex] - leftLine.Position).transpose() * leftLine.SemiDist * (rightNeighbor[neighIndex] - leftLine.Position)));
       }
-      else if (!rightFlat && leftFlat)
+      dist2 = 0.5 * dist2;
+    }
+    else
+    {
+      // Compute saillant point score
+      double currDepth = centralPoint.norm();
+      unsigned int diffDepth = 0;
+      bool canLeftBeAdded = true; bool hasLeftEncounteredDepthGap = false;
+      bool canRightBeAdded = true; bool hasRightEncounteredDepthGap = false;
+
+      // The saillant point score is the distance between the current point
+      // and the points that have a depth gap with the current point
+      for (unsigned int neighIndex = 0; neighIndex < leftNeighbor.size(); ++neighIndex)
       {
-        dist2 = 1000.0;
-        for (unsigned int neighIndex = 0; neighIndex < leftNeighbor.size(); ++neighIndex)
+        // Left neighborhood depth gap computation
+        if ((std::abs(leftNeighbor[leftNeighbor.size() - 1 - neighIndex].norm() - currDepth) > 1.5) && canLeftBeAdded)
         {
-          dist2 = std::min(dist2,
-                  std::sqrt((rightNeighbor[neighIndex] - leftLine.Position).transpose() * leftLine.SemiDist * (rightNeighbor[neighIndex] - leftLine.Position)));
+          hasLeftEncounteredDepthGap = true;
+          diffDepth++;
+          farNeighbors.push_back(leftNeighbor[neighIndex]);
         }
-        dist2 = 0.5 * dist2;
-      }
-      else
-      {
-        // Compute saillant point score
-        double currDepth = centralPoint.norm();
-        unsigned int diffDepth = 0;
-        bool canLeftBeAdded = true; bool hasLeftEncounteredDepthGap = false;
-        bool canRightBeAdded = true; bool hasRightEncounteredDepthGap = false;
-
-        // The saillant point score is the distance between the current point
-        // and the points that have a depth gap with the current point
-        for (unsigned int neighIndex = 0; neighIndex < leftNeighbor.size(); ++neighIndex)
+        else
         {
-          // Left neighborhood depth gap computation
-          if ((std::abs(leftNeighbor[leftNeighbor.size() - 1 - neighIndex].norm() - currDepth) > 1.5) && canLeftBeAdded)
-          {
-            hasLeftEncounteredDepthGap = true;
-            diffDepth++;
-            farNeighbors.push_back(leftNeighbor[neighIndex]);
-          }
-          else
-          {
-            if (hasLeftEncounteredDepthGap)
-            {
-              canLeftBeAdded = false;
-            }
-          }
-          // Right neigborhood depth gap computation
-          if ((std::abs(rightNeighbor[neighIndex].norm() - currDepth) > 1.5) && canRightBeAdded)
+          if (hasLeftEncounteredDepthGap)
           {
-            hasRightEncounteredDepthGap = true;
-            diffDepth++;
-            farNeighbors.push_back(rightNeighbor[neighIndex]);
-          }
-          else
-          {
-            if (hasRightEncounteredDepthGap)
-            {
-              canRightBeAdded = false;
-            }
+            canLeftBeAdded = false;
           }
         }
-
-        // If there is enought neighbors with a big depth gap
-        // we propose to compute the saillancy of the current
-        // as the distance between the line that fits the neighbors
-        // with a depth gap and the current point
-        if (static_cast<double>(diffDepth) / (2.0 * this->NeighborWidth) > 0.5)
+        // Right neigborhood depth gap computation
+        if ((std::abs(rightNeighbor[neighIndex].norm() - currDepth) > 1.5) && canRightBeAdded)
+        {
+          hasRightEncounteredDepthGap = true;
+          diffDepth++;
+          farNeighbors.push_back(rightNeighbor[neighIndex]);
+        }
+        else
         {
-          farNeighborsLine.FitPCA(farNeighbors);
-          this->SaillantPoint[scanLine][index] = std::sqrt(
-            (centralPoint - farNeighborsLine.Position).transpose() * farNeighborsLine.SemiDist * (centralPoint - farNeighborsLine.Position));
+          if (hasRightEncounteredDepthGap)
+          {
+            canRightBeAdded = false;
+          }
         }
+      }
 
-        this->BlobScore[scanLine][index] = 1;
+      // If there is enought neighbors with a big depth gap
+      // we propose to compute the saillancy of the current
+      // as the distance between the line that fits the neighbors
+      // with a depth gap and the current point
+      if (static_cast<double>(diffDepth) / (2.0 * this->NeighborWidth) > 0.5)
+      {
+        farNeighborsLine.FitPCA(farNeighbors);
+        saillantPoint[index] = std::sqrt(
+          (centralPoint - farNeighborsLine.Position).transpose() * farNeighborsLine.SemiDist * (centralPoint - farNeighborsLine.Position));
       }
 
-      this->DepthGap[scanLine][index] = std::max(dist1, dist2);
+      blobScore[index] = 1;
     }
+
+    depthGap[index] = std::max(dist1, dist2);
   }
 }
 
 //-----------------------------------------------------------------------------
-void vtkSlam::InvalidPointWithBadCriteria()
+void vtkSlam::InvalidPointWithBadCriteria(unsigned int scanLine)
 {
   // Temporary variables used in the next loop
   Eigen::Vector3d dX, X, Xn, Xp, Xproj, dXproj;
@@ -1272,421 +1452,384 @@ void vtkSlam::InvalidPointWithBadCriteria()
   Point currentPoint, nextPoint, previousPoint;
   Point temp;
 
-  // loop over scan lines
-  for (unsigned int scanLine = 0; scanLine < this->NLasers; ++scanLine)
+  const pcl::PointCloud<Point>& scan = *this->pclCurrentFrameByScan[scanLine];
+  int* isPointValid = this->Features.GetLine(this->Features.IsPointValid, scanLine);
+  int Npts = scan.size();
+
+  // if the line is almost empty, skip it
+  if (Npts < 3 * this->NeighborWidth)
+  {
+    return;
+  }
+  // invalidate first and last points
+  for (int index = 0; index <= this->NeighborWidth; ++index)
   {
-    int Npts = this->pclCurrentFrameByScan[scanLine]->size();
+    isPointValid[index] = 0;
+  }
+  for (int index = Npts - 1 - this->NeighborWidth - 1; index < Npts; ++index)
+  {
+    isPointValid[index] = 0;
+  }
 
-    // if the line is almost empty, skip it
-    if (Npts < 3 * this->NeighborWidth)
-    {
-      continue;
-    }
-    // invalidate first and last points
-    for (int index = 0; index <= this->NeighborWidth; ++index)
-    {
-      this->IsPointValid[scanLine][index] = 0;
-    }
-    for (int index = Npts - 1 - this->NeighborWidth - 1; index < Npts; ++index)
-    {
-      this->IsPointValid[scanLine][index] = 0;
-    }
+  // loop over points into the scan line
+  for (int index = this->NeighborWidth; index <  Npts - this->NeighborWidth - 1; ++index)
+  {
+    currentPoint = scan.points[index];
+    nextPoint = scan.points[index + 1];
+    previousPoint = scan.points[index - 1];
+    X << currentPoint.x, currentPoint.y, currentPoint.z;
+    Xn << nextPoint.x, nextPoint.y, nextPoint.z;
+    Xp << previousPoint.x, previousPoint.y, previousPoint.z;
+    dX = Xn - X;
+    L = X.norm();
+    Ln = Xn.norm();
+    dLn = dX.norm();
+
+    // the expected length between two firing of the same laser
+    // depend on the distance and the angular resolution of the
+    // sensor.
+    expectedLength = 2.0 *  std::tan(this->AngleResolution / 2.0) * L;
+    double ratioExpectedLength = 10.0;
 
-    // loop over points into the scan line
-    for (int index = this->NeighborWidth; index <  Npts - this->NeighborWidth - 1; ++index)
+    // if the length between the two firing
+    // is more than n-th the expected length
+    // it means that there is a gap. We now must
+    // determine if the gap is due to the geometry of
+    // the scene or if the gap is due to an occluded area
+    if (dLn > ratioExpectedLength * expectedLength)
     {
-      currentPoint = this->pclCurrentFrameByScan[scanLine]->points[index];
-      nextPoint = this->pclCurrentFrameByScan[scanLine]->points[index + 1];
-      previousPoint = this->pclCurrentFrameByScan[scanLine]->points[index - 1];
-      X << currentPoint.x, currentPoint.y, currentPoint.z;
-      Xn << nextPoint.x, nextPoint.y, nextPoint.z;
-      Xp << previousPoint.x, previousPoint.y, previousPoint.z;
-      dX = Xn - X;
-      L = X.norm();
-      Ln = Xn.norm();
-      dLn = dX.norm();
-
-      // the expected length between two firing of the same laser
-      // depend on the distance and the angular resolution of the
-      // sensor.
-      expectedLength = 2.0 *  std::tan(this->AngleResolution / 2.0) * L;
-      double ratioExpectedLength = 10.0;
-
-      // if the length between the two firing
-      // is more than n-th the expected length
-      // it means that there is a gap. We now must
-      // determine if the gap is due to the geometry of
-      // the scene or if the gap is due to an occluded area
-      if (dLn > ratioExpectedLength * expectedLength)
+      // Project the next point onto the
+      // sphere of center 0 and radius =
+      // norm of the current point. If the
+      // gap has disappeared it means that
+      // the gap was due to an occlusion
+      Xproj = L / Ln * Xn;
+      dXproj = Xproj - X;
+      // it is a depth gap, invalidate the part which belong
+      // to the occluded area (farest)
+      // invalid next part
+      if (L < Ln)
       {
-        // Project the next point onto the
-        // sphere of center 0 and radius =
-        // norm of the current point. If the
-        // gap has disappeared it means that
-        // the gap was due to an occlusion
-        Xproj = L / Ln * Xn;
-        dXproj = Xproj - X;
-        // it is a depth gap, invalidate the part which belong
-        // to the occluded area (farest)
-        // invalid next part
-        if (L < Ln)
+        for (int i = index + 1; i <= index + this->NeighborWidth; ++i)
         {
-          for (int i = index + 1; i <= index + this->NeighborWidth; ++i)
+          if (i > index + 1)
           {
-            if (i > index + 1)
+            temp = scan.points[i - 1];
+            Yp << temp.x, temp.y, temp.z;
+            temp = scan.points[i];
+            Y << temp.x, temp.y, temp.z;
+            dY = Y - Yp;
+            // if there is a gap in the neihborhood
+            // we do not invalidate the rest of neihborhood
+            if (dY.norm() > ratioExpectedLength * expectedLength)
             {
-              temp = this->pclCurrentFrameByScan[scanLine]->points[i - 1];
-              Yp << temp.x, temp.y, temp.z;
-              temp = this->pclCurrentFrameByScan[scanLine]->points[i];
-              Y << temp.x, temp.y, temp.z;
-              dY = Y - Yp;
-              // if there is a gap in the neihborhood
-              // we do not invalidate the rest of neihborhood
-              if (dY.norm() > ratioExpectedLength * expectedLength)
-              {
-                break;
-              }
+              break;
             }
-            this->IsPointValid[scanLine][i] = 0;
           }
+          isPointValid[i] = 0;
         }
-        // invalid previous part
-        else
+      }
+      // invalid previous part
+      else
+      {
+        for (int i = index - this->NeighborWidth; i <= index; ++i)
         {
-          for (int i = index - this->NeighborWidth; i <= index; ++i)
+          if (i < index)
           {
-            if (i < index)
+            temp = scan.points[i + 1];
+            Yn << temp.x, temp.y, temp.z;
+            temp = scan.points[i];
+            Y << temp.x, temp.y, temp.z;
+            dY = Yn - Y;
+            // if there is a gap in the neihborhood
+            // we do not invalidate the rest of neihborhood
+            if (dY.norm() > ratioExpectedLength * expectedLength)
             {
-              temp = this->pclCurrentFrameByScan[scanLine]->points[i + 1];
-              Yn << temp.x, temp.y, temp.z;
-              temp = this->pclCurrentFrameByScan[scanLine]->points[i];
-              Y << temp.x, temp.y, temp.z;
-              dY = Yn - Y;
-              // if there is a gap in the neihborhood
-              // we do not invalidate the rest of neihborhood
-              if (dY.norm() > ratioExpectedLength * expectedLength)
-              {
-                break;
-              }
+              break;
             }
-            this->IsPointValid[scanLine][i] = 0;
           }
+          isPointValid[i] = 0;
         }
       }
-      // Invalid points which are too close from the sensor
-      if (L < this->MinDistanceToSensor)
-      {
-        this->IsPointValid[scanLine][index] = 0;
-      }
+    }
+    // Invalid points which are too close from the sensor
+    if (L < this->MinDistanceToSensor)
+    {
+      isPointValid[index] = 0;
+    }
 
-      // Invalid points which are on a planar
-      // surface nearly parallel to the laser
-      // beam direction
-      dLp = (X - Xp).norm();
-      if ((dLp > 1 / 4.0 * ratioExpectedLength * expectedLength) && (dLn > 1 / 4.0 * ratioExpectedLength * expectedLength))
-      {
-        this->IsPointValid[scanLine][index] = 0;
-      }
+    // Invalid points which are on a planar
+    // surface nearly parallel to the laser
+    // beam direction
+    dLp = (X - Xp).norm();
+    if ((dLp > 1 / 4.0 * ratioExpectedLength * expectedLength) && (dLn > 1 / 4.0 * ratioExpectedLength * expectedLength))
+    {
+      isPointValid[index] = 0;
     }
   }
 }
 
 //-----------------------------------------------------------------------------
-void vtkSlam::SetKeyPointsLabels(vtkSmartPointer<vtkPolyData> vtkNotUsed(input))
+void vtkSlam::SetKeyPointsLabels(unsigned int scanLine)
 {
-  this->EdgesIndex.clear(); this->EdgesIndex.resize(0);
-  this->PlanarIndex.clear(); this->PlanarIndex.resize(0);
-  this->BlobIndex.clear(); this->BlobIndex.resize(0);
+  ScanLineKeypoints& picked = this->KeypointsByScan[scanLine];
+  picked.Edges.clear();
+  picked.Planars.clear();
+  picked.Blobs.clear();
+
+  int Npts = this->pclCurrentFrameByScan[scanLine]->size();
+  const double* angles = this->Features.GetLine(this->Features.Angles, scanLine);
+  const double* saillantPoint = this->Features.GetLine(this->Features.SaillantPoint, scanLine);
+  const double* depthGaps = this->Features.GetLine(this->Features.DepthGap, scanLine);
+  const double* intensityGap = this->Features.GetLine(this->Features.IntensityGap, scanLine);
+  int* isPointValid = this->Features.GetLine(this->Features.IsPointValid, scanLine);
+  int* label = this->Features.GetLine(this->Features.Label, scanLine);
+  unsigned int nbrEdgePicked = 0;
+  unsigned int nbrPlanarPicked = 0;
+
+  // We split the validity of points between the edges
+  // keypoints and planar keypoints. This allows to take
+  // some points as planar keypoints even if they are close
+  // to an edge keypoint.
+  std::vector<int> IsPointValidForPlanar(isPointValid, isPointValid + Npts);
+
+  // if the line is almost empty, skip it
+  if (Npts < 3 * this->NeighborWidth)
+  {
+    return;
+  }
 
-  // loop over the scan lines
-  for (unsigned int scanLine = 0; scanLine < this->NLasers; ++scanLine)
+  // Sort the curvature score in a decreasing order
+  std::vector<size_t> sortedDepthGapIdx = sortIdx<double>(depthGaps, Npts);
+  std::vector<size_t> sortedAnglesIdx = sortIdx<double>(angles, Npts);
+  std::vector<size_t> sortedSaillancyIdx = sortIdx<double>(saillantPoint, Npts);
+  std::vector<size_t> sortedIntensityGap = sortIdx<double>(intensityGap, Npts);
+
+  double depthGap, sinAngle, saillancy, intensity;
+  int index = 0;
+
+  // Edges using depth gap
+  for (int k = 0; k < Npts; ++k)
   {
-    int Npts = this->pclCurrentFrameByScan[scanLine]->size();
-    unsigned int nbrEdgePicked = 0;
-    unsigned int nbrPlanarPicked = 0;
+    index = sortedDepthGapIdx[k];
+    depthGap = depthGaps[index];
 
-    // We split the validity of points between the edges
-    // keypoints and planar keypoints. This allows to take
-    // some points as planar keypoints even if they are close
-    // to an edge keypoint.
-    std::vector<int> IsPointValidForPlanar = this->IsPointValid[scanLine];
+    // thresh
+    if (depthGap < this->EdgeDepthGapThreshold)
+    {
+      break;
+    }
 
-    // if the line is almost empty, skip it
-    if (Npts < 3 * this->NeighborWidth)
+    // if the point is invalid continue
+    if (isPointValid[index] == 0)
     {
       continue;
     }
 
-    // Sort the curvature score in a decreasing order
-    std::vector<size_t> sortedDepthGapIdx = sortIdx<double>(this->DepthGap[scanLine]);
-    std::vector<size_t> sortedAnglesIdx = sortIdx<double>(this->Angles[scanLine]);
-    std::vector<size_t> sortedSaillancyIdx = sortIdx<double>(this->SaillantPoint[scanLine]);
-    std::vector<size_t> sortedIntensityGap = sortIdx<double>(this->IntensityGap[scanLine]);
-
-    double depthGap, sinAngle, saillancy, intensity;
-    int index = 0;
-
-    // Edges using depth gap
-    for (int k = 0; k < Npts; ++k)
+    // else indicate that the point is an edge
+    label[index] = 4;
+    picked.Edges.push_back(index);
+    nbrEdgePicked++;
+    //IsPointValidForPlanar[index] = 0;
+
+    // invalid its neighborhod
+    int indexBegin = index - this->NeighborWidth + 1;
+    int indexEnd = index + this->NeighborWidth - 1;
+    indexBegin = std::max(0, indexBegin);
+    indexEnd = std::min(Npts - 1, indexEnd);
+    for (int j = indexBegin; j <= indexEnd; ++j)
     {
-      index = sortedDepthGapIdx[k];
-      depthGap = this->DepthGap[scanLine][index];
-
-      // thresh
-      if (depthGap < this->EdgeDepthGapThreshold)
-      {
-        break;
-      }
+      isPointValid[j] = 0;
+    }
+  }
 
-      // if the point is invalid continue
-      if (this->IsPointValid[scanLine][index] == 0)
-      {
-        continue;
-      }
+  // Edges using angles
+  for (int k = 0; k < Npts; ++k)
+  {
+    index = sortedAnglesIdx[k];
+    sinAngle = angles[index];
 
-      // else indicate that the point is an edge
-      this->Label[scanLine][index] = 4;
-      this->EdgesIndex.push_back(std::pair<int, int>(scanLine, index));
-      nbrEdgePicked++;
-      //IsPointValidForPlanar[index] = 0;
-
-      // invalid its neighborhod
-      int indexBegin = index - this->NeighborWidth + 1;
-      int indexEnd = index + this->NeighborWidth - 1;
-      indexBegin = std::max(0, indexBegin);
-      indexEnd = std::min(Npts - 1, indexEnd);
-      for (int j = indexBegin; j <= indexEnd; ++j)
-      {
-        this->IsPointValid[scanLine][j] = 0;
-      }
+    // thresh
+    if (sinAngle < this->EdgeSinAngleThreshold)
+    {
+      break;
     }
 
-    // Edges using angles
-    for (int k = 0; k < Npts; ++k)
+    // if the point is invalid continue
+    if (isPointValid[index] == 0)
     {
-      index = sortedAnglesIdx[k];
-      sinAngle = this->Angles[scanLine][index];
-
-      // thresh
-      if (sinAngle < this->EdgeSinAngleThreshold)
-      {
-        break;
-      }
-
-      // if the point is invalid continue
-      if (this->IsPointValid[scanLine][index] == 0)
-      {
-        continue;
-      }
-
-      // else indicate that the point is an edge
-      this->Label[scanLine][index] = 4;
-      this->EdgesIndex.push_back(std::pair<int, int>(scanLine, index));
-      nbrEdgePicked++;
-      //IsPointValidForPlanar[index] = 0;
-
-      // invalid its neighborhod
-      int indexBegin = index - this->NeighborWidth;
-      int indexEnd = index + this->NeighborWidth;
-      indexBegin = std::max(0, indexBegin);
-      indexEnd = std::min(Npts - 1, indexEnd);
-      for (int j = indexBegin; j <= indexEnd; ++j)
-      {
-        this->IsPointValid[scanLine][j] = 0;
-      }
+      continue;
     }
 
-    // Edges using saillancy
-    for (int k = 0; k < Npts; ++k)
+    // else indicate that the point is an edge
+    label[index] = 4;
+    picked.Edges.push_back(index);
+    nbrEdgePicked++;
+    //IsPointValidForPlanar[index] = 0;
+
+    // invalid its neighborhod
+    int indexBegin = index - this->NeighborWidth;
+    int indexEnd = index + this->NeighborWidth;
+    indexBegin = std::max(0, indexBegin);
+    indexEnd = std::min(Npts - 1, indexEnd);
+    for (int j = indexBegin; j <= indexEnd; ++j)
     {
-      index = sortedSaillancyIdx[k];
-      saillancy = this->SaillantPoint[scanLine][index];
-
-      // thresh
-      if (saillancy < 1.5)
-      {
-        break;
-      }
+      isPointValid[j] = 0;
+    }
+  }
 
-      // if the point is invalid continue
-      if (this->IsPointValid[scanLine][index] == 0)
-      {
-        continue;
-      }
+  // Edges using saillancy
+  for (int k = 0; k < Npts; ++k)
+  {
+    index = sortedSaillancyIdx[k];
+    saillancy = saillantPoint[index];
 
-      // else indicate that the point is an edge
-      this->Label[scanLine][index] = 4;
-      this->EdgesIndex.push_back(std::pair<int, int>(scanLine, index));
-      nbrEdgePicked++;
-      //IsPointValidForPlanar[index] = 0;
-
-      // invalid its neighborhod
-      int indexBegin = index - this->NeighborWidth + 1;
-      int indexEnd = index + this->NeighborWidth - 1;
-      indexBegin = std::max(0, indexBegin);
-      indexEnd = std::min(Npts - 1, indexEnd);
-      for (int j = indexBegin; j <= indexEnd; ++j)
-      {
-        this->IsPointValid[scanLine][j] = 0;
-      }
+    // thresh
+    if (saillancy < 1.5)
+    {
+      break;
     }
 
-    // Edges using intensity
-    for (int k = 0; k < Npts; ++k)
+    // if the point is invalid continue
+    if (isPointValid[index] == 0)
     {
-      index = sortedIntensityGap[k];
-      intensity = this->IntensityGap[scanLine][index];
-
-      // thresh
-      if (intensity < 50.0)
-      {
-        break;
-      }
-
-      // if the point is invalid continue
-      if (this->IsPointValid[scanLine][index] == 0)
-      {
-        continue;
-      }
-
-      // else indicate that the point is an edge
-      this->Label[scanLine][index] = 4;
-      this->EdgesIndex.push_back(std::pair<int, int>(scanLine, index));
-      nbrEdgePicked++;
-      //IsPointValidForPlanar[index] = 0;
-
-      // invalid its neighborhood
-      int indexBegin = index - 1;
-      int indexEnd = index + 1;
-      indexBegin = std::max(0, indexBegin);
-      indexEnd = std::min(Npts - 1, indexEnd);
-      for (int j = indexBegin; j <= indexEnd; ++j)
-      {
-        this->IsPointValid[scanLine][j] = 0;
-      }
+      continue;
     }
 
-    // Blobs Points
-    if (!this->FastSlam)
+    // else indicate that the point is an edge
+    label[index] = 4;
+    picked.Edges.push_back(index);
+    nbrEdgePicked++;
+    //IsPointValidForPlanar[index] = 0;
+
+    // invalid its neighborhod
+    int indexBegin = index - this->NeighborWidth + 1;
+    int indexEnd = index + this->NeighborWidth - 1;
+    indexBegin = std::max(0, indexBegin);
+    indexEnd = std::min(Npts - 1, indexEnd);
+    for (int j = indexBegin; j <= indexEnd; ++j)
     {
-      for (int k = 0; k < Npts; k = k + 3)
-      {
-        this->BlobIndex.push_back(std::pair<int, int>(scanLine, k));
-      }
+      isPointValid[j] = 0;
     }
+  }
 
-    // Planes
-    for (int k = Npts - 1; k >= 0; --k)
-    {
-      index = sortedAnglesIdx[k];
-      sinAngle = this->Angles[scanLine][index];
+  // Edges using intensity
+  for (int k = 0; k < Npts; ++k)
+  {
+    index = sortedIntensityGap[k];
+    intensity = intensityGap[index];
 
-      // thresh
-      if (sinAngle > this->PlaneSinAngleThreshold)
-      {
-        break;
-      }
+    // thresh
+    if (intensity < 50.0)
+    {
+      break;
+    }
 
-      // if the point is invalid continue
-      if (IsPointValidForPlanar[index] == 0)
-      {
-        continue;
-      }
+    // if the point is invalid continue
+    if (isPointValid[index] == 0)
+    {
+      continue;
+    }
 
-      // else indicate that the point is a planar one
-      if ((this->Label[scanLine][index] != 4) && (this->Label[scanLine][index] != 3))
-        this->Label[scanLine][index] = 2;
-      this->PlanarIndex.push_back(std::pair<int, int>(scanLine, index));
-      IsPointValidForPlanar[index] = 0;
-      this->IsPointValid[scanLine][index] = 0;
-
-      // Invalid its neighbor so that we don't have too
-      // many planar keypoints in the same region. This is
-      // required because of the k-nearest search + plane
-      // approximation realized in the odometry part. Indeed,
-      // if all the planar points are on the same scan line the
-      // problem is degenerated since all the points are distributed
-      // on a line.
-      int indexBegin = index - 4;
-      int indexEnd = index + 4;
-      indexBegin = std::max(0, indexBegin);
-      indexEnd = std::min(Npts - 1, indexEnd);
-      for (int j = indexBegin; j <= indexEnd; ++j)
-      {
-        IsPointValidForPlanar[j] = 0;
-      }
-      nbrPlanarPicked++;
+    // else indicate that the point is an edge
+    label[index] = 4;
+    picked.Edges.push_back(index);
+    nbrEdgePicked++;
+    //IsPointValidForPlanar[index] = 0;
+
+    // invalid its neighborhood
+    int indexBegin = index - 1;
+    int indexEnd = index + 1;
+    indexBegin = std::max(0, indexBegin);
+    indexEnd = std::min(Npts - 1, indexEnd);
+    for (int j = indexBegin; j <= indexEnd; ++j)
+    {
+      isPointValid[j] = 0;
     }
   }
 
-  // add keypoints in increasing scan id order
-  std::sort(this->EdgesIndex.begin(), this->EdgesIndex.end());
-  std::sort(this->PlanarIndex.begin(), this->PlanarIndex.end());
-  std::sort(this->BlobIndex.begin(), this->BlobIndex.end());
-
-  // fill the keypoints vectors and compute the max dist keypoints
-  this->FarestKeypointDist = 0.0;
-  Point p;
-  for (unsigned int k = 0; k < this->EdgesIndex.size(); ++k)
-  {
-    p = this->pclCurrentFrameByScan[this->EdgesIndex[k].first]->points[this->EdgesIndex[k].second];
-    this->CurrentEdgesPoints->push_back(p);
-    this->FarestKeypointDist = std::max(this->FarestKeypointDist, static_cast<double>(std::sqrt(std::pow(p.x, 2) + std::pow(p.y, 2) + std::pow(p.z, 2))));
-  }
-  for (unsigned int k = 0; k < this->PlanarIndex.size(); ++k)
+  // Blobs Points
+  if (!this->FastSlam)
   {
-    p = this->pclCurrentFrameByScan[this->PlanarIndex[k].first]->points[this->PlanarIndex[k].second];
-    this->CurrentPlanarsPoints->push_back(p);
-    this->FarestKeypointDist = std::max(this->FarestKeypointDist, static_cast<double>(std::sqrt(std::pow(p.x, 2) + std::pow(p.y, 2) + std::pow(p.z, 2))));
+    for (int k = 0; k < Npts; k = k + 3)
+    {
+      picked.Blobs.push_back(k);
+    }
   }
-  for (unsigned int k = 0; k < this->BlobIndex.size();  ++k)
+
+  // Planes
+  for (int k = Npts - 1; k >= 0; --k)
   {
-    p = this->pclCurrentFrameByScan[this->BlobIndex[k].first]->points[this->BlobIndex[k].second];
-    this->CurrentBlobsPoints->push_back(p);
-    this->FarestKeypointDist = std::max(this->FarestKeypointDist, static_cast<double>(std::sqrt(std::pow(p.x, 2) + std::pow(p.y, 2) + std::pow(p.z, 2))));
-  }
+    index = sortedAnglesIdx[k];
+    sinAngle = angles[index];
 
-  // Initialize the IsKeypointUsed vectors
-  this->EdgePointRejectionEgoMotion.clear(); this->EdgePointRejectionEgoMotion.resize(this->CurrentEdgesPoints->size());
-  this->PlanarPointRejectionEgoMotion.clear(); this->PlanarPointRejectionEgoMotion.resize(this->CurrentPlanarsPoints->size());
-  this->EdgePointRejectionMapping.clear(); this->EdgePointRejectionMapping.resize(this->CurrentEdgesPoints->size());
-  this->PlanarPointRejectionMapping.clear(); this->PlanarPointRejectionMapping.resize(this->CurrentPlanarsPoints->size());
+    // thresh
+    if (sinAngle > this->PlaneSinAngleThreshold)
+    {
+      break;
+    }
 
-  // keypoints extraction informations
-  std::cout << "Extracted Edges: " << this->CurrentEdgesPoints->size() << " Planars: "
-            << this->CurrentPlanarsPoints->size() << " Blobs: "
-            << this->CurrentBlobsPoints->size() << std::endl;
+    // if the point is invalid continue
+    if (IsPointValidForPlanar[index] == 0)
+    {
+      continue;
+    }
+
+    // else indicate that the point is a planar one
+    if ((label[index] != 4) && (label[index] != 3))
+      label[index] = 2;
+    picked.Planars.push_back(index);
+    IsPointValidForPlanar[index] = 0;
+    isPointValid[index] = 0;
+
+    // Invalid its neighbor so that we don't have too
+    // many planar keypoints in the same region. This is
+    // required because of the k-nearest search + plane
+    // approximation realized in the odometry part. Indeed,
+    // if all the planar points are on the same scan line the
+    // problem is degenerated since all the points are distributed
+    // on a line.
+    int indexBegin = index - 4;
+    int indexEnd = index + 4;
+    indexBegin = std::max(0, indexBegin);
+    indexEnd = std::min(Npts - 1, indexEnd);
+    for (int j = indexBegin; j <= indexEnd; ++j)
+    {
+      IsPointValidForPlanar[j] = 0;
+    }
+    nbrPlanarPicked++;
+  }
 }
 
 //-----------------------------------------------------------------------------
-void vtkSlam::TransformToWorld(Point& p)
+void vtkSlam::TransformToWorld(const pcl::PointCloud<Point>& input, pcl::PointCloud<Point>& output)
 {
+  output.resize(input.size());
   if (this->Undistortion)
   {
-    this->ExpressPointInOtherReferencial(p, this->MappingInterpolator);
+    this->MappingInterpolator.TransformPoints(input.begin(), input.end(), output.begin());
+    return;
   }
-  else
-  {
-    // Rotation and translation and points
-    Eigen::Matrix3d Rw;
-    Eigen::Vector3d Tw;
-    Eigen::Vector3d P;
-
-    Rw = GetRotationMatrix(this->Tworld);
-    Tw << this->Tworld(3), this->Tworld(4), this->Tworld(5);
-    P << p.x, p.y, p.z;
 
+  // the rigid transform is computed once for the whole cloud
+  Eigen::Matrix3d Rw = GetRotationMatrix(this->Tworld);
+  Eigen::Vector3d Tw;
+  Tw << this->Tworld(3), this->Tworld(4), this->Tworld(5);
+  for (size_t i = 0; i < input.size(); ++i)
+  {
+    Eigen::Vector3d P(input[i].x, input[i].y, input[i].z);
     P = Rw * P + Tw;
-
-    p.x = P(0);
-    p.y = P(1);
-    p.z = P(2);
+    output[i] = input[i];
+    output[i].x = P(0);
+    output[i].y = P(1);
+    output[i].z = P(2);
   }
 }
 
 //-----------------------------------------------------------------------------
-int vtkSlam::ComputeLineDistanceParameters(pcl::KdTreeFLANN<Point>::Ptr kdtreePreviousEdges, Eigen::Matrix3d& R,
-                                                   Eigen::Vector3d& dT, Point p, std::string step)
+int vtkSlam::ComputeLineDistanceParameters(const KDTree& kdtreePreviousEdges, Eigen::Matrix3d& R,
+                                                   Eigen::Vector3d& dT, Point p, MatchingStep step, MatchingBuffer& matches,
+                                                   const std::vector<char>* searched)
 {
   // number of neighbors edge points required to approximate
   // the corresponding egde line
@@ -1697,23 +1840,18 @@ int vtkSlam::ComputeLineDistanceParameters(pcl::KdTreeFLANN<Point>::Ptr kdtreePr
   // and their computed line
   double maxDist;
 
-  if (step == "egoMotion")
+  if (step == EgoMotionStep)
   {
     requiredNearest = this->EgoMotionLineDistanceNbrNeighbors;
     eigenValuesRatio = this->EgoMotionLineDistancefactor;
     maxDist = std::pow(this->EgoMotionMaxLineDistance, 2);
   }
-  else if (step == "mapping")
+  else
   {
     requiredNearest = this->MappingLineDistanceNbrNeighbors;
     eigenValuesRatio = this->MappingLineDistancefactor;
     maxDist = std::pow(this->MappingMaxLineDistance, 2);
   }
-  else
-  {
-    throw "ComputeLineDistanceParameters function got invalide step parameter";
-  }
-
 
   Eigen::Vector3d P0, P, n;
   Eigen::Matrix3d A;
@@ -1723,14 +1861,7 @@ int vtkSlam::ComputeLineDistanceParameters(pcl::KdTreeFLANN<Point>::Ptr kdtreePr
 
   if (this->Undistortion) // linear interpolated transform
   {
-    if (step == "egoMotion")
-    {
-      this->ExpressPointInOtherReferencial(p, this->EgoMotionInterpolator);
-    }
-    else if (step == "mapping")
-    {
-      this->ExpressPointInOtherReferencial(p, this->MappingInterpolator);
-    }
+    this->ExpressPointInOtherReferencial(p, step == EgoMotionStep ? this->EgoMotionInterpolator : this->MappingInterpolator);
   }
   else // rigid transform
   {
@@ -1738,27 +1869,26 @@ int vtkSlam::ComputeLineDistanceParameters(pcl::KdTreeFLANN<Point>::Ptr kdtreePr
     p.x = P(0); p.y = P(1); p.z = P(2);
   }
 
-  std::vector<int> nearestIndex;
-  std::vector<float> nearestDist;
+  std::vector<int>& nearestIndex = matches.NeighborIds;
+  std::vector<float>& nearestDist = matches.NeighborSquaredDistances;
 
-  if (step == "egoMotion")
+  if (step == EgoMotionStep)
   {
-    GetEgoMotionLineSpecificNeighbor(nearestIndex, nearestDist, requiredNearest, kdtreePreviousEdges, p);
+    GetEgoMotionLineSpecificNeighbor(nearestIndex, nearestDist, requiredNearest, kdtreePreviousEdges, p, matches);
     if (nearestIndex.size() < this->EgoMotionMinimumLineNeighborRejection)
     {
       return 0;
     }
     requiredNearest = nearestIndex.size();
   }
-  else if (step == "mapping")
+  else
   {
-    GetMappingLineSpecificNeigbbor(nearestIndex, nearestDist, this->MappingLineMaxDistInlier, requiredNearest, kdtreePreviousEdges, p);
+    GetMappingLineSpecificNeigbbor(nearestIndex, nearestDist, this->MappingLineMaxDistInlier, requiredNearest, kdtreePreviousEdges, p, matches, searched);
     if (nearestIndex.size() < this->MappingMinimumLineNeighborRejection)
     {
       return 0;
     }
     requiredNearest = nearestIndex.size();
-    //kdtreePreviousEdges->nearestKSearch(p, requiredNearest, nearestIndex, nearestDist);
   }
 
   // if the nearest edges are too far from the
@@ -1772,26 +1902,22 @@ int vtkSlam::ComputeLineDistanceParameters(pcl::KdTreeFLANN<Point>::Ptr kdtreePr
   // of the requiredNearest nearest edges points extracted
   // Thans to the PCA we will check the shape of the neighborhood
   // and keep it if it is distributed along a line
-  Eigen::MatrixXd data(requiredNearest, 3);
-
+  std::vector<Eigen::Vector3d>& neighbors = matches.NeighborPoints;
+  neighbors.resize(requiredNearest);
   for (unsigned int k = 0; k < requiredNearest; k++)
   {
-    Point pt = kdtreePreviousEdges->getInputCloud()->points[nearestIndex[k]];
-    data.row(k) << pt.x, pt.y, pt.z;
+    const Point& pt = kdtreePreviousEdges.GetPoint(nearestIndex[k]);
+    neighbors[k] << pt.x, pt.y, pt.z;
   }
 
-  Eigen::Vector3d mean = data.colwise().mean();
-  Eigen::MatrixXd centered = data.rowwise() - mean.transpose();
-  Eigen::MatrixXd cov = centered.transpose() * centered;
-  Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eig(cov);
+  NeighborhoodPCA pca;
+  pca.Compute(neighbors, requiredNearest);
+  const Eigen::Vector3d& mean = pca.Mean;
 
   // Eigen values
-  Eigen::MatrixXd D(1,3);
+  const Eigen::Vector3d& D = pca.GetEigenValues();
   // Eigen vectors
-  Eigen::MatrixXd V(3,3);
-
-  D = eig.eigenvalues();
-  V = eig.eigenvectors();
+  const Eigen::Matrix3d& V = pca.GetEigenVectors();
 
   // if the first eigen value is significantly higher than
   // the second one, it means the sourrounding points are
@@ -1828,14 +1954,10 @@ int vtkSlam::ComputeLineDistanceParameters(pcl::KdTreeFLANN<Point>::Ptr kdtreePr
 
   // Evaluate the distance from the fitted line distribution
   // of the neighborhood
-  Eigen::Vector3d Xtemp;
-  Point pt;
   double meanSquaredDist = 0;
   for (unsigned int k = 0; k < requiredNearest; ++k)
   {
-    pt = kdtreePreviousEdges->getInputCloud()->points[nearestIndex[k]];
-    Xtemp(0) = pt.x; Xtemp(1) = pt.y; Xtemp(2) = pt.z;
-    double squaredDist = (Xtemp - mean).transpose() * A * (Xtemp - mean);
+    double squaredDist = (neighbors[k] - mean).transpose() * A * (neighbors[k] - mean);
     if (squaredDist > maxDist)
     {
       return 4;
@@ -1847,11 +1969,11 @@ int vtkSlam::ComputeLineDistanceParameters(pcl::KdTreeFLANN<Point>::Ptr kdtreePr
 
   // distance between current point and the corresponding matching line
   double s = 1.0;
-  if (step == "mapping")
+  if (step == MappingStep)
   {
     s = 0.5 * fitQualityCoeff + 0.5 * linearityCoeff;
   }
-  else if (step == "egoMotion")
+  else
   {
     double orthogonalityCoeff = 0.5 + 0.5 * n(2) * n(2); // score the match by its angle with ez
     // Score the point - line matching by the angle of the
@@ -1865,18 +1987,19 @@ int vtkSlam::ComputeLineDistanceParameters(pcl::KdTreeFLANN<Point>::Ptr kdtreePr
     return 5;
 
   // store the distance parameters values
-  this->Avalues.push_back(A);
-  this->Pvalues.push_back(mean);
-  this->Xvalues.push_back(P0);
-  this->TimeValues.push_back(p.intensity);
-  this->residualCoefficient.push_back(s);
-  this->RadiusIncertitude.push_back(0.0);
+  matches.Avalues.push_back(A);
+  matches.Pvalues.push_back(mean);
+  matches.Xvalues.push_back(P0);
+  matches.TimeValues.push_back(p.time);
+  matches.residualCoefficient.push_back(s);
+  matches.RadiusIncertitude.push_back(0.0);
   return 6;
 }
 
 //-----------------------------------------------------------------------------
-int vtkSlam::ComputePlaneDistanceParameters(pcl::KdTreeFLANN<Point>::Ptr kdtreePreviousPlanes, Eigen::Matrix3d& R,
-                                                    Eigen::Vector3d& dT, Point p, std::string step)
+int vtkSlam::ComputePlaneDistanceParameters(const KDTree& kdtreePreviousPlanes, Eigen::Matrix3d& R,
+                                                    Eigen::Vector3d& dT, Point p, MatchingStep step, MatchingBuffer& matches,
+                                                    const std::vector<char>* searched)
 {
   // number of neighbors edge points required to approximate
   // the corresponding egde line
@@ -1887,24 +2010,20 @@ int vtkSlam::ComputePlaneDistanceParameters(pcl::KdTreeFLANN<Point>::Ptr kdtreeP
   // and their computed plane
   double maxDist;
 
-  if (step == "egoMotion")
+  if (step == EgoMotionStep)
   {
     significantlyFactor1 = this->EgoMotionPlaneDistancefactor1;
     significantlyFactor2 = this->EgoMotionPlaneDistancefactor2;
     requiredNearest = this->EgoMotionPlaneDistanceNbrNeighbors;
     maxDist = std::pow(this->EgoMotionMaxPlaneDistance, 2);
   }
-  else if (step == "mapping")
+  else
   {
     significantlyFactor1 = this->MappingPlaneDistancefactor1;
     significantlyFactor2 = this->MappingPlaneDistancefactor2;
     requiredNearest = this->MappingPlaneDistanceNbrNeighbors;
     maxDist = std::pow(this->MappingMaxPlaneDistance, 2);
   }
-  else
-  {
-    throw "ComputeLineDistanceParameters function got invalide step parameter";
-  }
 
   Eigen::Vector3d P0, P, n;
   Eigen::Matrix3d A;
@@ -1914,14 +2033,7 @@ int vtkSlam::ComputePlaneDistanceParameters(pcl::KdTreeFLANN<Point>::Ptr kdtreeP
 
   if (this->Undistortion) // linear interpolated transform
   {
-    if (step == "egoMotion")
-    {
-      this->ExpressPointInOtherReferencial(p, this->EgoMotionInterpolator);
-    }
-    else if (step == "mapping")
-    {
-      this->ExpressPointInOtherReferencial(p, this->MappingInterpolator);
-    }
+    this->ExpressPointInOtherReferencial(p, step == EgoMotionStep ? this->EgoMotionInterpolator : this->MappingInterpolator);
   }
   else // rigid transform
   {
@@ -1929,9 +2041,9 @@ int vtkSlam::ComputePlaneDistanceParameters(pcl::KdTreeFLANN<Point>::Ptr kdtreeP
     p.x = P(0); p.y = P(1); p.z = P(2);
   }
 
-  std::vector<int> nearestIndex;
-  std::vector<float> nearestDist;
-  kdtreePreviousPlanes->nearestKSearch(p, requiredNearest, nearestIndex, nearestDist);
+  std::vector<int>& nearestIndex = matches.NeighborIds;
+  std::vector<float>& nearestDist = matches.NeighborSquaredDistances;
+  kdtreePreviousPlanes.KNearestSearch(p, requiredNearest, nearestIndex, nearestDist, searched);
 
   // It means that there is not enought keypoints in the neighbohood
   if (nearestIndex.size() < requiredNearest)
@@ -1950,26 +2062,22 @@ int vtkSlam::ComputePlaneDistanceParameters(pcl::KdTreeFLANN<Point>::Ptr kdtreeP
   // of the requiredNearest nearest edges points extracted
   // Thanks to the PCA we will check the shape of the neighborhood
   // and keep it if it is distributed along a line
-  Eigen::MatrixXd data(requiredNearest,3);
-
+  std::vector<Eigen::Vector3d>& neighbors = matches.NeighborPoints;
+  neighbors.resize(requiredNearest);
   for (unsigned int k = 0; k < requiredNearest; k++)
   {
-    Point pt = kdtreePreviousPlanes->getInputCloud()->points[nearestIndex[k]];
-    data.row(k) << pt.x, pt.y, pt.z;
+    const Point& pt = kdtreePreviousPlanes.GetPoint(nearestIndex[k]);
+    neighbors[k] << pt.x, pt.y, pt.z;
   }
 
-  Eigen::Vector3d mean = data.colwise().mean();
-  Eigen::MatrixXd centered = data.rowwise() - mean.transpose();
-  Eigen::MatrixXd cov = centered.transpose() * centered;
-  Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eig(cov);
+  NeighborhoodPCA pca;
+  pca.Compute(neighbors, requiredNearest);
+  const Eigen::Vector3d& mean = pca.Mean;
 
   // Eigen values
-  Eigen::MatrixXd D(1,3);
+  const Eigen::Vector3d& D = pca.GetEigenValues();
   // Eigen vectors
-  Eigen::MatrixXd V(3,3);
-
-  D = eig.eigenvalues();
-  V = eig.eigenvectors();
+  const Eigen::Matrix3d& V = pca.GetEigenVectors();
 
   // if the second eigen value is close to the highest one
   // and bigger than the smallest one it means that the points
@@ -2002,14 +2110,10 @@ int vtkSlam::ComputePlaneDistanceParameters(pcl::KdTreeFLANN<Point>::Ptr kdtreeP
     return 3;
   }
 
-  Eigen::Vector3d Xtemp;
-  Point pt;
   double meanSquaredDist = 0;
   for (unsigned int k = 0; k < requiredNearest; ++k)
   {
-    pt = kdtreePreviousPlanes->getInputCloud()->points[nearestIndex[k]];
-    Xtemp(0) = pt.x; Xtemp(1) = pt.y; Xtemp(2) = pt.z;
-    double squaredDist = (Xtemp - mean).transpose() * A * (Xtemp - mean);
+    double squaredDist = (neighbors[k] - mean).transpose() * A * (neighbors[k] - mean);
     if (squaredDist > maxDist)
     {
       return 4;
@@ -2026,18 +2130,19 @@ int vtkSlam::ComputePlaneDistanceParameters(pcl::KdTreeFLANN<Point>::Ptr kdtreeP
     return 5;
 
   // store the distance parameters values
-  this->Avalues.push_back(A);
-  this->Pvalues.push_back(mean);
-  this->Xvalues.push_back(P0);
-  this->residualCoefficient.push_back(s);
-  this->TimeValues.push_back(p.intensity);
-  this->RadiusIncertitude.push_back(0.0);
+  matches.Avalues.push_back(A);
+  matches.Pvalues.push_back(mean);
+  matches.Xvalues.push_back(P0);
+  matches.residualCoefficient.push_back(s);
+  matches.TimeValues.push_back(p.time);
+  matches.RadiusIncertitude.push_back(0.0);
   return 6;
 }
 
 //-----------------------------------------------------------------------------
-int vtkSlam::ComputeBlobsDistanceParameters(pcl::KdTreeFLANN<Point>::Ptr kdtreePreviousBlobs, Eigen::Matrix3d& R,
-                                                    Eigen::Vector3d& dT, Point p, std::string vtkNotUsed(step))
+int vtkSlam::ComputeBlobsDistanceParameters(const KDTree& kdtreePreviousBlobs, Eigen::Matrix3d& R,
+                                                    Eigen::Vector3d& dT, Point p, MatchingStep vtkNotUsed(step),
+                                                    MatchingBuffer& matches, const std::vector<char>* searched)
 {
   // number of neighbors blobs points required to approximate
   // the corresponding ellipsoide
@@ -2058,9 +2163,9 @@ int vtkSlam::ComputeBlobsDistanceParameters(pcl::KdTreeFLANN<Point>::Ptr kdtreeP
   P = R * P + dT;
   p.x = P(0); p.y = P(1); p.z = P(2);
 
-  std::vector<int> nearestIndex;
-  std::vector<float> nearestDist;
-  kdtreePreviousBlobs->nearestKSearch(p, requiredNearest, nearestIndex, nearestDist);
+  std::vector<int>& nearestIndex = matches.NeighborIds;
+  std::vector<float>& nearestDist = matches.NeighborSquaredDistances;
+  kdtreePreviousBlobs.KNearestSearch(p, requiredNearest, nearestIndex, nearestDist, searched);
 
   // It means that there is not enought keypoints in the neighbohood
   if (nearestIndex.size() < requiredNearest)
@@ -2080,14 +2185,19 @@ int vtkSlam::ComputeBlobsDistanceParameters(pcl::KdTreeFLANN<Point>::Ptr kdtreeP
   // to keep this blobs. We must do that since
   // the blobs fitted ellipsoide is assume to
   // encode the local neighborhood shape.
+  std::vector<Eigen::Vector3d>& neighbors = matches.NeighborPoints;
+  neighbors.resize(requiredNearest);
+  for (unsigned int k = 0; k < requiredNearest; k++)
+  {
+    const Point& pt = kdtreePreviousBlobs.GetPoint(nearestIndex[k]);
+    neighbors[k] << pt.x, pt.y, pt.z;
+  }
   float maxDiameter = 0;
   for (unsigned int i = 0; i < requiredNearest; ++i)
   {
-    for (unsigned int j = 0; j < requiredNearest; ++j)
+    for (unsigned int j = i + 1; j < requiredNearest; ++j)
     {
-      Point pt1 = kdtreePreviousBlobs->getInputCloud()->points[nearestIndex[i]];
-      Point pt2 = kdtreePreviousBlobs->getInputCloud()->points[nearestIndex[j]];
-      float neighborhoodDiameter = std::pow(pt1.x - pt2.x, 2) + std::pow(pt1.y - pt2.y, 2) + std::pow(pt1.z - pt2.z, 2);
+      float neighborhoodDiameter = (neighbors[i] - neighbors[j]).squaredNorm();
       maxDiameter = std::max(maxDiameter, neighborhoodDiameter);
     }
   }
@@ -2101,17 +2211,10 @@ int vtkSlam::ComputeBlobsDistanceParameters(pcl::KdTreeFLANN<Point>::Ptr kdtreeP
   // Thanks to the PCA we will check the shape of the neighborhood
   // tune a distance function adapter to the distribution
   // (Mahalanobis distance)
-  Eigen::MatrixXd data(requiredNearest, 3);
-
-  for (unsigned int k = 0; k < requiredNearest; k++)
-  {
-    Point pt = kdtreePreviousBlobs->getInputCloud()->points[nearestIndex[k]];
-    data.row(k) << pt.x, pt.y, pt.z;
-  }
-
-  Eigen::Vector3d mean = data.colwise().mean();
-  Eigen::MatrixXd centered = data.rowwise() - mean.transpose();
-  Eigen::MatrixXd cov = centered.transpose() * centered;
+  NeighborhoodPCA pca;
+  pca.ComputeMeanAndCovariance(neighbors, requiredNearest);
+  const Eigen::Vector3d& mean = pca.Mean;
+  const Eigen::Matrix3d& cov = pca.Covariance;
 
   // Sigma is the inverse of the covariance
   // Matrix encoding the mahalanobis distance
@@ -2120,18 +2223,17 @@ int vtkSlam::ComputeBlobsDistanceParameters(pcl::KdTreeFLANN<Point>::Ptr kdtreeP
   {
     return 3;
   }
-  Eigen::MatrixXd sigma = cov.inverse();
-  Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eig(sigma);
+  Eigen::Matrix3d sigma = cov.inverse();
+  Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> eig;
+  eig.computeDirect(sigma);
 
   // rescale the variance covariance matrix to preserve the
   // shape of the mahalanobis distance but removing the
   // variance values scaling
-  Eigen::MatrixXd D = eig.eigenvalues();
-  Eigen::MatrixXd U = eig.eigenvectors();
+  Eigen::Vector3d D = eig.eigenvalues();
+  const Eigen::Matrix3d& U = eig.eigenvectors();
   D = D / D(2);
-  Eigen::Matrix3d diagD = Eigen::Matrix3d::Zero();
-  diagD(0, 0) = D(0); diagD(1, 1) = D(1); diagD(2, 2) = D(2);
-  A = U * diagD * U.transpose();
+  A = U * D.asDiagonal() * U.transpose();
 
   if (!vtkMath::IsFinite(A.determinant()))
   {
@@ -2146,45 +2248,49 @@ int vtkSlam::ComputeBlobsDistanceParameters(pcl::KdTreeFLANN<Point>::Ptr kdtreeP
   double s = 1.0;//1.0 - nearestDist[requiredNearest - 1] / maxDist;
 
   // store the distance parameters values
-  this->Avalues.push_back(A);
-  this->Pvalues.push_back(mean);
-  this->Xvalues.push_back(P0);
-  this->residualCoefficient.push_back(s);
-  this->RadiusIncertitude.push_back(0.0);
+  matches.Avalues.push_back(A);
+  matches.Pvalues.push_back(mean);
+  matches.Xvalues.push_back(P0);
+  matches.residualCoefficient.push_back(s);
+  matches.TimeValues.push_back(p.time);
+  matches.RadiusIncertitude.push_back(0.0);
   return 5;
 }
 
 //-----------------------------------------------------------------------------
 void vtkSlam::GetEgoMotionLineSpecificNeighbor(std::vector<int>& nearestValid, std::vector<float>& nearestValidDist,
-                                               unsigned int nearestSearch, pcl::KdTreeFLANN<Point>::Ptr kdtreePreviousEdges, Point p)
+                                               unsigned int nearestSearch, const KDTree& kdtreePreviousEdges, Point p,
+                                               MatchingBuffer& matches)
 {
   // clear vector
   nearestValid.clear();
-  nearestValid.resize(0);
   nearestValidDist.clear();
-  nearestValidDist.resize(0);
 
   // get nearest neighbor of the query point
-  std::vector<int> nearestIndex;
-  std::vector<float> nearestDist;
-  kdtreePreviousEdges->nearestKSearch(p, nearestSearch, nearestIndex, nearestDist);
+  std::vector<int>& nearestIndex = matches.SearchIds;
+  std::vector<float>& nearestDist = matches.SearchSquaredDistances;
+  if (kdtreePreviousEdges.KNearestSearch(p, nearestSearch, nearestIndex, nearestDist) == 0)
+  {
+    return;
+  }
 
   // take the closest point
-  std::vector<int> idAlreadyTook(this->NLasers, 0);
-  Point closest = kdtreePreviousEdges->getInputCloud()->points[nearestIndex[0]];
+  std::vector<int>& idAlreadyTook = matches.TakenLasers;
+  idAlreadyTook.assign(this->NLasers, 0);
+  Point closest = kdtreePreviousEdges.GetPoint(nearestIndex[0]);
   nearestValid.push_back(nearestIndex[0]);
   nearestValidDist.push_back(nearestDist[0]);
 
   // invalid all possible points that
   // are on the same scan line than the
   // closest one
-  idAlreadyTook[(int)closest.normal_y] = 1;
+  idAlreadyTook[(int)closest.laser_id] = 1;
 
   // invalid all possible points from scan
   // lines that are too far from the closest one
   for (unsigned int k = 0; k < this->NLasers; ++k)
   {
-    if (std::abs(closest.normal_y - k) > 3)
+    if (std::abs(closest.laser_id - k) > 3)
     {
       idAlreadyTook[k] = 1;
     }
@@ -2196,7 +2302,7 @@ void vtkSlam::GetEgoMotionLineSpecificNeighbor(std::vector<int>& nearestValid, s
   int id;
   for (unsigned int k = 1; k < nearestIndex.size(); ++k)
   {
-    id = kdtreePreviousEdges->getInputCloud()->points[nearestIndex[k]].normal_y;
+    id = kdtreePreviousEdges.GetPoint(nearestIndex[k]).laser_id;
     if (idAlreadyTook[id] < 1)
     {
       idAlreadyTook[id] = 1;
@@ -2208,79 +2314,79 @@ void vtkSlam::GetEgoMotionLineSpecificNeighbor(std::vector<int>& nearestValid, s
 
 //-----------------------------------------------------------------------------
 void vtkSlam::GetMappingLineSpecificNeigbbor(std::vector<int>& nearestValid, std::vector<float>& nearestValidDist, double maxDistInlier,
-                                             unsigned int nearestSearch, pcl::KdTreeFLANN<Point>::Ptr kdtreePreviousEdges, Point p)
+                                             unsigned int nearestSearch, const KDTree& kdtreePreviousEdges, Point p,
+                                             MatchingBuffer& matches, const std::vector<char>* searched)
 {
   // reset vectors
   nearestValid.clear();
-  nearestValid.resize(0);
   nearestValidDist.clear();
-  nearestValidDist.resize(0);
 
   // to prevent square root when making camparisons
   maxDistInlier = std::pow(maxDistInlier, 2);
 
   // Take the neighborhood of the query point
   // get nearest neighbor of the query point
-  std::vector<int> nearestIndex;
-  std::vector<float> nearestDist;
-  kdtreePreviousEdges->nearestKSearch(p, nearestSearch, nearestIndex, nearestDist);
+  std::vector<int>& nearestIndex = matches.SearchIds;
+  std::vector<float>& nearestDist = matches.SearchSquaredDistances;
+  if (kdtreePreviousEdges.KNearestSearch(p, nearestSearch, nearestIndex, nearestDist, searched) == 0)
+  {
+    return;
+  }
 
   // take the closest point
-  std::vector<std::vector<int> > inliersList;
-  Point closest = kdtreePreviousEdges->getInputCloud()->points[nearestIndex[0]];
+  std::vector<Eigen::Vector3d>& neighbors = matches.NeighborPoints;
+  neighbors.resize(nearestIndex.size());
+  for (unsigned int k = 0; k < nearestIndex.size(); ++k)
+  {
+    const Point& pt = kdtreePreviousEdges.GetPoint(nearestIndex[k]);
+    neighbors[k] << pt.x, pt.y, pt.z;
+  }
   nearestValid.push_back(nearestIndex[0]);
   nearestValidDist.push_back(nearestDist[0]);
 
-  Eigen::Vector3d P1, P2, dir, Pcdt;
-  Eigen::Matrix3d D;
-  P1 << closest.x, closest.y, closest.z;
-  Point pclP2;
-  Point inlierCandidate;
+  const Eigen::Vector3d& P1 = neighbors[0];
+  Eigen::Vector3d dir;
+  Eigen::Matrix3d D, bestD;
 
   // Loop over other neighbors of the neighborhood. For each of them
   // compute the line between closest point and current point and
-  // compute the number of inlier that fit this line. Keep the line and its
-  // inmliers with the most inliers
-  for (unsigned int ptIndex = 1; ptIndex < nearestIndex.size(); ++ptIndex)
-  {
-    std::vector<int> inlierIndex;
-    pclP2 = kdtreePreviousEdges->getInputCloud()->points[nearestIndex[ptIndex]];
-    P2 << pclP2.x, pclP2.y, pclP2.z;
-    dir = (P2 - P1).normalized();
+  // compute the number of inlier that fit this line. Keep the line
+  // with the most inliers, the first one in case of a tie
+  unsigned int maxInliers = 0;
+  for (unsigned int ptIndex = 1; ptIndex < neighbors.size(); ++ptIndex)
+  {
+    dir = (neighbors[ptIndex] - P1).normalized();
     D = this->I3 - dir * dir.transpose();
     D = D.transpose() * D;
 
-    for (unsigned int candidateIndex = 1; candidateIndex < nearestIndex.size(); ++candidateIndex)
+    unsigned int nInliers = 0;
+    for (unsigned int candidateIndex = 1; candidateIndex < neighbors.size(); ++candidateIndex)
     {
-      inlierCandidate = kdtreePreviousEdges->getInputCloud()->points[nearestIndex[candidateIndex]];
-      Pcdt << inlierCandidate.x, inlierCandidate.y, inlierCandidate.z;
-      if ( (Pcdt - P1).transpose() * D * (Pcdt - P1) < maxDistInlier)
+      if ((neighbors[candidateIndex] - P1).transpose() * D * (neighbors[candidateIndex] - P1) < maxDistInlier)
       {
-        inlierIndex.push_back(candidateIndex);
+        nInliers++;
       }
     }
-    inliersList.push_back(inlierIndex);
-  }
-
-  std::size_t maxInliers = 0;
-  int indexMaxInliers = -1;
-  for (unsigned int k = 0; k < inliersList.size(); ++k)
-  {
-    if (inliersList[k].size() > maxInliers)
+    if (nInliers > maxInliers)
     {
-      maxInliers = inliersList[k].size();
-      indexMaxInliers = k;
+      maxInliers = nInliers;
+      bestD = D;
     }
   }
 
-  // fill
-  for (unsigned int k = 0; k < inliersList[indexMaxInliers].size(); ++k)
+  // fill with the inliers of the best line
+  if (maxInliers == 0)
   {
-    nearestValid.push_back(nearestIndex[inliersList[indexMaxInliers][k]]);
-    nearestValidDist.push_back(nearestDist[inliersList[indexMaxInliers][k]]);
+    return;
+  }
+  for (unsigned int candidateIndex = 1; candidateIndex < neighbors.size(); ++candidateIndex)
+  {
+    if ((neighbors[candidateIndex] - P1).transpose() * bestD * (neighbors[candidateIndex] - P1) < maxDistInlier)
+    {
+      nearestValid.push_back(nearestIndex[candidateIndex]);
+      nearestValidDist.push_back(nearestDist[candidateIndex]);
+    }
   }
-
-  return;
 }
 
 //-----------------------------------------------------------------------------
@@ -2299,21 +2405,19 @@ void vtkSlam::ComputeEgoMotion()
   this->Trelative = Eigen::Matrix<double, 6, 1>::Zero();
 
   // kd-tree to process fast nearest neighbor
-  // among the keypoints of the previous pointcloud
-  pcl::KdTreeFLANN<Point>::Ptr kdtreePreviousEdges(new pcl::KdTreeFLANN<Point>());
-  pcl::KdTreeFLANN<Point>::Ptr kdtreePreviousPlanes(new pcl::KdTreeFLANN<Point>());
-  pcl::KdTreeFLANN<Point>::Ptr kdtreePreviousBlobs(new pcl::KdTreeFLANN<Point>());
-  kdtreePreviousEdges->setInputCloud(this->PreviousEdgesPoints);
-  kdtreePreviousPlanes->setInputCloud(this->PreviousPlanarsPoints);
-  kdtreePreviousBlobs->setInputCloud(this->PreviousBlobsPoints);
-
-  std::cout << "========== Ego-Motion ==========" << std::endl;
-  std::cout << "previous <-> current edges : " << this->PreviousEdgesPoints->size() << " <-> " << this->CurrentEdgesPoints->size()
+  // among the keypoints of the previous pointcloud,
+  // the ids of the points are their indices in the pointcloud
+  KDTree kdtreePreviousEdges;
+  KDTree kdtreePreviousPlanes;
+  kdtreePreviousEdges.Add(this->PreviousEdgesPoints->begin(), this->PreviousEdgesPoints->end());
+  kdtreePreviousPlanes.Add(this->PreviousPlanarsPoints->begin(), this->PreviousPlanarsPoints->end());
+
+  Report() << "========== Ego-Motion ==========" << std::endl;
+  Report() << "previous <-> current edges : " << this->PreviousEdgesPoints->size() << " <-> " << this->CurrentEdgesPoints->size()
             << "previous <-> current planes : " << this->PreviousPlanarsPoints->size() << " <-> " << this->CurrentPlanarsPoints->size() << std::endl;
 
   unsigned int usedEdges = 0;
   unsigned int usedPlanes = 0;
-  Point currentPoint, transformedPoint;
 
   // ICP - Levenberg-Marquardt loop:
   // At each step of this loop an ICP matching is performed
@@ -2330,44 +2434,40 @@ void vtkSlam::ComputeEgoMotion()
     // clear all keypoints matching data
     this->ResetDistanceParameters();
 
-    // Init the undistortion interpolator
+    // Init the undistortion interpolators
     if (this->Undistortion)
     {
-      this->EgoMotionInterpolator = this->InitUndistortionInterpolatorEgoMotion();
+      this->InitUndistortionInterpolatorEgoMotion();
     }
 
     // loop over edges
-    for (unsigned int edgeIndex = 0; edgeIndex < this->CurrentEdgesPoints->size(); ++edgeIndex)
+    // Find the closest correspondence edge line of the current edge point
+    if ((this->PreviousEdgesPoints->size() > 7) && (this->CurrentEdgesPoints->size() > 0))
     {
-      currentPoint = this->CurrentEdgesPoints->points[edgeIndex];
-
-      // Find the closest correspondence edge line of the current edge point
-      if ((this->PreviousEdgesPoints->size() > 7) && (this->CurrentEdgesPoints->size() > 0))
-      {
-        // Compute the parameters of the point - line distance
-        // i.e A = (I - n*n.t)^2 with n being the director vector
-        // and P a point of the line
-        int rejectionIndex = this->ComputeLineDistanceParameters(kdtreePreviousEdges, R, T, currentPoint, "egoMotion");
-        this->EdgePointRejectionEgoMotion[edgeIndex] = rejectionIndex;
-        this->MatchRejectionHistogramLine[rejectionIndex] += 1;
-      }
+      // Compute the parameters of the point - line distance
+      // i.e A = (I - n*n.t)^2 with n being the director vector
+      // and P a point of the line
+      this->MatchKeypoints(this->CurrentEdgesPoints->size(),
+        [&](unsigned int edgeIndex, MatchingBuffer& matches) {
+          return this->ComputeLineDistanceParameters(kdtreePreviousEdges, R, T,
+            this->CurrentEdgesPoints->points[edgeIndex], EgoMotionStep, matches);
+        },
+        this->EdgePointRejectionEgoMotion, this->MatchRejectionHistogramLine);
     }
 
     // loop over surfaces
-    for (unsigned int planarIndex = 0; planarIndex < this->CurrentPlanarsPoints->size(); ++planarIndex)
+    // Find the closest correspondence plane of the current planar point
+    if ((this->PreviousPlanarsPoints->size() > 7) && (this->CurrentPlanarsPoints->size() > 0))
     {
-      currentPoint = this->CurrentPlanarsPoints->points[planarIndex];
-
-      // Find the closest correspondence plane of the current planar point
-      if ((this->PreviousPlanarsPoints->size() > 7) && (this->CurrentPlanarsPoints->size() > 0))
-      {
-        // Compute the parameters of the point - plane distance
-        // i.e A = n * n.t with n being a normal of the plane
-        // and is a point of the plane
-        int rejectionIndex = this->ComputePlaneDistanceParameters(kdtreePreviousPlanes, R, T, currentPoint, "egoMotion");
-        this->PlanarPointRejectionEgoMotion[planarIndex] = rejectionIndex;
-        this->MatchRejectionHistogramPlane[rejectionIndex] += 1;
-      }
+      // Compute the parameters of the point - plane distance
+      // i.e A = n * n.t with n being a normal of the plane
+      // and is a point of the plane
+      this->MatchKeypoints(this->CurrentPlanarsPoints->size(),
+        [&](unsigned int planarIndex, MatchingBuffer& matches) {
+          return this->ComputePlaneDistanceParameters(kdtreePreviousPlanes, R, T,
+            this->CurrentPlanarsPoints->points[planarIndex], EgoMotionStep, matches);
+        },
+        this->PlanarPointRejectionEgoMotion, this->MatchRejectionHistogramPlane);
     }
 
     usedEdges = this->MatchRejectionHistogramLine[6];
@@ -2383,43 +2483,8 @@ void vtkSlam::ComputeEgoMotion()
     // We want to estimate our 6-DOF parameters using a non
     // linear least square minimization. The non linear part
     // comes from the Euler Angle parametrization of the rotation
-    // endomorphism SO(3). To minimize it we use CERES to perform
-    // the Levenberg-Marquardt algorithm.
-    ceres::Problem problem;
-    for (unsigned int k = 0; k < Xvalues.size(); ++k)
-    {
-      if (this->Undistortion)
-      {
-        ceres::CostFunction* cost_function = new ceres::AutoDiffCostFunction<CostFunctions::MahalanobisDistanceLinearDistortionResidual, 1, 6>(
-                                              new CostFunctions::MahalanobisDistanceLinearDistortionResidual(
-                                                this->Avalues[k], this->Pvalues[k], this->Xvalues[k],
-                                                Eigen::Matrix<double, 3, 1>::Zero(),
-                                                Eigen::Matrix<double, 3, 3>::Identity(),
-                                                this->TimeValues[k], this->residualCoefficient[k]));
-        problem.AddResidualBlock(cost_function, new ceres::ArctanLoss(2.0), this->Trelative.data());
-      }
-      else
-      {
-        ceres::CostFunction* cost_function = new ceres::AutoDiffCostFunction<CostFunctions::MahalanobisDistanceAffineIsometryResidual, 1, 6>(
-                                             new CostFunctions::MahalanobisDistanceAffineIsometryResidual(this->Avalues[k], this->Pvalues[k],
-                                                                                                          this->Xvalues[k], this->residualCoefficient[k]));
-        problem.AddResidualBlock(cost_function, new ceres::ArctanLoss(2.0), this->Trelative.data());
-      }
-    }
-
-    ceres::Solver::Options options;
-    options.max_num_iterations = this->EgoMotionLMMaxIter;
-    options.linear_solver_type = ceres::DENSE_QR;
-    options.minimizer_progress_to_stdout = false;
-
-    ceres::Solver::Summary summary;
-    ceres::Solve(options, &problem, &summary);
-    std::cout << summary.BriefReport() << std::endl;
-
-    // If no L-M iteration has been made since the
-    // last ICP matching it means we reached a local
-    // minimum for the ICP-LM algorithm
-    if (summary.num_successful_steps == 1)
+    // endomorphism SO(3)
+    if (this->EstimateParameters(this->Trelative, Eigen::Vector3d::Zero(), this->EgoMotionLMMaxIter, nullptr))
     {
       break;
     }
@@ -2431,8 +2496,8 @@ void vtkSlam::ComputeEgoMotion()
   static_cast<vtkIntArray*>(this->Trajectory->GetPointData()->GetArray("EgoMotion: edges used"))->InsertNextValue(usedEdges);
   static_cast<vtkIntArray*>(this->Trajectory->GetPointData()->GetArray("EgoMotion: planes used"))->InsertNextValue(usedPlanes);
   static_cast<vtkIntArray*>(this->Trajectory->GetPointData()->GetArray("EgoMotion: total keypoints used"))->InsertNextValue(this->Xvalues.size());
-  std::cout << "used keypoints : " << this->Xvalues.size() << std::endl;
-  std::cout << "edges : " << usedEdges << " planes : " << usedPlanes << std::endl;
+  Report() << "used keypoints : " << this->Xvalues.size() << std::endl;
+  Report() << "edges : " << usedEdges << " planes : " << usedPlanes << std::endl;
 
   // Integrate the relative motion
   // to the world transformation
@@ -2452,36 +2517,36 @@ void vtkSlam::Mapping()
     return;
   }
 
-  // contruct kd-tree for fast search
-  pcl::KdTreeFLANN<Point>::Ptr kdtreeEdges(new pcl::KdTreeFLANN<Point>());
-  pcl::KdTreeFLANN<Point>::Ptr kdtreePlanes(new pcl::KdTreeFLANN<Point>());
-  pcl::KdTreeFLANN<Point>::Ptr kdtreeBlobs(new pcl::KdTreeFLANN<Point>());
-
   // Set the FarestPoint to reduce the map to the minimun since
   this->SetLidarMaximunRange(this->FarestKeypointDist);
 
-  pcl::PointCloud<Point>::Ptr subEdgesPointsLocalMap = this->EdgesPointsLocalMap->Get(this->Tworld);
-  pcl::PointCloud<Point>::Ptr subPlanarPointsLocalMap = this->PlanarPointsLocalMap->Get(this->Tworld);
+  // kd-trees for fast search, kept up to date by the maps as
+  // they are rolled and as keypoints are added to them
+  const KDTree& kdtreeEdges = this->EdgesPointsLocalMap->GetIndex();
+  const KDTree& kdtreePlanes = this->PlanarPointsLocalMap->GetIndex();
+  const KDTree& kdtreeBlobs = this->BlobsPointsLocalMap->GetIndex();
 
-  std::cout << "========== Mapping ==========" << std::endl;
-  std::cout << "Edges extracted from map: " << subEdgesPointsLocalMap->points.size()
-            << "Planes extracted from map: " << subPlanarPointsLocalMap->points.size() << std::endl;
+  // the neighbors are only searched among the points of the
+  // voxels around the sensor, up to the farest keypoint
+  std::vector<char> edgesWindow, planesWindow, blobsWindow;
+  const size_t nEdgesInWindow = this->EdgesPointsLocalMap->GetWindow(this->Tworld, edgesWindow);
+  const size_t nPlanesInWindow = this->PlanarPointsLocalMap->GetWindow(this->Tworld, planesWindow);
 
-  kdtreeEdges->setInputCloud(subEdgesPointsLocalMap);
-  kdtreePlanes->setInputCloud(subPlanarPointsLocalMap);
+  Report() << "========== Mapping ==========" << std::endl;
+  Report() << "Edges extracted from map: " << nEdgesInWindow
+            << " Planes extracted from map: " << nPlanesInWindow << std::endl;
 
   if (!this->FastSlam)
   {
-    pcl::PointCloud<Point>::Ptr subBlobPointsLocalMap = this->BlobsPointsLocalMap->Get(this->Tworld);
-    kdtreeBlobs->setInputCloud(subBlobPointsLocalMap);
-    std::cout << "blobs map : " << subBlobPointsLocalMap->points.size() << std::endl;
+    const size_t nBlobsInWindow = this->BlobsPointsLocalMap->GetWindow(this->Tworld, blobsWindow);
+    Report() << "blobs map : " << nBlobsInWindow << std::endl;
   }
 
   unsigned int usedEdges = 0;
   unsigned int usedPlanes = 0;
   unsigned int usedBlobs = 0;
-  Point currentPoint;
-  Eigen::MatrixXd estimatorCovariance(6, 6);
+  std::vector<int> blobPointRejectionMapping;
+  Eigen::Matrix<double, 6, 6> estimatorCovariance = Eigen::Matrix<double, 6, 6>::Zero();
 
   // ICP - Levenberg-Marquardt loop:
   // At each step of this loop an ICP matching is performed
@@ -2493,10 +2558,10 @@ void vtkSlam::Mapping()
     // clear all keypoints matching data
     this->ResetDistanceParameters();
 
-    // Init the undistortion interpolator
+    // Init the undistortion interpolators
     if (this->Undistortion)
     {
-      this->MappingInterpolator = this->InitUndistortionInterpolatorMapping();
+      this->InitUndistortionInterpolatorMapping();
     }
 
     // Rotation and position at this step
@@ -2505,126 +2570,72 @@ void vtkSlam::Mapping()
     T << this->Tworld(3), this->Tworld(4), this->Tworld(5);
 
     // loop over edges
-    for (unsigned int edgeIndex = 0; edgeIndex < this->CurrentEdgesPoints->size(); ++edgeIndex)
+    if (this->CurrentEdgesPoints->size() > 0 && nEdgesInWindow > 10)
     {
-      currentPoint = this->CurrentEdgesPoints->points[edgeIndex];
-
-      if (this->CurrentEdgesPoints->size() > 0 && subEdgesPointsLocalMap->points.size() > 10)
-      {
-        // Find the closest correspondence edge line of the current edge point
-        int rejectionIndex = this->ComputeLineDistanceParameters(kdtreeEdges, R, T, currentPoint, "mapping");
-        this->EdgePointRejectionMapping[edgeIndex] = rejectionIndex;
-        this->MatchRejectionHistogramLine[rejectionIndex] += 1;
-        usedEdges = this->Xvalues.size();
-      }
+      // Find the closest correspondence edge line of the current edge point
+      this->MatchKeypoints(this->CurrentEdgesPoints->size(),
+        [&](unsigned int edgeIndex, MatchingBuffer& matches) {
+          return this->ComputeLineDistanceParameters(kdtreeEdges, R, T,
+            this->CurrentEdgesPoints->points[edgeIndex], MappingStep, matches, &edgesWindow);
+        },
+        this->EdgePointRejectionMapping, this->MatchRejectionHistogramLine);
+      usedEdges = this->Xvalues.size();
     }
 
     // loop over surfaces
-    for (unsigned int planarIndex = 0; planarIndex < this->CurrentPlanarsPoints->size(); ++planarIndex)
+    if (this->CurrentPlanarsPoints->size() > 0 && nPlanesInWindow > 10)
     {
-      currentPoint = this->CurrentPlanarsPoints->points[planarIndex];
-
-      if (this->CurrentPlanarsPoints->size() > 0 && subPlanarPointsLocalMap->size() > 10)
-      {
-        // Find the closest correspondence plane of the current planar point
-        int rejectionIndex = this->ComputePlaneDistanceParameters(kdtreePlanes, R, T, currentPoint, "mapping");
-        this->PlanarPointRejectionMapping[planarIndex] = rejectionIndex;
-        this->MatchRejectionHistogramPlane[rejectionIndex] += 1;
-        usedPlanes = this->Xvalues.size() - usedEdges;
-      }
+      // Find the closest correspondence plane of the current planar point
+      this->MatchKeypoints(this->CurrentPlanarsPoints->size(),
+        [&](unsigned int planarIndex, MatchingBuffer& matches) {
+          return this->ComputePlaneDistanceParameters(kdtreePlanes, R, T,
+            this->CurrentPlanarsPoints->points[planarIndex], MappingStep, matches, &planesWindow);
+        },
+        this->PlanarPointRejectionMapping, this->MatchRejectionHistogramPlane);
+      usedPlanes = this->Xvalues.size() - usedEdges;
     }
 
-    if (!this->FastSlam && this->NbrFrameProcessed > 10)
+    if (!this->FastSlam && this->NbrFrameProcessed > 10 && this->CurrentBlobsPoints->size() > 0)
     {
       // loop over blobs
-      for (unsigned int blobIndex = 0; blobIndex < this->CurrentBlobsPoints->size(); ++blobIndex)
-      {
-        currentPoint = this->CurrentBlobsPoints->points[blobIndex];
-
-        // Find the closest correspondence plane of the current planar point
-        this->ComputeBlobsDistanceParameters(kdtreeBlobs, R, T, currentPoint, "mapping");
-        usedBlobs = this->Xvalues.size() - usedPlanes - usedEdges;
-      }
+      // Find the closest correspondence blob of the current blob point
+      this->MatchKeypoints(this->CurrentBlobsPoints->size(),
+        [&](unsigned int blobIndex, MatchingBuffer& matches) {
+          return this->ComputeBlobsDistanceParameters(kdtreeBlobs, R, T,
+            this->CurrentBlobsPoints->points[blobIndex], MappingStep, matches, &blobsWindow);
+        },
+        blobPointRejectionMapping, this->MatchRejectionHistogramBlob);
+      usedBlobs = this->Xvalues.size() - usedPlanes - usedEdges;
     }
 
     // Skip this frame if there is too few geometric keypoints matched
     if ((usedPlanes + usedEdges + usedBlobs) < 20)
     {
       vtkGenericWarningMacro("Too few geometric features, loop breaked");
-      std::cout << "planes: " << usedPlanes << " edges: " << usedEdges << " Blobs: " << usedBlobs << std::endl;
+      Report() << "planes: " << usedPlanes << " edges: " << usedEdges << " Blobs: " << usedBlobs << std::endl;
       break;
     }
 
-    // Get the previous sensor pose
-    Eigen::Matrix3d R0 = GetRotationMatrix(this->PreviousTworld);
+    // Get the previous sensor position
     Eigen::Vector3d T0; T0 << this->PreviousTworld[3], this->PreviousTworld[4], this->PreviousTworld[5];
 
     // We want to estimate our 6-DOF parameters using a non
     // linear least square minimization. The non linear part
     // comes from the Euler Angle parametrization of the rotation
-    // endomorphism SO(3). To minimize it we use CERES to perform
-    // the Levenberg-Marquardt algorithm.
-    ceres::Problem problem;
-    for (unsigned int k = 0; k < Xvalues.size(); ++k)
+    // endomorphism SO(3). Once a local minimum is reached, the
+    // quality of the parameters estimated is evaluated using an
+    // approximate computation of the variance covariance matrix
+    if (this->EstimateParameters(this->Tworld, T0, this->MappingLMMaxIter, &estimatorCovariance))
     {
-      if (this->Undistortion)
-      {
-        ceres::CostFunction* cost_function = new ceres::AutoDiffCostFunction<CostFunctions::MahalanobisDistanceLinearDistortionResidual, 1, 6>(
-                                              new CostFunctions::MahalanobisDistanceLinearDistortionResidual(
-                                                this->Avalues[k], this->Pvalues[k], this->Xvalues[k], T0, R0,
-                                                this->TimeValues[k], this->residualCoefficient[k]));
-        problem.AddResidualBlock(cost_function, new ceres::ArctanLoss(2.0), this->Tworld.data());
-      }
-      else
-      {
-        ceres::CostFunction* cost_function = new ceres::AutoDiffCostFunction<CostFunctions::MahalanobisDistanceAffineIsometryResidual, 1, 6>(
-                                             new CostFunctions::MahalanobisDistanceAffineIsometryResidual(this->Avalues[k], this->Pvalues[k],
-                                                                                                          this->Xvalues[k], this->residualCoefficient[k]));
-        problem.AddResidualBlock(cost_function, new ceres::ArctanLoss(2.0), this->Tworld.data());
-      }
-    }
-
-    ceres::Solver::Options options;
-    options.max_num_iterations = this->MappingLMMaxIter;
-    options.linear_solver_type = ceres::DENSE_QR;
-    options.minimizer_progress_to_stdout = false;
-
-    ceres::Solver::Summary summary;
-    ceres::Solve(options, &problem, &summary);
-    std::cout << summary.BriefReport() << std::endl;
-
-    // If no L-M iteration has been made since the
-    // last ICP matching it means we reached a local
-    // minimum for the ICP-LM algorithm
-    if (summary.num_successful_steps == 1)
-    {
-      // Now evaluate the quality of the parameters
-      // estimated using an approximate computation
-      // of the variance covariance matrix
-      // Covariance computation options
-      ceres::Covariance::Options covOptions;
-      covOptions.apply_loss_function = true;
-      covOptions.algorithm_type = ceres::CovarianceAlgorithmType::DENSE_SVD;
-
-      // Computation of the variance-covariance matrix
-      ceres::Covariance covariance(covOptions);
-      std::vector<std::pair<const double*, const double* > > covariance_blocks;
-      covariance_blocks.push_back(std::make_pair(this->Tworld.data(), this->Tworld.data()));
-      covariance.Compute(covariance_blocks, &problem);
-      double covarianceMat[6 * 6];
-      covariance.GetCovarianceBlock(this->Tworld.data(), this->Tworld.data(), covarianceMat);
-      for (int i = 0; i < 6; ++i)
-        for (int j = 0; j < 6; ++j)
-          estimatorCovariance(i, j) = covarianceMat[i + 6 * j];
       break;
-      }
+    }
   }
 
   // Provide information about keypoints-neighborhood matching rejections
   this->RejectionInformationDisplay();
 
-  Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eig(estimatorCovariance);
-  Eigen::MatrixXd D = eig.eigenvalues();
+  Eigen::SelfAdjointEigenSolver<Eigen::Matrix<double, 6, 6> > eig(estimatorCovariance);
+  Eigen::Matrix<double, 6, 1> D = eig.eigenvalues();
 
   static_cast<vtkDoubleArray*>(this->Trajectory->GetPointData()->GetArray("Variance Error"))->InsertNextValue(D(5));
   static_cast<vtkIntArray*>(this->Trajectory->GetPointData()->GetArray("Mapping: edges used"))->InsertNextValue(usedEdges);
@@ -2632,10 +2643,10 @@ void vtkSlam::Mapping()
   static_cast<vtkIntArray*>(this->Trajectory->GetPointData()->GetArray("Mapping: blobs used"))->InsertNextValue(usedBlobs);
   static_cast<vtkIntArray*>(this->Trajectory->GetPointData()->GetArray("Mapping: total keypoints used"))->InsertNextValue(this->Xvalues.size());
 
-  std::cout << "Matches used: Total: " << this->Xvalues.size()
+  Report() << "Matches used: Total: " << this->Xvalues.size()
             << " edges: " << usedEdges << " planes: " << usedPlanes << " blobs: " << usedBlobs << std::endl;
-  std::cout << "Covariance Eigen values: " << D.transpose() << std::endl;
-  std::cout << "Maximum variance: " << D(5) << std::endl;
+  Report() << "Covariance Eigen values: " << D.transpose() << std::endl;
+  Report() << "Maximum variance: " << D(5) << std::endl;
 
   // Add the current computed transform to the list
   this->TworldList.push_back(this->Tworld);
@@ -2653,26 +2664,18 @@ void vtkSlam::UpdateMapsUsingTworld()
   // Init the mapping interpolator
   if (this->Undistortion)
   {
-    this->MappingInterpolator = this->InitUndistortionInterpolatorMapping();
+    this->InitUndistortionInterpolatorMapping();
   }
 
   // Update EdgeMap
   pcl::PointCloud<Point>::Ptr MapEdgesPoints(new pcl::PointCloud<Point>());
-  for (unsigned int i = 0; i < this->CurrentEdgesPoints->size(); ++i)
-  {
-    MapEdgesPoints->push_back(this->CurrentEdgesPoints->at(i));
-    this->TransformToWorld(MapEdgesPoints->at(i));
-  }
+  this->TransformToWorld(*this->CurrentEdgesPoints, *MapEdgesPoints);
   EdgesPointsLocalMap->Roll(this->Tworld);
   EdgesPointsLocalMap->Add(MapEdgesPoints);
 
   // Update PlanarMap
   pcl::PointCloud<Point>::Ptr MapPlanarsPoints(new pcl::PointCloud<Point>());
-  for (unsigned int i = 0; i < this->CurrentPlanarsPoints->size(); ++i)
-  {
-    MapPlanarsPoints->push_back(this->CurrentPlanarsPoints->at(i));
-    this->TransformToWorld(MapPlanarsPoints->at(i));
-  }
+  this->TransformToWorld(*this->CurrentPlanarsPoints, *MapPlanarsPoints);
   PlanarPointsLocalMap->Roll(this->Tworld);
   PlanarPointsLocalMap->Add(MapPlanarsPoints);
 
@@ -2680,11 +2683,7 @@ void vtkSlam::UpdateMapsUsingTworld()
   if (!this->FastSlam)
   {
     pcl::PointCloud<Point>::Ptr MapBlobsPoints(new pcl::PointCloud<Point>());
-    for (unsigned int i = 0; i < this->pclCurrentFrame->size(); ++i)
-    {
-      MapBlobsPoints->push_back(this->pclCurrentFrame->at(i));
-      this->TransformToWorld(MapBlobsPoints->at(i));
-    }
+    this->TransformToWorld(*this->pclRegisteredFrame, *MapBlobsPoints);
     BlobsPointsLocalMap->Roll(this->Tworld);
     BlobsPointsLocalMap->Add(MapBlobsPoints);
   }
@@ -2709,65 +2708,27 @@ void vtkSlam::FillEgoMotionInfoArrayWithDefaultValues()
 }
 
 //-----------------------------------------------------------------------------
-vtkSmartPointer<vtkVelodyneTransformInterpolator> vtkSlam::InitUndistortionInterpolatorEgoMotion()
+void vtkSlam::InitUndistortionInterpolatorEgoMotion()
 {
-  vtkSmartPointer<vtkVelodyneTransformInterpolator> resultInterp = vtkSmartPointer<vtkVelodyneTransformInterpolator>::New();
-  resultInterp->SetInterpolationTypeToLinear();
-
   // Transforms representing the passage from the
   // referential of the sensor at time t0 resp t1
-  // to the referential of the sensor at the time 0
-  vtkNew<vtkTransform> transform0, transform1;
-
-  // transform 0 is identity
-  transform0->Identity();
-  transform0->Modified();
-  transform0->Update();
-
-  // transform 1 is the delta transform
-  // between T0 and T1 computed in the EgoMotion
-  // i.e Trelative
+  // to the referential of the sensor at the time 0:
+  // transform 0 is identity and transform 1 is the
+  // delta transform between T0 and T1 computed in
+  // the EgoMotion i.e Trelative
   Eigen::Matrix3d R = GetRotationMatrix(this->Trelative);
   Eigen::Vector3d T;
   T << this->Trelative(3), this->Trelative(4), this->Trelative(5);
 
-  vtkNew<vtkMatrix4x4> M;
-  for (unsigned int i = 0; i < 3; ++i)
-  {
-    for (unsigned int j = 0; j < 3; ++j)
-    {
-      M->Element[i][j] = R(i, j);
-    }
-    M->Element[i][3] = T(i);
-    M->Element[3][i] = 0;
-  }
-  M->Element[3][3] = 1.0;
-
-  transform1->SetMatrix(M.Get());
-  transform1->Modified();
-  transform1->Update();
-
-  // Add the transforms and update
-  resultInterp->AddTransform(0.0, transform0.GetPointer());
-  resultInterp->AddTransform(1.0, transform1.GetPointer());
-  resultInterp->Modified();
-
-  return resultInterp;
+  this->EgoMotionInterpolator.SetTransforms(Eigen::Matrix3d::Identity(), Eigen::Vector3d::Zero(), R, T);
 }
 
 //-----------------------------------------------------------------------------
-vtkSmartPointer<vtkVelodyneTransformInterpolator> vtkSlam::InitUndistortionInterpolatorMapping()
+void vtkSlam::InitUndistortionInterpolatorMapping()
 {
-  vtkSmartPointer<vtkVelodyneTransformInterpolator> resultInterp = vtkSmartPointer<vtkVelodyneTransformInterpolator>::New();
-  resultInterp->SetInterpolationTypeToLinear();
-
   // Transforms representing the passage from the
   // referential of the sensor at time t0 resp t1
-  // to the referential of the sensor at the time 0
-  vtkNew<vtkTransform> transform0, transform1;
-
-  // transform 1 is the delta transform
-  // between T0 and T1
+  // to the world referential
   Eigen::Matrix3d R0, R1;
   R0 = GetRotationMatrix(this->PreviousTworld);
   R1 = GetRotationMatrix(this->Tworld);
@@ -2776,52 +2737,18 @@ vtkSmartPointer<vtkVelodyneTransformInterpolator> vtkSlam::InitUndistortionInter
   T0 << this->PreviousTworld(3), this->PreviousTworld(4), this->PreviousTworld(5);
   T1 << this->Tworld(3), this->Tworld(4), this->Tworld(5);
 
-  vtkNew<vtkMatrix4x4> M0, M1;
-  for (unsigned int i = 0; i < 3; ++i)
-  {
-    for (unsigned int j = 0; j < 3; ++j)
-    {
-      M0->Element[i][j] = R0(i, j);
-      M1->Element[i][j] = R1(i, j);
-    }
-    M0->Element[i][3] = T0(i);
-    M0->Element[3][i] = 0;
-    M1->Element[i][3] = T1(i);
-    M1->Element[3][i] = 0;
-  }
-  M0->Element[3][3] = 1.0;
-  M1->Element[3][3] = 1.0;
-
-  transform0->SetMatrix(M0.Get());
-  transform0->Modified();
-  transform0->Update();
-
-  transform1->SetMatrix(M1.Get());
-  transform1->Modified();
-  transform1->Update();
-
-  // Add the transforms and update
-  resultInterp->AddTransform(0.0, transform0.GetPointer());
-  resultInterp->AddTransform(1.0, transform1.GetPointer());
-  resultInterp->Modified();
-
-  return resultInterp;
+  this->MappingInterpolator.SetTransforms(R0, T0, R1, T1);
 }
 
 //-----------------------------------------------------------------------------
-void vtkSlam::ExpressPointInOtherReferencial(Point& p, vtkSmartPointer<vtkVelodyneTransformInterpolator> transform)
+void vtkSlam::ExpressPointInOtherReferencial(Point& p, const LinearTransformInterpolator& interpolator)
 {
-  // interpolate the transform
-  vtkNew<vtkTransform> currTransform;
-  transform->InterpolateTransform(p.intensity, currTransform.GetPointer());
-  currTransform->Modified();
-  currTransform->Update();
-
-  double pos[3] = {p.x, p.y, p.z};
-  currTransform->InternalTransformPoint(pos, pos);
-  p.x = pos[0];
-  p.y = pos[1];
-  p.z = pos[2];
+  // interpolate the transform at the time of acquisition of the point
+  Eigen::Vector3d P(p.x, p.y, p.z);
+  P = interpolator.TransformPoint(p.time, P);
+  p.x = P(0);
+  p.y = P(1);
+  p.z = P(2);
 }
 
 //-----------------------------------------------------------------------------
@@ -2845,6 +2772,174 @@ void vtkSlam::ResetDistanceParameters()
   this->MatchRejectionHistogramPlane.resize(NrejectionCauses);
   this->MatchRejectionHistogramBlob.clear();
   this->MatchRejectionHistogramBlob.resize(NrejectionCauses);
+
+  // One matching buffer per thread of the pool
+  this->MatchingBuffers.resize(this->Pool.GetNumberOfThreads());
+}
+
+//-----------------------------------------------------------------------------
+unsigned int vtkSlam::ComputeNumberOfThreads() const
+{
+  if (this->NumberOfThreads > 0)
+  {
+    return this->NumberOfThreads;
+  }
+  return std::max(1u, boost::thread::hardware_concurrency());
+}
+
+//-----------------------------------------------------------------------------
+void vtkSlam::ResizeThreadPool()
+{
+  // The threads running the loops are threads of the slam too: the
+  // calling thread, and in pipelined mode the back-end thread whose
+  // loops run at the same time as those of the front-end
+  const unsigned int nCallers = this->Pipelined ? 2 : 1;
+  const unsigned int nThreads = this->ComputeNumberOfThreads();
+  this->Pool.SetNumberOfWorkers(nThreads > nCallers ? nThreads - nCallers : 0);
+}
+
+//-----------------------------------------------------------------------------
+void vtkSlam::MatchingBuffer::Clear()
+{
+  // clear keeps the capacity, the buffers are not reallocated at each ICP iteration
+  this->Avalues.clear();
+  this->Pvalues.clear();
+  this->Xvalues.clear();
+  this->RadiusIncertitude.clear();
+  this->residualCoefficient.clear();
+  this->TimeValues.clear();
+}
+
+//-----------------------------------------------------------------------------
+void vtkSlam::MatchKeypoints(unsigned int nKeypoints,
+                             const std::function<int(unsigned int, MatchingBuffer&)>& matchKeypoint,
+                             std::vector<int>& rejectionIndex, std::vector<double>& rejectionHistogram)
+{
+  rejectionIndex.resize(nKeypoints);
+  if (nKeypoints == 0)
+  {
+    return;
+  }
+
+  // Each thread of the pool matches a contiguous range of keypoints
+  const size_t nThreads = std::max(static_cast<size_t>(1),
+    std::min(this->MatchingBuffers.size(), static_cast<size_t>(nKeypoints)));
+  this->Pool.ParallelFor(nThreads, [&](size_t thread) {
+    MatchingBuffer& matches = this->MatchingBuffers[thread];
+    matches.Clear();
+    const size_t begin = nKeypoints * thread / nThreads;
+    const size_t end = nKeypoints * (thread + 1) / nThreads;
+    for (size_t k = begin; k < end; ++k)
+    {
+      rejectionIndex[k] = matchKeypoint(static_cast<unsigned int>(k), matches);
+    }
+  });
+
+  // Append the matches in the keypoints order
+  for (size_t thread = 0; thread < nThreads; ++thread)
+  {
+    const MatchingBuffer& matches = this->MatchingBuffers[thread];
+    this->Avalues.insert(this->Avalues.end(), matches.Avalues.begin(), matches.Avalues.end());
+    this->Pvalues.insert(this->Pvalues.end(), matches.Pvalues.begin(), matches.Pvalues.end());
+    this->Xvalues.insert(this->Xvalues.end(), matches.Xvalues.begin(), matches.Xvalues.end());
+    this->RadiusIncertitude.insert(this->RadiusIncertitude.end(),
+      matches.RadiusIncertitude.begin(), matches.RadiusIncertitude.end());
+    this->residualCoefficient.insert(this->residualCoefficient.end(),
+      matches.residualCoefficient.begin(), matches.residualCoefficient.end());
+    this->TimeValues.insert(this->TimeValues.end(), matches.TimeValues.begin(), matches.TimeValues.end());
+  }
+  for (unsigned int k = 0; k < nKeypoints; ++k)
+  {
+    rejectionHistogram[rejectionIndex[k]] += 1;
+  }
+}
+
+//-----------------------------------------------------------------------------
+bool vtkSlam::EstimateParameters(Eigen::Matrix<double, 6, 1>& w, const Eigen::Vector3d& T0,
+                                 unsigned int maxIterations, Eigen::Matrix<double, 6, 6>* covariance)
+{
+  // The residuals of the matched keypoints, whose jacobians are computed analytically
+  auto residual = [&](unsigned int k) -> CostFunctions::MahalanobisDistanceAnalyticResidual {
+    if (this->Undistortion)
+    {
+      return CostFunctions::MahalanobisDistanceAnalyticResidual(this->Avalues[k], this->Pvalues[k], this->Xvalues[k],
+                                                                T0, this->TimeValues[k], this->residualCoefficient[k]);
+    }
+    return CostFunctions::MahalanobisDistanceAnalyticResidual(this->Avalues[k], this->Pvalues[k], this->Xvalues[k],
+                                                              this->residualCoefficient[k]);
+  };
+
+  if (this->BuiltInSolver)
+  {
+    this->Solver.Clear();
+    for (unsigned int k = 0; k < this->Xvalues.size(); ++k)
+    {
+      this->Solver.AddResidual(residual(k));
+    }
+    PoseSolver<CostFunctions::MahalanobisDistanceAnalyticResidual>::Summary summary =
+      this->Solver.Solve(w, maxIterations, this->Pool);
+    Report() << "Built-in solver, Initial " << summary.InitialCost << ", Final " << summary.FinalCost
+              << ", Iterations: " << summary.Iterations << std::endl;
+
+    // If at most one L-M iteration has been made since the
+    // last ICP matching it means we reached a local
+    // minimum for the ICP-LM algorithm
+    if (summary.SuccessfulSteps > 1)
+    {
+      return false;
+    }
+    if (covariance)
+    {
+      *covariance = this->Solver.GetCovariance();
+    }
+    return true;
+  }
+
+  // To minimize it we use CERES to perform
+  // the Levenberg-Marquardt algorithm
+  ceres::Problem problem;
+  for (unsigned int k = 0; k < this->Xvalues.size(); ++k)
+  {
+    ceres::CostFunction* cost_function =
+      new CostFunctions::AnalyticCostFunction<CostFunctions::MahalanobisDistanceAnalyticResidual>(residual(k));
+    problem.AddResidualBlock(cost_function, new ceres::ArctanLoss(2.0), w.data());
+  }
+
+  ceres::Solver::Options options;
+  options.max_num_iterations = maxIterations;
+  options.linear_solver_type = ceres::DENSE_QR;
+  options.minimizer_progress_to_stdout = false;
+
+  ceres::Solver::Summary summary;
+  ceres::Solve(options, &problem, &summary);
+  Report() << summary.BriefReport() << std::endl;
+
+  // If no L-M iteration has been made since the
+  // last ICP matching it means we reached a local
+  // minimum for the ICP-LM algorithm
+  if (summary.num_successful_steps != 1)
+  {
+    return false;
+  }
+  if (covariance)
+  {
+    // Covariance computation options
+    ceres::Covariance::Options covOptions;
+    covOptions.apply_loss_function = true;
+    covOptions.algorithm_type = ceres::CovarianceAlgorithmType::DENSE_SVD;
+
+    // Computation of the variance-covariance matrix
+    ceres::Covariance ceresCovariance(covOptions);
+    std::vector<std::pair<const double*, const double* > > covariance_blocks;
+    covariance_blocks.push_back(std::make_pair(w.data(), w.data()));
+    ceresCovariance.Compute(covariance_blocks, &problem);
+    double covarianceMat[6 * 6];
+    ceresCovariance.GetCovarianceBlock(w.data(), w.data(), covarianceMat);
+    for (int i = 0; i < 6; ++i)
+      for (int j = 0; j < 6; ++j)
+        (*covariance)(i, j) = covarianceMat[i + 6 * j];
+  }
+  return true;
 }
 
 //-----------------------------------------------------------------------------
@@ -2886,9 +2981,46 @@ void vtkSlam::UpdateTworldUsingTrelative()
   this->Tworld(5) = newTw(2);
 }
 
+//-----------------------------------------------------------------------------
+void vtkSlam::SetUndistortion(bool undistortion)
+{
+  if (this->Undistortion != undistortion)
+  {
+    this->Flush();
+    this->Undistortion = undistortion;
+    this->Modified();
+  }
+}
+
+//-----------------------------------------------------------------------------
+void vtkSlam::SetPipelined(bool pipelined)
+{
+  if (this->Pipelined != pipelined)
+  {
+    this->Flush();
+    this->Pipelined = pipelined;
+    this->ResizeThreadPool();
+    this->Modified();
+  }
+}
+
+//-----------------------------------------------------------------------------
+void vtkSlam::SetNumberOfThreads(int nThreads)
+{
+  if (this->NumberOfThreads != nThreads)
+  {
+    this->Flush();
+    this->NumberOfThreads = nThreads;
+    this->ResizeThreadPool();
+    this->Modified();
+  }
+}
+
 //-----------------------------------------------------------------------------
 void vtkSlam::SetVoxelGridLeafSize(double size)
 {
+  // the maps may be in use by the back-end
+  this->Flush();
   this->PlanarPointsLocalMap->SetLeafSize(size);
   this->EdgesPointsLocalMap->SetLeafSize(0.75 * size);
   this->BlobsPointsLocalMap->SetLeafSize(0.20 * size);
@@ -2898,6 +3030,8 @@ void vtkSlam::SetVoxelGridLeafSize(double size)
 //-----------------------------------------------------------------------------
 void vtkSlam::SetVoxelGridSize(unsigned int size)
 {
+  // the maps may be in use by the back-end
+  this->Flush();
   this->EdgesPointsLocalMap->SetSize(size);
   this->PlanarPointsLocalMap->SetSize(size);
   this->BlobsPointsLocalMap->SetSize(size);
@@ -2907,12 +3041,22 @@ void vtkSlam::SetVoxelGridSize(unsigned int size)
 //-----------------------------------------------------------------------------
 void vtkSlam::SetVoxelGridResolution(double resolution)
 {
+  // the maps may be in use by the back-end
+  this->Flush();
   this->EdgesPointsLocalMap->SetResolution(resolution);
   this->PlanarPointsLocalMap->SetResolution(resolution);
   this->BlobsPointsLocalMap->SetResolution(resolution);
   this->ParametersModificationTime.Modified();
 }
 
+//-----------------------------------------------------------------------------
+size_t vtkSlam::GetMapMemoryUsage()
+{
+  return this->EdgesPointsLocalMap->GetMemoryUsage() +
+         this->PlanarPointsLocalMap->GetMemoryUsage() +
+         this->BlobsPointsLocalMap->GetMemoryUsage();
+}
+
 //-----------------------------------------------------------------------------
 void vtkSlam::SetLidarMaximunRange(const double maxRange)
 {
@@ -2934,7 +3078,7 @@ void vtkSlam::UpdateLaserIdMapping(vtkTable *calib)
     {
       verticalCorrection[i] = array->GetTuple1(i);
     }
-    this->LaserIdMapping = sortIdx(verticalCorrection);
+    this->LaserIdMapping = sortIdx(verticalCorrection.data(), verticalCorrection.size());
   }
   else
   {
@@ -2952,16 +3096,16 @@ void vtkSlam::RejectionInformationDisplay()
     totalRejectionsLine += this->MatchRejectionHistogramLine[k];
     totalRejectionsPlane += this->MatchRejectionHistogramPlane[k];
   }
-  std::cout << "Rejection frequencies lines: [";
+  Report() << "Rejection frequencies lines: [";
   for (int k = 0; k < this->NrejectionCauses; ++k)
   {
-    std::cout << this->MatchRejectionHistogramLine[k] / totalRejectionsLine * 100.0 << ", ";
+    Report() << this->MatchRejectionHistogramLine[k] / totalRejectionsLine * 100.0 << ", ";
   }
-  std::cout << std::endl;
-  std::cout << "Rejection frequencies planes: [";
+  Report() << std::endl;
+  Report() << "Rejection frequencies planes: [";
   for (int k = 0; k < this->NrejectionCauses; ++k)
   {
-    std::cout << this->MatchRejectionHistogramPlane[k] / totalRejectionsPlane * 100.0 << ", ";
+    Report() << this->MatchRejectionHistogramPlane[k] / totalRejectionsPlane * 100.0 << ", ";
   }
-  std::cout << std::endl;
+  Report() << std::endl;
 }
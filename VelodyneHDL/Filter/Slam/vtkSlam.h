@@ -76,6 +76,7 @@
 // STD
 #include <string>
 #include <ctime>
+#include <functional>
 // VTK
 #include <vtkPolyDataAlgorithm.h>
 #include <vtkSmartPointer.h>
@@ -84,10 +85,15 @@
 #include <Eigen/Dense>
 // PCL
 #include <pcl/point_types.h>
-#include <pcl/filters/voxel_grid.h>
-#include <pcl/kdtree/kdtree_flann.h>
 
+#include "BoundedQueue.h"
+#include "IncrementalKDTree.h"
 #include "KalmanFilter.h"
+#include "LinearTransformInterpolator.h"
+#include "PoseSolver.h"
+#include "ScanLineFeatures.h"
+#include "SlamPoint.h"
+#include "ThreadPool.h"
 #include "vtkTemporalTransforms.h"
 
 // This custom macro is needed to make the SlamManager time agnostic
@@ -96,22 +102,25 @@
 // By keeping track of the last time the parameters been modified there is
 // no ambiguty anymore. This mecanimsm is similar to the one usedby the paraview filter
 // PlotDataOverTime
+// The back-end of the pipelined processing is flushed first,
+// as it may be using the parameter
 #define vtkCustomSetMacro(name,type) \
 virtual void Set##name (type _arg) \
 { \
   vtkDebugMacro(<< this->GetClassName() << " (" << this << "): setting " #name " to " << _arg); \
   if (this->name != _arg) \
   { \
+    this->Flush(); \
     this->name = _arg; \
     this->Modified(); \
     this->ParametersModificationTime.Modified(); \
   } \
 }
 
-class vtkVelodyneTransformInterpolator;
 class RollingGrid;
 class vtkTable;
-typedef pcl::PointXYZINormal Point;
+typedef SlamPoint Point;
+typedef IncrementalKDTree<Point> KDTree;
 
 class VTK_EXPORT vtkSlam : public vtkPolyDataAlgorithm
 {
@@ -127,6 +136,11 @@ public:
   // and to update the map using keypoints and ego-motion
   void AddFrame(vtkPolyData* newFrame);
 
+  // Wait until the frames added have been processed,
+  // in pipelined mode. The results of the slam (world
+  // transform, trajectory, maps) are then up to date
+  void Flush();
+
   // Get the computed world transform so far
   void GetWorldTransform(double* Tworld);
 
@@ -146,14 +160,42 @@ public:
   vtkGetMacro(FastSlam, bool)
   vtkCustomSetMacro(FastSlam, bool)
 
-  vtkSetMacro(Undistortion, bool)
+  void SetUndistortion(bool undistortion);
   vtkGetMacro(Undistortion, bool)
 
+  // Number of threads extracting and matching the keypoints and
+  // estimating the pose, 0 uses one thread per core. In pipelined
+  // mode the front-end and the back-end share them. It does not
+  // change the result, only the time needed to get it
+  vtkGetMacro(NumberOfThreads, int)
+  void SetNumberOfThreads(int nThreads);
+
+  // Estimate the 6-DOF parameters with the built-in
+  // Levenberg-Marquardt solver instead of ceres
+  vtkGetMacro(BuiltInSolver, bool)
+  vtkCustomSetMacro(BuiltInSolver, bool)
+
+  // Process the frames in two stages running concurrently:
+  // the keypoints of a new frame are extracted while the
+  // ego-motion and the mapping of the previous ones are
+  // computed. It does not change the result, only the time
+  // needed to get it when frames are added faster than the
+  // results are requested, as the offline slam does. The
+  // online slam waits for the pose of each frame in
+  // RequestData, it does not benefit from it
+  vtkGetMacro(Pipelined, bool)
+  void SetPipelined(bool pipelined);
+
   // Set RollingGrid Parameters
   void SetVoxelGridLeafSize(double size);
   void SetVoxelGridSize(unsigned int size);
   void SetVoxelGridResolution(double resolution);
 
+  // Memory used by the edges, planars and blobs maps, in bytes.
+  // It is also given for each frame by the "Map memory usage (MB)"
+  // array of the trajectory, to follow its growth on long runs
+  size_t GetMapMemoryUsage();
+
   // Get/Set Keypoint
   vtkGetMacro(NeighborWidth, int)
   vtkCustomSetMacro(NeighborWidth, int)
@@ -244,6 +286,13 @@ protected:
   int FillInputPortInformation(int port, vtkInformation* info) override;
   int RequestData(vtkInformation *, vtkInformationVector **, vtkInformationVector *) override;
 
+  // Add the frame of the input to the slam, the
+  // two steps of RequestData being separated so that
+  // the offline slam can add several frames before
+  // filling the outputs
+  void AddInputFrame(vtkInformationVector** inputVector);
+  void FillOutputs(vtkInformationVector* outputVector);
+
   // Keeps track of the time the parameters have been modified
   // This will enable the SlamManager to be time-agnostic
   // MTime is a much more general mecanism so we can't rely on it
@@ -284,8 +333,47 @@ private:
   // The undistortion will improve the accuracy but
   // the computation speed will decrease
   bool Undistortion = false;
-  vtkSmartPointer<vtkVelodyneTransformInterpolator> EgoMotionInterpolator;
-  vtkSmartPointer<vtkVelodyneTransformInterpolator> MappingInterpolator;
+  LinearTransformInterpolator EgoMotionInterpolator;
+  LinearTransformInterpolator MappingInterpolator;
+
+  // Number of threads used to extract and match the keypoints
+  int NumberOfThreads = 0;
+  unsigned int ComputeNumberOfThreads() const;
+
+  // Threads started once and shared by the keypoints
+  // extraction, the matching and the built-in solver
+  ThreadPool Pool;
+  void ResizeThreadPool();
+
+  // Should the 6-DOF parameters be estimated by
+  // the built-in solver or by ceres
+  bool BuiltInSolver = false;
+  PoseSolver<CostFunctions::MahalanobisDistanceAnalyticResidual> Solver;
+
+  // Keypoints extracted from a frame by the front-end
+  // (conversion and keypoints extraction), to be
+  // registered by the back-end (ego-motion and mapping)
+  struct FrameKeypoints
+  {
+    pcl::PointCloud<Point>::Ptr Edges;
+    pcl::PointCloud<Point>::Ptr Planars;
+    pcl::PointCloud<Point>::Ptr Blobs;
+    pcl::PointCloud<Point>::Ptr Frame;
+    double FarestKeypointDist = 0.0;
+    double Time = 0.0;
+  };
+  FrameKeypoints ExtractedKeypoints;
+
+  // In pipelined mode, the keypoints extracted are
+  // queued to the thread running the back-end. The
+  // queue is small to bound the memory used when
+  // the back-end is the slowest stage
+  bool Pipelined = false;
+  BoundedQueue<FrameKeypoints> KeypointsQueue;
+  boost::thread BackEndThread;
+
+  // Points of the frame registered by the back-end
+  pcl::PointCloud<Point>::Ptr pclRegisteredFrame;
 
   // keypoints extracted
   pcl::PointCloud<Point>::Ptr CurrentEdgesPoints;
@@ -305,14 +393,17 @@ private:
 
   // Curvature and over differntial operations
   // scan by scan; point by point
-  std::vector<std::vector<double> > Angles;
-  std::vector<std::vector<double> > DepthGap;
-  std::vector<std::vector<double> > BlobScore;
-  std::vector<std::vector<double> > LengthResolution;
-  std::vector<std::vector<double> > SaillantPoint;
-  std::vector<std::vector<double> > IntensityGap;
-  std::vector<std::vector<int> > IsPointValid;
-  std::vector<std::vector<int> > Label;
+  ScanLineFeatures Features;
+
+  // Keypoints picked in each scan line,
+  // by their index in the scan line
+  struct ScanLineKeypoints
+  {
+    std::vector<int> Edges;
+    std::vector<int> Planars;
+    std::vector<int> Blobs;
+  };
+  std::vector<ScanLineKeypoints> KeypointsByScan;
 
   // with of the neighbor used to compute discrete
   // differential operators
@@ -446,6 +537,40 @@ private:
   std::vector<double> residualCoefficient;
   std::vector<double> TimeValues;
 
+  // The keypoints are matched by several threads, each one
+  // matching a contiguous range of keypoints and storing the
+  // distance parameters in its own buffer. The buffers are then
+  // appended to the values above in the keypoints order, so that
+  // the result does not depend on the number of threads
+  struct MatchingBuffer
+  {
+    std::vector<Eigen::Matrix3d > Avalues;
+    std::vector<Eigen::Vector3d > Pvalues;
+    std::vector<Eigen::Vector3d > Xvalues;
+    std::vector<double> RadiusIncertitude;
+    std::vector<double> residualCoefficient;
+    std::vector<double> TimeValues;
+
+    // Neighborhood of the keypoint being matched, reused
+    // from one keypoint to the next to avoid allocations
+    std::vector<int> NeighborIds;
+    std::vector<float> NeighborSquaredDistances;
+    std::vector<Eigen::Vector3d> NeighborPoints;
+    std::vector<int> SearchIds;
+    std::vector<float> SearchSquaredDistances;
+    std::vector<int> TakenLasers;
+
+    void Clear();
+  };
+  std::vector<MatchingBuffer> MatchingBuffers;
+
+  // Match the keypoints [0, nKeypoints) using the matching buffers,
+  // matchKeypoint(k, buffer) matching the keypoint k and returning its
+  // rejection index. Then append the buffers to the distance parameters
+  void MatchKeypoints(unsigned int nKeypoints,
+                      const std::function<int(unsigned int, MatchingBuffer&)>& matchKeypoint,
+                      std::vector<int>& rejectionIndex, std::vector<double>& rejectionHistogram);
+
   // Histogram of the ICP matching rejection causes
   std::vector<double> MatchRejectionHistogramPlane;
   std::vector<double> MatchRejectionHistogramLine;
@@ -453,6 +578,15 @@ private:
   int NrejectionCauses = 7;
   void ResetDistanceParameters();
 
+  // Estimate the 6-DOF parameters w minimizing the distances
+  // of the matched keypoints, starting from their current value,
+  // T0 being the position at the beginning of the frame used by
+  // the undistortion. Return true if a local minimum of the
+  // ICP-LM algorithm is reached, in which case the covariance
+  // of the estimator is computed if covariance is not null
+  bool EstimateParameters(Eigen::Matrix<double, 6, 1>& w, const Eigen::Vector3d& T0,
+                          unsigned int maxIterations, Eigen::Matrix<double, 6, 6>* covariance);
+
   // Display information about the keypoints - neighborhood
   // mathching rejections
   void RejectionInformationDisplay();
@@ -468,24 +602,26 @@ private:
   // Extract keypoints from the pointcloud. The key points
   // will be separated in two classes : Edges keypoints which
   // correspond to area with high curvature scan lines and
-  // planar keypoints which have small curvature
-  void ComputeKeyPoints(vtkSmartPointer<vtkPolyData> input);
+  // planar keypoints which have small curvature. The scan
+  // lines are processed independently by several threads
+  void ComputeKeyPoints();
 
-  // Compute the curvature of the scan lines
+  // Compute the curvature of a scan line
   // The curvature is not the one of the surface
   // that intersected the lines but the curvature
   // of the scan lines taken in an isolated way
-  void ComputeCurvature(vtkSmartPointer<vtkPolyData> input);
+  void ComputeCurvature(unsigned int scanLine);
 
   // Invalid the points with bad criteria from
   // the list of possible future keypoints.
   // This points correspond to planar surface
   // roughtly parallel to laser beam and points
   // close to a gap created by occlusion
-  void InvalidPointWithBadCriteria();
+  void InvalidPointWithBadCriteria(unsigned int scanLine);
 
-  // Labelizes point to be a keypoints or not
-  void SetKeyPointsLabels(vtkSmartPointer<vtkPolyData> input);
+  // Labelizes the points of a scan line
+  // to be a keypoints or not
+  void SetKeyPointsLabels(unsigned int scanLine);
 
   // Reset all mumbers variables that are
   // used during the process of a frame.
@@ -493,6 +629,13 @@ private:
   // won't be reset.
   void PrepareDataForNextFrame();
 
+  // Estimate the pose of a frame from its keypoints,
+  // and add them to the maps
+  void RegisterKeypoints(const FrameKeypoints& keypoints);
+
+  // Register the keypoints queued, until the queue is closed
+  void RunBackEnd();
+
   // Find the ego motion of the sensor between
   // the current frame and the next one using
   // the keypoints extracted.
@@ -503,8 +646,16 @@ private:
   // using the map and the keypoints extracted.
   void Mapping();
 
-  // Transform the input point already undistort into Tworld.
-  void TransformToWorld(Point& p);
+  // Transform the points of the input cloud already
+  // undistort into Tworld, in one pass
+  void TransformToWorld(const pcl::PointCloud<Point>& input, pcl::PointCloud<Point>& output);
+
+  // Step of the algorithm a keypoint is matched for
+  enum MatchingStep
+  {
+    EgoMotionStep,
+    MappingStep
+  };
 
   // Match the current keypoint with its neighborhood in the map / previous
   // frames. From this match we compute the point-to-neighborhood distance
@@ -512,24 +663,31 @@ private:
   // (R * X + T - P).t * A * (R * X + T - P)
   // Where P is the mean point of the neighborhood and A is the symmetric
   // variance-covariance matrix encoding the shape of the neighborhood
-  int ComputeLineDistanceParameters(pcl::KdTreeFLANN<Point>::Ptr kdtreePreviousEdges, Eigen::Matrix3d& R,
-                                             Eigen::Vector3d& dT, Point p, std::string step);
-  int ComputePlaneDistanceParameters(pcl::KdTreeFLANN<Point>::Ptr kdtreePreviousPlanes, Eigen::Matrix3d& R,
-                                              Eigen::Vector3d& dT, Point p, std::string step);
-  int ComputeBlobsDistanceParameters(pcl::KdTreeFLANN<Point>::Ptr kdtreePreviousBlobs, Eigen::Matrix3d& R,
-                                              Eigen::Vector3d& dT, Point p, std::string step);
+  // The parameters are stored in the matching buffer of the calling thread
+  // The neighborhood is searched among the points marked in searched if given
+  int ComputeLineDistanceParameters(const KDTree& kdtreePreviousEdges, Eigen::Matrix3d& R,
+                                             Eigen::Vector3d& dT, Point p, MatchingStep step, MatchingBuffer& matches,
+                                             const std::vector<char>* searched = nullptr);
+  int ComputePlaneDistanceParameters(const KDTree& kdtreePreviousPlanes, Eigen::Matrix3d& R,
+                                              Eigen::Vector3d& dT, Point p, MatchingStep step, MatchingBuffer& matches,
+                                              const std::vector<char>* searched = nullptr);
+  int ComputeBlobsDistanceParameters(const KDTree& kdtreePreviousBlobs, Eigen::Matrix3d& R,
+                                              Eigen::Vector3d& dT, Point p, MatchingStep step, MatchingBuffer& matches,
+                                              const std::vector<char>* searched = nullptr);
 
   // Instead of taking the k-nearest neigbirs in the odometry
   // step we will take specific neighbor using the particularities
   // of the velodyne's lidar sensor
   void GetEgoMotionLineSpecificNeighbor(std::vector<int>& nearestValid, std::vector<float>& nearestValidDist,
-                                        unsigned int nearestSearch, pcl::KdTreeFLANN<Point>::Ptr kdtreePreviousEdges, Point p);
+                                        unsigned int nearestSearch, const KDTree& kdtreePreviousEdges, Point p,
+                                        MatchingBuffer& matches);
 
   // Instead of taking the k-nearest neighbors in the mapping
   // step we will take specific neighbor using a sample consensus
   // model
   void GetMappingLineSpecificNeigbbor(std::vector<int>& nearestValid, std::vector<float>& nearestValidDist, double maxDistInlier,
-                                        unsigned int nearestSearch, pcl::KdTreeFLANN<Point>::Ptr kdtreePreviousEdges, Point p);
+                                        unsigned int nearestSearch, const KDTree& kdtreePreviousEdges, Point p,
+                                        MatchingBuffer& matches, const std::vector<char>* searched);
 
   // All points of the current frame has been
   // acquired at a different timestamp. The goal
@@ -541,15 +699,17 @@ private:
   // at time t0. The referential at time of acquisition t is estimated
   // using the constant velocity hypothesis and the provided sensor
   // position estimation
-  void ExpressPointInOtherReferencial(Point& p, vtkSmartPointer<vtkVelodyneTransformInterpolator> transform);
+  void ExpressPointInOtherReferencial(Point& p, const LinearTransformInterpolator& interpolator);
 
   // Initialize the undistortion interpolator
   // for the EgoMotion part it is just an interpolation
   // between Id and Trelative
   // for the mapping part it is an interpolation between indentity
   // and the incremental transform between TworldPrevious and Tworld
-  vtkSmartPointer<vtkVelodyneTransformInterpolator> InitUndistortionInterpolatorEgoMotion();
-  vtkSmartPointer<vtkVelodyneTransformInterpolator> InitUndistortionInterpolatorMapping();
+  // The interpolators only depend on the two poses, they are
+  // initialized once per ICP iteration and shared by the threads
+  void InitUndistortionInterpolatorEgoMotion();
+  void InitUndistortionInterpolatorMapping();
 
   // Update the world transformation by integrating
   // the relative motion recover and the previous
@@ -568,7 +728,7 @@ private:
 
   // Display infos
   template<typename T, typename Tvtk>
-  void AddVectorToPolydataPoints(const std::vector<std::vector<T>>& vec, const char* name, vtkPolyData* pd);
+  void AddVectorToPolydataPoints(const std::vector<T>& feature, const char* name, vtkPolyData* pd);
   void DisplayLaserIdMapping(vtkSmartPointer<vtkPolyData> input);
   void DisplayRelAdv(vtkSmartPointer<vtkPolyData> input);
   void DisplayUsedKeypoints(vtkSmartPointer<vtkPolyData> input);
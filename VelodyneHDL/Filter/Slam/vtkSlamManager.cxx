@@ -121,8 +121,17 @@ int vtkSlamManager::RequestData(vtkInformation *request, vtkInformationVector **
   double progress = double(this->CurrentFrame-start)/double(stop-start);
   this->UpdateProgress(progress);
 
-  // process the frame
-  vtkSlam::RequestData(request, inputVector, outputVector);
+  // process the frame. In pipelined mode the outputs are only filled
+  // once the last frame is added, so that the next frame is read and its
+  // keypoints extracted while the previous ones are registered
+  if (this->GetPipelined() && !LastIteration)
+  {
+    this->AddInputFrame(inputVector);
+  }
+  else
+  {
+    vtkSlam::RequestData(request, inputVector, outputVector);
+  }
 
   // save data to the cache at the end
   if (LastIteration)
@@ -19,71 +19,364 @@
 #include "CrashAnalysing.h"
 
 // STD
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstring>
 #include <ctime>
+#include <exception>
 #include <fstream>
-#include <sstream>
 #include <stdio.h>
 
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
 // VTK
 #include <vtkInformation.h>
 
+namespace
+{
+// pcap record header, followed by the 42 bytes of the ethernet, IP and UDP headers
+const std::size_t RecordHeaderSize = 16;
+const std::size_t NetworkHeaderSize = 42;
+const std::size_t MaxPayloadSize = 1500;
+const std::size_t SlotSize = RecordHeaderSize + NetworkHeaderSize + MaxPayloadSize;
+
+// pcap global header: magic, version 2.4, timezone, accuracy, snapshot length, ethernet
+const uint32_t PcapGlobalHeader[6] = { 0xa1b2c3d4, 0x00040002, 0, 0, 65535, 1 };
+
+// Writers whose ring is saved when crashing
+const int MaxNumberOfAnalyzers = 8;
+std::atomic<const CrashAnalysisWriter*> Analyzers[MaxNumberOfAnalyzers];
+
+// The previous handlers are called once the rings are written
+const int HandledSignals[] = { SIGSEGV, SIGABRT, SIGFPE, SIGILL, SIGTERM
+#ifndef _WIN32
+  , SIGBUS
+#endif
+};
+const int NumberOfHandledSignals = sizeof(HandledSignals) / sizeof(HandledSignals[0]);
+#ifdef _WIN32
+void (*PreviousSignalHandlers[NumberOfHandledSignals])(int);
+#else
+struct sigaction PreviousSignalHandlers[NumberOfHandledSignals];
+#endif
+std::terminate_handler PreviousTerminateHandler = nullptr;
+std::atomic<bool> HasFlushed{ false };
+
+//-----------------------------------------------------------------------------
+double MonotonicTime()
+{
+#ifdef _WIN32
+  return std::chrono::duration<double>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+#else
+  // clock_gettime is async-signal-safe, unlike std::chrono
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + 1e-9 * now.tv_nsec;
+#endif
+}
+
 //-----------------------------------------------------------------------------
-void CrashAnalysisWriter::AddPacket(const std::string& packet)
-{
-  // The idea is to store 2 .pcap files. One corresponding
-  // to the last N packets received and one corresponding to
-  // the N older ones. Switching from one file to the other
-  // insure that we always have at least the N last packets
-  // (except for the very beginning).
-  // When switching to file 0 or 1, the existing content of the
-  // file is discarded resulting in a storage of a number of packets
-  // between N and 2*N
-  if (this->PacketCount % this->NbrPacketsToStore == 0)
-  {
-    // Close the writer if it is already opened
-    if (this->Writer.IsOpen())
+bool WriteAll(int fd, const char* data, std::size_t size)
+{
+  while (size > 0)
+  {
+#ifdef _WIN32
+    const int written = _write(fd, data, static_cast<unsigned int>(size));
+#else
+    const ssize_t written = write(fd, data, size);
+#endif
+    if (written <= 0)
     {
-      this->Writer.Close();
+      return false;
     }
+    data += written;
+    size -= static_cast<std::size_t>(written);
+  }
+  return true;
+}
+}
+
+//-----------------------------------------------------------------------------
+void CrashAnalysisWriter::SetNbrPacketsToStore(unsigned int arg)
+{
+  this->NbrPacketsToStore = arg;
+  this->Ring.assign(static_cast<std::size_t>(arg) * SlotSize, 0);
+  this->RecordSizes.assign(arg, 0);
+  this->PacketCount = 0;
+}
+
+//-----------------------------------------------------------------------------
+void CrashAnalysisWriter::SetFilename(const std::string& arg)
+{
+  this->Filename = arg;
+  this->CrashFilename = arg + "0.bin";
+}
 
-    // Switch the filename and open the writer
-    this->FileToStore++;
-    unsigned int nbrFile = this->FileToStore % 2; // file name: 0 or 1
-    std::stringstream ss;
-    ss << this->Filename << nbrFile << ".bin";
-    if (!this->Writer.Open(ss.str()))
+//-----------------------------------------------------------------------------
+void CrashAnalysisWriter::StartAnalyzer()
+{
+  if (this->IsStarted || this->NbrPacketsToStore == 0)
+  {
+    return;
+  }
+
+  InstallCrashHandlers();
+  for (int i = 0; i < MaxNumberOfAnalyzers; ++i)
+  {
+    const CrashAnalysisWriter* expected = nullptr;
+    if (Analyzers[i].compare_exchange_strong(expected, this))
     {
-      vtkGenericWarningMacro("Crash analysis failed to open the log file.");
+      this->IsStarted = true;
       return;
     }
   }
-
-  this->WriteLastPacket(packet);
-  this->PacketCount++;
+  vtkGenericWarningMacro("Too many crash analyzers, the packets won't be saved on crash.");
 }
 
 //-----------------------------------------------------------------------------
-void CrashAnalysisWriter::WriteLastPacket(const std::string& packet)
+void CrashAnalysisWriter::AddPacket(const char* data, std::size_t numberOfBytes, double time)
 {
-  // check that the writer is opened
-  if (!this->Writer.IsOpen())
+  if (this->NbrPacketsToStore == 0)
   {
-    vtkGenericWarningMacro("Crash analysis couldn't save last packet received since the writer is not opened");
     return;
   }
 
-  this->Writer.WritePacket(
-          reinterpret_cast<const unsigned char*>(packet.c_str()), packet.length());
+  const uint64_t count = this->PacketCount.load(std::memory_order_relaxed);
+  const std::size_t slot = static_cast<std::size_t>(count % this->NbrPacketsToStore);
+  char* record = &this->Ring[slot * SlotSize];
+
+  // Same record as vtkPacketFileWriter::WritePacket
+  const uint32_t payloadSize = static_cast<uint32_t>(std::min(numberOfBytes, MaxPayloadSize));
+  const uint64_t microseconds = static_cast<uint64_t>(time * 1e6 + 0.5);
+  const uint32_t header[4] = {
+    static_cast<uint32_t>(microseconds / 1000000),
+    static_cast<uint32_t>(microseconds % 1000000),
+    static_cast<uint32_t>(payloadSize + NetworkHeaderSize),
+    static_cast<uint32_t>(numberOfBytes + NetworkHeaderSize)
+  };
+  std::memcpy(record, header, RecordHeaderSize);
+  std::memcpy(record + RecordHeaderSize,
+    numberOfBytes == 512 ? vtkPacketFileWriter::PositionPacketHeader
+                         : vtkPacketFileWriter::LidarPacketHeader,
+    NetworkHeaderSize);
+  std::memcpy(record + RecordHeaderSize + NetworkHeaderSize, data, payloadSize);
+  this->RecordSizes[slot] = static_cast<uint32_t>(RecordHeaderSize + NetworkHeaderSize + payloadSize);
+
+  this->PacketCount.store(count + 1, std::memory_order_release);
 }
 
 //-----------------------------------------------------------------------------
 void CrashAnalysisWriter::CloseAnalyzer()
 {
-  if (this->Writer.IsOpen())
+  if (!this->IsStarted)
   {
-    this->Writer.Close();
     return;
   }
+
+  for (int i = 0; i < MaxNumberOfAnalyzers; ++i)
+  {
+    const CrashAnalysisWriter* expected = this;
+    Analyzers[i].compare_exchange_strong(expected, nullptr);
+  }
+  this->IsStarted = false;
+}
+
+//-----------------------------------------------------------------------------
+bool CrashAnalysisWriter::WriteLastPackets(const std::string& filename) const
+{
+  if (this->NbrPacketsToStore == 0)
+  {
+    return false;
+  }
+
+  // Copy the records first, as the receiving thread keeps reusing the slots.
+  // The slot following the last packet may be being overwritten, it is skipped
+  const uint64_t count = this->PacketCount.load(std::memory_order_acquire);
+  const uint64_t nbrPackets = std::min<uint64_t>(count, this->NbrPacketsToStore - 1);
+  std::vector<char> records;
+  records.reserve(static_cast<std::size_t>(nbrPackets) * SlotSize);
+  std::vector<std::size_t> recordEnds;
+  recordEnds.reserve(static_cast<std::size_t>(nbrPackets));
+  for (uint64_t index = count - nbrPackets; index < count; ++index)
+  {
+    const std::size_t slot = static_cast<std::size_t>(index % this->NbrPacketsToStore);
+    const std::size_t size = std::min<std::size_t>(this->RecordSizes[slot], SlotSize);
+    records.insert(records.end(), &this->Ring[slot * SlotSize], &this->Ring[slot * SlotSize] + size);
+    recordEnds.push_back(records.size());
+  }
+
+  // The packet of index i is overwritten by the one of index i + NbrPacketsToStore,
+  // which may have been written while copying. These records may be torn, and are
+  // dropped, the records being in the order of the packets
+  std::atomic_thread_fence(std::memory_order_acquire);
+  const uint64_t newCount = this->PacketCount.load(std::memory_order_relaxed);
+  std::size_t firstRecord = 0;
+  if (newCount >= count - nbrPackets + this->NbrPacketsToStore)
+  {
+    firstRecord = static_cast<std::size_t>(
+      std::min<uint64_t>(newCount - this->NbrPacketsToStore - (count - nbrPackets) + 1, nbrPackets));
+  }
+  const std::size_t firstByte = (firstRecord == 0) ? 0 : recordEnds[firstRecord - 1];
+
+  std::ofstream file(filename.c_str(), std::ios::binary | std::ios::trunc);
+  file.write(reinterpret_cast<const char*>(PcapGlobalHeader), sizeof(PcapGlobalHeader));
+  if (firstByte < records.size())
+  {
+    file.write(&records[firstByte], records.size() - firstByte);
+  }
+  file.close();
+  if (!file)
+  {
+    vtkGenericWarningMacro("Crash analysis failed to write the last packets to " << filename);
+    return false;
+  }
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+bool CrashAnalysisWriter::WriteRing(const char* filename, double maxDuration) const
+{
+  if (this->NbrPacketsToStore == 0)
+  {
+    return false;
+  }
+  const double deadline = MonotonicTime() + maxDuration;
+
+#ifdef _WIN32
+  const int fd = _open(filename, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, 0644);
+#else
+  const int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+  if (fd < 0)
+  {
+    return false;
+  }
+
+  bool isWritten = WriteAll(fd, reinterpret_cast<const char*>(PcapGlobalHeader), sizeof(PcapGlobalHeader));
+
+  // The slot following the last packet may be being overwritten by the
+  // receiving thread, it is skipped
+  const uint64_t count = this->PacketCount.load(std::memory_order_acquire);
+  const uint64_t nbrPackets = std::min<uint64_t>(count, this->NbrPacketsToStore - 1);
+  uint64_t index = count - nbrPackets;
+  while (isWritten && index < count)
+  {
+    if (maxDuration > 0 && MonotonicTime() > deadline)
+    {
+      break;
+    }
+
+#ifdef _WIN32
+    const std::size_t slot = static_cast<std::size_t>(index % this->NbrPacketsToStore);
+    isWritten = WriteAll(fd, &this->Ring[slot * SlotSize], this->RecordSizes[slot]);
+    ++index;
+#else
+    // Gather the records by groups, to bound the number of system calls
+    const int maxRecordsPerCall = 64;
+    struct iovec records[maxRecordsPerCall];
+    std::size_t nBytes = 0;
+    int nRecords = 0;
+    for (; nRecords < maxRecordsPerCall && index < count; ++nRecords, ++index)
+    {
+      const std::size_t slot = static_cast<std::size_t>(index % this->NbrPacketsToStore);
+      records[nRecords].iov_base = const_cast<char*>(&this->Ring[slot * SlotSize]);
+      records[nRecords].iov_len = this->RecordSizes[slot];
+      nBytes += this->RecordSizes[slot];
+    }
+    const ssize_t written = writev(fd, records, nRecords);
+    isWritten = written == static_cast<ssize_t>(nBytes);
+#endif
+  }
+
+#ifdef _WIN32
+  _close(fd);
+#else
+  close(fd);
+#endif
+  return isWritten;
+}
+
+//-----------------------------------------------------------------------------
+void CrashAnalysisWriter::FlushAllAnalyzers()
+{
+  // A call to std::terminate ends up raising SIGABRT, only write once
+  if (HasFlushed.exchange(true))
+  {
+    return;
+  }
+
+  for (int i = 0; i < MaxNumberOfAnalyzers; ++i)
+  {
+    const CrashAnalysisWriter* analyzer = Analyzers[i].load();
+    if (analyzer)
+    {
+      analyzer->WriteRing(analyzer->CrashFilename.c_str(), analyzer->MaxFlushDuration);
+    }
+  }
+}
+
+//-----------------------------------------------------------------------------
+void CrashAnalysisWriter::SignalHandler(int signal)
+{
+  FlushAllAnalyzers();
+
+  // Restore the previous handler and let it handle the signal
+  for (int i = 0; i < NumberOfHandledSignals; ++i)
+  {
+    if (HandledSignals[i] == signal)
+    {
+#ifdef _WIN32
+      std::signal(signal, PreviousSignalHandlers[i]);
+#else
+      sigaction(signal, &PreviousSignalHandlers[i], nullptr);
+#endif
+    }
+  }
+  std::raise(signal);
+}
+
+//-----------------------------------------------------------------------------
+void CrashAnalysisWriter::TerminateHandler()
+{
+  FlushAllAnalyzers();
+  if (PreviousTerminateHandler)
+  {
+    PreviousTerminateHandler();
+  }
+  std::abort();
+}
+
+//-----------------------------------------------------------------------------
+void CrashAnalysisWriter::InstallCrashHandlers()
+{
+  static std::atomic<bool> areInstalled{ false };
+  if (areInstalled.exchange(true))
+  {
+    return;
+  }
+
+  for (int i = 0; i < NumberOfHandledSignals; ++i)
+  {
+#ifdef _WIN32
+    PreviousSignalHandlers[i] = std::signal(HandledSignals[i], &CrashAnalysisWriter::SignalHandler);
+#else
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = &CrashAnalysisWriter::SignalHandler;
+    sigemptyset(&action.sa_mask);
+    sigaction(HandledSignals[i], &action, &PreviousSignalHandlers[i]);
+#endif
+  }
+  PreviousTerminateHandler = std::set_terminate(&CrashAnalysisWriter::TerminateHandler);
 }
 
 //-----------------------------------------------------------------------------
@@ -22,31 +22,51 @@
 #include "vtkPacketFileWriter.h"
 
 // STD
+#include <atomic>
+#include <cstdint>
 #include <string>
+#include <vector>
 
 /**
  * \class CrashAnalysisWriter
- * \brief This class is responsible to save as a .pcap file
- *        the last N packets received and remove the older ones.
- *        The idea is to generate a small .pcap to analyze when
- *        the software crashes in streaming mode
+ * \brief This class is responsible to keep in memory the last N packets
+ *        received, and to save them as a .pcap file when the software
+ *        crashes in streaming mode, or on request.
+ *        The packets are stored as ready to write pcap records in a ring
+ *        preallocated by SetNbrPacketsToStore, so that nothing is written on
+ *        the disk while receiving. On a fatal signal or a call to std::terminate,
+ *        the rings of all the started writers are written with async-signal-safe
+ *        calls, each one within MaxFlushDuration.
 */
 class CrashAnalysisWriter
 {
 public:
   // Default constructor
-  CrashAnalysisWriter() {this->PacketCount = 0;}
+  CrashAnalysisWriter() {}
+
+  ~CrashAnalysisWriter() { this->CloseAnalyzer(); }
 
   // Setters
-  void SetNbrPacketsToStore(unsigned int arg) {this->NbrPacketsToStore = arg;}
-  void SetFilename(const std::string& arg) {this->Filename = arg;}
+  // Allocate the ring, must not be called while packets are added
+  void SetNbrPacketsToStore(unsigned int arg);
+  void SetFilename(const std::string& arg);
+
+  // Maximum time in seconds spent writing the ring when crashing
+  void SetMaxFlushDuration(double arg) { this->MaxFlushDuration = arg; }
+
+  // Start watching for a crash, the ring will be written to Filename0.bin
+  void StartAnalyzer();
 
-  // Add a packet to the crash analyzer
-  void AddPacket(const std::string& packet);
+  // Add a packet to the crash analyzer, received at time (seconds since the epoch)
+  void AddPacket(const char* data, std::size_t numberOfBytes, double time);
 
-  // Close the pcap writer if it is opened
+  // Stop watching for a crash
   void CloseAnalyzer();
 
+  // Save the packets currently in the ring, without stopping the analyzer.
+  // The packets overwritten by the receiving thread while saving are dropped
+  bool WriteLastPackets(const std::string& filename) const;
+
   // Delete the logs files
   void DeleteLogFiles();
 
@@ -58,17 +78,32 @@ public:
 
 private:
   // Export file information
-  unsigned int NbrPacketsToStore = 5000;
+  unsigned int NbrPacketsToStore = 0;
   std::string Filename = "";
+  // File written when crashing, computed beforehand as nothing can be allocated then
+  std::string CrashFilename = "";
+  double MaxFlushDuration = 1.0;
+
+  // Ring of NbrPacketsToStore slots, each one holding a pcap record header,
+  // the network header and the payload of a packet
+  std::vector<char> Ring;
+  std::vector<uint32_t> RecordSizes;
+
+  // Number of packets added since the ring allocation
+  std::atomic<uint64_t> PacketCount{ 0 };
 
-  // Writer
-  vtkPacketFileWriter Writer;
+  bool IsStarted = false;
 
-  // Internal parameters
-  unsigned int PacketCount = 0;
-  unsigned int FileToStore = 0;
+  // Write the ring to a file with async-signal-safe calls only, when crashing.
+  // It is a best effort, the packets received meanwhile may tear their records
+  // @param maxDuration time in seconds after which the packets left are skipped, 0 for no limit
+  bool WriteRing(const char* filename, double maxDuration) const;
 
-  void WriteLastPacket(const std::string& packet);
+  // Called on a fatal signal or by std::terminate
+  static void FlushAllAnalyzers();
+  static void InstallCrashHandlers();
+  static void SignalHandler(int signal);
+  static void TerminateHandler();
 };
 
-#endif // CRASH_ANALYSING_H
\ No newline at end of file
+#endif // CRASH_ANALYSING_H
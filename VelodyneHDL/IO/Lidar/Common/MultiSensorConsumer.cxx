@@ -0,0 +1,555 @@
+//=========================================================================
+//
+// Copyright 2018 Kitware, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//=========================================================================
+
+// LOCAL
+#include "MultiSensorConsumer.h"
+#include "NetworkPacket.h"
+#include "PacketConsumer.h"
+#include "SharedFramePublisher.h"
+#include "StreamStatistics.h"
+#include "SynchronizedQueue.h"
+#include "vtkLidarPacketInterpreter.h"
+
+// VTK
+#include <vtkAppendPolyData.h>
+#include <vtkMath.h>
+#include <vtkPointData.h>
+#include <vtkPolyData.h>
+#include <vtkTransform.h>
+#include <vtkUnsignedCharArray.h>
+
+// BOOST
+#include <boost/asio/ip/address_v4.hpp>
+
+// STD
+#include <algorithm>
+#include <cmath>
+#include <set>
+
+namespace
+{
+//! Frames kept per sensor to be merged with the frames of the main sensor
+const size_t MaxFramesPerSensor = 4;
+//! Frames of the main sensor waiting for a late sensor before being merged without it
+const size_t MaxPendingFrames = 2;
+}
+
+//----------------------------------------------------------------------------
+//! A sensor, its interpreter and the packets it has not decoded yet
+struct MultiSensorConsumer::Sensor
+{
+  int Port = 0;
+  //! 0 to accept any address
+  uint32_t SourceAddress = 0;
+  std::string CalibrationFile;
+  vtkSmartPointer<vtkTransform> Extrinsics;
+  //! interpreter holding the calibration loaded from LoadedCalibrationFile
+  vtkSmartPointer<vtkLidarPacketInterpreter> Calibration;
+  std::string LoadedCalibrationFile;
+
+  vtkSmartPointer<vtkLidarPacketInterpreter> Interpreter;
+  //! modification time of the consumer interpreter when its configuration was copied
+  vtkMTimeType ConfigurationTime = 0;
+  double FrameDecodeStartTime = -1.0;
+
+  //! Hold this when accessing Packets or IsScheduled
+  boost::mutex PacketsMutex;
+  std::vector<NetworkPacket*> Packets;
+  //! whether the sensor is in ScheduledSensors or being decoded
+  bool IsScheduled = false;
+
+  //! last frames of the sensor, the most recent at the back. Hold FramesMutex.
+  std::deque<SensorFrame> Frames;
+};
+
+//----------------------------------------------------------------------------
+MultiSensorConsumer::MultiSensorConsumer()
+  : Interpreter(nullptr)
+  , NumberOfThreads(0)
+  , MergeFrames(false)
+  , MergeTolerance(0.05)
+{
+  this->Sensors.emplace_back(new Sensor);
+  this->Sensors[0]->Port = 2368;
+}
+
+//----------------------------------------------------------------------------
+MultiSensorConsumer::~MultiSensorConsumer()
+{
+  this->Stop();
+}
+
+//----------------------------------------------------------------------------
+int MultiSensorConsumer::GetMainPort() const
+{
+  return this->Sensors[0]->Port;
+}
+
+//----------------------------------------------------------------------------
+void MultiSensorConsumer::SetMainPort(int port)
+{
+  // the port is read by the network thread while the sensors are decoded
+  if (this->IsRunning())
+  {
+    return;
+  }
+  this->Sensors[0]->Port = port;
+}
+
+//----------------------------------------------------------------------------
+int MultiSensorConsumer::AddSensor(int port, const std::string& sourceAddress,
+  const std::string& calibrationFile, vtkTransform* extrinsics)
+{
+  // the sensors are used by the network and the decoding threads
+  if (this->IsRunning())
+  {
+    vtkGenericWarningMacro("A sensor can not be added while the sensors are decoded");
+    return -1;
+  }
+  std::unique_ptr<Sensor> sensor(new Sensor);
+  sensor->Port = port;
+  if (!sourceAddress.empty())
+  {
+    boost::system::error_code error;
+    const boost::asio::ip::address_v4 address =
+      boost::asio::ip::address_v4::from_string(sourceAddress, error);
+    if (error)
+    {
+      vtkGenericWarningMacro("Invalid sensor address: " << sourceAddress);
+      return -1;
+    }
+    sensor->SourceAddress = static_cast<uint32_t>(address.to_ulong());
+  }
+  sensor->CalibrationFile = calibrationFile;
+  if (extrinsics)
+  {
+    sensor->Extrinsics = vtkSmartPointer<vtkTransform>::New();
+    sensor->Extrinsics->DeepCopy(extrinsics);
+  }
+
+  this->Sensors.push_back(std::move(sensor));
+  return static_cast<int>(this->Sensors.size()) - 1;
+}
+
+//----------------------------------------------------------------------------
+void MultiSensorConsumer::RemoveAllSensors()
+{
+  if (this->IsRunning())
+  {
+    vtkGenericWarningMacro("The sensors can not be removed while they are decoded");
+    return;
+  }
+  this->Sensors.resize(1);
+}
+
+//----------------------------------------------------------------------------
+std::vector<int> MultiSensorConsumer::GetPorts() const
+{
+  std::set<int> ports;
+  for (const auto& sensor : this->Sensors)
+  {
+    ports.insert(sensor->Port);
+  }
+  return std::vector<int>(ports.begin(), ports.end());
+}
+
+//----------------------------------------------------------------------------
+bool MultiSensorConsumer::IsSensorPort(int port) const
+{
+  for (const auto& sensor : this->Sensors)
+  {
+    if (sensor->Port == port)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+//----------------------------------------------------------------------------
+int MultiSensorConsumer::FindSensor(int port, uint32_t sourceAddress) const
+{
+  int anyAddressSensor = -1;
+  for (size_t i = 0; i < this->Sensors.size(); ++i)
+  {
+    const Sensor& sensor = *this->Sensors[i];
+    if (sensor.Port != port)
+    {
+      continue;
+    }
+    if (sensor.SourceAddress == sourceAddress && sourceAddress != 0)
+    {
+      return static_cast<int>(i);
+    }
+    if (sensor.SourceAddress == 0 && anyAddressSensor < 0)
+    {
+      anyAddressSensor = static_cast<int>(i);
+    }
+  }
+  return anyAddressSensor;
+}
+
+//----------------------------------------------------------------------------
+void MultiSensorConsumer::SetNumberOfThreads(int nThreads)
+{
+  this->NumberOfThreads = std::max(0, nThreads);
+}
+
+//----------------------------------------------------------------------------
+bool MultiSensorConsumer::Start()
+{
+  if (this->IsRunning())
+  {
+    return true;
+  }
+  if (!this->Consumer || !this->Interpreter)
+  {
+    return false;
+  }
+
+  for (auto& sensor : this->Sensors)
+  {
+    sensor->Interpreter.TakeReference(this->Interpreter->NewInstance());
+    sensor->ConfigurationTime = 0;
+    sensor->FrameDecodeStartTime = -1.0;
+    sensor->IsScheduled = false;
+    sensor->Frames.clear();
+    if (!this->UpdateConfiguration(*sensor))
+    {
+      vtkGenericWarningMacro("Decoding several sensors is not supported by "
+        << this->Interpreter->GetClassName());
+      for (auto& other : this->Sensors)
+      {
+        other->Interpreter = nullptr;
+      }
+      return false;
+    }
+    sensor->Interpreter->ResetCurrentFrame();
+  }
+  this->PendingFrames.clear();
+
+  int nThreads = this->NumberOfThreads;
+  if (nThreads == 0)
+  {
+    nThreads = PacketConsumer::GetDefaultNumberOfDecodingThreads();
+  }
+  nThreads = std::max(1, std::min(nThreads, this->GetNumberOfSensors()));
+
+  this->ScheduledSensors.reset(new SynchronizedQueue<int>);
+  for (int i = 0; i < nThreads; ++i)
+  {
+    this->Threads.push_back(boost::shared_ptr<boost::thread>(
+      new boost::thread(boost::bind(&MultiSensorConsumer::ThreadLoop, this))));
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void MultiSensorConsumer::Stop()
+{
+  if (!this->IsRunning())
+  {
+    return;
+  }
+
+  this->ScheduledSensors->stopQueue();
+  for (size_t i = 0; i < this->Threads.size(); ++i)
+  {
+    this->Threads[i]->join();
+  }
+  this->Threads.clear();
+  this->ScheduledSensors.reset();
+
+  for (auto& sensor : this->Sensors)
+  {
+    for (NetworkPacket* packet : sensor->Packets)
+    {
+      delete packet;
+    }
+    sensor->Packets.clear();
+    sensor->IsScheduled = false;
+  }
+}
+
+//----------------------------------------------------------------------------
+void MultiSensorConsumer::Enqueue(NetworkPacket* packet)
+{
+  const int index = this->IsRunning() ? this->FindSensor(packet->Port, packet->SourceAddress) : -1;
+  if (index < 0)
+  {
+    delete packet;
+    return;
+  }
+
+  Sensor& sensor = *this->Sensors[index];
+  bool shouldSchedule = false;
+  {
+    boost::lock_guard<boost::mutex> lock(sensor.PacketsMutex);
+    sensor.Packets.push_back(packet);
+    shouldSchedule = !sensor.IsScheduled;
+    sensor.IsScheduled = true;
+  }
+  if (shouldSchedule)
+  {
+    this->ScheduledSensors->enqueue(index);
+  }
+}
+
+//----------------------------------------------------------------------------
+void MultiSensorConsumer::ThreadLoop()
+{
+  std::vector<NetworkPacket*> packets;
+  int index = 0;
+  while (this->ScheduledSensors->dequeue(index))
+  {
+    // No other thread handles this sensor until it is scheduled again
+    Sensor& sensor = *this->Sensors[index];
+    {
+      boost::lock_guard<boost::mutex> lock(sensor.PacketsMutex);
+      packets.swap(sensor.Packets);
+    }
+
+    this->UpdateConfiguration(sensor);
+    for (NetworkPacket* packet : packets)
+    {
+      this->DecodePacket(index, *packet);
+      delete packet;
+    }
+    packets.clear();
+
+    bool shouldSchedule = false;
+    {
+      boost::lock_guard<boost::mutex> lock(sensor.PacketsMutex);
+      shouldSchedule = !sensor.Packets.empty();
+      sensor.IsScheduled = shouldSchedule;
+    }
+    if (shouldSchedule)
+    {
+      // go to the back of the queue, so that the other sensors are not delayed
+      this->ScheduledSensors->enqueue(index);
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+bool MultiSensorConsumer::UpdateConfiguration(Sensor& sensor)
+{
+  // The settings edited by the user apply to all the sensors, only their
+  // calibration and their extrinsics are specific to each sensor
+  {
+    boost::lock_guard<boost::mutex> lock(this->Consumer->ReaderMutex);
+    const vtkMTimeType configurationTime = this->Interpreter->GetMTime();
+    if (configurationTime == sensor.ConfigurationTime)
+    {
+      return true;
+    }
+    if (!sensor.Interpreter->CopyConfiguration(this->Interpreter))
+    {
+      return false;
+    }
+    sensor.ConfigurationTime = configurationTime;
+  }
+
+  if (!sensor.CalibrationFile.empty())
+  {
+    // the file is only parsed when it changes, a cropping or a transform
+    // edited afterwards only restores the calibration already loaded
+    if (!sensor.Calibration || sensor.LoadedCalibrationFile != sensor.CalibrationFile)
+    {
+      sensor.Calibration.TakeReference(sensor.Interpreter->NewInstance());
+      sensor.Calibration->LoadCalibration(sensor.CalibrationFile);
+      sensor.LoadedCalibrationFile = sensor.CalibrationFile;
+    }
+    if (!sensor.Interpreter->CopyCalibration(sensor.Calibration))
+    {
+      sensor.Interpreter->LoadCalibration(sensor.CalibrationFile);
+    }
+  }
+  if (sensor.Extrinsics)
+  {
+    // each interpreter has its own copy, vtkTransform::Update is not thread safe
+    auto transform = vtkSmartPointer<vtkTransform>::New();
+    transform->DeepCopy(sensor.Extrinsics);
+    sensor.Interpreter->SetSensorTransform(transform);
+    sensor.Interpreter->SetApplyTransform(true);
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void MultiSensorConsumer::DecodePacket(int sensorIndex, const NetworkPacket& packet)
+{
+  Sensor& sensor = *this->Sensors[sensorIndex];
+  vtkLidarPacketInterpreter* interpreter = sensor.Interpreter;
+  std::shared_ptr<StreamStatistics> statistics = this->Consumer->GetStatistics();
+
+  const double decodeStartTime = StreamStatistics::Now();
+  statistics->AddLatency(StreamStatistics::ReceiveToDecode, decodeStartTime - packet.ReceptionTime);
+  if (!interpreter->IsLidarPacket(packet.GetData(), packet.GetLength()))
+  {
+    statistics->MalformedPackets.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  if (sensor.FrameDecodeStartTime < 0)
+  {
+    sensor.FrameDecodeStartTime = decodeStartTime;
+  }
+
+  interpreter->ProcessPacket(packet.GetData(), packet.GetLength());
+  if (interpreter->IsNewFrameReady())
+  {
+    const double splitTime = StreamStatistics::Now();
+    statistics->AddLatency(
+      StreamStatistics::DecodeToSplit, splitTime - sensor.FrameDecodeStartTime);
+    // the next frame starts within this packet
+    sensor.FrameDecodeStartTime = splitTime;
+
+    SensorFrame frame;
+    frame.Frame = interpreter->GetLastFrameAvailable();
+    frame.Time = packet.Timestamp;
+    frame.SplitTime = splitTime;
+    frame.ReceptionTime = packet.ReceptionTime;
+    interpreter->ClearAllFramesAvailable();
+    this->AddSensorFrame(sensorIndex, frame);
+  }
+}
+
+//----------------------------------------------------------------------------
+void MultiSensorConsumer::AddSensorFrame(int sensorIndex, const SensorFrame& frame)
+{
+  // Unless merged, the frames of the other sensors never reach the consumer,
+  // which publishes the ones of the main sensor
+  std::shared_ptr<SharedFramePublisher> publisher = this->Consumer->GetPublisher();
+  if (publisher && sensorIndex != 0 && !this->MergeFrames)
+  {
+    publisher->Publish(frame.Frame, static_cast<uint32_t>(sensorIndex), frame.Time,
+      frame.ReceptionTime);
+  }
+
+  boost::lock_guard<boost::mutex> lock(this->FramesMutex);
+  std::deque<SensorFrame>& frames = this->Sensors[sensorIndex]->Frames;
+  frames.push_back(frame);
+  if (frames.size() > MaxFramesPerSensor)
+  {
+    frames.pop_front();
+  }
+
+  if (!this->MergeFrames || this->Sensors.size() == 1)
+  {
+    if (sensorIndex == 0)
+    {
+      this->Consumer->AddFrame(frame.Frame, frame.Time, frame.SplitTime, frame.ReceptionTime);
+    }
+    return;
+  }
+
+  if (sensorIndex == 0)
+  {
+    this->PendingFrames.push_back(frame);
+  }
+  this->MergePendingFrames(this->PendingFrames.size() > MaxPendingFrames);
+}
+
+//----------------------------------------------------------------------------
+void MultiSensorConsumer::MergePendingFrames(bool force)
+{
+  while (!this->PendingFrames.empty())
+  {
+    const SensorFrame& mainFrame = this->PendingFrames.front();
+
+    // The closest frame of a sensor is known once it has a frame past the main one
+    bool isComplete = true;
+    for (size_t i = 1; i < this->Sensors.size() && isComplete; ++i)
+    {
+      const std::deque<SensorFrame>& frames = this->Sensors[i]->Frames;
+      isComplete = !frames.empty() && frames.back().Time >= mainFrame.Time;
+    }
+    if (!isComplete && !force)
+    {
+      return;
+    }
+
+    vtkSmartPointer<vtkPolyData> merged = this->MergeFrame(mainFrame);
+    this->Consumer->AddFrame(
+      merged, mainFrame.Time, mainFrame.SplitTime, mainFrame.ReceptionTime);
+    this->PendingFrames.pop_front();
+    force = this->PendingFrames.size() > MaxPendingFrames;
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkSmartPointer<vtkPolyData> MultiSensorConsumer::MergeFrame(const SensorFrame& mainFrame)
+{
+  auto append = vtkSmartPointer<vtkAppendPolyData>::New();
+  for (size_t i = 0; i < this->Sensors.size(); ++i)
+  {
+    const SensorFrame* closest = i == 0 ? &mainFrame : nullptr;
+    for (const SensorFrame& frame : this->Sensors[i]->Frames)
+    {
+      if (i != 0 && std::abs(frame.Time - mainFrame.Time) <= this->MergeTolerance &&
+        (!closest || std::abs(frame.Time - mainFrame.Time) < std::abs(closest->Time - mainFrame.Time)))
+      {
+        closest = &frame;
+      }
+    }
+    if (!closest || !closest->Frame)
+    {
+      continue;
+    }
+
+    // The frames of the sensors are shared, the array is added to a shallow copy
+    auto part = vtkSmartPointer<vtkPolyData>::New();
+    part->ShallowCopy(closest->Frame);
+    auto sensorArray = vtkSmartPointer<vtkUnsignedCharArray>::New();
+    sensorArray->SetName("sensor");
+    sensorArray->SetNumberOfTuples(part->GetNumberOfPoints());
+    sensorArray->FillComponent(0, static_cast<double>(i));
+    part->GetPointData()->AddArray(sensorArray);
+    append->AddInputData(part);
+  }
+  append->Update();
+  return vtkSmartPointer<vtkPolyData>(append->GetOutput());
+}
+
+//----------------------------------------------------------------------------
+vtkSmartPointer<vtkPolyData> MultiSensorConsumer::GetSensorFrame(int sensor, double& time)
+{
+  if (sensor < 0 || sensor >= this->GetNumberOfSensors())
+  {
+    return nullptr;
+  }
+  boost::lock_guard<boost::mutex> lock(this->FramesMutex);
+  const std::deque<SensorFrame>& frames = this->Sensors[sensor]->Frames;
+  if (frames.empty())
+  {
+    return nullptr;
+  }
+  time = frames.back().Time;
+  return frames.back().Frame;
+}
+
+//----------------------------------------------------------------------------
+unsigned int MultiSensorConsumer::GetPacketQueueSize()
+{
+  unsigned int size = 0;
+  for (auto& sensor : this->Sensors)
+  {
+    boost::lock_guard<boost::mutex> lock(sensor->PacketsMutex);
+    size += static_cast<unsigned int>(sensor->Packets.size());
+  }
+  return size;
+}
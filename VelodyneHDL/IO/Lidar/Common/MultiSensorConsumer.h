@@ -0,0 +1,224 @@
+//=========================================================================
+//
+// Copyright 2018 Kitware, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//=========================================================================
+
+#ifndef MULTI_SENSOR_CONSUMER_H
+#define MULTI_SENSOR_CONSUMER_H
+
+// VTK
+#include <vtkSmartPointer.h>
+
+// BOOST
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+// STD
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+template<typename T>
+class SynchronizedQueue;
+class NetworkPacket;
+class PacketConsumer;
+class vtkLidarPacketInterpreter;
+class vtkPolyData;
+class vtkTransform;
+
+/**
+ * \class MultiSensorConsumer
+ * \brief Decodes the packets of several sensors of the same model received by one
+ *        NetworkSource, each sensor being identified by the port and the source address
+ *        of its packets.
+ *
+ *        Each sensor owns a copy of the interpreter of the PacketConsumer, with its own
+ *        calibration and extrinsics. The packets are decoded by a pool of threads shared
+ *        by all the sensors: a sensor is handled by at most one thread at a time, so that
+ *        its packets are decoded in order, and a thread goes on with the next sensor
+ *        having packets waiting.
+ *
+ *        The frames are handed over to the PacketConsumer, which caches them as its own.
+ *        By default these are the frames of the main sensor (sensor 0). When merging, each
+ *        frame of the main sensor is combined with the closest frame of each other sensor,
+ *        expressed in the common frame given by the extrinsics of each sensor.
+ */
+class MultiSensorConsumer
+{
+public:
+  MultiSensorConsumer();
+
+  ~MultiSensorConsumer();
+
+  /**
+   * @brief SetConsumer set the consumer whose interpreter is copied for each sensor,
+   * and to which the frames are handed over
+   */
+  void SetConsumer(std::shared_ptr<PacketConsumer> consumer) { this->Consumer = consumer; }
+
+  void SetInterpreter(vtkLidarPacketInterpreter* interpreter) { this->Interpreter = interpreter; }
+
+  //! Port of the main sensor, whose packets are decoded with the interpreter as is.
+  //! It can not be changed while running.
+  int GetMainPort() const;
+  void SetMainPort(int port);
+
+  /**
+   * @brief AddSensor add a sensor to the main one
+   * @param port destination port of the packets of the sensor
+   * @param sourceAddress IPv4 address of the sensor, empty to accept any address. Several
+   *        sensors can share a port if they have different addresses.
+   * @param calibrationFile calibration of the sensor, empty to use the one of the interpreter
+   * @param extrinsics pose of the sensor in the common frame, null to use the sensor
+   *        transform of the interpreter. It is copied.
+   * @return index of the sensor, -1 if the address is not valid or if running
+   * @warning only taken into account by the next call to Start, and refused while
+   *          running as the sensors are used by the decoding and the network threads
+   */
+  int AddSensor(int port, const std::string& sourceAddress, const std::string& calibrationFile,
+    vtkTransform* extrinsics);
+
+  //! Remove the sensors added to the main one, refused while running
+  void RemoveAllSensors();
+
+  //! Number of sensors, including the main one
+  int GetNumberOfSensors() const { return static_cast<int>(this->Sensors.size()); }
+
+  //! Ports the sensors are listening to, without duplicates
+  std::vector<int> GetPorts() const;
+
+  bool IsSensorPort(int port) const;
+
+  /**
+   * @brief FindSensor return the sensor the packets of a given origin belong to.
+   * A sensor with this very address is prefered to one accepting any address.
+   * @param port destination port of the packet
+   * @param sourceAddress IPv4 address of the sender, in host byte order
+   * @return index of the sensor, -1 if none
+   */
+  int FindSensor(int port, uint32_t sourceAddress) const;
+
+  /**
+   * @brief SetNumberOfThreads set the number of threads decoding the packets of all the
+   * sensors. There is no use for more threads than sensors.
+   * @param nThreads number of threads, 0 selects it from the number of cores
+   * @warning only taken into account by the next call to Start
+   */
+  void SetNumberOfThreads(int nThreads);
+  int GetNumberOfThreads() const { return this->NumberOfThreads; }
+
+  /**
+   * @brief SetMergeFrames combine the frames of all the sensors in a single frame, with
+   * a "sensor" point array holding the index of the sensor of each point
+   */
+  void SetMergeFrames(bool value) { this->MergeFrames = value; }
+  bool GetMergeFrames() const { return this->MergeFrames; }
+
+  /**
+   * @brief SetMergeTolerance set the largest time difference in seconds between a frame
+   * of the main sensor and the frames merged with it. A sensor without frame close enough
+   * is missing from the merged frame.
+   */
+  void SetMergeTolerance(double seconds) { this->MergeTolerance = seconds; }
+  double GetMergeTolerance() const { return this->MergeTolerance; }
+
+  /**
+   * @brief Start create the interpreter of each sensor and start the decoding threads
+   * @return false if the interpreter does not support CopyConfiguration
+   */
+  bool Start();
+
+  void Stop();
+
+  bool IsRunning() const { return !this->Threads.empty(); }
+
+  /**
+   * @brief Enqueue hand over a packet to the sensor it comes from
+   * @param packet the packet received, whose ownership is taken. It is deleted
+   * if it does not belong to any sensor.
+   */
+  void Enqueue(NetworkPacket* packet);
+
+  /**
+   * @brief GetSensorFrame return the last frame of a sensor, in the common frame
+   * @param sensor index of the sensor
+   * @param time[out] time of the frame
+   * @return null if the sensor has no frame yet
+   */
+  vtkSmartPointer<vtkPolyData> GetSensorFrame(int sensor, double& time);
+
+  //! Number of packets waiting to be decoded, for all the sensors
+  unsigned int GetPacketQueueSize();
+
+private:
+  struct Sensor;
+
+  //! A frame of a sensor, kept until it can no longer be merged
+  struct SensorFrame
+  {
+    vtkSmartPointer<vtkPolyData> Frame;
+    double Time;
+    double SplitTime;
+    double ReceptionTime;
+  };
+
+  void ThreadLoop();
+
+  /**
+   * @brief UpdateConfiguration copy the configuration of the interpreter of the consumer
+   * to the one of a sensor if it changed, then apply the calibration and the extrinsics
+   * of the sensor, its calibration file being only parsed again if it changed
+   * @return false if the interpreter does not support CopyConfiguration
+   */
+  bool UpdateConfiguration(Sensor& sensor);
+
+  void DecodePacket(int sensorIndex, const NetworkPacket& packet);
+
+  /**
+   * @brief AddSensorFrame record a new frame of a sensor, and hand over to the consumer
+   * the frames which are now complete
+   */
+  void AddSensorFrame(int sensorIndex, const SensorFrame& frame);
+
+  //! Merge the pending frames of the main sensor whose other sensors are known
+  void MergePendingFrames(bool force);
+
+  //! Combine a frame of the main sensor with the closest frames of the other sensors
+  vtkSmartPointer<vtkPolyData> MergeFrame(const SensorFrame& mainFrame);
+
+  std::shared_ptr<PacketConsumer> Consumer;
+  vtkLidarPacketInterpreter* Interpreter;
+
+  //! Sensor 0 is the main one
+  std::vector<std::unique_ptr<Sensor> > Sensors;
+
+  int NumberOfThreads;
+  bool MergeFrames;
+  double MergeTolerance;
+
+  //! Index of each sensor having packets waiting and no thread decoding them
+  boost::shared_ptr<SynchronizedQueue<int> > ScheduledSensors;
+  std::vector<boost::shared_ptr<boost::thread> > Threads;
+
+  //! Hold this when accessing the frames of the sensors
+  boost::mutex FramesMutex;
+
+  //! Frames of the main sensor waiting for the frames of the other ones
+  std::deque<SensorFrame> PendingFrames;
+};
+
+#endif // MULTI_SENSOR_CONSUMER_H
@@ -0,0 +1,58 @@
+//=========================================================================
+//
+// Copyright 2018 Kitware, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//=========================================================================
+
+#ifndef NETWORK_PACKET_H
+#define NETWORK_PACKET_H
+
+// STD
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * \class NetworkPacket
+ * \brief A datagram received by a PacketReceiver, along with when and where
+ *        it was received. It goes through NetworkSource to the consumer and the writer.
+ */
+class NetworkPacket
+{
+public:
+  NetworkPacket(const char* data, std::size_t numberOfBytes, double receptionTime,
+    double timestamp, int port, uint32_t sourceAddress = 0)
+    : Data(data, numberOfBytes)
+    , ReceptionTime(receptionTime)
+    , Timestamp(timestamp)
+    , Port(port)
+    , SourceAddress(sourceAddress)
+  {
+  }
+
+  const unsigned char* GetData() const
+  {
+    return reinterpret_cast<const unsigned char*>(this->Data.c_str());
+  }
+
+  unsigned int GetLength() const { return static_cast<unsigned int>(this->Data.length()); }
+
+  std::string Data;       /*!< Payload of the datagram */
+  double ReceptionTime;   /*!< Time the datagram was received, see StreamStatistics::Now */
+  double Timestamp;       /*!< Same time in seconds since the epoch, written in the recordings */
+  int Port;               /*!< Port the datagram was received on */
+  uint32_t SourceAddress; /*!< IPv4 address of the sender in host byte order, 0 if unknown */
+};
+
+#endif // NETWORK_PACKET_H
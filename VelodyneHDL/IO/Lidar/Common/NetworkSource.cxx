@@ -17,6 +17,8 @@
 
 // LOCAL
 #include "NetworkSource.h"
+#include "MultiSensorConsumer.h"
+#include "NetworkPacket.h"
 #include "vtkPacketFileWriter.h"
 #include "PacketReceiver.h"
 #include "PacketFileWriter.h"
@@ -39,22 +41,30 @@ NetworkSource::~NetworkSource()
 }
 
 //-----------------------------------------------------------------------------
-void NetworkSource::QueuePackets(std::string *packet)
+void NetworkSource::QueuePackets(NetworkPacket* packet)
 {
-  std::string* packet2 = 0;
+  // The position packets are only useful to the writer
+  const bool isForSensors = this->Sensors && this->Sensors->IsSensorPort(packet->Port);
+  const bool isForConsumer =
+    !isForSensors && this->Consumer && packet->Port == this->LIDARPort;
+
   if (this->Writer)
   {
-    packet2 = new std::string(*packet);
+    this->Writer->Enqueue(
+      (isForSensors || isForConsumer) ? new NetworkPacket(*packet) : packet);
   }
 
-  if (this->Consumer)
+  if (isForSensors)
+  {
+    this->Sensors->Enqueue(packet);
+  }
+  else if (isForConsumer)
   {
     this->Consumer->Enqueue(packet);
   }
-
-  if (this->Writer)
+  else if (!this->Writer)
   {
-    this->Writer->Enqueue(packet2);
+    delete packet;
   }
 }
 
@@ -72,10 +82,35 @@ void NetworkSource::Start()
   this->LIDARPortReceiver = boost::shared_ptr<PacketReceiver>(new PacketReceiver(
     this->IOService, LIDARPort, ForwardedLIDARPort, ForwardedIpAddress, IsForwarding, this));
 
+  this->LIDARPortReceiver->SetReceiveBufferSize(this->ReceiveBufferSize);
+  this->LIDARPortReceiver->SetReceiveBatchSize(this->ReceiveBatchSize);
+  this->LIDARPortReceiver->SetTimestampMode(this->TimestampMode);
+
   if (this->ListenGPS)
   {
     this->PositionPortReceiver = boost::shared_ptr<PacketReceiver>(new PacketReceiver(
       this->IOService, GPSPort, ForwardedGPSPort, ForwardedIpAddress, IsForwarding, this));
+    this->PositionPortReceiver->SetReceiveBufferSize(this->ReceiveBufferSize);
+    this->PositionPortReceiver->SetReceiveBatchSize(this->ReceiveBatchSize);
+    this->PositionPortReceiver->SetTimestampMode(this->TimestampMode);
+  }
+
+  this->SensorPortReceivers.clear();
+  if (this->Sensors)
+  {
+    for (int port : this->Sensors->GetPorts())
+    {
+      if (port == this->LIDARPort || (this->ListenGPS && port == this->GPSPort))
+      {
+        continue;
+      }
+      boost::shared_ptr<PacketReceiver> receiver(
+        new PacketReceiver(this->IOService, port, 0, "", false, this));
+      receiver->SetReceiveBufferSize(this->ReceiveBufferSize);
+      receiver->SetReceiveBatchSize(this->ReceiveBatchSize);
+      receiver->SetTimestampMode(this->TimestampMode);
+      this->SensorPortReceivers.push_back(receiver);
+    }
   }
 
   if (this->IsCrashAnalysing)
@@ -122,6 +157,10 @@ void NetworkSource::Start()
   {
       this->PositionPortReceiver->StartReceive();
   }
+  for (size_t i = 0; i < this->SensorPortReceivers.size(); ++i)
+  {
+    this->SensorPortReceivers[i]->StartReceive();
+  }
 }
 
 //-----------------------------------------------------------------------------
@@ -133,4 +172,58 @@ void NetworkSource::Stop()
   {
     this->PositionPortReceiver.reset();
   }
+  this->SensorPortReceivers.clear();
+}
+
+//-----------------------------------------------------------------------------
+bool NetworkSource::SaveLastPackets(const std::string& filename)
+{
+  if (!this->LIDARPortReceiver)
+  {
+    return false;
+  }
+
+  if (this->PositionPortReceiver)
+  {
+    boost::filesystem::path gpsFilename(filename);
+    gpsFilename.replace_extension();
+    gpsFilename += "_GPS";
+    gpsFilename += boost::filesystem::path(filename).extension();
+    this->PositionPortReceiver->SaveLastPackets(gpsFilename.string());
+  }
+  return this->LIDARPortReceiver->SaveLastPackets(filename);
+}
+
+//-----------------------------------------------------------------------------
+unsigned int NetworkSource::GetKernelDropCount() const
+{
+  unsigned int count = 0;
+  if (this->LIDARPortReceiver)
+  {
+    count += this->LIDARPortReceiver->GetKernelDropCount();
+  }
+  if (this->PositionPortReceiver)
+  {
+    count += this->PositionPortReceiver->GetKernelDropCount();
+  }
+  for (size_t i = 0; i < this->SensorPortReceivers.size(); ++i)
+  {
+    count += this->SensorPortReceivers[i]->GetKernelDropCount();
+  }
+  return count;
+}
+
+//-----------------------------------------------------------------------------
+unsigned int NetworkSource::GetForwardDropCount() const
+{
+  unsigned int count = 0;
+  if (this->LIDARPortReceiver)
+  {
+    count += this->LIDARPortReceiver->GetForwardDropCount();
+  }
+  if (this->PositionPortReceiver)
+  {
+    count += this->PositionPortReceiver->GetForwardDropCount();
+  }
+  return count;
 }
@@ -35,17 +35,21 @@
 
 #include <deque>
 #include <queue>
+#include <vector>
 
+class MultiSensorConsumer;
+class NetworkPacket;
 class PacketConsumer;
 class PacketReceiver;
 class PacketFileWriter;
+class StreamStatistics;
 /**
 * \class PacketReceiver
 * \brief This class is responsible for the IOService and  two PacketReceiver classes
 * @param _consumer boost::shared_ptr<PacketConsumer>
 * @param argLIDARPort The used port to receive the LIDAR information
 * @param ForwardedLIDARPort_ The port which will receive the lidar forwarded packets
-* @param ForwardedIpAddress_ The ip which will receive the forwarded packets
+* @param ForwardedIpAddress_ The ips which will receive the forwarded packets
 * @param isForwarding_ Allow the forwarding
 */
 class NetworkSource
@@ -59,6 +63,9 @@ public:
     , ForwardedIpAddress(ForwardedIpAddress_)
     , IsForwarding(isForwarding_)
     , IsCrashAnalysing(isCrashAnalysing_)
+    , ReceiveBatchSize(64)
+    , ReceiveBufferSize(16 * 1024 * 1024)
+    , TimestampMode(1) // PacketReceiver::Kernel
     , IOService()
     , Thread()
     , LIDARPortReceiver()
@@ -71,21 +78,49 @@ public:
 
   ~NetworkSource();
 
-  void QueuePackets(std::string* packet);
+  /**
+   * @brief QueuePackets hand over a received packet to the writer, and to the
+   * consumer if it was received on the LIDAR port. With several sensors, the
+   * packets of all of them are handed over to Sensors instead of the consumer.
+   * @param packet the packet received, whose ownership is taken
+   */
+  void QueuePackets(NetworkPacket* packet);
 
   void Start();
 
   void Stop();
 
+  /**
+   * @brief SaveLastPackets write the packets kept for crash analysis, without
+   * waiting for a crash. The GPS packets are written next to the LIDAR ones,
+   * with a _GPS suffix.
+   * @param filename the name of the output pcap file for the LIDAR packets
+   * @return true if the LIDAR packets were written
+   */
+  bool SaveLastPackets(const std::string& filename);
+
+  /**
+   * @copydoc PacketReceiver::GetKernelDropCount
+   */
+  unsigned int GetKernelDropCount() const;
+
+  /**
+   * @copydoc PacketReceiver::GetForwardDropCount
+   */
+  unsigned int GetForwardDropCount() const;
+
   //! @todo currently evrything is public, but it should be private
   int LIDARPort;                  /*!< The port to receive LIDAR information. Default is 2368 */
   bool ListenGPS;
   int GPSPort;                    /*!< The port to receive GPS information. Default is 8308 */
   int ForwardedLIDARPort;         /*!< The port to send LIDAR forwarded packets*/
   int ForwardedGPSPort;           /*!< The port to send GPS forwarded packets*/
-  std::string ForwardedIpAddress; /*!< The ip to send forwarded packets*/
+  std::string ForwardedIpAddress; /*!< Comma separated list of unicast or multicast ips to send forwarded packets*/
   bool IsForwarding;              /*!< Allowing the forwarding of the packets*/
   bool IsCrashAnalysing;
+  unsigned int ReceiveBatchSize;  /*!< Datagrams drained per recvmmsg call (Linux only), 0 receives them one by one */
+  int ReceiveBufferSize;          /*!< Requested socket receive buffer in bytes, 0 keeps the system default */
+  int TimestampMode;              /*!< Source of the packet arrival times, see PacketReceiver::TIMESTAMP_MODE */
 
   boost::asio::io_service IOService; /*!< The in/out service which will handle the Packets */
   boost::shared_ptr<boost::thread> Thread;
@@ -96,9 +131,19 @@ public:
   boost::shared_ptr<PacketReceiver>
     PositionPortReceiver; /*!< The PacketReceiver configured to receive GPS information */
 
+  /*!< The PacketReceivers of the ports of Sensors other than the LIDAR and GPS ones.
+   *   They are not forwarded nor saved for crash analysis. */
+  std::vector<boost::shared_ptr<PacketReceiver> > SensorPortReceivers;
+
   std::shared_ptr<PacketConsumer> Consumer;
   std::shared_ptr<PacketFileWriter> Writer;
 
+  //! Decodes the packets when listening to several sensors, null otherwise
+  std::shared_ptr<MultiSensorConsumer> Sensors;
+
+  //! Counters updated by the receivers, may be null
+  std::shared_ptr<StreamStatistics> Statistics;
+
   boost::asio::io_service::work* DummyWork;
 };
 
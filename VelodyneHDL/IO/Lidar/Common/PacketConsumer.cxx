@@ -1,28 +1,102 @@
 #include "PacketConsumer.h"
 
+#include "NetworkPacket.h"
+#include "SharedFramePublisher.h"
+#include "StreamStatistics.h"
 #include "SynchronizedQueue.h"
-#include "vtkAppendPolyData.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace
+{
+//! Smallest interval between the times of two frames, in seconds
+const double MinFrameInterval = 1e-6;
+}
+
+//----------------------------------------------------------------------------
+//! Packets of one frame, from the one where the frame starts to the one where the next starts
+struct PacketConsumer::FrameShard
+{
+  size_t SequenceNumber = 0;
+  //! offset of the first firing of the frame in the first packet
+  int FirstFramePositionInPacket = 0;
+  //! the packet holding a frame boundary is shared by the two frames
+  std::vector<boost::shared_ptr<NetworkPacket> > Packets;
+  //! memory used by the packets
+  size_t NumberOfBytes = 0;
+  //! when the frame was split by the decoding worker
+  double SplitTime = 0;
+
+  void AddPacket(const boost::shared_ptr<NetworkPacket>& packet)
+  {
+    this->Packets.push_back(packet);
+    this->NumberOfBytes += sizeof(NetworkPacket) + packet->Data.capacity();
+  }
+};
+
+//----------------------------------------------------------------------------
+//! A decoding thread and the interpreter it owns
+struct PacketConsumer::DecodingWorker
+{
+  vtkSmartPointer<vtkLidarPacketInterpreter> Interpreter;
+  //! modification time of the consumer interpreter when its configuration was copied
+  vtkMTimeType ConfigurationTime = 0;
+  boost::shared_ptr<boost::thread> Thread;
+};
 
 //----------------------------------------------------------------------------
 PacketConsumer::PacketConsumer()
 {
+  this->NumberOfDecodingThreads = 0;
+  this->NextShardSequenceNumber = 0;
+  this->NextSequenceNumberToPublish = 0;
   this->NewData = false;
   this->ShouldCheckSensor = true;
   this->MaxNumberOfFrames = 1000;
+  this->MaxNumberOfBytes = 0;
+  this->NumberOfBytes = 0;
+  this->FirstFrameId = 0;
+  this->CacheMode = CACHE_MODE::DecodedFrames;
+  this->MaxNumberOfDecodedFrames = 16;
+  this->CacheInterpreterConfigurationTime = 0;
   this->LastTime = 0.0;
-  this->Timesteps.clear();
+  this->FrameDecodeStartTime = -1.0;
+  this->NumberOfTrailingFrames = 0;
+  this->Statistics.reset(new StreamStatistics);
   this->Frames.clear();
-  this->Packets.reset(new SynchronizedQueue<std::string*>);
+  this->Packets.reset(new SynchronizedQueue<NetworkPacket*>);
 }
 
 //----------------------------------------------------------------------------
-void PacketConsumer::HandleSensorData(const unsigned char *data, unsigned int length)
+void PacketConsumer::HandleSensorData(const NetworkPacket& packet)
 {
+  const double decodeStartTime = StreamStatistics::Now();
+  this->Statistics->AddLatency(
+    StreamStatistics::ReceiveToDecode, decodeStartTime - packet.ReceptionTime);
+
   boost::lock_guard<boost::mutex> lock(this->ReaderMutex);
-  this->Interpreter->ProcessPacket(data, length);
+  if (!this->Interpreter->IsLidarPacket(packet.GetData(), packet.GetLength()))
+  {
+    this->Statistics->MalformedPackets.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  if (this->FrameDecodeStartTime < 0)
+  {
+    this->FrameDecodeStartTime = decodeStartTime;
+  }
+
+  this->Interpreter->ProcessPacket(packet.GetData(), packet.GetLength());
   if (this->Interpreter->IsNewFrameReady())
   {
-    this->HandleNewData(this->Interpreter->GetLastFrameAvailable());
+    const double splitTime = StreamStatistics::Now();
+    this->Statistics->AddLatency(
+      StreamStatistics::DecodeToSplit, splitTime - this->FrameDecodeStartTime);
+    // the next frame starts within this packet
+    this->FrameDecodeStartTime = splitTime;
+
+    this->HandleNewData(this->Interpreter->GetLastFrameAvailable(), packet.Timestamp, splitTime,
+      packet.ReceptionTime);
     this->Interpreter->ClearAllFramesAvailable();
   }
 }
@@ -31,24 +105,33 @@ void PacketConsumer::HandleSensorData(const unsigned char *data, unsigned int le
 vtkSmartPointer<vtkPolyData> PacketConsumer::GetFrameForTime(double timeRequest, double &actualTime, int numberOfTrailingFrames)
 {
   size_t stepIndex = this->GetIndexForTime(timeRequest);
-  if (stepIndex < this->Timesteps.size())
+  if (stepIndex < this->Frames.size())
   {
-    actualTime = this->Timesteps[stepIndex];
-    if(numberOfTrailingFrames == 0)
+    FrameEntry& entry = this->Frames[stepIndex];
+    actualTime = entry.Time;
+    if (!entry.IsPublished)
+    {
+      const double publishTime = StreamStatistics::Now();
+      this->Statistics->AddLatency(
+        StreamStatistics::SplitToPublish, publishTime - entry.SplitTime);
+      this->Statistics->AddLatency(
+        StreamStatistics::ReceiveToPublish, publishTime - entry.ReceptionTime);
+      this->Statistics->FramesPublished.fetch_add(1, std::memory_order_relaxed);
+      entry.IsPublished = true;
+    }
+
+    if(numberOfTrailingFrames <= 0)
     {
-      return this->Frames[stepIndex];
+      return this->GetFrame(stepIndex);
     }
     else
     {
-      vtkSmartPointer<vtkAppendPolyData> appendFilter = vtkSmartPointer<vtkAppendPolyData>::New();
-      for (size_t i = stepIndex - std::min(stepIndex, static_cast<size_t>(numberOfTrailingFrames));
-           i < stepIndex; ++i)
-      {
-        appendFilter->AddInputData(this->Frames[i]);
-      }
-
-      appendFilter->Update();
-      return vtkSmartPointer<vtkPolyData>(appendFilter->GetOutput());
+      // the requested frame and the previous ones
+      const size_t firstIndex =
+        stepIndex - std::min(stepIndex, static_cast<size_t>(numberOfTrailingFrames));
+      return this->TrailingFrames.Update(this->FirstFrameId + firstIndex,
+        this->FirstFrameId + stepIndex + 1,
+        [this](size_t frameId) { return this->GetFrame(frameId - this->FirstFrameId); });
     }
   }
   actualTime = 0;
@@ -59,21 +142,96 @@ vtkSmartPointer<vtkPolyData> PacketConsumer::GetFrameForTime(double timeRequest,
 std::vector<double> PacketConsumer::GetTimesteps()
 {
   boost::lock_guard<boost::mutex> lock(this->ConsumerMutex);
-  const size_t nTimesteps = this->Timesteps.size();
+  const size_t nTimesteps = this->Frames.size();
   std::vector<double> timesteps(nTimesteps, 0);
   for (size_t i = 0; i < nTimesteps; ++i)
   {
-    timesteps[i] = this->Timesteps[i];
+    timesteps[i] = this->Frames[i].Time;
   }
   return timesteps;
 }
 
+//----------------------------------------------------------------------------
+bool PacketConsumer::UpdateTimesteps(std::deque<double>& timesteps, size_t& firstFrameId)
+{
+  boost::lock_guard<boost::mutex> lock(this->ConsumerMutex);
+  const size_t endFrameId = this->FirstFrameId + this->Frames.size();
+  const size_t copyEndFrameId = firstFrameId + timesteps.size();
+  if (firstFrameId == this->FirstFrameId && copyEndFrameId == endFrameId)
+  {
+    return false;
+  }
+
+  // the copy is older than the oldest frame, or newer in case the frames were unloaded
+  if (copyEndFrameId <= this->FirstFrameId || copyEndFrameId > endFrameId)
+  {
+    timesteps.clear();
+    firstFrameId = this->FirstFrameId;
+  }
+
+  // drop the timesteps of the released frames
+  while (firstFrameId < this->FirstFrameId && !timesteps.empty())
+  {
+    timesteps.pop_front();
+    ++firstFrameId;
+  }
+
+  // append the timesteps of the new frames
+  for (size_t i = firstFrameId + timesteps.size() - this->FirstFrameId; i < this->Frames.size(); ++i)
+  {
+    timesteps.push_back(this->Frames[i].Time);
+  }
+  return true;
+}
+
 //----------------------------------------------------------------------------
 void PacketConsumer::SetMaxNumberOfFrames(int nFrames)
 {
   boost::lock_guard<boost::mutex> lock(this->ConsumerMutex);
   this->MaxNumberOfFrames = nFrames;
-  this->UpdateDequeSize();
+  this->ReleaseOldestFrames(0);
+}
+
+//----------------------------------------------------------------------------
+void PacketConsumer::SetMaxNumberOfBytes(size_t nBytes)
+{
+  boost::lock_guard<boost::mutex> lock(this->ConsumerMutex);
+  this->MaxNumberOfBytes = nBytes;
+  this->ReleaseOldestFrames(0);
+}
+
+//----------------------------------------------------------------------------
+size_t PacketConsumer::GetNumberOfBytes()
+{
+  boost::lock_guard<boost::mutex> lock(this->ConsumerMutex);
+  return this->NumberOfBytes;
+}
+
+//----------------------------------------------------------------------------
+int PacketConsumer::GetNumberOfFrames()
+{
+  boost::lock_guard<boost::mutex> lock(this->ConsumerMutex);
+  return static_cast<int>(this->Frames.size());
+}
+
+//----------------------------------------------------------------------------
+unsigned int PacketConsumer::GetPacketQueueSize()
+{
+  boost::shared_ptr<SynchronizedQueue<NetworkPacket*> > packets = this->Packets;
+  return packets ? packets->size() : 0;
+}
+
+//----------------------------------------------------------------------------
+unsigned int PacketConsumer::GetFrameQueueSize()
+{
+  unsigned int size = 0;
+  boost::shared_ptr<SynchronizedQueue<boost::shared_ptr<FrameShard> > > shards = this->Shards;
+  if (shards)
+  {
+    size += shards->size();
+  }
+  boost::lock_guard<boost::mutex> lock(this->FramesToPublishMutex);
+  return size + static_cast<unsigned int>(this->FramesToPublish.size());
 }
 
 //----------------------------------------------------------------------------
@@ -88,16 +246,337 @@ bool PacketConsumer::CheckForNewData()
 //----------------------------------------------------------------------------
 void PacketConsumer::ThreadLoop()
 {
-  std::string* packet = 0;
+  NetworkPacket* packet = 0;
   this->Interpreter->ResetCurrentFrame();
+  this->FrameDecodeStartTime = -1.0;
   while (this->Packets->dequeue(packet))
   {
-    this->HandleSensorData(
-          reinterpret_cast<const unsigned char*>(packet->c_str()), packet->length());
+    if (this->Shards)
+    {
+      this->DispatchSensorData(packet);
+      continue;
+    }
+    this->HandleSensorData(*packet);
     delete packet;
   }
 }
 
+//----------------------------------------------------------------------------
+void PacketConsumer::SetNumberOfDecodingThreads(int nThreads)
+{
+  this->NumberOfDecodingThreads = std::max(0, nThreads);
+}
+
+//----------------------------------------------------------------------------
+void PacketConsumer::DispatchSensorData(NetworkPacket* rawPacket)
+{
+  boost::shared_ptr<NetworkPacket> packet(rawPacket);
+  const unsigned char* data = packet->GetData();
+  const unsigned int length = packet->GetLength();
+
+  bool isNewFrame = false;
+  int framePositionInPacket = 0;
+  {
+    boost::lock_guard<boost::mutex> lock(this->ReaderMutex);
+    if (!this->Interpreter->IsLidarPacket(data, length))
+    {
+      this->Statistics->MalformedPackets.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    this->Interpreter->PreProcessPacket(data, length, isNewFrame, framePositionInPacket);
+
+    // Until the sensor is calibrated (HDL-64 live calibration)
+    // the packets are only used to gather the calibration
+    if (!this->Interpreter->GetIsCalibrated())
+    {
+      this->CurrentShard.reset();
+      return;
+    }
+  }
+
+  // As in the single thread mode, the first frame starts with the first packet
+  if (!this->CurrentShard)
+  {
+    this->CurrentShard.reset(new FrameShard);
+    this->CurrentShard->SequenceNumber = this->NextShardSequenceNumber++;
+  }
+  this->CurrentShard->AddPacket(packet);
+
+  if (isNewFrame)
+  {
+    this->Shards->enqueue(this->CurrentShard);
+    this->CurrentShard.reset(new FrameShard);
+    this->CurrentShard->SequenceNumber = this->NextShardSequenceNumber++;
+    this->CurrentShard->FirstFramePositionInPacket = framePositionInPacket;
+    this->CurrentShard->AddPacket(packet);
+  }
+}
+
+//----------------------------------------------------------------------------
+int PacketConsumer::GetDefaultNumberOfDecodingThreads()
+{
+  // keep a core for the receiver and the consumer threads
+  return std::min(4, static_cast<int>(boost::thread::hardware_concurrency()) - 1);
+}
+
+//----------------------------------------------------------------------------
+void PacketConsumer::StartDecodingWorkers()
+{
+  this->CurrentShard.reset();
+  this->NextShardSequenceNumber = 0;
+  this->NextSequenceNumberToPublish = 0;
+  this->FramesToPublish.clear();
+  this->CacheInterpreter = nullptr;
+
+  int nThreads = this->NumberOfDecodingThreads;
+  if (nThreads == 0)
+  {
+    nThreads = GetDefaultNumberOfDecodingThreads();
+  }
+  if (!this->Interpreter)
+  {
+    return;
+  }
+
+  // The packets of each frame are only known when going through the decoding
+  // workers, which is required to cache them. A single one is enough in that case.
+  if (this->CacheMode == CACHE_MODE::RawPackets)
+  {
+    nThreads = std::max(1, nThreads);
+  }
+  else if (nThreads <= 1)
+  {
+    return;
+  }
+
+  boost::lock_guard<boost::mutex> lock(this->ReaderMutex);
+  for (int i = 0; i < nThreads; ++i)
+  {
+    boost::shared_ptr<DecodingWorker> worker(new DecodingWorker);
+    worker->Interpreter.TakeReference(this->Interpreter->NewInstance());
+    if (!worker->Interpreter->CopyConfiguration(this->Interpreter))
+    {
+      // this interpreter can only decode the packets sequentially
+      if (this->CacheMode == CACHE_MODE::RawPackets)
+      {
+        vtkGenericWarningMacro("This interpreter can not decode the cached packets again, "
+                               "the decoded frames will be cached instead");
+      }
+      this->Workers.clear();
+      return;
+    }
+    worker->ConfigurationTime = this->Interpreter->GetMTime();
+    this->Workers.push_back(worker);
+  }
+
+  this->Shards.reset(new SynchronizedQueue<boost::shared_ptr<FrameShard> >);
+  for (size_t i = 0; i < this->Workers.size(); ++i)
+  {
+    this->Workers[i]->Thread.reset(new boost::thread(
+      boost::bind(&PacketConsumer::DecodingThreadLoop, this, this->Workers[i])));
+  }
+}
+
+//----------------------------------------------------------------------------
+void PacketConsumer::StopDecodingWorkers()
+{
+  if (this->Shards)
+  {
+    this->Shards->stopQueue();
+  }
+  for (size_t i = 0; i < this->Workers.size(); ++i)
+  {
+    if (this->Workers[i]->Thread)
+    {
+      this->Workers[i]->Thread->join();
+    }
+  }
+  this->Workers.clear();
+  this->Shards.reset();
+  this->CurrentShard.reset();
+  this->FramesToPublish.clear();
+}
+
+//----------------------------------------------------------------------------
+void PacketConsumer::DecodingThreadLoop(boost::shared_ptr<DecodingWorker> worker)
+{
+  vtkLidarPacketInterpreter* interpreter = worker->Interpreter;
+  boost::shared_ptr<FrameShard> shard;
+  while (this->Shards->dequeue(shard))
+  {
+    // Follow the changes made to the consumer interpreter (cropping, transform,
+    // calibration, ...) since the last frame
+    {
+      boost::lock_guard<boost::mutex> lock(this->ReaderMutex);
+      if (this->Interpreter->GetMTime() != worker->ConfigurationTime ||
+          this->Interpreter->GetIsCalibrated() != interpreter->GetIsCalibrated())
+      {
+        interpreter->CopyConfiguration(this->Interpreter);
+        worker->ConfigurationTime = this->Interpreter->GetMTime();
+      }
+    }
+
+    // The packet holding the boundary with the previous frame has already been counted
+    const double decodeStartTime = StreamStatistics::Now();
+    for (size_t i = shard->SequenceNumber == 0 ? 0 : 1; i < shard->Packets.size(); ++i)
+    {
+      this->Statistics->AddLatency(StreamStatistics::ReceiveToDecode,
+        decodeStartTime - shard->Packets[i]->ReceptionTime);
+    }
+
+    vtkSmartPointer<vtkPolyData> frame = DecodeShard(interpreter, *shard);
+    shard->SplitTime = StreamStatistics::Now();
+    this->Statistics->AddLatency(
+      StreamStatistics::DecodeToSplit, shard->SplitTime - decodeStartTime);
+    this->PublishFrame(shard, frame);
+    shard.reset();
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkSmartPointer<vtkPolyData> PacketConsumer::DecodeShard(
+  vtkLidarPacketInterpreter* interpreter, const FrameShard& shard)
+{
+  // Same decoding as vtkLidarReader::GetFrame
+  interpreter->ResetCurrentFrame();
+  int firstFramePositionInPacket = shard.FirstFramePositionInPacket;
+  for (size_t i = 0; i < shard.Packets.size() && !interpreter->IsNewFrameReady(); ++i)
+  {
+    const NetworkPacket& packet = *shard.Packets[i];
+    interpreter->ProcessPacket(packet.GetData(), packet.GetLength(), firstFramePositionInPacket);
+    firstFramePositionInPacket = 0;
+  }
+  if (!interpreter->IsNewFrameReady())
+  {
+    interpreter->SplitFrame();
+  }
+
+  vtkSmartPointer<vtkPolyData> frame;
+  if (interpreter->IsNewFrameReady())
+  {
+    frame = interpreter->GetLastFrameAvailable();
+    interpreter->ClearAllFramesAvailable();
+  }
+  return frame;
+}
+
+//----------------------------------------------------------------------------
+void PacketConsumer::PublishFrame(boost::shared_ptr<FrameShard> shard, vtkSmartPointer<vtkPolyData> frame)
+{
+  boost::lock_guard<boost::mutex> lock(this->FramesToPublishMutex);
+  this->FramesToPublish[shard->SequenceNumber] = std::make_pair(frame, shard);
+
+  auto it = this->FramesToPublish.begin();
+  while (it != this->FramesToPublish.end() && it->first == this->NextSequenceNumberToPublish)
+  {
+    if (it->second.first)
+    {
+      const boost::shared_ptr<FrameShard>& shard = it->second.second;
+      const NetworkPacket& lastPacket = *shard->Packets.back();
+      this->HandleNewData(it->second.first, lastPacket.Timestamp, shard->SplitTime,
+        lastPacket.ReceptionTime, shard);
+    }
+    it = this->FramesToPublish.erase(it);
+    ++this->NextSequenceNumberToPublish;
+  }
+}
+
+//----------------------------------------------------------------------------
+void PacketConsumer::SetCacheMode(int mode)
+{
+  this->CacheMode = mode;
+}
+
+//----------------------------------------------------------------------------
+void PacketConsumer::SetMaxNumberOfDecodedFrames(int nFrames)
+{
+  boost::lock_guard<boost::mutex> lock(this->ConsumerMutex);
+  this->MaxNumberOfDecodedFrames = std::max(1, nFrames);
+}
+
+//----------------------------------------------------------------------------
+vtkSmartPointer<vtkPolyData> PacketConsumer::GetFrame(size_t index)
+{
+  FrameEntry& entry = this->Frames[index];
+  const size_t frameId = this->FirstFrameId + index;
+  if (!entry.Shard)
+  {
+    return entry.Frame;
+  }
+  if (entry.Frame)
+  {
+    this->MarkAsDecoded(frameId);
+    return entry.Frame;
+  }
+
+  // Decode the frame again with an interpreter dedicated to the cache, as the
+  // other ones are busy with the live packets. In RawPackets mode, ReaderMutex
+  // is never held while waiting for ConsumerMutex, so it is safe to lock it here.
+  {
+    boost::lock_guard<boost::mutex> lock(this->ReaderMutex);
+    if (!this->CacheInterpreter)
+    {
+      this->CacheInterpreter.TakeReference(this->Interpreter->NewInstance());
+      this->CacheInterpreterConfigurationTime = 0;
+    }
+    if (this->Interpreter->GetMTime() != this->CacheInterpreterConfigurationTime)
+    {
+      this->CacheInterpreter->CopyConfiguration(this->Interpreter);
+      this->CacheInterpreterConfigurationTime = this->Interpreter->GetMTime();
+    }
+  }
+
+  vtkSmartPointer<vtkPolyData> frame = DecodeShard(this->CacheInterpreter, *entry.Shard);
+  if (frame)
+  {
+    const size_t nBytes = static_cast<size_t>(frame->GetActualMemorySize()) * 1024;
+    entry.Frame = frame;
+    entry.NumberOfBytes += nBytes;
+    this->NumberOfBytes += nBytes;
+    this->MarkAsDecoded(frameId);
+
+    // If releasing the other decoded frames was not enough, the frames older
+    // than this one are released as HandleNewData does. The newer ones are kept,
+    // as the trailing frames are decoded from the oldest to the newest.
+    while (this->MaxNumberOfBytes > 0 && this->NumberOfBytes > this->MaxNumberOfBytes &&
+      this->FirstFrameId < frameId)
+    {
+      this->NumberOfBytes -= this->Frames.front().NumberOfBytes;
+      this->Frames.pop_front();
+      this->DecodedFrameIds.remove(this->FirstFrameId);
+      ++this->FirstFrameId;
+    }
+  }
+  return frame;
+}
+
+//----------------------------------------------------------------------------
+void PacketConsumer::MarkAsDecoded(size_t frameId)
+{
+  auto it = std::find(this->DecodedFrameIds.begin(), this->DecodedFrameIds.end(), frameId);
+  if (it != this->DecodedFrameIds.end())
+  {
+    this->DecodedFrameIds.erase(it);
+  }
+  this->DecodedFrameIds.push_front(frameId);
+
+  // release the least recently used decoded frames, keeping their packets,
+  // while there are too many or while they exceed the memory budget. The
+  // frame just decoded is kept.
+  while (static_cast<int>(this->DecodedFrameIds.size()) > this->MaxNumberOfDecodedFrames ||
+    (this->MaxNumberOfBytes > 0 && this->NumberOfBytes > this->MaxNumberOfBytes &&
+      this->DecodedFrameIds.size() > 1))
+  {
+    const size_t releasedId = this->DecodedFrameIds.back();
+    this->DecodedFrameIds.pop_back();
+    FrameEntry& entry = this->Frames[releasedId - this->FirstFrameId];
+    const size_t nBytes = entry.NumberOfBytes - entry.Shard->NumberOfBytes;
+    entry.Frame = nullptr;
+    entry.NumberOfBytes -= nBytes;
+    this->NumberOfBytes -= nBytes;
+  }
+}
+
 //----------------------------------------------------------------------------
 void PacketConsumer::Start()
 {
@@ -106,7 +585,8 @@ void PacketConsumer::Start()
     return;
   }
 
-  this->Packets.reset(new SynchronizedQueue<std::string*>);
+  this->Packets.reset(new SynchronizedQueue<NetworkPacket*>);
+  this->StartDecodingWorkers();
   this->Thread = boost::shared_ptr<boost::thread>(
         new boost::thread(boost::bind(&PacketConsumer::ThreadLoop, this)));
 }
@@ -120,59 +600,105 @@ void PacketConsumer::Stop()
     this->Thread->join();
     this->Thread.reset();
     this->Packets.reset();
+    this->StopDecodingWorkers();
   }
 }
 
 //----------------------------------------------------------------------------
-void PacketConsumer::Enqueue(std::string *packet) { this->Packets->enqueue(packet); }
+void PacketConsumer::Enqueue(NetworkPacket* packet) { this->Packets->enqueue(packet); }
 
 //----------------------------------------------------------------------------
 void PacketConsumer::UnloadData()
 {
+  boost::lock_guard<boost::mutex> lock(this->ConsumerMutex);
+  this->FirstFrameId += this->Frames.size();
   this->Frames.clear();
-  this->Timesteps.clear();
+  this->DecodedFrameIds.clear();
+  this->NumberOfBytes = 0;
+  this->TrailingFrames.Clear();
 }
 
 //----------------------------------------------------------------------------
-void PacketConsumer::UpdateDequeSize()
+void PacketConsumer::ReleaseOldestFrames(size_t incomingBytes)
 {
-  if (this->MaxNumberOfFrames <= 0)
-  {
-    return;
-  }
-  while (static_cast<int>(this->Frames.size()) >= this->MaxNumberOfFrames)
+  while (!this->Frames.empty())
   {
+    const bool tooManyFrames = this->MaxNumberOfFrames > 0 &&
+      static_cast<int>(this->Frames.size()) >= this->MaxNumberOfFrames;
+    const bool tooManyBytes = this->MaxNumberOfBytes > 0 &&
+      this->NumberOfBytes + incomingBytes > this->MaxNumberOfBytes;
+    if (!tooManyFrames && !tooManyBytes)
+    {
+      return;
+    }
+    this->NumberOfBytes -= this->Frames.front().NumberOfBytes;
     this->Frames.pop_front();
-    this->Timesteps.pop_front();
+    this->DecodedFrameIds.remove(this->FirstFrameId);
+    ++this->FirstFrameId;
   }
 }
 
 //----------------------------------------------------------------------------
 size_t PacketConsumer::GetIndexForTime(double time)
 {
-  size_t index = 0;
-  double minDifference = VTK_DOUBLE_MAX;
-  const size_t nTimesteps = this->Timesteps.size();
-  for (size_t i = 0; i < nTimesteps; ++i)
+  if (this->Frames.empty())
   {
-    double difference = std::abs(this->Timesteps[i] - time);
-    if (difference < minDifference)
-    {
-      minDifference = difference;
-      index = i;
-    }
+    return 0;
   }
-  return index;
+
+  // the frames are sorted by time, look for the closest one
+  auto next = std::lower_bound(this->Frames.begin(), this->Frames.end(), time,
+    [](const FrameEntry& entry, double t) { return entry.Time < t; });
+  if (next == this->Frames.end())
+  {
+    return this->Frames.size() - 1;
+  }
+  if (next != this->Frames.begin() && time - std::prev(next)->Time <= next->Time - time)
+  {
+    --next;
+  }
+  return static_cast<size_t>(next - this->Frames.begin());
 }
 
 //----------------------------------------------------------------------------
-void PacketConsumer::HandleNewData(vtkSmartPointer<vtkPolyData> polyData)
+void PacketConsumer::HandleNewData(vtkSmartPointer<vtkPolyData> polyData, double frameTime,
+                                   double splitTime, double receptionTime,
+                                   boost::shared_ptr<FrameShard> shard)
 {
+  // computed before locking, as it walks through all the arrays
+  size_t nBytes = static_cast<size_t>(polyData->GetActualMemorySize()) * 1024;
+
+  // the other processes get the frame as soon as it is decoded
+  if (this->Publisher)
+  {
+    this->Publisher->Publish(polyData, 0, frameTime, receptionTime);
+  }
+
+  FrameEntry entry;
+  if (this->CacheMode == CACHE_MODE::RawPackets && shard)
+  {
+    entry.Shard = shard;
+    nBytes += shard->NumberOfBytes;
+  }
+
   boost::lock_guard<boost::mutex> lock(this->ConsumerMutex);
 
-  this->UpdateDequeSize();
-  this->Timesteps.push_back(this->LastTime);
-  this->Frames.push_back(polyData);
+  this->ReleaseOldestFrames(nBytes);
+  // GetIndexForTime expects strictly increasing times, even if the system clock
+  // is stepped back
+  entry.Time = std::max(frameTime, this->LastTime + MinFrameInterval);
+  entry.Frame = polyData;
+  entry.NumberOfBytes = nBytes;
+  entry.SplitTime = splitTime;
+  entry.ReceptionTime = receptionTime;
+  entry.IsPublished = false;
+  this->Frames.push_back(entry);
+  this->NumberOfBytes += nBytes;
+  if (entry.Shard)
+  {
+    this->MarkAsDecoded(this->FirstFrameId + this->Frames.size() - 1);
+  }
   this->NewData = true;
-  this->LastTime += 1.0;
+  this->LastTime = entry.Time;
+  this->Statistics->AddFrame(splitTime);
 }
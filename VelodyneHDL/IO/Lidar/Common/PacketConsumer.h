@@ -32,31 +32,114 @@
 #include <boost/shared_ptr.hpp>
 #include <boost/thread.hpp>
 #include <vtkNew.h>
+#include <algorithm>
 #include <deque>
+#include <list>
+#include <map>
+#include <memory>
+#include <vector>
 
 #include "vtkSmartPointer.h"
 #include "vtkLidarPacketInterpreter.h"
+#include "TrailingFrameAccumulator.h"
 
 
 template<typename T>
 class SynchronizedQueue;
+class NetworkPacket;
+class SharedFramePublisher;
+class StreamStatistics;
 
 class PacketConsumer
 {
 public:
+  /**
+   * @brief The CACHE_MODE enum select what is kept in memory for each cached frame
+   */
+  enum CACHE_MODE
+  {
+    DecodedFrames = 0, /*!< keep the decoded frames */
+    RawPackets = 1,    /*!< keep the packets of each frame, only the last frames
+                            used are kept decoded, the others are decoded on demand */
+  };
+
   PacketConsumer();
 
-  void HandleSensorData(const unsigned char* data, unsigned int length);
+  void HandleSensorData(const NetworkPacket& packet);
 
-  // You must lock PacketConsumer.ConsumerMutex while calling this function
+  // You must lock PacketConsumer.ConsumerMutex while calling this function.
+  // In RawPackets mode, the frame may be decoded, which will also lock ReaderMutex.
+  // The first time a frame is returned, its publication latencies are recorded.
+  // With trailing frames, the frame is combined with the previous ones, see
+  // TrailingFrameAccumulator: only the frames entering and leaving the window are copied.
   vtkSmartPointer<vtkPolyData> GetFrameForTime(double timeRequest, double& actualTime, int numberOfTrailingFrame = 0);
 
+  /**
+   * @brief SetNumberOfTrailingFrames set the number of previous frames combined
+   * with the requested one by vtkLidarStream
+   */
+  void SetNumberOfTrailingFrames(int nFrames) { this->NumberOfTrailingFrames = std::max(0, nFrames); }
+  int GetNumberOfTrailingFrames() { return this->NumberOfTrailingFrames; }
+
   std::vector<double> GetTimesteps();
 
+  /**
+   * @brief UpdateTimesteps bring up to date a copy of the timesteps obtained by a previous
+   * call, by removing the timesteps of the released frames and appending the new ones.
+   * This keeps the time spent holding ConsumerMutex proportional to the number of changes.
+   * @param timesteps[in,out] copy of the timesteps, empty on the first call
+   * @param firstFrameId[in,out] id of the frame of timesteps.front(), 0 on the first call
+   * @return true if the copy has been modified
+   */
+  bool UpdateTimesteps(std::deque<double>& timesteps, size_t& firstFrameId);
+
   int GetMaxNumberOfFrames() { return this->MaxNumberOfFrames; }
 
   void SetMaxNumberOfFrames(int nFrames);
 
+  /**
+   * @brief SetMaxNumberOfBytes bound the memory used by the cached frames. The oldest
+   * frames are released first. Both this limit and MaxNumberOfFrames are enforced.
+   * @param nBytes maximum memory used by the frames, 0 for no limit
+   */
+  void SetMaxNumberOfBytes(size_t nBytes);
+  size_t GetMaxNumberOfBytes() { return this->MaxNumberOfBytes; }
+
+  /**
+   * @brief GetNumberOfBytes return the memory currently used by the cached frames
+   */
+  size_t GetNumberOfBytes();
+
+  /**
+   * @brief GetNumberOfFrames return the number of cached frames
+   */
+  int GetNumberOfFrames();
+
+  /**
+   * @brief GetPacketQueueSize return the number of received packets waiting to be processed
+   */
+  unsigned int GetPacketQueueSize();
+
+  /**
+   * @brief GetFrameQueueSize return the number of frames waiting to be decoded, or
+   * decoded and waiting for the previous ones. Always 0 with a single decoding thread.
+   */
+  unsigned int GetFrameQueueSize();
+
+  /**
+   * @brief GetStatistics return the counters and latencies of the live path,
+   * shared with the NetworkSource feeding this consumer
+   */
+  std::shared_ptr<StreamStatistics> GetStatistics() { return this->Statistics; }
+
+  /**
+   * @brief SetPublisher set where each new frame is published for other processes,
+   * null to publish nothing. The frames are published as sensor 0.
+   * @warning must not be changed while the consumer is running
+   */
+  void SetPublisher(std::shared_ptr<SharedFramePublisher> publisher) { this->Publisher = publisher; }
+  std::shared_ptr<SharedFramePublisher> GetPublisher() { return this->Publisher; }
+
   bool CheckForNewData();
 
   void ThreadLoop();
@@ -65,10 +148,58 @@ public:
 
   void Stop();
 
-  void Enqueue(std::string* packet);
+  void Enqueue(NetworkPacket* packet);
 
   void SetInterpreter(vtkLidarPacketInterpreter* inter) { this->Interpreter = inter;}
 
+  /**
+   * @brief AddFrame add to the cache a frame decoded outside of the consumer,
+   * e.g. by a MultiSensorConsumer. The arguments are the ones of HandleNewData.
+   */
+  void AddFrame(vtkSmartPointer<vtkPolyData> polyData, double frameTime, double splitTime,
+                double receptionTime)
+  {
+    this->HandleNewData(polyData, frameTime, splitTime, receptionTime);
+  }
+
+  /**
+   * @brief SetNumberOfDecodingThreads set the number of threads decoding the packets.
+   * With more than one thread, the consumer thread only looks for the frame boundaries
+   * with PreProcessPacket, and the packets of each frame are decoded by a pool of workers,
+   * each one owning its own copy of the interpreter. The decoded frames are then published
+   * in the order they were received. With a single thread, or if the interpreter does not
+   * support CopyConfiguration, the packets are decoded by the consumer thread itself.
+   * @param nThreads number of decoding threads, 0 selects it from the number of cores
+   * @warning only taken into account by the next call to Start
+   */
+  void SetNumberOfDecodingThreads(int nThreads);
+  int GetNumberOfDecodingThreads() { return this->NumberOfDecodingThreads; }
+
+  /**
+   * @brief GetDefaultNumberOfDecodingThreads number of decoding threads selected when 0
+   * is requested, here or by a MultiSensorConsumer: one per core up to 4, a core being
+   * kept for the receiver and the consumer threads
+   */
+  static int GetDefaultNumberOfDecodingThreads();
+
+  /**
+   * @brief SetCacheMode select whether the decoded frames are kept, or only the
+   * packets they were decoded from, which are about 20 times smaller. Like
+   * vtkLidarReader does with the file, the frames are then decoded again when requested.
+   * The RawPackets mode requires an interpreter supporting CopyConfiguration.
+   * @param mode one of CACHE_MODE
+   * @warning only taken into account by the next call to Start
+   */
+  void SetCacheMode(int mode);
+  int GetCacheMode() { return this->CacheMode; }
+
+  /**
+   * @brief SetMaxNumberOfDecodedFrames set the number of frames kept decoded in
+   * RawPackets mode, the least recently used are released first
+   */
+  void SetMaxNumberOfDecodedFrames(int nFrames);
+  int GetMaxNumberOfDecodedFrames() { return this->MaxNumberOfDecodedFrames; }
+
   void UnloadData();
 
   // Hold this when running reader code code or modifying its internals
@@ -78,24 +209,152 @@ public:
   boost::mutex ConsumerMutex;
 
 protected:
-  void UpdateDequeSize();
+  struct FrameShard;
+  struct DecodingWorker;
+
+  /**
+   * @brief ReleaseOldestFrames release the oldest frames until there is enough room
+   * for a new frame of the given size
+   * @param incomingBytes size of the frame about to be added
+   */
+  void ReleaseOldestFrames(size_t incomingBytes);
+
+  /**
+   * @brief DispatchSensorData look for frame boundaries and group the packets
+   * by frame, each complete frame being sent to the decoding workers
+   * @param packet the packet received, whose ownership is taken
+   */
+  void DispatchSensorData(NetworkPacket* packet);
+
+  void StartDecodingWorkers();
+
+  void StopDecodingWorkers();
+
+  void DecodingThreadLoop(boost::shared_ptr<DecodingWorker> worker);
+
+  /**
+   * @brief PublishFrame store a decoded frame and hand over to HandleNewData all the
+   * frames which are now in sequence
+   * @param shard packets the frame has been decoded from
+   * @param frame decoded frame, null if the packets did not produce any frame
+   */
+  void PublishFrame(boost::shared_ptr<FrameShard> shard, vtkSmartPointer<vtkPolyData> frame);
+
+  /**
+   * @brief DecodeShard decode the frame starting in the first packet of the shard,
+   * the same way vtkLidarReader::GetFrame does
+   * @return the decoded frame, null if the packets did not produce any frame
+   */
+  static vtkSmartPointer<vtkPolyData> DecodeShard(
+    vtkLidarPacketInterpreter* interpreter, const FrameShard& shard);
 
   size_t GetIndexForTime(double time);
 
-  void HandleNewData(vtkSmartPointer<vtkPolyData> polyData);
+  /**
+   * @brief GetFrame return the frame at the given index, decoding it if needed
+   * You must lock ConsumerMutex while calling this function
+   */
+  vtkSmartPointer<vtkPolyData> GetFrame(size_t index);
+
+  /**
+   * @brief MarkAsDecoded record that a frame is decoded, and release the least
+   * recently used decoded frames if there are too many, or if the cache exceeds
+   * MaxNumberOfBytes
+   */
+  void MarkAsDecoded(size_t frameId);
+
+  /**
+   * @brief HandleNewData add a decoded frame to the cache
+   * @param frameTime time of the frame, the arrival time of its last packet in
+   * seconds since the epoch. It is raised if needed to keep the times increasing.
+   * @param splitTime when the frame was split, see StreamStatistics::Now
+   * @param receptionTime when the last packet of the frame was received
+   * @param shard packets of the frame, only kept in RawPackets mode
+   */
+  void HandleNewData(vtkSmartPointer<vtkPolyData> polyData, double frameTime, double splitTime,
+                     double receptionTime,
+                     boost::shared_ptr<FrameShard> shard = boost::shared_ptr<FrameShard>());
+
+  //! A cached frame, with its time and its memory footprint
+  struct FrameEntry
+  {
+    double Time;
+    //! may be null in RawPackets mode if the frame is not decoded
+    vtkSmartPointer<vtkPolyData> Frame;
+    //! packets of the frame, only kept in RawPackets mode
+    boost::shared_ptr<FrameShard> Shard;
+    size_t NumberOfBytes;
+    //! when the frame was split, see StreamStatistics::Now
+    double SplitTime;
+    //! when the last packet of the frame was received
+    double ReceptionTime;
+    //! whether the frame has already been returned by GetFrameForTime
+    bool IsPublished;
+  };
 
   bool ShouldCheckSensor;
   bool NewData;
   int MaxNumberOfFrames;
+  size_t MaxNumberOfBytes;
+  //! time of the last frame added to the cache, 0 if none
   double LastTime;
 
-  std::deque<vtkSmartPointer<vtkPolyData> > Frames;
-  std::deque<double> Timesteps;
+  //! Circular frame store, sorted by time: new frames are pushed
+  //! at the back while the oldest are released from the front
+  std::deque<FrameEntry> Frames;
+
+  //! Memory used by all the frames of Frames
+  size_t NumberOfBytes;
+
+  //! Id of Frames.front(), each new frame gets the next id
+  size_t FirstFrameId;
+
+  int CacheMode;
+
+  //! Ids of the decoded frames in RawPackets mode, the most recently used first
+  std::list<size_t> DecodedFrameIds;
+  int MaxNumberOfDecodedFrames;
+
+  //! Interpreter used to decode again the cached packets in RawPackets mode
+  vtkSmartPointer<vtkLidarPacketInterpreter> CacheInterpreter;
+  vtkMTimeType CacheInterpreterConfigurationTime;
+
   vtkLidarPacketInterpreter* Interpreter;
 
-  boost::shared_ptr<SynchronizedQueue<std::string*> > Packets;
+  boost::shared_ptr<SynchronizedQueue<NetworkPacket*> > Packets;
 
   boost::shared_ptr<boost::thread> Thread;
+
+  //! Number of threads decoding the packets, 0 for automatic
+  int NumberOfDecodingThreads;
+
+  //! Frames waiting to be decoded, only used with several decoding threads
+  boost::shared_ptr<SynchronizedQueue<boost::shared_ptr<FrameShard> > > Shards;
+
+  //! Packets of the frame being received
+  boost::shared_ptr<FrameShard> CurrentShard;
+
+  size_t NextShardSequenceNumber;
+
+  std::vector<boost::shared_ptr<DecodingWorker> > Workers;
+
+  //! Decoded frames waiting for the previous ones to be decoded before being published
+  std::map<size_t, std::pair<vtkSmartPointer<vtkPolyData>, boost::shared_ptr<FrameShard> > >
+    FramesToPublish;
+  size_t NextSequenceNumberToPublish;
+  boost::mutex FramesToPublishMutex;
+
+  //! When the consumer thread started decoding the current frame, negative if not started
+  double FrameDecodeStartTime;
+
+  int NumberOfTrailingFrames;
+
+  //! Combination of the last frames requested with their trailing frames
+  TrailingFrameAccumulator TrailingFrames;
+
+  std::shared_ptr<StreamStatistics> Statistics;
+
+  std::shared_ptr<SharedFramePublisher> Publisher;
 };
 
 #endif // PACKETCONSUMER_H
@@ -0,0 +1,638 @@
+//=========================================================================
+//
+// Copyright 2018 Kitware, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//=========================================================================
+
+// LOCAL
+#include "PacketFileSegmentWriter.h"
+#include "vtkPacketFileWriter.h"
+#include "vtkZstdSeekableFile.h"
+
+// STD
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <malloc.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//! @todo this include is only for vtkGenericWarningMacro which is strange
+#include <vtkMath.h>
+
+namespace
+{
+// pcap record header, followed by the 42 bytes of the ethernet, IP and UDP headers
+const std::size_t RecordHeaderSize = 16;
+const std::size_t NetworkHeaderSize = 42;
+
+// pcap global header: magic, version 2.4, timezone, accuracy, snapshot length, ethernet
+const uint32_t GlobalHeader[6] = { 0xa1b2c3d4, 0x00040002, 0, 0, 65535, 1 };
+
+// index sidecar header: magic, size of the indexed segment, framing key of the interpreter.
+// The version 01 only held the class name of the interpreter, its indexes are not read.
+const char IndexMagic[8] = { 'V', 'V', 'P', 'I', 'D', 'X', '0', '2' };
+const std::size_t FramingKeySize = 256;
+const std::size_t IndexHeaderSize = sizeof(IndexMagic) + sizeof(uint64_t) + FramingKeySize;
+
+// Records compressed together in a zstd frame, which is decompressed entirely
+// to read any of them
+const std::size_t CompressedFrameSize = 1 << 20;
+
+// Disk space reserved at once when the segments have no maximum size
+const uint64_t PreallocationStep = 256 << 20;
+
+//-----------------------------------------------------------------------------
+bool WriteAll(int fd, const char* data, std::size_t size)
+{
+  while (size > 0)
+  {
+#ifdef _WIN32
+    const int written = _write(fd, data, static_cast<unsigned int>(size));
+#else
+    const ssize_t written = write(fd, data, size);
+    if (written < 0 && errno == EINTR)
+    {
+      continue;
+    }
+#endif
+    if (written <= 0)
+    {
+      return false;
+    }
+    data += written;
+    size -= static_cast<std::size_t>(written);
+  }
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+uint64_t GetFileSize(const std::string& filename)
+{
+#ifdef _WIN32
+  struct _stat64 status;
+  if (_stat64(filename.c_str(), &status) != 0)
+#else
+  struct stat status;
+  if (stat(filename.c_str(), &status) != 0)
+#endif
+  {
+    return 0;
+  }
+  return static_cast<uint64_t>(status.st_size);
+}
+
+//-----------------------------------------------------------------------------
+char* AllocateAligned(std::size_t size)
+{
+#ifdef _WIN32
+  return static_cast<char*>(_aligned_malloc(size, PacketFileSegmentWriter::Alignment));
+#else
+  void* buffer = nullptr;
+  return posix_memalign(&buffer, PacketFileSegmentWriter::Alignment, size) == 0
+    ? static_cast<char*>(buffer) : nullptr;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+void FreeAligned(char* buffer)
+{
+#ifdef _WIN32
+  _aligned_free(buffer);
+#else
+  std::free(buffer);
+#endif
+}
+}
+
+//-----------------------------------------------------------------------------
+PacketFileSegmentWriter::PacketFileSegmentWriter()
+  : Compressor(new vtkZstdSeekableWriter)
+  , SegmentIndex(0)
+  , FileDescriptor(-1)
+  , IndexFile(nullptr)
+  , Buffer(nullptr)
+  , BufferSize(0)
+  , BufferUsed(0)
+  , Output(nullptr)
+  , OutputSize(0)
+  , OutputUsed(0)
+  , SegmentSize(0)
+  , FileSize(0)
+  , AllocatedSize(0)
+  , LastRecordOffset(0)
+  , SegmentStartTime(0)
+  , PacketsInSegment(0)
+  , MaxSegmentSize(0)
+  , MaxSegmentDuration(0)
+  , UseCompression(false)
+  , IsCompressed(false)
+  , UseDirectIO(false)
+  , IsDirectIO(false)
+  , Preallocate(false)
+  , CanPreallocate(true)
+  , HasFailed(false)
+{
+  this->SetBufferSize(4 << 20);
+}
+
+//-----------------------------------------------------------------------------
+PacketFileSegmentWriter::~PacketFileSegmentWriter()
+{
+  this->Close();
+  FreeAligned(this->Buffer);
+  FreeAligned(this->Output);
+}
+
+//-----------------------------------------------------------------------------
+void PacketFileSegmentWriter::SetBufferSize(std::size_t bytes)
+{
+  // The buffer must hold at least one block and the largest record
+  bytes = std::max<std::size_t>(bytes, 16 * Alignment);
+  bytes = (bytes + Alignment - 1) / Alignment * Alignment;
+  if (bytes == this->BufferSize || this->IsOpen())
+  {
+    return;
+  }
+
+  FreeAligned(this->Buffer);
+  this->Buffer = AllocateAligned(bytes);
+  this->BufferSize = this->Buffer ? bytes : 0;
+  this->BufferUsed = 0;
+}
+
+//-----------------------------------------------------------------------------
+int PacketFileSegmentWriter::GetCompressionLevel() const
+{
+  return this->Compressor->GetLevel();
+}
+
+//-----------------------------------------------------------------------------
+void PacketFileSegmentWriter::SetCompressionLevel(int level)
+{
+  this->Compressor->SetLevel(level);
+}
+
+//-----------------------------------------------------------------------------
+std::string PacketFileSegmentWriter::GetSegmentFileName(int segment) const
+{
+  if (this->MaxSegmentSize == 0 && this->MaxSegmentDuration <= 0)
+  {
+    return this->FileName;
+  }
+
+  // record.pcap -> record_0000.pcap
+  const std::size_t separator = this->FileName.find_last_of("/\\");
+  std::size_t extension = this->FileName.find_last_of('.');
+  if (extension == std::string::npos ||
+    (separator != std::string::npos && extension < separator))
+  {
+    extension = this->FileName.size();
+  }
+  std::ostringstream name;
+  name << this->FileName.substr(0, extension) << "_" << std::setw(4) << std::setfill('0')
+       << segment << this->FileName.substr(extension);
+  return name.str();
+}
+
+//-----------------------------------------------------------------------------
+std::string PacketFileSegmentWriter::GetIndexFileName(const std::string& segmentFileName)
+{
+  return segmentFileName + ".idx";
+}
+
+//-----------------------------------------------------------------------------
+bool PacketFileSegmentWriter::Open(const std::string& filename, const std::string& framingKey)
+{
+  this->Close();
+  if (!this->Buffer)
+  {
+    vtkGenericWarningMacro("Failed to allocate the recording buffer");
+    return false;
+  }
+
+  this->IsCompressed = this->UseCompression && vtkZstdSeekableWriter::IsAvailable();
+  if (this->UseCompression && !this->IsCompressed)
+  {
+    vtkGenericWarningMacro("VeloView is built without zstd, the recording won't be compressed");
+  }
+  if (this->IsCompressed)
+  {
+    // the compressed frames are written by whole blocks like the records
+    const std::size_t outputSize =
+      vtkZstdSeekableWriter::GetFrameBound(CompressedFrameSize) + 2 * Alignment;
+    if (outputSize != this->OutputSize)
+    {
+      FreeAligned(this->Output);
+      this->Output = AllocateAligned(outputSize);
+      this->OutputSize = this->Output ? outputSize : 0;
+    }
+    if (!this->Output)
+    {
+      vtkGenericWarningMacro("Failed to allocate the recording buffer");
+      return false;
+    }
+  }
+
+  this->FileName = filename;
+  this->FramingKey = framingKey.substr(0, FramingKeySize - 1);
+  this->SegmentIndex = 0;
+  this->HasFailed = false;
+  if (!this->OpenSegment())
+  {
+    this->FileName.clear();
+    return false;
+  }
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+void PacketFileSegmentWriter::Close()
+{
+  this->CloseSegment();
+  this->FileName.clear();
+}
+
+//-----------------------------------------------------------------------------
+bool PacketFileSegmentWriter::OpenSegment()
+{
+  const std::string segmentFileName = this->GetSegmentFileName(this->SegmentIndex);
+#ifdef _WIN32
+  this->FileDescriptor = _open(segmentFileName.c_str(),
+    _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+  this->IsDirectIO = false;
+#else
+  int flags = O_WRONLY | O_CREAT | O_TRUNC;
+  this->IsDirectIO = false;
+#ifdef O_DIRECT
+  if (this->UseDirectIO)
+  {
+    this->FileDescriptor = open(segmentFileName.c_str(), flags | O_DIRECT, 0644);
+    // Some file systems, like tmpfs, do not support it
+    this->IsDirectIO = this->FileDescriptor >= 0;
+  }
+#endif
+  if (!this->IsDirectIO)
+  {
+    this->FileDescriptor = open(segmentFileName.c_str(), flags, 0644);
+  }
+#endif
+  if (this->FileDescriptor < 0)
+  {
+    vtkGenericWarningMacro("Failed to open packet file: " << segmentFileName << ": "
+                                                           << std::strerror(errno));
+    return false;
+  }
+
+  this->SegmentSize = 0;
+  this->FileSize = 0;
+  this->AllocatedSize = 0;
+  this->LastRecordOffset = 0;
+  this->PacketsInSegment = 0;
+  this->CanPreallocate = this->Preallocate;
+
+  std::memcpy(this->Buffer, GlobalHeader, sizeof(GlobalHeader));
+  this->BufferUsed = sizeof(GlobalHeader);
+  this->SegmentSize = sizeof(GlobalHeader);
+  this->FileSize = this->IsCompressed ? 0 : sizeof(GlobalHeader);
+  this->OutputUsed = 0;
+  this->Compressor->Reset();
+
+  if (!this->FramingKey.empty())
+  {
+    const std::string indexFileName = GetIndexFileName(segmentFileName);
+    this->IndexFile = std::fopen(indexFileName.c_str(), "wb");
+    if (!this->IndexFile)
+    {
+      vtkGenericWarningMacro("Failed to open index file: " << indexFileName);
+    }
+    else
+    {
+      // The segment size is only written when closing, so that an index
+      // interrupted by a crash does not match its segment
+      char header[IndexHeaderSize] = { 0 };
+      std::memcpy(header, IndexMagic, sizeof(IndexMagic));
+      std::memcpy(header + sizeof(IndexMagic) + sizeof(uint64_t), this->FramingKey.c_str(),
+        this->FramingKey.size());
+      std::fwrite(header, 1, IndexHeaderSize, this->IndexFile);
+    }
+  }
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+void PacketFileSegmentWriter::CloseSegment()
+{
+  if (!this->IsOpen())
+  {
+    return;
+  }
+
+  const bool isWritten = this->Flush(true);
+#ifdef _WIN32
+  _close(this->FileDescriptor);
+#else
+  if (this->AllocatedSize > this->FileSize)
+  {
+    // give back the disk space reserved beyond the end of the segment
+    if (ftruncate(this->FileDescriptor, static_cast<off_t>(this->FileSize)) != 0)
+    {
+      vtkGenericWarningMacro("Failed to truncate the packet file: " << std::strerror(errno));
+    }
+  }
+  close(this->FileDescriptor);
+#endif
+  this->FileDescriptor = -1;
+
+  if (this->IndexFile)
+  {
+    this->FlushIndex();
+    if (isWritten)
+    {
+      std::fseek(this->IndexFile, sizeof(IndexMagic), SEEK_SET);
+      std::fwrite(&this->FileSize, sizeof(uint64_t), 1, this->IndexFile);
+    }
+    std::fclose(this->IndexFile);
+    this->IndexFile = nullptr;
+  }
+  this->PendingEntries.clear();
+}
+
+//-----------------------------------------------------------------------------
+bool PacketFileSegmentWriter::WritePacket(const unsigned char* data, unsigned int dataLength,
+  double time, bool& isNewSegment, int port)
+{
+  isNewSegment = false;
+  if (!this->IsOpen() || this->HasFailed)
+  {
+    return false;
+  }
+
+  const std::size_t recordSize = RecordHeaderSize + NetworkHeaderSize + dataLength;
+  if (recordSize > this->BufferSize - Alignment)
+  {
+    return false;
+  }
+
+  // Start a new segment when the current one is full or too old. The size of
+  // a compressed segment is overestimated with its records not compressed yet.
+  if (this->PacketsInSegment > 0)
+  {
+    const uint64_t size = this->FileSize + (this->IsCompressed ? this->BufferUsed : 0);
+    const bool isFull =
+      this->MaxSegmentSize > 0 && size + recordSize > this->MaxSegmentSize;
+    const bool isOld =
+      this->MaxSegmentDuration > 0 && time - this->SegmentStartTime >= this->MaxSegmentDuration;
+    if (isFull || isOld)
+    {
+      this->CloseSegment();
+      ++this->SegmentIndex;
+      if (!this->OpenSegment())
+      {
+        this->HasFailed = true;
+        return false;
+      }
+    }
+  }
+
+  const std::size_t capacity =
+    this->IsCompressed ? std::min(this->BufferSize, CompressedFrameSize) : this->BufferSize;
+  if (this->BufferUsed + recordSize > capacity && !this->Flush(false))
+  {
+    return false;
+  }
+
+  // Same record as vtkPacketFileWriter::WritePacket
+  double seconds = 0;
+  const double fraction = std::modf(time, &seconds);
+  const uint32_t header[4] = {
+    static_cast<uint32_t>(seconds),
+    static_cast<uint32_t>(std::min(999999.0, std::floor(fraction * 1e6 + 0.5))),
+    static_cast<uint32_t>(dataLength + NetworkHeaderSize),
+    static_cast<uint32_t>(dataLength + NetworkHeaderSize)
+  };
+  unsigned char* record = reinterpret_cast<unsigned char*>(this->Buffer + this->BufferUsed);
+  std::memcpy(record, header, RecordHeaderSize);
+  unsigned char* packet = record + RecordHeaderSize;
+  std::memcpy(packet,
+    dataLength == 512 ? vtkPacketFileWriter::PositionPacketHeader
+                      : vtkPacketFileWriter::LidarPacketHeader,
+    NetworkHeaderSize);
+  // IP and UDP lengths, in network byte order
+  packet[2 * 8] = ((dataLength + 28) & 0xFF00) >> 8;
+  packet[2 * 8 + 1] = (dataLength + 28) & 0x00FF;
+  packet[2 * 19] = ((dataLength + 8) & 0xFF00) >> 8;
+  packet[2 * 19 + 1] = (dataLength + 8) & 0x00FF;
+  if (port > 0)
+  {
+    packet[2 * 18] = (port & 0xFF00) >> 8;
+    packet[2 * 18 + 1] = port & 0x00FF;
+  }
+  std::memcpy(packet + NetworkHeaderSize, data, dataLength);
+
+  if (this->PacketsInSegment == 0)
+  {
+    this->SegmentStartTime = time;
+    isNewSegment = true;
+  }
+  this->LastRecordOffset = this->SegmentSize;
+  this->BufferUsed += recordSize;
+  this->SegmentSize += recordSize;
+  this->FileSize += this->IsCompressed ? 0 : recordSize;
+  ++this->PacketsInSegment;
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+void PacketFileSegmentWriter::AddFrameToIndex(int skip, double time)
+{
+  if (!this->IndexFile || this->PacketsInSegment == 0)
+  {
+    return;
+  }
+  IndexEntry entry;
+  entry.Offset = static_cast<int64_t>(this->LastRecordOffset);
+  entry.Skip = skip;
+  entry.Unused = 0;
+  entry.Time = time;
+  this->PendingEntries.push_back(entry);
+}
+
+//-----------------------------------------------------------------------------
+bool PacketFileSegmentWriter::Flush(bool isFinal)
+{
+  if (this->HasFailed)
+  {
+    return false;
+  }
+
+  if (!this->IsCompressed)
+  {
+    if (!this->WriteBlocks(this->Buffer, this->BufferUsed, isFinal))
+    {
+      return false;
+    }
+  }
+  else
+  {
+    // the records are compressed in a new frame, appended to the partial block
+    // which remains from the previous frames
+    if (this->BufferUsed > 0)
+    {
+      const std::size_t frameSize = this->Compressor->CompressFrame(
+        this->Buffer, this->BufferUsed, this->Output + this->OutputUsed);
+      if (frameSize == 0)
+      {
+        vtkGenericWarningMacro("Failed to compress the packets");
+        this->HasFailed = true;
+        return false;
+      }
+      this->OutputUsed += frameSize;
+      this->FileSize += frameSize;
+      this->BufferUsed = 0;
+    }
+    if (!this->WriteBlocks(this->Output, this->OutputUsed, isFinal))
+    {
+      return false;
+    }
+    if (isFinal)
+    {
+      const std::string seekTable = this->Compressor->GetSeekTable();
+      if (!WriteAll(this->FileDescriptor, seekTable.data(), seekTable.size()))
+      {
+        vtkGenericWarningMacro("Failed to write the packet file: " << std::strerror(errno));
+        this->HasFailed = true;
+        return false;
+      }
+      this->FileSize += seekTable.size();
+    }
+  }
+
+  this->FlushIndex();
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+bool PacketFileSegmentWriter::WriteBlocks(char* buffer, std::size_t& used, bool isFinal)
+{
+#if !defined(_WIN32) && defined(__linux__)
+  if (this->CanPreallocate && this->FileSize > this->AllocatedSize)
+  {
+    const uint64_t size = this->MaxSegmentSize > 0
+      ? std::max(this->MaxSegmentSize, this->FileSize)
+      : this->FileSize + PreallocationStep;
+    if (fallocate(this->FileDescriptor, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(size)) == 0)
+    {
+      this->AllocatedSize = size;
+    }
+    else
+    {
+      // not supported by the file system, don't try again for this segment
+      this->CanPreallocate = false;
+    }
+  }
+#endif
+
+  // Only whole blocks are written, the rest stays at the beginning of the buffer
+  const std::size_t nBytes = used / Alignment * Alignment;
+  bool isWritten = nBytes == 0 || WriteAll(this->FileDescriptor, buffer, nBytes);
+  std::memmove(buffer, buffer + nBytes, used - nBytes);
+  used -= nBytes;
+
+  if (isWritten && isFinal)
+  {
+#if !defined(_WIN32) && defined(O_DIRECT)
+    // The last partial block, and the seek table, can't be written directly
+    if (this->IsDirectIO)
+    {
+      fcntl(this->FileDescriptor, F_SETFL, fcntl(this->FileDescriptor, F_GETFL) & ~O_DIRECT);
+      this->IsDirectIO = false;
+    }
+#endif
+    isWritten = used == 0 || WriteAll(this->FileDescriptor, buffer, used);
+    used = 0;
+  }
+
+  if (!isWritten)
+  {
+    vtkGenericWarningMacro("Failed to write the packet file: " << std::strerror(errno));
+    this->HasFailed = true;
+  }
+  return isWritten;
+}
+
+//-----------------------------------------------------------------------------
+void PacketFileSegmentWriter::FlushIndex()
+{
+  if (!this->IndexFile || this->PendingEntries.empty())
+  {
+    return;
+  }
+  std::fwrite(this->PendingEntries.data(), sizeof(IndexEntry), this->PendingEntries.size(),
+    this->IndexFile);
+  std::fflush(this->IndexFile);
+  this->PendingEntries.clear();
+}
+
+//-----------------------------------------------------------------------------
+bool PacketFileSegmentWriter::ReadIndex(const std::string& segmentFileName,
+  const std::string& framingKey, std::vector<IndexEntry>& entries)
+{
+  entries.clear();
+  std::FILE* file = std::fopen(GetIndexFileName(segmentFileName).c_str(), "rb");
+  if (!file)
+  {
+    return false;
+  }
+
+  char header[IndexHeaderSize];
+  bool isValid = std::fread(header, 1, IndexHeaderSize, file) == IndexHeaderSize &&
+    std::memcmp(header, IndexMagic, sizeof(IndexMagic)) == 0;
+  if (isValid)
+  {
+    // The index must describe this exact segment, whose frames were
+    // split by an interpreter of the same type with the same configuration
+    uint64_t segmentSize = 0;
+    std::memcpy(&segmentSize, header + sizeof(IndexMagic), sizeof(uint64_t));
+    header[IndexHeaderSize - 1] = '\0';
+    const std::string key(header + sizeof(IndexMagic) + sizeof(uint64_t));
+    isValid = segmentSize > 0 && segmentSize == GetFileSize(segmentFileName) &&
+      key == framingKey.substr(0, FramingKeySize - 1);
+  }
+
+  IndexEntry entry;
+  while (isValid && std::fread(&entry, sizeof(IndexEntry), 1, file) == 1)
+  {
+    entries.push_back(entry);
+  }
+  std::fclose(file);
+
+  if (!isValid)
+  {
+    entries.clear();
+  }
+  return isValid && !entries.empty();
+}
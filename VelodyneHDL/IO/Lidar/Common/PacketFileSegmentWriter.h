@@ -0,0 +1,213 @@
+//=========================================================================
+//
+// Copyright 2018 Kitware, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//=========================================================================
+
+#ifndef PACKET_FILE_SEGMENT_WRITER_H
+#define PACKET_FILE_SEGMENT_WRITER_H
+
+// STD
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+class vtkZstdSeekableWriter;
+
+/**
+ * \class PacketFileSegmentWriter
+ * \brief Writes a recording as a series of pcap files (segments), readable by
+ *        vtkPacketFileReader like the ones of vtkPacketFileWriter.
+ *        The records are coalesced in a large aligned buffer which is written to
+ *        the file by whole blocks, possibly bypassing the page cache (O_DIRECT), so
+ *        that a recording can sustain several sensors at full rate.
+ *        A new segment is started when the current one exceeds a size or a duration.
+ *        The segments can be compressed with the zstd seekable format, by frames of
+ *        1 MB of records, which vtkPacketFileReader reads at random positions.
+ *
+ *        Each segment can come with an index sidecar (segment name + ".idx") holding
+ *        the position of each frame, filled as the segment is written, which
+ *        vtkLidarReader uses instead of reading the whole segment when opening it.
+ */
+class PacketFileSegmentWriter
+{
+public:
+  /**
+   * @brief IndexEntry position of a frame in a segment, see FramePosition
+   */
+  struct IndexEntry
+  {
+    int64_t Offset; /*!< Offset in bytes of the pcap record the frame starts in */
+    int32_t Skip;   /*!< Offset specific to the lidar data format */
+    int32_t Unused;
+    double Time;    /*!< Time of the pcap record, in seconds since the epoch */
+  };
+
+  PacketFileSegmentWriter();
+
+  ~PacketFileSegmentWriter();
+
+  /**
+   * @brief Open create the first segment of a recording
+   * @param filename name of the recording. When segments are rotated, they are named
+   *        after it with a 4 digits suffix, e.g. record_0000.pcap, record_0001.pcap.
+   * @param framingKey framing configuration of the interpreter the index is made with,
+   *        see vtkLidarPacketInterpreter::GetFramingKey. An empty string disables the
+   *        index sidecars
+   */
+  bool Open(const std::string& filename, const std::string& framingKey = "");
+
+  bool IsOpen() const { return this->FileDescriptor >= 0; }
+
+  //! flush the buffer and close the current segment
+  void Close();
+
+  const std::string& GetFileName() const { return this->FileName; }
+
+  //! name of a segment of the recording
+  std::string GetSegmentFileName(int segment) const;
+
+  int GetNumberOfSegments() const { return this->SegmentIndex + 1; }
+
+  /**
+   * @brief WritePacket add a pcap record with the same headers as vtkPacketFileWriter
+   * @param data payload of the UDP datagram
+   * @param dataLength size of the payload
+   * @param time reception time of the packet, in seconds since the epoch
+   * @param isNewSegment set to true when the packet is the first one of its segment
+   * @param port UDP destination port to write, 0 to keep the one of the headers
+   * @return false if the packet could not be written
+   */
+  bool WritePacket(const unsigned char* data, unsigned int dataLength, double time,
+    bool& isNewSegment, int port = 0);
+
+  /**
+   * @brief AddFrameToIndex index a frame starting in the last written packet
+   * @param skip offset specific to the lidar data format
+   * @param time time of the frame
+   */
+  void AddFrameToIndex(int skip, double time);
+
+  //! Size in bytes of the write buffer, rounded up to a multiple of Alignment
+  void SetBufferSize(std::size_t bytes);
+
+  //! Size in bytes after which a new segment is started, 0 for no limit
+  uint64_t GetMaxSegmentSize() const { return this->MaxSegmentSize; }
+  void SetMaxSegmentSize(uint64_t bytes) { this->MaxSegmentSize = bytes; }
+
+  //! Duration in seconds after which a new segment is started, 0 for no limit
+  double GetMaxSegmentDuration() const { return this->MaxSegmentDuration; }
+  void SetMaxSegmentDuration(double seconds) { this->MaxSegmentDuration = seconds; }
+
+  //! Compress the segments opened from now on, if VeloView is built with zstd
+  bool GetCompression() const { return this->UseCompression; }
+  void SetCompression(bool value) { this->UseCompression = value; }
+
+  /**
+   * @brief Compression level of the next compressed frames, it can be changed while
+   * writing. See vtkZstdSeekableWriter::SetLevel.
+   */
+  int GetCompressionLevel() const;
+  void SetCompressionLevel(int level);
+
+  //! Bypass the page cache when writing (Linux only)
+  bool GetUseDirectIO() const { return this->UseDirectIO; }
+  void SetUseDirectIO(bool value) { this->UseDirectIO = value; }
+
+  //! Reserve the disk space of the segments ahead of the writes (Linux only)
+  bool GetPreallocate() const { return this->Preallocate; }
+  void SetPreallocate(bool value) { this->Preallocate = value; }
+
+  static std::string GetIndexFileName(const std::string& segmentFileName);
+
+  /**
+   * @brief ReadIndex read the index sidecar of a segment
+   * @param segmentFileName name of the pcap file
+   * @param framingKey framing configuration the index must have been made with
+   * @param entries the frame positions
+   * @return false if there is no index, or if it does not match the pcap file or the
+   * framing configuration
+   */
+  static bool ReadIndex(const std::string& segmentFileName, const std::string& framingKey,
+    std::vector<IndexEntry>& entries);
+
+  /*!< Block size the writes are aligned on */
+  static const std::size_t Alignment = 4096;
+
+private:
+  bool OpenSegment();
+
+  void CloseSegment();
+
+  /**
+   * @brief Flush write the buffer to the file, compressing it if needed
+   * @param isFinal write everything, including the last partial block
+   */
+  bool Flush(bool isFinal);
+
+  /**
+   * @brief WriteBlocks write the whole blocks of a buffer to the file, and move the
+   * remaining bytes to its beginning
+   * @param buffer aligned buffer
+   * @param used number of bytes in the buffer, updated
+   * @param isFinal write everything, including the last partial block
+   */
+  bool WriteBlocks(char* buffer, std::size_t& used, bool isFinal);
+
+  //! write the pending index entries to the sidecar
+  void FlushIndex();
+
+  std::string FileName;
+  std::string FramingKey;
+  std::unique_ptr<vtkZstdSeekableWriter> Compressor;
+
+  int SegmentIndex;
+  int FileDescriptor;
+  std::FILE* IndexFile;
+  std::vector<IndexEntry> PendingEntries;
+
+  /*!< Buffer of BufferSize bytes, aligned on Alignment */
+  char* Buffer;
+  std::size_t BufferSize;
+  std::size_t BufferUsed;
+  /*!< Buffer of the compressed frames, aligned on Alignment */
+  char* Output;
+  std::size_t OutputSize;
+  std::size_t OutputUsed;
+
+  /*!< Bytes of the current segment, written or in the buffer, before compression */
+  uint64_t SegmentSize;
+  /*!< Bytes of the current segment file, written or in the output buffer */
+  uint64_t FileSize;
+  /*!< Bytes of the current segment reserved on the disk */
+  uint64_t AllocatedSize;
+  uint64_t LastRecordOffset;
+  double SegmentStartTime;
+  uint64_t PacketsInSegment;
+
+  uint64_t MaxSegmentSize;
+  double MaxSegmentDuration;
+  bool UseCompression;
+  bool IsCompressed;
+  bool UseDirectIO;
+  bool IsDirectIO;
+  bool Preallocate;
+  bool CanPreallocate;
+  bool HasFailed;
+};
+
+#endif // PACKET_FILE_SEGMENT_WRITER_H
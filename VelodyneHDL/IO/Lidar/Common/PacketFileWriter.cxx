@@ -1,21 +1,115 @@
 #include "PacketFileWriter.h"
+#include "NetworkPacket.h"
+#include "vtkLidarPacketInterpreter.h"
+
+#include "vtkZstdSeekableFile.h"
+
+#include <algorithm>
+#include <cmath>
 
 //! @todo this include is only for vtkGenericWarningMacro which is strange
 #include <vtkMath.h>
 
+namespace
+{
+// Packets written between two checks of the compression level
+const unsigned int CompressionCheckPeriod = 1024;
+// Queued packets above which the compression gets faster, and below which it
+// gets back to the requested level. About 20 ms and 0.3 ms of a HDL-64 stream.
+const unsigned int CompressionHighWatermark = 4096;
+const unsigned int CompressionLowWatermark = 64;
+}
+
 //-----------------------------------------------------------------------------
 void PacketFileWriter::ThreadLoop()
 {
-  std::string* packet = 0;
+  NetworkPacket* packet = 0;
+  unsigned int nPackets = 0;
   while (this->Packets->dequeue(packet))
   {
-    this->PacketWriter.WritePacket(
-          reinterpret_cast<const unsigned char*>(packet->c_str()), packet->length());
+    // pcap timestamps have a microsecond resolution
+    const double time = 1e-6 * std::floor(packet->Timestamp * 1e6 + 0.5);
+    if (this->RecordingMode == Pcap)
+    {
+      this->PacketWriter.WritePacket(packet->GetData(), packet->GetLength(), time, packet->Port);
+      delete packet;
+      continue;
+    }
+    if (this->RecordingMode == Compressed && ++nPackets % CompressionCheckPeriod == 0)
+    {
+      this->AdaptCompressionLevel();
+    }
+    bool isNewSegment = false;
+    if (this->SegmentWriter.WritePacket(
+          packet->GetData(), packet->GetLength(), time, isNewSegment, packet->Port))
+    {
+      this->IsFirstLidarPacket |= isNewSegment;
+      if (isNewSegment && this->IndexInterpreter)
+      {
+        // Each segment is read on its own, by an interpreter which
+        // has not seen the packets of the previous segments
+        this->IndexInterpreter->ResetCurrentFrame();
+      }
+      if (this->IndexInterpreter &&
+        (this->IndexedPort == 0 || packet->Port == this->IndexedPort) &&
+        this->IndexInterpreter->IsLidarPacket(packet->GetData(), packet->GetLength()))
+      {
+        // Same frame positions as vtkLidarReader::ReadFrameInformation
+        if (this->IsFirstLidarPacket)
+        {
+          this->SegmentWriter.AddFrameToIndex(0, time - 1);
+          this->IsFirstLidarPacket = false;
+        }
+        bool isNewFrame = false;
+        int framePositionInPacket = 0;
+        this->IndexInterpreter->PreProcessPacket(
+          packet->GetData(), packet->GetLength(), isNewFrame, framePositionInPacket);
+        if (isNewFrame)
+        {
+          this->SegmentWriter.AddFrameToIndex(framePositionInPacket, time);
+        }
+      }
+    }
 
     delete packet;
   }
 }
 
+//-----------------------------------------------------------------------------
+void PacketFileWriter::AdaptCompressionLevel()
+{
+  const unsigned int nQueued = this->Packets->size();
+  const int level = this->SegmentWriter.GetCompressionLevel();
+  if (nQueued > CompressionHighWatermark && level > vtkZstdSeekableWriter::GetMinimumLevel())
+  {
+    this->SegmentWriter.SetCompressionLevel(level - 1);
+  }
+  else if (nQueued < CompressionLowWatermark && level < this->CompressionLevel)
+  {
+    this->SegmentWriter.SetCompressionLevel(level + 1);
+  }
+}
+
+//-----------------------------------------------------------------------------
+bool PacketFileWriter::IsOpen()
+{
+  return this->PacketWriter.IsOpen() || this->SegmentWriter.IsOpen();
+}
+
+//-----------------------------------------------------------------------------
+void PacketFileWriter::Close()
+{
+  this->Stop();
+  this->PacketWriter.Close();
+  this->SegmentWriter.Close();
+}
+
+//-----------------------------------------------------------------------------
+void PacketFileWriter::SetInterpreter(vtkLidarPacketInterpreter* interpreter)
+{
+  this->Interpreter = interpreter;
+}
+
 //-----------------------------------------------------------------------------
 void PacketFileWriter::Start(const std::string &filename)
 {
@@ -24,21 +118,58 @@ void PacketFileWriter::Start(const std::string &filename)
     return;
   }
 
-  if (this->PacketWriter.GetFileName() != filename)
+  if (this->RecordingMode != Pcap)
   {
     this->PacketWriter.Close();
-  }
+    const bool isCompressed = this->RecordingMode == Compressed;
+    if (this->SegmentWriter.GetFileName() != filename ||
+      this->SegmentWriter.GetCompression() != isCompressed)
+    {
+      this->SegmentWriter.Close();
+    }
+    this->SegmentWriter.SetCompression(isCompressed);
+    this->SegmentWriter.SetCompressionLevel(this->CompressionLevel);
 
-  if (!this->PacketWriter.IsOpen())
+    if (!this->SegmentWriter.IsOpen())
+    {
+      // The index is only valid if the frames are split as the reader will do
+      this->IndexInterpreter = nullptr;
+      if (this->Interpreter && this->Interpreter->GetIsCalibrated())
+      {
+        this->IndexInterpreter.TakeReference(this->Interpreter->NewInstance());
+        if (!this->IndexInterpreter->CopyConfiguration(this->Interpreter))
+        {
+          this->IndexInterpreter = nullptr;
+        }
+      }
+      const std::string framingKey =
+        this->IndexInterpreter ? this->IndexInterpreter->GetFramingKey() : "";
+      if (!this->SegmentWriter.Open(filename, framingKey))
+      {
+        return;
+      }
+      this->IsFirstLidarPacket = true;
+    }
+  }
+  else
   {
-    if (!this->PacketWriter.Open(filename))
+    this->SegmentWriter.Close();
+    if (this->PacketWriter.GetFileName() != filename)
     {
-      vtkGenericWarningMacro("Failed to open packet file: " << filename);
-      return;
+      this->PacketWriter.Close();
+    }
+
+    if (!this->PacketWriter.IsOpen())
+    {
+      if (!this->PacketWriter.Open(filename))
+      {
+        vtkGenericWarningMacro("Failed to open packet file: " << filename);
+        return;
+      }
     }
   }
 
-  this->Packets.reset(new SynchronizedQueue<std::string*>);
+  this->Packets.reset(new SynchronizedQueue<NetworkPacket*>);
   this->Thread = boost::shared_ptr<boost::thread>(
         new boost::thread(boost::bind(&PacketFileWriter::ThreadLoop, this)));
 }
@@ -56,7 +187,7 @@ void PacketFileWriter::Stop()
 }
 
 //-----------------------------------------------------------------------------
-void PacketFileWriter::Enqueue(std::string *packet)
+void PacketFileWriter::Enqueue(NetworkPacket* packet)
 {
   // TODO
   // After capturing a stream and stoping the recording, Packets is NULL
@@ -67,6 +198,7 @@ void PacketFileWriter::Enqueue(std::string *packet)
   }
   else
   {
+    delete packet;
     this->Stop();
   }
 }
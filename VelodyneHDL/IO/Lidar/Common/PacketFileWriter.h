@@ -34,28 +34,89 @@
 #include <boost/thread/thread.hpp>
 #include <boost/asio.hpp>
 
+#include <vtkSmartPointer.h>
+
 #include "vtkPacketFileWriter.h"
+#include "PacketFileSegmentWriter.h"
 #include "SynchronizedQueue.h"
 
+class NetworkPacket;
+class vtkLidarPacketInterpreter;
+
 class PacketFileWriter
 {
 public:
+  /**
+   * @brief The RECORDING_MODE enum selects how the packets are written
+   */
+  enum RECORDING_MODE
+  {
+    Pcap = 0,     /*!< one libpcap call per packet, with vtkPacketFileWriter */
+    Buffered = 1, /*!< large buffered writes, rotated segments and index sidecars,
+                       with PacketFileSegmentWriter */
+    Compressed = 2 /*!< Buffered, with the segments compressed by zstd */
+  };
+
   void ThreadLoop();
 
   void Start(const std::string& filename);
 
   void Stop();
 
-  void Enqueue(std::string* packet);
+  void Enqueue(NetworkPacket* packet);
+
+  bool IsOpen();
+
+  void Close();
+
+  int GetRecordingMode() { return this->RecordingMode; }
+  //! Takes effect at the next start of the recording
+  void SetRecordingMode(int mode) { this->RecordingMode = mode; }
 
-  bool IsOpen() { return this->PacketWriter.IsOpen(); }
+  int GetCompressionLevel() { return this->CompressionLevel; }
+  /**
+   * @brief SetCompressionLevel zstd level of the Compressed mode. The writing thread
+   * lowers it temporarily when the packets arrive faster than they are compressed,
+   * so that the queue of packets does not grow.
+   */
+  void SetCompressionLevel(int level) { this->CompressionLevel = level; }
 
-  void Close() { this->PacketWriter.Close(); }
+  /**
+   * @brief SetInterpreter set the interpreter whose configuration is used to index
+   * the frames of the Buffered and Compressed recordings. The index is only written if the
+   * interpreter is calibrated when the recording starts, and supports CopyConfiguration.
+   */
+  void SetInterpreter(vtkLidarPacketInterpreter* interpreter);
+
+  /**
+   * @brief SetIndexedPort only index the frames of the packets received on a port,
+   * when several sensors are recorded. 0 indexes the lidar packets of any port.
+   */
+  void SetIndexedPort(int port) { this->IndexedPort = port; }
+  int GetIndexedPort() { return this->IndexedPort; }
+
+  //! Writer of the Buffered and Compressed modes, to set their options
+  PacketFileSegmentWriter& GetSegmentWriter() { return this->SegmentWriter; }
 
 private:
+  //! lower or raise the compression level depending on the queued packets
+  void AdaptCompressionLevel();
+
+  int RecordingMode = Pcap;
+  int CompressionLevel = 3;
+  int IndexedPort = 0;
+
   vtkPacketFileWriter PacketWriter;
+  PacketFileSegmentWriter SegmentWriter;
+
+  vtkSmartPointer<vtkLidarPacketInterpreter> Interpreter;
+  //! Copy of Interpreter used by the writing thread to find the frames
+  vtkSmartPointer<vtkLidarPacketInterpreter> IndexInterpreter;
+  //! The next lidar packet is the first one of its segment
+  bool IsFirstLidarPacket = true;
+
   boost::shared_ptr<boost::thread> Thread;
-  boost::shared_ptr<SynchronizedQueue<std::string*> > Packets;
+  boost::shared_ptr<SynchronizedQueue<NetworkPacket*> > Packets;
 };
 
 
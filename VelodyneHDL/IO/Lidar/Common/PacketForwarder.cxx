@@ -0,0 +1,243 @@
+//=========================================================================
+//
+// Copyright 2018 Kitware, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//=========================================================================
+
+// LOCAL
+#include "PacketForwarder.h"
+
+#include <vtkMath.h>
+
+// BOOST
+#include <boost/algorithm/string.hpp>
+
+// STD
+#include <algorithm>
+#include <cstring>
+
+#ifdef __linux__
+#include <cerrno>
+#include <sys/uio.h>
+#endif
+
+//-----------------------------------------------------------------------------
+PacketForwarder::PacketForwarder(const std::string& destinations, int port,
+  unsigned int ringSize, unsigned int batchSize)
+  : Socket(IOService)
+  , RingSize(std::max(1u, ringSize))
+  , BatchSize(std::max(1u, batchSize))
+  , Head(0)
+  , Count(0)
+  , ShouldStop(false)
+  , DropCount(0)
+  , HasWarned(false)
+{
+  std::vector<std::string> addresses;
+  boost::split(addresses, destinations, boost::is_any_of(",; "), boost::token_compress_on);
+
+  bool hasMulticast = false;
+  for (const std::string& address : addresses)
+  {
+    if (address.empty())
+    {
+      continue;
+    }
+
+    // Only v4 addresses are accepted, as the socket is opened with this protocol
+    boost::system::error_code errCode;
+    boost::asio::ip::address_v4 ipAddress = boost::asio::ip::address_v4::from_string(address, errCode);
+    if (errCode)
+    {
+      vtkGenericWarningMacro("Forward ip address " << address << " not valid, packets won't be forwarded to it");
+      continue;
+    }
+    hasMulticast |= ipAddress.is_multicast();
+    this->Destinations.push_back(boost::asio::ip::udp::endpoint(ipAddress, port));
+  }
+
+  this->Socket.open(boost::asio::ip::udp::v4());
+  // Allow to send the packet on the same machine
+  this->Socket.set_option(boost::asio::ip::multicast::enable_loopback(true));
+  if (hasMulticast)
+  {
+    // Keep the multicast traffic on the local network
+    this->Socket.set_option(boost::asio::ip::multicast::hops(1));
+  }
+
+  this->Slots.assign(this->RingSize * SlotSize, 0);
+  this->Lengths.assign(this->RingSize, 0);
+
+#ifdef __linux__
+  const std::size_t nMessages = this->BatchSize * this->Destinations.size();
+  this->Iovecs.resize(this->BatchSize);
+  this->Headers.resize(nMessages);
+#endif
+}
+
+//-----------------------------------------------------------------------------
+PacketForwarder::~PacketForwarder()
+{
+  this->Stop();
+}
+
+//-----------------------------------------------------------------------------
+void PacketForwarder::Start()
+{
+  if (this->Thread || !this->HasDestination())
+  {
+    return;
+  }
+
+  this->ShouldStop = false;
+  this->Thread.reset(new boost::thread(boost::bind(&PacketForwarder::ThreadLoop, this)));
+}
+
+//-----------------------------------------------------------------------------
+void PacketForwarder::Stop()
+{
+  if (!this->Thread)
+  {
+    return;
+  }
+
+  {
+    boost::lock_guard<boost::mutex> lock(this->RingMutex);
+    this->ShouldStop = true;
+  }
+  this->RingCondition.notify_one();
+  this->Thread->join();
+  this->Thread.reset();
+}
+
+//-----------------------------------------------------------------------------
+void PacketForwarder::Enqueue(const char* data, std::size_t numberOfBytes)
+{
+  {
+    boost::lock_guard<boost::mutex> lock(this->RingMutex);
+    if (this->Count == this->RingSize)
+    {
+      this->DropCount.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+
+    // The slots between Head and Head + Count are owned by the forwarding
+    // thread, the one at Head is free
+    const std::size_t nBytes = std::min(numberOfBytes, SlotSize);
+    std::memcpy(&this->Slots[this->Head * SlotSize], data, nBytes);
+    this->Lengths[this->Head] = nBytes;
+    this->Head = (this->Head + 1) % this->RingSize;
+    ++this->Count;
+  }
+  this->RingCondition.notify_one();
+}
+
+//-----------------------------------------------------------------------------
+void PacketForwarder::ThreadLoop()
+{
+  while (true)
+  {
+    std::size_t firstSlot = 0;
+    std::size_t nSlots = 0;
+    {
+      boost::unique_lock<boost::mutex> lock(this->RingMutex);
+      while (this->Count == 0 && !this->ShouldStop)
+      {
+        this->RingCondition.wait(lock);
+      }
+      if (this->ShouldStop)
+      {
+        return;
+      }
+
+      // Take everything available, up to the end of the ring
+      firstSlot = (this->Head + this->RingSize - this->Count) % this->RingSize;
+      nSlots = std::min(std::min(this->Count, this->RingSize - firstSlot), this->BatchSize);
+    }
+
+    // The ring is not locked while sending, Enqueue only writes the free slots
+    this->SendBatch(firstSlot, nSlots);
+
+    {
+      boost::lock_guard<boost::mutex> lock(this->RingMutex);
+      this->Count -= nSlots;
+    }
+  }
+}
+
+//-----------------------------------------------------------------------------
+void PacketForwarder::SendBatch(std::size_t firstSlot, std::size_t nSlots)
+{
+#ifdef __linux__
+  // One message per datagram and per destination, all sharing the datagram iovec
+  const std::size_t nDestinations = this->Destinations.size();
+  std::size_t nMessages = 0;
+  for (std::size_t i = 0; i < nSlots; ++i)
+  {
+    const std::size_t slot = firstSlot + i;
+    this->Iovecs[i].iov_base = &this->Slots[slot * SlotSize];
+    this->Iovecs[i].iov_len = this->Lengths[slot];
+    for (std::size_t d = 0; d < nDestinations; ++d)
+    {
+      struct mmsghdr& header = this->Headers[nMessages++];
+      std::memset(&header, 0, sizeof(struct mmsghdr));
+      header.msg_hdr.msg_name = this->Destinations[d].data();
+      header.msg_hdr.msg_namelen = static_cast<socklen_t>(this->Destinations[d].size());
+      header.msg_hdr.msg_iov = &this->Iovecs[i];
+      header.msg_hdr.msg_iovlen = 1;
+    }
+  }
+
+  const int fd = this->Socket.native_handle();
+  std::size_t nSent = 0;
+  while (nSent < nMessages)
+  {
+    const int result = sendmmsg(fd, &this->Headers[nSent],
+                                static_cast<unsigned int>(nMessages - nSent), 0);
+    if (result < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      if (!this->HasWarned)
+      {
+        vtkGenericWarningMacro("Failed to forward packets: " << std::strerror(errno));
+        this->HasWarned = true;
+      }
+      // skip the message which failed and go on with the others
+      ++nSent;
+      continue;
+    }
+    nSent += static_cast<std::size_t>(result);
+  }
+#else
+  for (std::size_t i = 0; i < nSlots; ++i)
+  {
+    const std::size_t slot = firstSlot + i;
+    for (const boost::asio::ip::udp::endpoint& destination : this->Destinations)
+    {
+      boost::system::error_code errCode;
+      this->Socket.send_to(
+        boost::asio::buffer(&this->Slots[slot * SlotSize], this->Lengths[slot]),
+        destination, 0, errCode);
+      if (errCode && !this->HasWarned)
+      {
+        vtkGenericWarningMacro("Failed to forward packets: " << errCode.message());
+        this->HasWarned = true;
+      }
+    }
+  }
+#endif
+}
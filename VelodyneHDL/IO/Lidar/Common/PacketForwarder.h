@@ -0,0 +1,125 @@
+//=========================================================================
+//
+// Copyright 2018 Kitware, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//=========================================================================
+
+#ifndef PACKET_FORWARDER_H
+#define PACKET_FORWARDER_H
+
+// BOOST
+#include <boost/asio.hpp>
+#include <boost/thread/thread.hpp>
+
+// STD
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/socket.h>
+#endif
+
+/**
+ * \class PacketForwarder
+ * \brief Forwards the received datagrams to one or several destinations from its own
+ *        thread, so that a slow forward path never delays the reception.
+ *        The datagrams are copied into a preallocated ring of slots by Enqueue, and
+ *        sent by batches, with sendmmsg on Linux. When the ring is full, the new
+ *        datagrams are not forwarded and counted as dropped.
+ */
+class PacketForwarder
+{
+public:
+  /**
+   * @brief PacketForwarder
+   * @param destinations comma separated list of unicast or multicast ip addresses
+   * @param port the port the datagrams are sent to on each destination
+   * @param ringSize number of datagrams which can wait to be sent
+   * @param batchSize maximum number of datagrams sent per system call
+   */
+  PacketForwarder(const std::string& destinations, int port,
+    unsigned int ringSize = 4096, unsigned int batchSize = 64);
+
+  ~PacketForwarder();
+
+  /**
+   * @brief HasDestination
+   * @return false if none of the given destinations is a valid address
+   */
+  bool HasDestination() const { return !this->Destinations.empty(); }
+
+  void Start();
+
+  void Stop();
+
+  /**
+   * @brief Enqueue copy a datagram in the ring, to be sent by the forwarding thread
+   * @param data pointer on the received bytes
+   * @param numberOfBytes size of the datagram
+   */
+  void Enqueue(const char* data, std::size_t numberOfBytes);
+
+  /**
+   * @brief GetDropCount
+   * @return the number of datagrams which were not forwarded because the ring was full
+   */
+  uint64_t GetDropCount() const { return this->DropCount; }
+
+  /*!< Size of a slot of the ring, datagrams are truncated to it */
+  static const std::size_t SlotSize = 1500;
+
+private:
+  void ThreadLoop();
+
+  /**
+   * @brief SendBatch send contiguous slots of the ring to all the destinations
+   * @param firstSlot index of the first slot
+   * @param nSlots number of slots
+   */
+  void SendBatch(std::size_t firstSlot, std::size_t nSlots);
+
+  boost::asio::io_service IOService;
+  boost::asio::ip::udp::socket Socket;
+  std::vector<boost::asio::ip::udp::endpoint> Destinations;
+
+  /*!< Ring of RingSize slots of SlotSize bytes */
+  std::vector<char> Slots;
+  std::vector<std::size_t> Lengths;
+  std::size_t RingSize;
+  std::size_t BatchSize;
+
+  /*!< Index of the next slot written by Enqueue */
+  std::size_t Head;
+  /*!< Number of slots written and not sent yet */
+  std::size_t Count;
+
+  boost::mutex RingMutex;
+  boost::condition_variable RingCondition;
+  bool ShouldStop;
+
+  std::atomic<uint64_t> DropCount;
+  /*!< Only warn once about a failing destination */
+  bool HasWarned;
+
+  boost::shared_ptr<boost::thread> Thread;
+
+#ifdef __linux__
+  std::vector<struct iovec> Iovecs;
+  std::vector<struct mmsghdr> Headers;
+#endif
+};
+
+#endif // PACKET_FORWARDER_H
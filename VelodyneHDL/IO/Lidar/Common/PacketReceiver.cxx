@@ -18,20 +18,65 @@
 // LOCAL
 #include "PacketReceiver.h"
 #include "NetworkSource.h"
+#include "NetworkPacket.h"
+#include "PacketForwarder.h"
+#include "StreamStatistics.h"
 
 #include <vtkMath.h>
 
+#include <chrono>
+
+#ifdef __linux__
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <linux/net_tstamp.h>
+#include <netinet/in.h>
+#include <sys/uio.h>
+
+// Not exposed by old glibc headers, but supported since Linux 2.6.33
+#ifndef SO_RXQ_OVFL
+#define SO_RXQ_OVFL 40
+#endif
+#endif
+
+namespace
+{
+//! Clock of the kernel timestamps, in seconds since the epoch
+double WallClockNow()
+{
+  return std::chrono::duration<double>(
+    std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+#ifdef __linux__
+// Ancillary data of a datagram: the drop counter, and the timestamps
+// (SO_TIMESTAMPING gives three of them)
+const std::size_t ControlSize =
+  CMSG_SPACE(sizeof(uint32_t)) + CMSG_SPACE(3 * sizeof(struct timespec));
+
+// A datagram older than that was not stamped with the system clock, as the
+// receive buffer is drained far more often
+const double MaxTimestampAge = 10.0;
+const double MaxClockOffset = 1e-3;
+#endif
+}
 
 //-----------------------------------------------------------------------------
 PacketReceiver::PacketReceiver(boost::asio::io_service &io, int port, int forwardport, std::string forwarddestinationIp, bool isforwarding, NetworkSource *parent)
-  : isForwarding(isforwarding)
-  , Port(port)
+  : Port(port)
   , PacketCounter(0)
   , Socket(io)
-  , ForwardedSocket(io)
   , Parent(parent)
   , IsReceiving(true)
   , ShouldStop(false)
+  , IsCrashAnalysing(false)
+  , BatchSize(0)
+  , KernelDropCount(0)
+  , TimestampMode(Host)
+  , HasWarnedAboutTimestamps(false)
 {
   this->Socket.open(boost::asio::ip::udp::v4()); // Opening the socket with an UDP v4 protocol
   this->Socket.set_option(boost::asio::ip::udp::socket::reuse_address(
@@ -39,38 +84,25 @@ PacketReceiver::PacketReceiver(boost::asio::io_service &io, int port, int forwar
   this->Socket.bind(boost::asio::ip::udp::endpoint(
                 boost::asio::ip::udp::v4(), port)); // Bind the socket to the right address
 
-  // Check that the provided ipadress is valid
-  boost::system::error_code errCode;
-  boost::asio::ip::address ipAddressForwarding = boost::asio::ip::address_v4::from_string(forwarddestinationIp, errCode);
-
-  // If the ip address is not valid we replace it by a generic
-  // 0.0.0.0 ip address. This is due to the application
-  // crashes on windows if a not valid ip address is provided
-  // with error message:
-  // Qt has caught an exception from an event handler. This
-  // is not supported in Qt.
-  if (errCode)
-  {
-    ipAddressForwarding = boost::asio::ip::address_v4::from_string("0.0.0.0");
-    if (this->isForwarding)
+  if (isforwarding)
+  {
+    this->Forwarder.reset(new PacketForwarder(forwarddestinationIp, forwardport));
+    if (this->Forwarder->HasDestination())
+    {
+      this->Forwarder->Start();
+    }
+    else
     {
-      vtkGenericWarningMacro("Forward ip address not valid, packets won't be forwarded");
-      this->isForwarding = false;
+      vtkGenericWarningMacro("No valid forward ip address, packets won't be forwarded");
+      this->Forwarder.reset();
     }
   }
-
-  this->ForwardEndpoint = boost::asio::ip::udp::endpoint(ipAddressForwarding, forwardport);
-  this->ForwardedSocket.open(ForwardEndpoint.protocol()); // Opening the socket with an UDP v4 protocol
-  // toward the forwarded ip address and port
-  this->ForwardedSocket.set_option(boost::asio::ip::multicast::enable_loopback(
-                                true)); // Allow to send the packet on the same machine
 }
 
 //-----------------------------------------------------------------------------
 PacketReceiver::~PacketReceiver()
 {
   this->Socket.cancel();
-  this->ForwardedSocket.cancel();
   {
     boost::unique_lock<boost::mutex> guard(this->IsReceivingMtx);
     this->ShouldStop = true;
@@ -80,6 +112,9 @@ PacketReceiver::~PacketReceiver()
     }
   }
 
+  // No more packets will be enqueued
+  this->Forwarder.reset();
+
   // Close and delete the logs files. So that,
   // if a log file is present in the next session
   // it means that the software has been closed
@@ -96,11 +131,24 @@ void PacketReceiver::StartReceive()
     this->IsReceiving = true;
   }
 
+#ifdef __linux__
+  if (this->BatchSize > 0)
+  {
+    // Only wait for the socket to be readable, the datagrams are then
+    // drained in one go by BatchSocketCallback
+    this->Socket.async_receive(boost::asio::null_buffers(),
+                               boost::bind(&PacketReceiver::BatchSocketCallback, this,
+                                           boost::asio::placeholders::error));
+    return;
+  }
+#endif
+
   // expecting exactly 1206 bytes, using a larger buffer so that if a
   // larger packet arrives unexpectedly we'll notice it.
-  this->Socket.async_receive(boost::asio::buffer(this->RXBuffer, BUFFER_SIZE),
-                             boost::bind(&PacketReceiver::SocketCallback, this, boost::asio::placeholders::error,
-                                         boost::asio::placeholders::bytes_transferred));
+  this->Socket.async_receive_from(boost::asio::buffer(this->RXBuffer, BUFFER_SIZE),
+                                  this->SenderEndpoint,
+                                  boost::bind(&PacketReceiver::SocketCallback, this, boost::asio::placeholders::error,
+                                              boost::asio::placeholders::bytes_transferred));
 }
 
 //-----------------------------------------------------------------------------
@@ -114,45 +162,306 @@ void PacketReceiver::EnableCrashAnalysing(std::string filenameCrashAnalysis_, un
     this->CrashAnalysis.SetNbrPacketsToStore(nbrPacketToStore_);
     this->CrashAnalysis.SetFilename(filenameCrashAnalysis_);
     this->CrashAnalysis.ArchivePreviousLogIfExist();
+    this->CrashAnalysis.StartAnalyzer();
   }
 }
 
 //-----------------------------------------------------------------------------
-void PacketReceiver::SocketCallback(
-  const boost::system::error_code& error, std::size_t numberOfBytes)
+void PacketReceiver::SetReceiveBufferSize(int size)
 {
-  if (error || this->ShouldStop)
+  if (size <= 0)
   {
-    // This is called on cancel
-    // TODO: Check other error codes
+    return;
+  }
+
+  boost::system::error_code errCode;
+  this->Socket.set_option(boost::asio::socket_base::receive_buffer_size(size), errCode);
+  boost::asio::socket_base::receive_buffer_size grantedSize;
+  this->Socket.get_option(grantedSize, errCode);
+
+  // Linux reports twice the requested size to account for its bookkeeping overhead
+#ifdef __linux__
+  const int usableSize = grantedSize.value() / 2;
+#else
+  const int usableSize = grantedSize.value();
+#endif
+  if (errCode || usableSize < size)
+  {
+    vtkGenericWarningMacro("Requested a receive buffer of " << size << " bytes on port "
+      << this->Port << " but only got " << usableSize << " bytes."
+      << " Consider increasing net.core.rmem_max");
+  }
+}
+
+//-----------------------------------------------------------------------------
+void PacketReceiver::SetReceiveBatchSize(unsigned int batchSize)
+{
+#ifdef __linux__
+  this->BatchSize = batchSize;
+  if (this->BatchSize == 0)
+  {
+    return;
+  }
+
+  // Ask the kernel to attach its drop counter to each received datagram
+  int enable = 1;
+  if (setsockopt(this->Socket.native_handle(), SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(enable)) != 0)
+  {
+    vtkGenericWarningMacro("Unable to enable SO_RXQ_OVFL on port " << this->Port
+      << ", kernel drops won't be reported");
+  }
+
+  this->BatchBuffer.assign(this->BatchSize * BUFFER_SIZE, 0);
+  this->BatchControl.assign(this->BatchSize * ControlSize, 0);
+  this->BatchAddresses.resize(this->BatchSize);
+  this->BatchIovecs.resize(this->BatchSize);
+  this->BatchHeaders.resize(this->BatchSize);
+  for (unsigned int k = 0; k < this->BatchSize; ++k)
+  {
+    this->BatchIovecs[k].iov_base = &this->BatchBuffer[k * BUFFER_SIZE];
+    this->BatchIovecs[k].iov_len = BUFFER_SIZE;
+    std::memset(&this->BatchHeaders[k], 0, sizeof(struct mmsghdr));
+    this->BatchHeaders[k].msg_hdr.msg_iov = &this->BatchIovecs[k];
+    this->BatchHeaders[k].msg_hdr.msg_iovlen = 1;
+  }
+#else
+  if (batchSize > 0)
+  {
+    vtkGenericWarningMacro("Batched receive is only available on Linux, "
+                           "falling back to one datagram per receive");
+  }
+#endif
+}
+
+//-----------------------------------------------------------------------------
+void PacketReceiver::SetTimestampMode(int mode)
+{
+  this->TimestampMode = Host;
+#ifdef __linux__
+  const int fd = this->Socket.native_handle();
+  if (mode == Hardware)
+  {
+    int flags = SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE |
+      SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+    if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == 0)
+    {
+      this->TimestampMode = Hardware;
+      return;
+    }
+    vtkGenericWarningMacro("Unable to enable SO_TIMESTAMPING on port " << this->Port
+      << ", using the kernel timestamps");
+    mode = Kernel;
+  }
+  if (mode == Kernel)
+  {
+    int enable = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable)) == 0)
+    {
+      this->TimestampMode = Kernel;
+    }
+    else
     {
-      boost::lock_guard<boost::mutex> guard(this->IsReceivingMtx);
-      this->IsReceiving = false;
+      vtkGenericWarningMacro("Unable to enable SO_TIMESTAMPNS on port " << this->Port
+        << ", using the host clock");
     }
-    this->IsReceivingCond.notify_one();
+  }
+#else
+  if (mode != Host)
+  {
+    vtkGenericWarningMacro("Kernel timestamps are only available on Linux, using the host clock");
+  }
+#endif
+}
 
-    return;
+//-----------------------------------------------------------------------------
+bool PacketReceiver::SaveLastPackets(const std::string& filename) const
+{
+  if (!this->IsCrashAnalysing)
+  {
+    return false;
+  }
+  return this->CrashAnalysis.WriteLastPackets(filename);
+}
+
+//-----------------------------------------------------------------------------
+unsigned int PacketReceiver::GetKernelDropCount() const
+{
+  return this->KernelDropCount;
+}
+
+//-----------------------------------------------------------------------------
+unsigned int PacketReceiver::GetForwardDropCount() const
+{
+  return this->Forwarder ? static_cast<unsigned int>(this->Forwarder->GetDropCount()) : 0;
+}
+
+//-----------------------------------------------------------------------------
+void PacketReceiver::StopReceiving()
+{
+  {
+    boost::lock_guard<boost::mutex> guard(this->IsReceivingMtx);
+    this->IsReceiving = false;
   }
-  std::string* packet = new std::string(this->RXBuffer, numberOfBytes);
+  this->IsReceivingCond.notify_one();
+}
+
+//-----------------------------------------------------------------------------
+void PacketReceiver::ProcessPacket(const char* data, std::size_t numberOfBytes,
+  double receptionTime, double timestamp, uint32_t sourceAddress)
+{
+  NetworkPacket* packet = new NetworkPacket(
+    data, numberOfBytes, receptionTime, timestamp, this->Port, sourceAddress);
 
-  if (this->isForwarding)
+  if (this->Forwarder)
   {
-    ForwardedSocket.send_to(boost::asio::buffer(packet->c_str(), numberOfBytes), ForwardEndpoint);
+    this->Forwarder->Enqueue(data, numberOfBytes);
   }
 
   if (this->IsCrashAnalysing)
   {
-    this->CrashAnalysis.AddPacket(*packet);
+    this->CrashAnalysis.AddPacket(data, numberOfBytes, timestamp);
   }
 
-  this->Parent->QueuePackets(packet);
+  if (this->Parent->Statistics)
+  {
+    this->Parent->Statistics->PacketsReceived.fetch_add(1, std::memory_order_relaxed);
+  }
 
-  this->StartReceive();
+  this->Parent->QueuePackets(packet);
 
   if ((++this->PacketCounter % 5000) == 0)
   {
     std::cout << "RECV packets: " << this->PacketCounter << " on " << this->Port << std::endl;
-    ;
   }
 }
 
+//-----------------------------------------------------------------------------
+void PacketReceiver::BatchSocketCallback(const boost::system::error_code& error)
+{
+  if (error || this->ShouldStop)
+  {
+    this->StopReceiving();
+    return;
+  }
+
+#ifdef __linux__
+  const int fd = this->Socket.native_handle();
+
+  // Drain the socket: a partially filled batch means the queue was empty
+  int nbReceived = static_cast<int>(this->BatchSize);
+  while (nbReceived == static_cast<int>(this->BatchSize))
+  {
+    // recvmmsg overwrites the lengths, they have to be restored before each call
+    for (unsigned int k = 0; k < this->BatchSize; ++k)
+    {
+      this->BatchHeaders[k].msg_hdr.msg_name = &this->BatchAddresses[k];
+      this->BatchHeaders[k].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+      this->BatchHeaders[k].msg_hdr.msg_control = &this->BatchControl[k * ControlSize];
+      this->BatchHeaders[k].msg_hdr.msg_controllen = ControlSize;
+      this->BatchHeaders[k].msg_hdr.msg_flags = 0;
+      this->BatchHeaders[k].msg_len = 0;
+    }
+
+    nbReceived = recvmmsg(fd, this->BatchHeaders.data(), this->BatchSize, MSG_DONTWAIT, nullptr);
+    if (nbReceived < 0)
+    {
+      if (errno == EINTR)
+      {
+        nbReceived = static_cast<int>(this->BatchSize);
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+      {
+        vtkGenericWarningMacro("recvmmsg failed on port " << this->Port << ": " << std::strerror(errno));
+      }
+      break;
+    }
+
+    // The clocks are read once per batch. The kernel timestamps are converted to
+    // the monotonic clock of the statistics from their age.
+    const double receptionNow = StreamStatistics::Now();
+    const double timestampNow = WallClockNow();
+    for (int k = 0; k < nbReceived; ++k)
+    {
+      double timestamp = timestampNow;
+      struct msghdr& header = this->BatchHeaders[k].msg_hdr;
+      for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&header); cmsg != nullptr;
+           cmsg = CMSG_NXTHDR(&header, cmsg))
+      {
+        if (cmsg->cmsg_level != SOL_SOCKET)
+        {
+          continue;
+        }
+        if (cmsg->cmsg_type == SO_RXQ_OVFL)
+        {
+          uint32_t drops = 0;
+          std::memcpy(&drops, CMSG_DATA(cmsg), sizeof(drops));
+          this->KernelDropCount = drops;
+        }
+        else if (cmsg->cmsg_type == SCM_TIMESTAMPNS)
+        {
+          struct timespec time;
+          std::memcpy(&time, CMSG_DATA(cmsg), sizeof(time));
+          timestamp = time.tv_sec + 1e-9 * time.tv_nsec;
+        }
+        else if (cmsg->cmsg_type == SCM_TIMESTAMPING)
+        {
+          // software time first, then raw hardware time if the NIC stamped the datagram
+          struct timespec times[3];
+          std::memcpy(times, CMSG_DATA(cmsg), sizeof(times));
+          const struct timespec& time =
+            (times[2].tv_sec != 0 || times[2].tv_nsec != 0) ? times[2] : times[0];
+          timestamp = time.tv_sec + 1e-9 * time.tv_nsec;
+        }
+      }
+
+      // a synchronized hardware clock can be slightly ahead of the system one
+      double age = timestampNow - timestamp;
+      if (age < -MaxClockOffset || age > MaxTimestampAge)
+      {
+        if (!this->HasWarnedAboutTimestamps)
+        {
+          vtkGenericWarningMacro("The timestamps of port " << this->Port << " are " << -age
+            << " s away from the system clock, using the host clock instead");
+          this->HasWarnedAboutTimestamps = true;
+        }
+        timestamp = timestampNow;
+        age = 0;
+      }
+      age = std::max(age, 0.0);
+
+      // truncated datagrams are forwarded as is, the interpreter will reject them
+      const std::size_t numberOfBytes =
+        std::min<std::size_t>(this->BatchHeaders[k].msg_len, BUFFER_SIZE);
+      const uint32_t sourceAddress = this->BatchHeaders[k].msg_hdr.msg_namelen > 0
+        ? ntohl(this->BatchAddresses[k].sin_addr.s_addr) : 0;
+      this->ProcessPacket(&this->BatchBuffer[k * BUFFER_SIZE], numberOfBytes,
+        receptionNow - age, timestamp, sourceAddress);
+    }
+  }
+#endif
+
+  this->StartReceive();
+}
+
+//-----------------------------------------------------------------------------
+void PacketReceiver::SocketCallback(
+  const boost::system::error_code& error, std::size_t numberOfBytes)
+{
+  if (error || this->ShouldStop)
+  {
+    // This is called on cancel
+    // TODO: Check other error codes
+    this->StopReceiving();
+    return;
+  }
+
+  const boost::asio::ip::address sender = this->SenderEndpoint.address();
+  const uint32_t sourceAddress =
+    sender.is_v4() ? static_cast<uint32_t>(sender.to_v4().to_ulong()) : 0;
+  this->ProcessPacket(
+    this->RXBuffer, numberOfBytes, StreamStatistics::Now(), WallClockNow(), sourceAddress);
+
+  this->StartReceive();
+}
+
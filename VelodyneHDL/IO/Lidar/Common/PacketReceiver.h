@@ -37,10 +37,19 @@
 #include <boost/thread/thread.hpp>
 
 // STD
+#include <atomic>
+#include <cstdint>
 #include <fstream>
 #include <iostream>
+#include <vector>
+
+#ifdef __linux__
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
 
 class NetworkSource;
+class PacketForwarder;
 
 /*!< Size of the buffer used to store the data received */
 #define BUFFER_SIZE 1500
@@ -57,12 +66,29 @@ class NetworkSource;
 class PacketReceiver
 {
 public:
+  /**
+   * @brief The TIMESTAMP_MODE enum selects where the arrival time of the datagrams
+   * comes from. The kernel and hardware times are only available on Linux with the
+   * batched receive, see SetReceiveBatchSize. Otherwise the host clock is read
+   * when the datagram is handed over by the socket.
+   */
+  enum TIMESTAMP_MODE
+  {
+    Host = 0,    /*!< clock read by the receiving thread */
+    Kernel = 1,  /*!< time the kernel received the datagram (SO_TIMESTAMPNS) */
+    Hardware = 2 /*!< time the NIC received the datagram (SO_TIMESTAMPING), if the NIC
+                      is configured to stamp all the packets and its clock is synchronized
+                      with the system clock (e.g. with phc2sys). The kernel time is used
+                      for the packets without hardware time. */
+  };
+
   /**
    * @brief PacketReceiver
    * @param io The in/out service used to handle the reception of the packets
    * @param port The port address which will receive the packet
    * @param forwardport The port adress which will receive the forwarded packets
-   * @param forwarddestinationIp The IP adress of the computer which will receive the forwarded packets
+   * @param forwarddestinationIp Comma separated list of the unicast or multicast IP adresses
+   * which will receive the forwarded packets
    * @param isforwarding Allow or not the forwarding of the packets
    * @param parent @todo to replace by a synchronizedQueue
    */
@@ -85,15 +111,80 @@ public:
    */
   void EnableCrashAnalysing(std::string filenameCrashAnalysis_, unsigned int nbrPacketToStore_, bool isCrashAnalysing_);
 
+  /**
+   * @brief SaveLastPackets write the packets kept for crash analysis as a pcap file
+   * @param filename the name of the output file
+   * @return false if crash analysing is not enabled or if the file could not be written
+   */
+  bool SaveLastPackets(const std::string& filename) const;
+
+  /**
+   * @brief SetReceiveBufferSize request a kernel receive buffer (SO_RCVBUF) of the given size
+   * @param size requested size in bytes, 0 keeps the system default
+   * @note the kernel silently caps the value to net.core.rmem_max, a warning is
+   * displayed if the granted size is smaller than the requested one
+   */
+  void SetReceiveBufferSize(int size);
+
+  /**
+   * @brief SetReceiveBatchSize set the maximum number of datagrams drained per system call.
+   * On Linux, a non null value switches the receiver to a mode which waits for the socket
+   * to be readable and then drains it with recvmmsg into preallocated slots. It also enables
+   * SO_RXQ_OVFL so that the number of datagrams dropped by the kernel can be reported.
+   * On other platforms, and with a null value, one datagram is received per completion.
+   * @param batchSize maximum number of datagrams per recvmmsg call
+   * @warning must be called before StartReceive
+   */
+  void SetReceiveBatchSize(unsigned int batchSize);
+
+  /**
+   * @brief SetTimestampMode enable the timestamping of the datagrams by the kernel or
+   * the NIC, falling back to the next available mode
+   * @param mode see TIMESTAMP_MODE
+   * @warning must be called before StartReceive
+   */
+  void SetTimestampMode(int mode);
+
+  int GetTimestampMode() const { return this->TimestampMode; }
+
+  /**
+   * @brief GetKernelDropCount
+   * @return the number of datagrams dropped by the kernel because the socket
+   * receive buffer was full. Only available in batched mode on Linux, 0 otherwise
+   */
+  unsigned int GetKernelDropCount() const;
+
+  /**
+   * @brief GetForwardDropCount
+   * @return the number of datagrams which were not forwarded because the forward path
+   * could not keep up with the reception, see PacketForwarder
+   */
+  unsigned int GetForwardDropCount() const;
+
   void SocketCallback(const boost::system::error_code& error, std::size_t numberOfBytes);
 
+  void BatchSocketCallback(const boost::system::error_code& error);
+
 private:
-  /*!< Allow or not the forwarding of the packets */
-  bool isForwarding;
+  /**
+   * @brief ProcessPacket forward, save for crash analysis and enqueue a received datagram
+   * @param data pointer on the received bytes
+   * @param numberOfBytes size of the datagram
+   * @param receptionTime arrival time of the datagram, see StreamStatistics::Now
+   * @param timestamp same time in seconds since the epoch
+   * @param sourceAddress IPv4 address of the sender in host byte order, 0 if unknown
+   */
+  void ProcessPacket(const char* data, std::size_t numberOfBytes, double receptionTime,
+    double timestamp, uint32_t sourceAddress);
+
+  /**
+   * @brief StopReceiving signal the destructor that no more completion is pending
+   */
+  void StopReceiving();
+
+  /*!< Sends the received packets to the forward destinations, null if not forwarding */
+  boost::shared_ptr<PacketForwarder> Forwarder;
 
-  /*!< EndPoint to forward to, contain information such as forward ip, forward port */
-  boost::asio::ip::udp::endpoint ForwardEndpoint;
-  
   /*!< Port address which will receive the packet */
   int Port;                
   
@@ -103,9 +194,6 @@ private:
   /*!< Socket : determines the protocol used and the address used for the reception of the packets */
   boost::asio::ip::udp::socket Socket;
 
-  /*!< Socket : determines the protocol used and the address used for the reception of the forwarded packets */
-  boost::asio::ip::udp::socket ForwardedSocket;
-
   /*!< Network Shouce where the packet will be enqueue */
   NetworkSource* Parent;
 
@@ -113,6 +201,9 @@ private:
    *  so that if a larger packet arrives unexpectedly we'll notice it. */
   char RXBuffer[BUFFER_SIZE];
 
+  /*!< Sender of the datagram received in RXBuffer */
+  boost::asio::ip::udp::endpoint SenderEndpoint;
+
   bool IsReceiving; /*!< Flag indicating if the socket is receiving packets */
   bool ShouldStop;  /*!< Flag indicating if we should stop the listening */
   boost::mutex IsReceivingMtx; /*!< Mutex : Block the access of IsReceiving when a thread is seting the flag */
@@ -120,6 +211,31 @@ private:
   boost::mutex IsWriting;
   bool IsCrashAnalysing;
   CrashAnalysisWriter CrashAnalysis;
+
+  /*!< Maximum number of datagrams received per recvmmsg call, 0 disables the batched mode */
+  unsigned int BatchSize;
+
+  /*!< Cumulative number of datagrams dropped by the kernel, as reported by SO_RXQ_OVFL */
+  std::atomic<unsigned int> KernelDropCount;
+
+  /*!< Source of the arrival times, see TIMESTAMP_MODE */
+  int TimestampMode;
+  bool HasWarnedAboutTimestamps;
+
+#ifdef __linux__
+  /*!< Ring of BatchSize slots of BUFFER_SIZE bytes the datagrams are received in */
+  std::vector<char> BatchBuffer;
+
+  /*!< Ancillary data buffers, one per slot, used to retrieve the kernel drop counter
+   *   and the kernel timestamp */
+  std::vector<char> BatchControl;
+
+  /*!< Sender of the datagram of each slot */
+  std::vector<struct sockaddr_in> BatchAddresses;
+
+  std::vector<struct iovec> BatchIovecs;
+  std::vector<struct mmsghdr> BatchHeaders;
+#endif
 };
 
 #endif // PACKETRECEIVER_H
@@ -0,0 +1,235 @@
+//=========================================================================
+//
+// Copyright 2018 Kitware, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//=========================================================================
+
+#include "SharedFramePublisher.h"
+#include "StreamStatistics.h"
+
+// VTK
+#include <vtkDataArray.h>
+#include <vtkObject.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+
+// STD
+#include <cstring>
+#include <vector>
+
+namespace
+{
+//-----------------------------------------------------------------------------
+/**
+ * @brief GetSharedDataType return the vvSharedFrame::DATA_TYPE of an array
+ * @return false if its type can't be published, e.g. a bit array
+ */
+bool GetSharedDataType(vtkDataArray* array, uint32_t& dataType)
+{
+  const bool is32Bits = array->GetDataTypeSize() == 4;
+  switch (array->GetDataType())
+  {
+    case VTK_FLOAT:
+      dataType = vvSharedFrame::Float32;
+      return true;
+    case VTK_DOUBLE:
+      dataType = vvSharedFrame::Float64;
+      return true;
+    case VTK_CHAR:
+    case VTK_SIGNED_CHAR:
+      dataType = vvSharedFrame::Int8;
+      return true;
+    case VTK_UNSIGNED_CHAR:
+      dataType = vvSharedFrame::UInt8;
+      return true;
+    case VTK_SHORT:
+      dataType = vvSharedFrame::Int16;
+      return true;
+    case VTK_UNSIGNED_SHORT:
+      dataType = vvSharedFrame::UInt16;
+      return true;
+    case VTK_INT:
+    case VTK_LONG:
+    case VTK_LONG_LONG:
+    case VTK_ID_TYPE:
+      dataType = is32Bits ? vvSharedFrame::Int32 : vvSharedFrame::Int64;
+      return true;
+    case VTK_UNSIGNED_INT:
+    case VTK_UNSIGNED_LONG:
+    case VTK_UNSIGNED_LONG_LONG:
+      dataType = is32Bits ? vvSharedFrame::UInt32 : vvSharedFrame::UInt64;
+      return true;
+    default:
+      return false;
+  }
+}
+
+//! An array to publish, with its place in the slot
+struct PublishedArray
+{
+  vtkDataArray* Array;
+  const char* Name;
+  uint32_t DataType;
+  uint64_t Offset;
+  uint64_t Size;
+};
+}
+
+//-----------------------------------------------------------------------------
+SharedFramePublisher::SharedFramePublisher()
+{
+}
+
+//-----------------------------------------------------------------------------
+SharedFramePublisher::~SharedFramePublisher()
+{
+  this->Close();
+}
+
+//-----------------------------------------------------------------------------
+bool SharedFramePublisher::Open(const std::string& name, int nSlots, uint64_t slotSize)
+{
+  boost::lock_guard<boost::mutex> lock(this->Mutex);
+  if (nSlots < 1 || !this->Ring.Create(name, static_cast<uint32_t>(nSlots), slotSize))
+  {
+    vtkGenericWarningMacro("Failed to publish the frames in shared memory: "
+      << (nSlots < 1 ? std::string("no slot") : this->Ring.GetLastError()));
+    return false;
+  }
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+void SharedFramePublisher::Close()
+{
+  boost::lock_guard<boost::mutex> lock(this->Mutex);
+  this->Ring.Close();
+}
+
+//-----------------------------------------------------------------------------
+bool SharedFramePublisher::IsOpen()
+{
+  boost::lock_guard<boost::mutex> lock(this->Mutex);
+  return this->Ring.IsOpen();
+}
+
+//-----------------------------------------------------------------------------
+std::string SharedFramePublisher::GetName()
+{
+  boost::lock_guard<boost::mutex> lock(this->Mutex);
+  return this->Ring.GetName();
+}
+
+//-----------------------------------------------------------------------------
+uint64_t SharedFramePublisher::GetNumberOfFramesPublished()
+{
+  boost::lock_guard<boost::mutex> lock(this->Mutex);
+  return this->Ring.IsOpen()
+    ? this->Ring.GetHeader()->NumberOfFramesPublished.load(std::memory_order_relaxed)
+    : 0;
+}
+
+//-----------------------------------------------------------------------------
+uint64_t SharedFramePublisher::GetNumberOfFramesDropped()
+{
+  boost::lock_guard<boost::mutex> lock(this->Mutex);
+  return this->Ring.IsOpen()
+    ? this->Ring.GetHeader()->NumberOfFramesDropped.load(std::memory_order_relaxed)
+    : 0;
+}
+
+//-----------------------------------------------------------------------------
+bool SharedFramePublisher::Publish(
+  vtkPolyData* frame, uint32_t sensorId, double time, double receptionTime)
+{
+  boost::lock_guard<boost::mutex> lock(this->Mutex);
+  if (!this->Ring.IsOpen() || !frame)
+  {
+    return false;
+  }
+  vvSharedFrame::RingHeader* header = this->Ring.GetHeader();
+
+  // Place the arrays first, to know whether the frame fits in a slot
+  const vtkIdType nPoints = frame->GetNumberOfPoints();
+  std::vector<PublishedArray> arrays;
+  auto addArray = [&](vtkDataArray* array, const char* name) {
+    PublishedArray published;
+    if (!array || !name || array->GetNumberOfTuples() != nPoints ||
+      arrays.size() == vvSharedFrame::MaxNumberOfArrays ||
+      !GetSharedDataType(array, published.DataType))
+    {
+      return;
+    }
+    published.Array = array;
+    published.Name = name;
+    published.Size = static_cast<uint64_t>(nPoints) * array->GetNumberOfComponents() *
+      array->GetDataTypeSize();
+    published.Offset = arrays.empty()
+      ? vvSharedFrame::AlignUp(sizeof(vvSharedFrame::SlotHeader))
+      : vvSharedFrame::AlignUp(arrays.back().Offset + arrays.back().Size);
+    arrays.push_back(published);
+  };
+  if (frame->GetPoints())
+  {
+    addArray(frame->GetPoints()->GetData(), "Points");
+  }
+  vtkPointData* pointData = frame->GetPointData();
+  for (int i = 0; i < pointData->GetNumberOfArrays(); ++i)
+  {
+    vtkDataArray* array = pointData->GetArray(i);
+    addArray(array, array ? array->GetName() : nullptr);
+  }
+  if (!arrays.empty() && arrays.back().Offset + arrays.back().Size > header->SlotSize)
+  {
+    header->NumberOfFramesDropped.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  // Sequence lock: odd while writing, the readers of the previous frame of this
+  // slot then know it is being overwritten
+  const uint64_t index = header->NumberOfFramesPublished.load(std::memory_order_relaxed);
+  unsigned char* slotData = this->Ring.GetSlot(index);
+  vvSharedFrame::SlotHeader* slot = reinterpret_cast<vvSharedFrame::SlotHeader*>(slotData);
+  slot->Sequence.store(2 * index + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  slot->FrameIndex = index;
+  slot->Time = time;
+  slot->ReceptionTime = receptionTime;
+  slot->SensorId = sensorId;
+  slot->NumberOfPoints = static_cast<uint64_t>(nPoints);
+  slot->NumberOfArrays = static_cast<uint32_t>(arrays.size());
+  for (size_t i = 0; i < arrays.size(); ++i)
+  {
+    const PublishedArray& published = arrays[i];
+    vvSharedFrame::ArrayHeader& arrayHeader = slot->Arrays[i];
+    std::strncpy(arrayHeader.Name, published.Name, vvSharedFrame::MaxArrayNameLength - 1);
+    arrayHeader.Name[vvSharedFrame::MaxArrayNameLength - 1] = '\0';
+    arrayHeader.DataType = published.DataType;
+    arrayHeader.NumberOfComponents =
+      static_cast<uint32_t>(published.Array->GetNumberOfComponents());
+    arrayHeader.Offset = published.Offset;
+    arrayHeader.Size = published.Size;
+    if (published.Size > 0)
+    {
+      std::memcpy(slotData + published.Offset, published.Array->GetVoidPointer(0), published.Size);
+    }
+  }
+  slot->PublicationTime = StreamStatistics::Now();
+
+  slot->Sequence.store(2 * index + 2, std::memory_order_release);
+  header->NumberOfFramesPublished.store(index + 1, std::memory_order_release);
+  return true;
+}
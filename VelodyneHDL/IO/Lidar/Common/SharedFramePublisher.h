@@ -0,0 +1,90 @@
+//=========================================================================
+//
+// Copyright 2018 Kitware, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//=========================================================================
+
+#ifndef SHARED_FRAME_PUBLISHER_H
+#define SHARED_FRAME_PUBLISHER_H
+
+// LOCAL
+#include "vvSharedFrameRing.h"
+
+// BOOST
+#include <boost/thread.hpp>
+
+// STD
+#include <cstdint>
+#include <string>
+
+class vtkPolyData;
+
+/**
+ * \class SharedFramePublisher
+ * \brief Publishes the decoded frames of a live stream in a POSIX shared memory ring,
+ *        so that other processes get them without decoding the packets again.
+ *        They read them in place with vvSharedFrameReader, see vvSharedFrame for
+ *        the layout.
+ *
+ *        The points and each point data array are copied as is in a contiguous
+ *        block of the slot, the arrays of a type not supported being skipped.
+ *        The writer never waits for the readers.
+ */
+class SharedFramePublisher
+{
+public:
+  SharedFramePublisher();
+
+  ~SharedFramePublisher();
+
+  /**
+   * @brief Open create the ring, see vvSharedFrameRing::Create
+   * @param name name of the shared memory region, e.g. "/veloview"
+   * @param nSlots number of frames kept in the ring
+   * @param slotSize size in bytes of a slot, larger frames are dropped
+   */
+  bool Open(const std::string& name, int nSlots, uint64_t slotSize);
+
+  //! Mark the ring as closed for the readers and remove it
+  void Close();
+
+  bool IsOpen();
+
+  std::string GetName();
+
+  /**
+   * @brief Publish copy a frame in the next slot of the ring. Can be called from
+   * several threads.
+   * @param frame the decoded frame
+   * @param sensorId index of the sensor of the frame, see MultiSensorConsumer
+   * @param time time of the frame, in seconds since the epoch
+   * @param receptionTime when its last packet was received, see StreamStatistics::Now
+   * @return false if the ring is not open or if the frame does not fit in a slot
+   */
+  bool Publish(vtkPolyData* frame, uint32_t sensorId, double time, double receptionTime);
+
+  uint64_t GetNumberOfFramesPublished();
+
+  uint64_t GetNumberOfFramesDropped();
+
+private:
+  SharedFramePublisher(const SharedFramePublisher&) = delete;
+  SharedFramePublisher& operator=(const SharedFramePublisher&) = delete;
+
+  vvSharedFrameRing Ring;
+  //! there is a single writer per ring
+  boost::mutex Mutex;
+};
+
+#endif // SHARED_FRAME_PUBLISHER_H
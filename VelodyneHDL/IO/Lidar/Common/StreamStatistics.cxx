@@ -0,0 +1,186 @@
+//=========================================================================
+//
+// Copyright 2018 Kitware, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//=========================================================================
+
+// LOCAL
+#include "StreamStatistics.h"
+
+// BOOST
+#include <boost/thread/lock_guard.hpp>
+
+// STD
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+const double StreamStatistics::FrameRateWindow = 2.0;
+
+//-----------------------------------------------------------------------------
+void LatencyHistogram::Add(double duration)
+{
+  const double microseconds = std::max(0.0, duration * 1e6);
+  int bin = 0;
+  if (microseconds >= 1.0)
+  {
+    bin = std::min(NumberOfBins - 1, 1 + static_cast<int>(std::log2(microseconds)));
+  }
+  this->Counts[bin].fetch_add(1, std::memory_order_relaxed);
+  this->SumMicroseconds.fetch_add(static_cast<uint64_t>(microseconds), std::memory_order_relaxed);
+}
+
+//-----------------------------------------------------------------------------
+void LatencyHistogram::Reset()
+{
+  for (int i = 0; i < NumberOfBins; ++i)
+  {
+    this->Counts[i] = 0;
+  }
+  this->SumMicroseconds = 0;
+}
+
+//-----------------------------------------------------------------------------
+double LatencyHistogram::GetBinUpperBound(int bin)
+{
+  return std::ldexp(1e-6, bin);
+}
+
+//-----------------------------------------------------------------------------
+std::vector<uint64_t> LatencyHistogram::GetCounts() const
+{
+  std::vector<uint64_t> counts(NumberOfBins);
+  for (int i = 0; i < NumberOfBins; ++i)
+  {
+    counts[i] = this->Counts[i].load(std::memory_order_relaxed);
+  }
+  return counts;
+}
+
+//-----------------------------------------------------------------------------
+uint64_t LatencyHistogram::GetTotalCount() const
+{
+  uint64_t total = 0;
+  for (int i = 0; i < NumberOfBins; ++i)
+  {
+    total += this->Counts[i].load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+//-----------------------------------------------------------------------------
+double LatencyHistogram::GetMean() const
+{
+  const uint64_t total = this->GetTotalCount();
+  if (total == 0)
+  {
+    return 0.0;
+  }
+  return 1e-6 * this->SumMicroseconds.load(std::memory_order_relaxed) / total;
+}
+
+//-----------------------------------------------------------------------------
+double LatencyHistogram::GetPercentile(double percentile) const
+{
+  const std::vector<uint64_t> counts = this->GetCounts();
+  uint64_t total = 0;
+  for (uint64_t count : counts)
+  {
+    total += count;
+  }
+  if (total == 0)
+  {
+    return 0.0;
+  }
+
+  const double rank = std::min(100.0, std::max(0.0, percentile)) / 100.0 * total;
+  uint64_t cumulated = 0;
+  for (int i = 0; i < NumberOfBins; ++i)
+  {
+    cumulated += counts[i];
+    if (cumulated > 0 && cumulated >= rank)
+    {
+      return GetBinUpperBound(i);
+    }
+  }
+  return GetBinUpperBound(NumberOfBins - 1);
+}
+
+//-----------------------------------------------------------------------------
+double StreamStatistics::Now()
+{
+  return std::chrono::duration<double>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//-----------------------------------------------------------------------------
+const char* StreamStatistics::GetStageName(int stage)
+{
+  switch (stage)
+  {
+    case ReceiveToDecode: return "Receive to decode";
+    case DecodeToSplit: return "Decode to split";
+    case SplitToPublish: return "Split to publish";
+    case ReceiveToPublish: return "Receive to publish";
+    default: return "Unknown";
+  }
+}
+
+//-----------------------------------------------------------------------------
+void StreamStatistics::AddLatency(int stage, double duration)
+{
+  if (stage >= 0 && stage < NumberOfStages)
+  {
+    this->Latencies[stage].Add(duration);
+  }
+}
+
+//-----------------------------------------------------------------------------
+void StreamStatistics::AddFrame(double time)
+{
+  this->FramesDecoded.fetch_add(1, std::memory_order_relaxed);
+  boost::lock_guard<boost::mutex> lock(this->FrameTimesMutex);
+  this->FrameTimes.push_back(time);
+  while (this->FrameTimes.front() < time - FrameRateWindow)
+  {
+    this->FrameTimes.pop_front();
+  }
+}
+
+//-----------------------------------------------------------------------------
+double StreamStatistics::GetFramesPerSecond()
+{
+  const double now = Now();
+  boost::lock_guard<boost::mutex> lock(this->FrameTimesMutex);
+  while (!this->FrameTimes.empty() && this->FrameTimes.front() < now - FrameRateWindow)
+  {
+    this->FrameTimes.pop_front();
+  }
+  return this->FrameTimes.size() / FrameRateWindow;
+}
+
+//-----------------------------------------------------------------------------
+void StreamStatistics::Reset()
+{
+  this->PacketsReceived = 0;
+  this->MalformedPackets = 0;
+  this->FramesDecoded = 0;
+  this->FramesPublished = 0;
+  for (int i = 0; i < NumberOfStages; ++i)
+  {
+    this->Latencies[i].Reset();
+  }
+  boost::lock_guard<boost::mutex> lock(this->FrameTimesMutex);
+  this->FrameTimes.clear();
+}
@@ -0,0 +1,132 @@
+//=========================================================================
+//
+// Copyright 2018 Kitware, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//=========================================================================
+
+#ifndef STREAM_STATISTICS_H
+#define STREAM_STATISTICS_H
+
+// BOOST
+#include <boost/thread/mutex.hpp>
+
+// STD
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+/**
+ * \class LatencyHistogram
+ * \brief Lock free histogram of durations, with one bin per power of two
+ *        microseconds: bin 0 counts the durations below 1us, and bin i
+ *        the durations in [2^(i-1), 2^i) us. The last bin also counts the
+ *        longer durations.
+ */
+class LatencyHistogram
+{
+public:
+  static const int NumberOfBins = 28;
+
+  LatencyHistogram() { this->Reset(); }
+
+  /**
+   * @brief Add count a duration
+   * @param duration in seconds, negative durations are counted in the first bin
+   */
+  void Add(double duration);
+
+  void Reset();
+
+  //! upper bound of a bin in seconds
+  static double GetBinUpperBound(int bin);
+
+  std::vector<uint64_t> GetCounts() const;
+
+  uint64_t GetTotalCount() const;
+
+  //! mean duration in seconds, 0 if nothing was counted
+  double GetMean() const;
+
+  /**
+   * @brief GetPercentile return an upper bound of the given percentile, with
+   * the resolution of the bins
+   * @param percentile between 0 and 100
+   * @return the duration in seconds, 0 if nothing was counted
+   */
+  double GetPercentile(double percentile) const;
+
+private:
+  std::atomic<uint64_t> Counts[NumberOfBins];
+  std::atomic<uint64_t> SumMicroseconds;
+};
+
+/**
+ * \class StreamStatistics
+ * \brief Health and latency counters of a live stream, shared by the
+ *        PacketReceiver, the PacketConsumer and vtkLidarStream. Counters and
+ *        histograms are updated without lock from the receiving and decoding threads.
+ */
+class StreamStatistics
+{
+public:
+  /**
+   * @brief The STAGE enum lists the latencies measured along the live path
+   */
+  enum STAGE
+  {
+    ReceiveToDecode = 0,  /*!< datagram received -> its decoding starts */
+    DecodeToSplit = 1,    /*!< decoding of a frame starts -> frame split */
+    SplitToPublish = 2,   /*!< frame split -> first returned by RequestData */
+    ReceiveToPublish = 3, /*!< last datagram of a frame received -> first returned by RequestData */
+    NumberOfStages = 4
+  };
+
+  StreamStatistics() { this->Reset(); }
+
+  //! Monotonic clock, in seconds, used for all the timestamps of the live path
+  static double Now();
+
+  static const char* GetStageName(int stage);
+
+  void AddLatency(int stage, double duration);
+
+  const LatencyHistogram& GetLatency(int stage) const { return this->Latencies[stage]; }
+
+  //! record a new frame added to the cache, used to compute the frame rate
+  void AddFrame(double time);
+
+  /**
+   * @brief GetFramesPerSecond return the frame rate over the last FrameRateWindow seconds
+   */
+  double GetFramesPerSecond();
+
+  void Reset();
+
+  std::atomic<uint64_t> PacketsReceived;    /*!< Datagrams read from the sockets */
+  std::atomic<uint64_t> MalformedPackets;   /*!< Datagrams rejected by the interpreter */
+  std::atomic<uint64_t> FramesDecoded;      /*!< Frames added to the cache */
+  std::atomic<uint64_t> FramesPublished;    /*!< Frames returned at least once by RequestData */
+
+  //! Duration over which the frame rate is averaged, in seconds
+  static const double FrameRateWindow;
+
+private:
+  LatencyHistogram Latencies[NumberOfStages];
+
+  boost::mutex FrameTimesMutex;
+  std::deque<double> FrameTimes;
+};
+
+#endif // STREAM_STATISTICS_H
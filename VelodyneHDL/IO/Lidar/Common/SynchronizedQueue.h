@@ -85,7 +85,8 @@ public:
   {
     boost::unique_lock<boost::mutex> lock(mutex_);
     request_to_end_ = true;
-    cond_.notify_one();
+    // several consumers may be waiting on the queue
+    cond_.notify_all();
   }
 
   unsigned int size()
@@ -0,0 +1,536 @@
+//=========================================================================
+//
+// Copyright 2018 Kitware, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//=========================================================================
+
+// LOCAL
+#include "TrailingFrameAccumulator.h"
+
+// VTK
+#include <vtkCellArray.h>
+#include <vtkDataArray.h>
+#include <vtkIdTypeArray.h>
+#include <vtkNew.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+
+// STD
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace
+{
+//-----------------------------------------------------------------------------
+//! Copy count tuples, converting them if the arrays have different types
+void CopyTuples(vtkDataArray* source, vtkIdType sourceStart, vtkDataArray* destination,
+  vtkIdType destinationStart, vtkIdType count)
+{
+  if (count <= 0)
+  {
+    return;
+  }
+  if (source->GetDataType() == destination->GetDataType())
+  {
+    const int nComponents = destination->GetNumberOfComponents();
+    std::memmove(destination->GetVoidPointer(destinationStart * nComponents),
+      source->GetVoidPointer(sourceStart * nComponents),
+      static_cast<size_t>(count) * nComponents * destination->GetDataTypeSize());
+  }
+  else
+  {
+    for (vtkIdType i = 0; i < count; ++i)
+    {
+      destination->SetTuple(destinationStart + i, sourceStart + i, source);
+    }
+  }
+}
+}
+
+//-----------------------------------------------------------------------------
+//! A combined frame, with the chunks of points of each frame
+struct TrailingFrameAccumulator::Buffer
+{
+  //! A contiguous range of points
+  struct Range
+  {
+    vtkIdType Start;
+    vtkIdType Count;
+  };
+
+  //! A range of points of a frame
+  struct Chunk
+  {
+    size_t FrameId;
+    vtkIdType Count;
+  };
+
+  Buffer()
+    : NumberOfPoints(0)
+    , LastUse(0)
+  {
+  }
+
+  //! Point coordinates, then the point data arrays, in the order of the layout
+  std::vector<vtkDataArray*> GetArrays() const
+  {
+    std::vector<vtkDataArray*> arrays;
+    if (this->Output && this->Output->GetPoints())
+    {
+      arrays.push_back(this->Output->GetPoints()->GetData());
+      vtkPointData* pointData = this->Output->GetPointData();
+      for (int i = 0; i < pointData->GetNumberOfArrays(); ++i)
+      {
+        arrays.push_back(pointData->GetArray(i));
+      }
+    }
+    return arrays;
+  }
+
+  /**
+   * @brief GetSourceArrays return the arrays of a frame matching the layout
+   * of the buffer, in the order of GetArrays
+   * @return an empty vector if an array is missing
+   */
+  std::vector<vtkDataArray*> GetSourceArrays(vtkPolyData* frame) const
+  {
+    std::vector<vtkDataArray*> sources;
+    std::vector<vtkDataArray*> arrays = this->GetArrays();
+    if (arrays.empty() || !frame->GetPoints())
+    {
+      return sources;
+    }
+    sources.push_back(frame->GetPoints()->GetData());
+    for (size_t i = 1; i < arrays.size(); ++i)
+    {
+      vtkDataArray* source = frame->GetPointData()->GetArray(arrays[i]->GetName());
+      if (!source || source->GetNumberOfComponents() != arrays[i]->GetNumberOfComponents())
+      {
+        return std::vector<vtkDataArray*>();
+      }
+      sources.push_back(source);
+    }
+    return sources;
+  }
+
+  //! Whether the arrays are referenced outside of the buffer
+  bool IsInUse() const
+  {
+    if (!this->Output)
+    {
+      return false;
+    }
+    if ((this->Output->GetPoints() && this->Output->GetPoints()->GetReferenceCount() > 1) ||
+      this->Output->GetVerts()->GetReferenceCount() > 1)
+    {
+      return true;
+    }
+    for (vtkDataArray* array : this->GetArrays())
+    {
+      if (array->GetReferenceCount() > 1)
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  //! Number of frames to add and to remove to cover a window
+  size_t GetDistance(size_t firstId, size_t endId) const
+  {
+    size_t common = 0;
+    for (size_t id : this->FrameIds)
+    {
+      common += (id >= firstId && id < endId) ? 1 : 0;
+    }
+    return (this->FrameIds.size() - common) + (endId - firstId - common);
+  }
+
+  //! Set the number of points of all the arrays and of the vertex cells
+  void Resize(vtkIdType nPoints)
+  {
+    for (vtkDataArray* array : this->GetArrays())
+    {
+      array->SetNumberOfTuples(nPoints);
+    }
+    const vtkIdType nVertices = this->VertexIds->GetNumberOfTuples() / 2;
+    this->VertexIds->SetNumberOfValues(nPoints * 2);
+    vtkIdType* ids = this->VertexIds->GetPointer(0);
+    for (vtkIdType i = nVertices; i < nPoints; ++i)
+    {
+      ids[i * 2] = 1;
+      ids[i * 2 + 1] = i;
+    }
+    this->Output->GetVerts()->SetCells(nPoints, this->VertexIds);
+    this->NumberOfPoints = nPoints;
+  }
+
+  //! Record that a range of points belongs to a frame, merging it with its neighbors
+  void AddChunk(vtkIdType start, vtkIdType count, size_t frameId)
+  {
+    auto next = this->Chunks.lower_bound(start);
+    if (next != this->Chunks.begin())
+    {
+      auto previous = std::prev(next);
+      if (previous->second.FrameId == frameId && previous->first + previous->second.Count == start)
+      {
+        start = previous->first;
+        count += previous->second.Count;
+        this->Chunks.erase(previous);
+      }
+    }
+    if (next != this->Chunks.end() && next->second.FrameId == frameId &&
+      start + count == next->first)
+    {
+      count += next->second.Count;
+      this->Chunks.erase(next);
+    }
+    Chunk chunk = { frameId, count };
+    this->Chunks[start] = chunk;
+  }
+
+  //! Copy the points of a frame into the holes
+  void FillHoles(size_t frameId, const std::vector<vtkDataArray*>& sources, vtkIdType nPoints)
+  {
+    const std::vector<vtkDataArray*> arrays = this->GetArrays();
+    vtkIdType copied = 0;
+    while (copied < nPoints && !this->Holes.empty())
+    {
+      Range& hole = this->Holes.back();
+      const vtkIdType count = std::min(hole.Count, nPoints - copied);
+      for (size_t i = 0; i < arrays.size(); ++i)
+      {
+        CopyTuples(sources[i], copied, arrays[i], hole.Start, count);
+      }
+      this->AddChunk(hole.Start, count, frameId);
+      copied += count;
+      hole.Start += count;
+      hole.Count -= count;
+      if (hole.Count == 0)
+      {
+        this->Holes.pop_back();
+      }
+    }
+  }
+
+  //! Move the last points into the holes, so that the points are contiguous
+  void Compact()
+  {
+    const std::vector<vtkDataArray*> arrays = this->GetArrays();
+    std::sort(this->Holes.begin(), this->Holes.end(),
+      [](const Range& a, const Range& b) { return a.Start < b.Start; });
+    vtkIdType end = this->NumberOfPoints;
+    while (!this->Holes.empty())
+    {
+      Range& hole = this->Holes.back();
+      if (hole.Start + hole.Count == end)
+      {
+        end = hole.Start;
+        this->Holes.pop_back();
+        continue;
+      }
+      // the last chunk ends at the end of the points, after the last hole
+      auto last = std::prev(this->Chunks.end());
+      const vtkIdType chunkStart = last->first;
+      const Chunk chunk = last->second;
+      const vtkIdType count = std::min(chunk.Count, hole.Count);
+      for (vtkDataArray* array : arrays)
+      {
+        CopyTuples(array, chunkStart + chunk.Count - count, array, hole.Start, count);
+      }
+      if (count == chunk.Count)
+      {
+        this->Chunks.erase(last);
+      }
+      else
+      {
+        last->second.Count -= count;
+      }
+      this->AddChunk(hole.Start, count, chunk.FrameId);
+      end -= count;
+      hole.Start += count;
+      hole.Count -= count;
+      if (hole.Count == 0)
+      {
+        this->Holes.pop_back();
+      }
+    }
+  }
+
+  //! Flag the arrays as modified, so that they are uploaded again for rendering
+  void Modified()
+  {
+    for (vtkDataArray* array : this->GetArrays())
+    {
+      array->Modified();
+    }
+    if (this->Output->GetPoints())
+    {
+      this->Output->GetPoints()->Modified();
+    }
+    this->Output->GetVerts()->Modified();
+    this->Output->Modified();
+  }
+
+  vtkSmartPointer<vtkPolyData> Output;
+  vtkSmartPointer<vtkIdTypeArray> VertexIds;
+  //! Chunks of points, by first point
+  std::map<vtkIdType, Chunk> Chunks;
+  //! Ranges of points of the frames removed, to be overwritten
+  std::vector<Range> Holes;
+  //! Frames of the window, including the ones without point
+  std::set<size_t> FrameIds;
+  vtkIdType NumberOfPoints;
+  //! Value of UpdateCount when last returned
+  size_t LastUse;
+};
+
+//-----------------------------------------------------------------------------
+TrailingFrameAccumulator::TrailingFrameAccumulator()
+  : MaxNumberOfBuffers(2)
+  , UpdateCount(0)
+  , NumberOfFramesCopied(0)
+{
+}
+
+//-----------------------------------------------------------------------------
+TrailingFrameAccumulator::~TrailingFrameAccumulator()
+{
+}
+
+//-----------------------------------------------------------------------------
+void TrailingFrameAccumulator::SetMaxNumberOfBuffers(int nBuffers)
+{
+  this->MaxNumberOfBuffers = std::max(1, nBuffers);
+  if (this->Buffers.size() > static_cast<size_t>(this->MaxNumberOfBuffers))
+  {
+    this->Buffers.resize(this->MaxNumberOfBuffers);
+  }
+}
+
+//-----------------------------------------------------------------------------
+void TrailingFrameAccumulator::Clear()
+{
+  this->Buffers.clear();
+}
+
+//-----------------------------------------------------------------------------
+vtkSmartPointer<vtkPolyData> TrailingFrameAccumulator::Update(
+  size_t firstId, size_t endId, const FrameGetter& getFrame)
+{
+  this->NumberOfFramesCopied = 0;
+  ++this->UpdateCount;
+  endId = std::max(firstId, endId);
+
+  // the buffer not in use that is the closest to the window
+  Buffer* buffer = nullptr;
+  size_t distance = std::numeric_limits<size_t>::max();
+  for (const std::unique_ptr<Buffer>& candidate : this->Buffers)
+  {
+    if (!candidate->IsInUse())
+    {
+      const size_t candidateDistance = candidate->GetDistance(firstId, endId);
+      if (candidateDistance < distance)
+      {
+        buffer = candidate.get();
+        distance = candidateDistance;
+      }
+    }
+  }
+
+  if (!buffer)
+  {
+    // the arrays of a buffer in use stay alive as long as they are referenced
+    if (this->Buffers.size() >= static_cast<size_t>(this->MaxNumberOfBuffers))
+    {
+      auto leastRecentlyUsed = std::min_element(this->Buffers.begin(), this->Buffers.end(),
+        [](const std::unique_ptr<Buffer>& a, const std::unique_ptr<Buffer>& b) {
+          return a->LastUse < b->LastUse;
+        });
+      this->Buffers.erase(leastRecentlyUsed);
+    }
+    this->Buffers.push_back(std::unique_ptr<Buffer>(new Buffer));
+    buffer = this->Buffers.back().get();
+  }
+
+  // moving the window by more than its size costs more than combining it again
+  if (!buffer->Output || distance >= endId - firstId ||
+    !this->UpdateBuffer(*buffer, firstId, endId, getFrame))
+  {
+    this->RebuildBuffer(*buffer, firstId, endId, getFrame);
+  }
+  buffer->LastUse = this->UpdateCount;
+
+  vtkSmartPointer<vtkPolyData> output = vtkSmartPointer<vtkPolyData>::New();
+  output->ShallowCopy(buffer->Output);
+  return output;
+}
+
+//-----------------------------------------------------------------------------
+bool TrailingFrameAccumulator::UpdateBuffer(
+  Buffer& buffer, size_t firstId, size_t endId, const FrameGetter& getFrame)
+{
+  // get the frames entering the window, and check them before modifying anything
+  std::vector<size_t> enteringIds;
+  std::vector<vtkSmartPointer<vtkPolyData> > enteringFrames;
+  std::vector<std::vector<vtkDataArray*> > enteringSources;
+  vtkIdType added = 0;
+  for (size_t id = firstId; id < endId; ++id)
+  {
+    if (buffer.FrameIds.count(id))
+    {
+      continue;
+    }
+    vtkSmartPointer<vtkPolyData> frame = getFrame(id);
+    std::vector<vtkDataArray*> sources;
+    if (frame && frame->GetNumberOfPoints() > 0)
+    {
+      sources = buffer.GetSourceArrays(frame);
+      if (sources.empty())
+      {
+        return false;
+      }
+      added += frame->GetNumberOfPoints();
+    }
+    enteringIds.push_back(id);
+    enteringFrames.push_back(frame);
+    enteringSources.push_back(sources);
+  }
+
+  // the points of the frames leaving the window are to be overwritten
+  vtkIdType removed = 0;
+  for (auto it = buffer.Chunks.begin(); it != buffer.Chunks.end();)
+  {
+    if (it->second.FrameId < firstId || it->second.FrameId >= endId)
+    {
+      Buffer::Range hole = { it->first, it->second.Count };
+      buffer.Holes.push_back(hole);
+      removed += it->second.Count;
+      it = buffer.Chunks.erase(it);
+    }
+    else
+    {
+      ++it;
+    }
+  }
+  for (auto it = buffer.FrameIds.begin(); it != buffer.FrameIds.end();)
+  {
+    it = (*it < firstId || *it >= endId) ? buffer.FrameIds.erase(it) : std::next(it);
+  }
+
+  // grow first, the new points being a hole to fill, or fill then shrink
+  const vtkIdType previousNumberOfPoints = buffer.NumberOfPoints;
+  const vtkIdType nPoints = previousNumberOfPoints - removed + added;
+  if (nPoints > previousNumberOfPoints)
+  {
+    buffer.Resize(nPoints);
+    Buffer::Range hole = { previousNumberOfPoints, nPoints - previousNumberOfPoints };
+    buffer.Holes.push_back(hole);
+  }
+  for (size_t i = 0; i < enteringIds.size(); ++i)
+  {
+    if (enteringFrames[i] && !enteringSources[i].empty())
+    {
+      buffer.FillHoles(enteringIds[i], enteringSources[i], enteringFrames[i]->GetNumberOfPoints());
+      ++this->NumberOfFramesCopied;
+    }
+    buffer.FrameIds.insert(enteringIds[i]);
+  }
+  if (nPoints < previousNumberOfPoints)
+  {
+    buffer.Compact();
+    buffer.Resize(nPoints);
+  }
+  buffer.Modified();
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+void TrailingFrameAccumulator::RebuildBuffer(
+  Buffer& buffer, size_t firstId, size_t endId, const FrameGetter& getFrame)
+{
+  std::vector<size_t> ids;
+  std::vector<vtkSmartPointer<vtkPolyData> > frames;
+  vtkIdType nPoints = 0;
+  buffer.FrameIds.clear();
+  for (size_t id = firstId; id < endId; ++id)
+  {
+    buffer.FrameIds.insert(id);
+    vtkSmartPointer<vtkPolyData> frame = getFrame(id);
+    if (frame && frame->GetPoints() && frame->GetNumberOfPoints() > 0)
+    {
+      ids.push_back(id);
+      frames.push_back(frame);
+      nPoints += frame->GetNumberOfPoints();
+    }
+  }
+
+  buffer.Output = vtkSmartPointer<vtkPolyData>::New();
+  buffer.VertexIds = vtkSmartPointer<vtkIdTypeArray>::New();
+  buffer.Output->SetVerts(vtkSmartPointer<vtkCellArray>::New());
+  buffer.Chunks.clear();
+  buffer.Holes.clear();
+  buffer.NumberOfPoints = 0;
+  if (frames.empty())
+  {
+    return;
+  }
+
+  // the layout is the one of the last frame, restricted to the arrays of all the frames
+  vtkPolyData* reference = frames.back();
+  vtkNew<vtkPoints> points;
+  points->SetDataType(reference->GetPoints()->GetDataType());
+  buffer.Output->SetPoints(points.GetPointer());
+  vtkPointData* referencePointData = reference->GetPointData();
+  for (int i = 0; i < referencePointData->GetNumberOfArrays(); ++i)
+  {
+    vtkDataArray* referenceArray = referencePointData->GetArray(i);
+    if (!referenceArray || !referenceArray->GetName())
+    {
+      continue;
+    }
+    bool isCommon = true;
+    for (vtkPolyData* frame : frames)
+    {
+      vtkDataArray* array = frame->GetPointData()->GetArray(referenceArray->GetName());
+      isCommon &= array && array->GetNumberOfComponents() == referenceArray->GetNumberOfComponents();
+    }
+    if (isCommon)
+    {
+      vtkSmartPointer<vtkDataArray> array;
+      array.TakeReference(referenceArray->NewInstance());
+      array->SetName(referenceArray->GetName());
+      array->SetNumberOfComponents(referenceArray->GetNumberOfComponents());
+      buffer.Output->GetPointData()->AddArray(array);
+    }
+  }
+
+  buffer.Resize(nPoints);
+  const std::vector<vtkDataArray*> arrays = buffer.GetArrays();
+  vtkIdType start = 0;
+  for (size_t i = 0; i < frames.size(); ++i)
+  {
+    const std::vector<vtkDataArray*> sources = buffer.GetSourceArrays(frames[i]);
+    const vtkIdType count = frames[i]->GetNumberOfPoints();
+    for (size_t j = 0; j < arrays.size(); ++j)
+    {
+      CopyTuples(sources[j], 0, arrays[j], start, count);
+    }
+    buffer.AddChunk(start, count, ids[i]);
+    start += count;
+  }
+  this->NumberOfFramesCopied += frames.size();
+}
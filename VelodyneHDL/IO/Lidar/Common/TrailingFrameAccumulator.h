@@ -0,0 +1,101 @@
+//=========================================================================
+//
+// Copyright 2018 Kitware, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//=========================================================================
+
+#ifndef TRAILING_FRAME_ACCUMULATOR_H
+#define TRAILING_FRAME_ACCUMULATOR_H
+
+// VTK
+#include <vtkSmartPointer.h>
+
+// STD
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+
+class vtkPolyData;
+
+/**
+ * \class TrailingFrameAccumulator
+ * \brief Combines a sliding window of consecutive frames in a single polydata,
+ *        updated incrementally when the window moves: the points of the frames
+ *        leaving the window are overwritten by the ones of the frames entering it,
+ *        so that the cost of a step only depends on the size of the frames
+ *        entering and leaving, and not on the size of the window.
+ *
+ *        The points of the combined frame are stored as contiguous chunks, each one
+ *        belonging to a frame. Unlike vtkAppendPolyData, the points are therefore not
+ *        sorted by frame. A frame may be split in several chunks.
+ *
+ *        The polydata returned shares its arrays with the accumulator, which never
+ *        modifies them while they are referenced elsewhere: it then works on another
+ *        buffer, which is built from scratch if all the buffers are in use.
+ */
+class TrailingFrameAccumulator
+{
+public:
+  //! Returns the frame of the given id, null if it has no point
+  typedef std::function<vtkSmartPointer<vtkPolyData>(size_t)> FrameGetter;
+
+  TrailingFrameAccumulator();
+
+  ~TrailingFrameAccumulator();
+
+  /**
+   * @brief Update combine the frames of a window
+   * @param firstId id of the first frame of the window
+   * @param endId id following the one of the last frame of the window. The ids are
+   *        expected to never be reused for other frames.
+   * @param getFrame called for the frames entering the window only
+   * @return the combined frame, with the point arrays common to all the frames
+   */
+  vtkSmartPointer<vtkPolyData> Update(size_t firstId, size_t endId, const FrameGetter& getFrame);
+
+  //! Release all the buffers
+  void Clear();
+
+  //! Number of buffers kept, at least 1. Two allow to update one buffer while
+  //! the previous result is still in use downstream.
+  void SetMaxNumberOfBuffers(int nBuffers);
+  int GetMaxNumberOfBuffers() const { return this->MaxNumberOfBuffers; }
+
+  //! Number of frames copied by the last call to Update, for testing
+  size_t GetNumberOfFramesCopied() const { return this->NumberOfFramesCopied; }
+
+private:
+  struct Buffer;
+
+  /**
+   * @brief UpdateBuffer move the window of a buffer, adding and removing only the
+   * frames that differ
+   * @return false if the layout of a new frame does not match the buffer, which
+   * must then be rebuilt
+   */
+  bool UpdateBuffer(Buffer& buffer, size_t firstId, size_t endId, const FrameGetter& getFrame);
+
+  //! Combine all the frames of the window in a new buffer
+  void RebuildBuffer(Buffer& buffer, size_t firstId, size_t endId, const FrameGetter& getFrame);
+
+  std::vector<std::unique_ptr<Buffer> > Buffers;
+  int MaxNumberOfBuffers;
+  //! Number of calls to Update, to select the least recently used buffer
+  size_t UpdateCount;
+  size_t NumberOfFramesCopied;
+};
+
+#endif // TRAILING_FRAME_ACCUMULATOR_H
@@ -2,6 +2,8 @@
 
 #include <vtkTransform.h>
 
+#include <sstream>
+
 namespace {
 //-----------------------------------------------------------------------------
 vtkSmartPointer<vtkCellArray> NewVertexCells(vtkIdType numberOfVerts)
@@ -75,6 +77,46 @@ bool vtkLidarPacketInterpreter::shouldBeCroppedOut(double pos[3], double theta)
   return !((pointInside && !this->CropOutside) || (!pointInside && this->CropOutside));
 }
 
+//-----------------------------------------------------------------------------
+void vtkLidarPacketInterpreter::CopyCommonConfiguration(vtkLidarPacketInterpreter* source)
+{
+  this->CalibrationFileName = source->CalibrationFileName;
+  this->CalibrationReportedNumLasers = source->CalibrationReportedNumLasers;
+  this->IsCalibrated = source->IsCalibrated;
+  this->TimeOffset = source->TimeOffset;
+  this->LaserSelection = source->LaserSelection;
+  this->DistanceResolutionM = source->DistanceResolutionM;
+  this->IgnoreZeroDistances = source->IgnoreZeroDistances;
+  this->IgnoreEmptyFrames = source->IgnoreEmptyFrames;
+  this->ApplyTransform = source->ApplyTransform;
+  this->CropMode = source->CropMode;
+  this->CropOutside = source->CropOutside;
+  std::copy(source->CropRegion, source->CropRegion + 6, this->CropRegion);
+
+  if (source->SensorTransform)
+  {
+    vtkNew<vtkTransform> transform;
+    transform->DeepCopy(source->SensorTransform);
+    this->SetSensorTransform(transform.Get());
+  }
+  else
+  {
+    this->SetSensorTransform(nullptr);
+  }
+  this->Modified();
+}
+
+//-----------------------------------------------------------------------------
+std::string vtkLidarPacketInterpreter::GetFramingKey()
+{
+  std::ostringstream key;
+  key << this->GetClassName()
+      << " lasers=" << this->CalibrationReportedNumLasers
+      << " ignoreZeroDistances=" << this->IgnoreZeroDistances
+      << " ignoreEmptyFrames=" << this->IgnoreEmptyFrames;
+  return key.str();
+}
+
 //-----------------------------------------------------------------------------
 vtkCxxSetObjectMacro(vtkLidarPacketInterpreter, SensorTransform, vtkTransform)
 
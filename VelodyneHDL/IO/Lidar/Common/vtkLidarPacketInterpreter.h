@@ -84,6 +84,8 @@ public:
    * @brief PreProcessPacket is use to construct the frame index and get some corretion
    * or live calibration comming from the data. A warning should be raise in case the calibration
    * information does not match the data (ex: factory field, number of laser, ...)
+   * The framing state is kept by the instance and reset by ResetCurrentFrame, so that
+   * different instances can be used from different threads.
    * @param data raw data packet
    * @param dataLength size of the data packet
    * @param isNewFrame[out] indicate if a new frame should be created
@@ -121,6 +123,32 @@ public:
    */
   void ClearAllFramesAvailable() { this->Frames.clear(); }
 
+  /**
+   * @brief CopyConfiguration copy the decoding parameters and the calibration of another
+   * interpreter of the same type, so that this one decodes the packets the same way.
+   * This allows to decode several frames in parallel, with one interpreter per thread.
+   * The state of the frame under construction is not copied.
+   * @param source interpreter to copy the configuration from
+   * @return false if the interpreter does not support it
+   */
+  virtual bool CopyConfiguration(vtkLidarPacketInterpreter* vtkNotUsed(source)) { return false; }
+
+  /**
+   * @brief CopyCalibration copy only the calibration of another interpreter of the same
+   * type, e.g. one calibration loaded once and applied again after CopyConfiguration,
+   * without parsing the calibration file again
+   * @param source interpreter to copy the calibration from
+   * @return false if the interpreter does not support it
+   */
+  virtual bool CopyCalibration(vtkLidarPacketInterpreter* vtkNotUsed(source)) { return false; }
+
+  /**
+   * @brief GetFramingKey describe the configuration PreProcessPacket splits the frames
+   * with, so that a frame index made by another interpreter is only used if it splits
+   * the frames the same way, see PacketFileSegmentWriter::ReadIndex
+   */
+  virtual std::string GetFramingKey();
+
   /**
    * @brief GetSensorInformation return information to display to the user
    * @return
@@ -186,6 +214,13 @@ protected:
    */
   bool shouldBeCroppedOut(double pos[3], double theta);
 
+  /**
+   * @brief CopyCommonConfiguration copy the parameters shared by all interpreters,
+   * helper for the subclasses implementing CopyConfiguration. The sensor transform
+   * is deep copied, as vtkTransform::Update is not safe to call from several threads.
+   */
+  void CopyCommonConfiguration(vtkLidarPacketInterpreter* source);
+
   //! Buffer to store the frame once they are ready
   std::vector<vtkSmartPointer<vtkPolyData> > Frames;
 
@@ -1,6 +1,7 @@
 #include "vtkLidarReader.h"
 
 #include "vtkLidarPacketInterpreter.h"
+#include "PacketFileSegmentWriter.h"
 #include "vtkPacketFileWriter.h"
 #include "vtkPacketFileReader.h"
 
@@ -25,6 +26,12 @@ int vtkLidarReader::ReadFrameInformation()
   int framePositionInPacket = 0;
   double timeSinceStart = 0;
 
+  // The calibration contained in the pcap file is only read when going through it
+  if (this->Interpreter->GetIsCalibrated() && this->ReadFrameIndex(reader))
+  {
+    return this->GetNumberOfFrames();
+  }
+
   this->FilePositions.clear();
   fpos_t lastFilePosition;
   reader.GetFilePosition(&lastFilePosition);
@@ -75,6 +82,30 @@ int vtkLidarReader::ReadFrameInformation()
   return this->GetNumberOfFrames();
 }
 
+//-----------------------------------------------------------------------------
+bool vtkLidarReader::ReadFrameIndex(vtkPacketFileReader& reader)
+{
+  std::vector<PacketFileSegmentWriter::IndexEntry> entries;
+  if (!PacketFileSegmentWriter::ReadIndex(
+        this->FileName, this->Interpreter->GetFramingKey(), entries))
+  {
+    return false;
+  }
+
+  this->FilePositions.clear();
+  for (const PacketFileSegmentWriter::IndexEntry& entry : entries)
+  {
+    fpos_t position;
+    if (!reader.GetFilePositionAtOffset(entry.Offset, &position))
+    {
+      this->FilePositions.clear();
+      return false;
+    }
+    this->FilePositions.push_back(FramePosition(position, entry.Skip, entry.Time));
+  }
+  return true;
+}
+
 //-----------------------------------------------------------------------------
 void vtkLidarReader::SetTimestepInformation(vtkInformation *info)
 {
@@ -100,6 +100,12 @@ private:
    * In case the calibration is contained in the pcap file, this will also read it
    */
   int ReadFrameInformation();
+  /**
+   * @brief ReadFrameIndex fill the frame index from the sidecar written along the
+   * pcap by a PacketFileSegmentWriter, if it matches the pcap and the interpreter
+   * @return false if the pcap must be read to create the frame index
+   */
+  bool ReadFrameIndex(vtkPacketFileReader& reader);
   /**
    * @brief SetTimestepInformation Set the timestep available
    * @param info
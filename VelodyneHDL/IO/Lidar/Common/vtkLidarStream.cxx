@@ -17,14 +17,25 @@
 
 // LOCAL
 #include "vtkLidarStream.h"
+#include "MultiSensorConsumer.h"
 #include "NetworkSource.h"
 #include "PacketConsumer.h"
 #include "PacketFileWriter.h"
+#include "SharedFramePublisher.h"
+#include "StreamStatistics.h"
 
 // VTK
+#include <vtkDoubleArray.h>
 #include <vtkInformationVector.h>
 #include <vtkInformation.h>
 #include <vtkStreamingDemandDrivenPipeline.h>
+#include <vtkTypeUInt64Array.h>
+
+// STD
+#include <algorithm>
+#include <deque>
+#include <iomanip>
+#include <sstream>
 
 class vtkLidarStreamInternal
 {
@@ -33,17 +44,35 @@ public:
                          std::string ForwardedIpAddress, bool isForwarding, bool isCrashAnalysing)
     : Consumer(new PacketConsumer)
     , Writer(new PacketFileWriter)
+    , Sensors(new MultiSensorConsumer)
     , Network(std::unique_ptr<NetworkSource>(new NetworkSource(this->Consumer, argLIDARPort, ForwardedLIDARPort,
-                                                               ForwardedIpAddress, isForwarding, isCrashAnalysing))) {}
+                                                               ForwardedIpAddress, isForwarding, isCrashAnalysing)))
+  {
+    this->Network->Statistics = this->Consumer->GetStatistics();
+    this->Sensors->SetConsumer(this->Consumer);
+  }
 
 
   //! where to save a live record of the sensor
   std::string OutputFileName;
 
+  //! Copy of the consumer timesteps, updated incrementally
+  std::deque<double> Timesteps;
+
+  //! Id of the frame of Timesteps.front()
+  size_t FirstTimestepFrameId = 0;
+
 
   std::shared_ptr<PacketConsumer> Consumer;
   std::shared_ptr<PacketFileWriter> Writer;
+  std::shared_ptr<MultiSensorConsumer> Sensors;
   std::unique_ptr<NetworkSource> Network;
+
+  //! where the frames are published for other processes, empty for nowhere
+  std::string SharedMemoryName;
+  int SharedMemoryNumberOfFrames = 4;
+  int SharedMemoryFrameSize = 32;
+  std::shared_ptr<SharedFramePublisher> Publisher = std::make_shared<SharedFramePublisher>();
 };
 
 
@@ -82,6 +111,115 @@ void vtkLidarStream::SetOutputFile(const std::string &filename)
   this->Internal->OutputFileName  = filename;
 }
 
+//-----------------------------------------------------------------------------
+std::string vtkLidarStream::GetSharedMemoryName()
+{
+  return this->Internal->SharedMemoryName;
+}
+
+//-----------------------------------------------------------------------------
+void vtkLidarStream::SetSharedMemoryName(const std::string& name)
+{
+  this->Internal->SharedMemoryName = name;
+}
+
+//-----------------------------------------------------------------------------
+int vtkLidarStream::GetSharedMemoryNumberOfFrames()
+{
+  return this->Internal->SharedMemoryNumberOfFrames;
+}
+
+//-----------------------------------------------------------------------------
+void vtkLidarStream::SetSharedMemoryNumberOfFrames(int nFrames)
+{
+  this->Internal->SharedMemoryNumberOfFrames = std::max(1, nFrames);
+}
+
+//-----------------------------------------------------------------------------
+int vtkLidarStream::GetSharedMemoryFrameSize()
+{
+  return this->Internal->SharedMemoryFrameSize;
+}
+
+//-----------------------------------------------------------------------------
+void vtkLidarStream::SetSharedMemoryFrameSize(int megabytes)
+{
+  this->Internal->SharedMemoryFrameSize = std::max(1, megabytes);
+}
+
+//-----------------------------------------------------------------------------
+int vtkLidarStream::GetRecordingMode()
+{
+  return this->Internal->Writer->GetRecordingMode();
+}
+
+//-----------------------------------------------------------------------------
+void vtkLidarStream::SetRecordingMode(int mode)
+{
+  this->Internal->Writer->SetRecordingMode(mode);
+}
+
+//-----------------------------------------------------------------------------
+int vtkLidarStream::GetRecordingCompressionLevel()
+{
+  return this->Internal->Writer->GetCompressionLevel();
+}
+
+//-----------------------------------------------------------------------------
+void vtkLidarStream::SetRecordingCompressionLevel(int level)
+{
+  this->Internal->Writer->SetCompressionLevel(level);
+}
+
+//-----------------------------------------------------------------------------
+int vtkLidarStream::GetRecordingSegmentSize()
+{
+  return static_cast<int>(this->Internal->Writer->GetSegmentWriter().GetMaxSegmentSize() >> 20);
+}
+
+//-----------------------------------------------------------------------------
+void vtkLidarStream::SetRecordingSegmentSize(int megabytes)
+{
+  this->Internal->Writer->GetSegmentWriter().SetMaxSegmentSize(
+    static_cast<uint64_t>(std::max(0, megabytes)) << 20);
+}
+
+//-----------------------------------------------------------------------------
+double vtkLidarStream::GetRecordingSegmentDuration()
+{
+  return this->Internal->Writer->GetSegmentWriter().GetMaxSegmentDuration();
+}
+
+//-----------------------------------------------------------------------------
+void vtkLidarStream::SetRecordingSegmentDuration(double seconds)
+{
+  this->Internal->Writer->GetSegmentWriter().SetMaxSegmentDuration(seconds);
+}
+
+//-----------------------------------------------------------------------------
+bool vtkLidarStream::GetRecordingDirectIO()
+{
+  return this->Internal->Writer->GetSegmentWriter().GetUseDirectIO();
+}
+
+//-----------------------------------------------------------------------------
+void vtkLidarStream::SetRecordingDirectIO(bool value)
+{
+  this->Internal->Writer->GetSegmentWriter().SetUseDirectIO(value);
+}
+
+//-----------------------------------------------------------------------------
+bool vtkLidarStream::GetRecordingPreallocation()
+{
+  return this->Internal->Writer->GetSegmentWriter().GetPreallocate();
+}
+
+//-----------------------------------------------------------------------------
+void vtkLidarStream::SetRecordingPreallocation(bool value)
+{
+  this->Internal->Writer->GetSegmentWriter().SetPreallocate(value);
+}
+
 //-----------------------------------------------------------------------------
 std::string vtkLidarStream::GetForwardedIpAddress()
 {
@@ -173,6 +311,264 @@ void vtkLidarStream::SetIsCrashAnalysing(const bool value)
   this->Internal->Network->IsCrashAnalysing = value;
 }
 
+//-----------------------------------------------------------------------------
+bool vtkLidarStream::SaveLastPackets(const std::string& filename)
+{
+  return this->Internal->Network->SaveLastPackets(filename);
+}
+
+//-----------------------------------------------------------------------------
+int vtkLidarStream::GetReceiveBatchSize()
+{
+  return static_cast<int>(this->Internal->Network->ReceiveBatchSize);
+}
+
+//-----------------------------------------------------------------------------
+void vtkLidarStream::SetReceiveBatchSize(int value)
+{
+  this->Internal->Network->ReceiveBatchSize = value > 0 ? static_cast<unsigned int>(value) : 0;
+}
+
+//-----------------------------------------------------------------------------
+int vtkLidarStream::GetReceiveBufferSize()
+{
+  return this->Internal->Network->ReceiveBufferSize;
+}
+
+//-----------------------------------------------------------------------------
+void vtkLidarStream::SetReceiveBufferSize(int value)
+{
+  this->Internal->Network->ReceiveBufferSize = value;
+}
+
+//-----------------------------------------------------------------------------
+int vtkLidarStream::GetTimestampMode()
+{
+  return this->Internal->Network->TimestampMode;
+}
+
+//-----------------------------------------------------------------------------
+void vtkLidarStream::SetTimestampMode(int mode)
+{
+  this->Internal->Network->TimestampMode = mode;
+}
+
+//-----------------------------------------------------------------------------
+int vtkLidarStream::AddSensor(int port, const std::string& sourceAddress,
+  const std::string& calibrationFile, vtkTransform* extrinsics)
+{
+  return this->Internal->Sensors->AddSensor(port, sourceAddress, calibrationFile, extrinsics);
+}
+
+//-----------------------------------------------------------------------------
+void vtkLidarStream::RemoveAllSensors()
+{
+  this->Internal->Sensors->RemoveAllSensors();
+}
+
+//-----------------------------------------------------------------------------
+int vtkLidarStream::GetNumberOfSensors()
+{
+  return this->Internal->Sensors->GetNumberOfSensors();
+}
+
+//-----------------------------------------------------------------------------
+bool vtkLidarStream::GetMergeSensors()
+{
+  return this->Internal->Sensors->GetMergeFrames();
+}
+
+//-----------------------------------------------------------------------------
+void vtkLidarStream::SetMergeSensors(bool value)
+{
+  this->Internal->Sensors->SetMergeFrames(value);
+}
+
+//-----------------------------------------------------------------------------
+double vtkLidarStream::GetSensorMergeTolerance()
+{
+  return this->Internal->Sensors->GetMergeTolerance();
+}
+
+//-----------------------------------------------------------------------------
+void vtkLidarStream::SetSensorMergeTolerance(double seconds)
+{
+  this->Internal->Sensors->SetMergeTolerance(seconds);
+}
+
+//-----------------------------------------------------------------------------
+double vtkLidarStream::GetSensorFrame(int sensor, vtkPolyData* output)
+{
+  double time = -1.0;
+  vtkSmartPointer<vtkPolyData> frame = this->Internal->Sensors->GetSensorFrame(sensor, time);
+  if (!frame || !output)
+  {
+    return -1.0;
+  }
+  output->ShallowCopy(frame);
+  return time;
+}
+
+//-----------------------------------------------------------------------------
+unsigned int vtkLidarStream::GetKernelDropCount()
+{
+  return this->Internal->Network->GetKernelDropCount();
+}
+
+//-----------------------------------------------------------------------------
+vtkIdType vtkLidarStream::GetNumberOfPacketsReceived()
+{
+  return static_cast<vtkIdType>(this->Internal->Consumer->GetStatistics()->PacketsReceived);
+}
+
+//-----------------------------------------------------------------------------
+vtkIdType vtkLidarStream::GetNumberOfPacketsDropped()
+{
+  return static_cast<vtkIdType>(this->Internal->Network->GetKernelDropCount());
+}
+
+//-----------------------------------------------------------------------------
+vtkIdType vtkLidarStream::GetNumberOfPacketsNotForwarded()
+{
+  return static_cast<vtkIdType>(this->Internal->Network->GetForwardDropCount());
+}
+
+//-----------------------------------------------------------------------------
+vtkIdType vtkLidarStream::GetNumberOfMalformedPackets()
+{
+  return static_cast<vtkIdType>(this->Internal->Consumer->GetStatistics()->MalformedPackets);
+}
+
+//-----------------------------------------------------------------------------
+vtkIdType vtkLidarStream::GetNumberOfFramesDecoded()
+{
+  return static_cast<vtkIdType>(this->Internal->Consumer->GetStatistics()->FramesDecoded);
+}
+
+//-----------------------------------------------------------------------------
+vtkIdType vtkLidarStream::GetNumberOfFramesPublished()
+{
+  return static_cast<vtkIdType>(this->Internal->Consumer->GetStatistics()->FramesPublished);
+}
+
+//-----------------------------------------------------------------------------
+int vtkLidarStream::GetPacketQueueSize()
+{
+  unsigned int size = this->Internal->Consumer->GetPacketQueueSize();
+  if (this->Internal->Network->Sensors)
+  {
+    size += this->Internal->Network->Sensors->GetPacketQueueSize();
+  }
+  return static_cast<int>(size);
+}
+
+//-----------------------------------------------------------------------------
+int vtkLidarStream::GetFrameQueueSize()
+{
+  return static_cast<int>(this->Internal->Consumer->GetFrameQueueSize());
+}
+
+//-----------------------------------------------------------------------------
+int vtkLidarStream::GetNumberOfCachedFrames()
+{
+  return this->Internal->Consumer->GetNumberOfFrames();
+}
+
+//-----------------------------------------------------------------------------
+double vtkLidarStream::GetCacheMemoryUsage()
+{
+  return this->Internal->Consumer->GetNumberOfBytes() / (1024.0 * 1024.0);
+}
+
+//-----------------------------------------------------------------------------
+double vtkLidarStream::GetFramesPerSecond()
+{
+  return this->Internal->Consumer->GetStatistics()->GetFramesPerSecond();
+}
+
+//-----------------------------------------------------------------------------
+double vtkLidarStream::GetLatencyPercentile(int stage, double percentile)
+{
+  if (stage < 0 || stage >= StreamStatistics::NumberOfStages)
+  {
+    vtkErrorMacro(<< "Invalid latency stage: " << stage);
+    return 0.0;
+  }
+  return this->Internal->Consumer->GetStatistics()->GetLatency(stage).GetPercentile(percentile);
+}
+
+//-----------------------------------------------------------------------------
+double vtkLidarStream::GetMeanLatency(int stage)
+{
+  if (stage < 0 || stage >= StreamStatistics::NumberOfStages)
+  {
+    vtkErrorMacro(<< "Invalid latency stage: " << stage);
+    return 0.0;
+  }
+  return this->Internal->Consumer->GetStatistics()->GetLatency(stage).GetMean();
+}
+
+//-----------------------------------------------------------------------------
+void vtkLidarStream::GetLatencyHistograms(vtkTable* histograms)
+{
+  if (!histograms)
+  {
+    vtkErrorMacro(<< "No table to fill with the latency histograms");
+    return;
+  }
+  std::shared_ptr<StreamStatistics> statistics = this->Internal->Consumer->GetStatistics();
+  histograms->Initialize();
+
+  auto upperBounds = vtkSmartPointer<vtkDoubleArray>::New();
+  upperBounds->SetName("Upper bound (s)");
+  upperBounds->SetNumberOfValues(LatencyHistogram::NumberOfBins);
+  for (int bin = 0; bin < LatencyHistogram::NumberOfBins; ++bin)
+  {
+    upperBounds->SetValue(bin, LatencyHistogram::GetBinUpperBound(bin));
+  }
+  histograms->AddColumn(upperBounds);
+
+  for (int stage = 0; stage < StreamStatistics::NumberOfStages; ++stage)
+  {
+    const std::vector<uint64_t> counts = statistics->GetLatency(stage).GetCounts();
+    auto column = vtkSmartPointer<vtkTypeUInt64Array>::New();
+    column->SetName(StreamStatistics::GetStageName(stage));
+    column->SetNumberOfValues(LatencyHistogram::NumberOfBins);
+    for (int bin = 0; bin < LatencyHistogram::NumberOfBins; ++bin)
+    {
+      column->SetValue(bin, counts[bin]);
+    }
+    histograms->AddColumn(column);
+  }
+}
+
+//-----------------------------------------------------------------------------
+std::string vtkLidarStream::GetStatisticsSummary()
+{
+  std::shared_ptr<StreamStatistics> statistics = this->Internal->Consumer->GetStatistics();
+  const LatencyHistogram& latency = statistics->GetLatency(StreamStatistics::ReceiveToPublish);
+
+  std::ostringstream summary;
+  summary << std::fixed << std::setprecision(1)
+          << statistics->GetFramesPerSecond() << " fps"
+          << " | packets: " << statistics->PacketsReceived.load()
+          << ", dropped: " << this->GetNumberOfPacketsDropped()
+          << ", malformed: " << statistics->MalformedPackets.load()
+          << " | queues: " << this->GetPacketQueueSize() << " packets, "
+          << this->GetFrameQueueSize() << " frames"
+          << " | cache: " << this->GetNumberOfCachedFrames() << " frames, "
+          << this->GetCacheMemoryUsage() << " MB"
+          << " | latency p50/p99: " << 1e3 * latency.GetPercentile(50) << "/"
+          << 1e3 * latency.GetPercentile(99) << " ms";
+  return summary.str();
+}
+
+//-----------------------------------------------------------------------------
+void vtkLidarStream::ResetStatistics()
+{
+  this->Internal->Consumer->GetStatistics()->Reset();
+}
+
 //-----------------------------------------------------------------------------
 bool vtkLidarStream::GetNeedsUpdate()
 {
@@ -188,10 +584,22 @@ void vtkLidarStream::Start()
     vtkErrorMacro(<< "Please set a Interpreter")
   }
   this->Internal->Consumer->SetInterpreter(this->Interpreter);
+  this->ResetStatistics();
+  // With several sensors, the packets of the LIDAR port are decoded by the
+  // multi sensor consumer, which hands over the frames to the consumer
+  const bool hasSeveralSensors = this->Internal->Sensors->GetNumberOfSensors() > 1;
   if (this->Internal->OutputFileName.length())
   {
+    this->Internal->Writer->SetInterpreter(this->Interpreter);
+    this->Internal->Writer->SetIndexedPort(
+      hasSeveralSensors ? this->Internal->Network->LIDARPort : 0);
     this->Internal->Writer->Start(this->Internal->OutputFileName);
   }
+  else
+  {
+    // the recording is over, flush it and release the file
+    this->Internal->Writer->Close();
+  }
 
   this->Internal->Network->Writer.reset();
 
@@ -211,7 +619,34 @@ void vtkLidarStream::Start()
 //    }
 //  }
 
+  // a new region each time, the readers of the previous one see it closed
+  this->Internal->Publisher->Close();
+  this->Internal->Consumer->SetPublisher(nullptr);
+  if (!this->Internal->SharedMemoryName.empty() &&
+    this->Internal->Publisher->Open(this->Internal->SharedMemoryName,
+      this->Internal->SharedMemoryNumberOfFrames,
+      static_cast<uint64_t>(this->Internal->SharedMemoryFrameSize) * 1024 * 1024))
+  {
+    this->Internal->Consumer->SetPublisher(this->Internal->Publisher);
+  }
+
   this->Internal->Consumer->Start();
+  this->Internal->Network->Sensors.reset();
+  if (hasSeveralSensors)
+  {
+    this->Internal->Sensors->SetInterpreter(this->Interpreter);
+    this->Internal->Sensors->SetMainPort(this->Internal->Network->LIDARPort);
+    this->Internal->Sensors->SetNumberOfThreads(
+      this->Internal->Consumer->GetNumberOfDecodingThreads());
+    if (this->Internal->Sensors->Start())
+    {
+      this->Internal->Network->Sensors = this->Internal->Sensors;
+    }
+    else
+    {
+      vtkErrorMacro(<< "Unable to decode several sensors, only the LIDAR port is decoded");
+    }
+  }
 //  this->Internal->Network->LIDARPort = this->LIDARPort;
 //  this->Internal->Network->ForwardedLIDARPort = this->ForwardedLIDARPort;
 //  this->Internal->Network->ForwardedIpAddress = this->ForwardedIpAddress;
@@ -224,8 +659,13 @@ void vtkLidarStream::Start()
 void vtkLidarStream::Stop()
 {
   this->Internal->Network->Stop();
+  this->Internal->Sensors->Stop();
   this->Internal->Consumer->Stop();
   this->Internal->Writer->Stop();
+
+  // the readers of the shared memory see it closed, as when the stream restarts
+  this->Internal->Consumer->SetPublisher(nullptr);
+  this->Internal->Publisher->Close();
 }
 
 //----------------------------------------------------------------------------
@@ -255,6 +695,97 @@ void vtkLidarStream::SetCacheSize(int cacheSize)
   this->Modified();
 }
 
+//----------------------------------------------------------------------------
+int vtkLidarStream::GetCacheMemoryLimit()
+{
+  return static_cast<int>(this->Internal->Consumer->GetMaxNumberOfBytes() / (1024 * 1024));
+}
+
+//----------------------------------------------------------------------------
+void vtkLidarStream::SetCacheMemoryLimit(int megabytes)
+{
+  if (megabytes == this->GetCacheMemoryLimit())
+  {
+    return;
+  }
+
+  this->Internal->Consumer->SetMaxNumberOfBytes(
+    static_cast<size_t>(std::max(0, megabytes)) * 1024 * 1024);
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+int vtkLidarStream::GetCacheMode()
+{
+  return this->Internal->Consumer->GetCacheMode();
+}
+
+//----------------------------------------------------------------------------
+void vtkLidarStream::SetCacheMode(int mode)
+{
+  if (mode == this->GetCacheMode())
+  {
+    return;
+  }
+
+  this->Internal->Consumer->SetCacheMode(mode);
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+int vtkLidarStream::GetNumberOfDecodedFramesCached()
+{
+  return this->Internal->Consumer->GetMaxNumberOfDecodedFrames();
+}
+
+//----------------------------------------------------------------------------
+void vtkLidarStream::SetNumberOfDecodedFramesCached(int nFrames)
+{
+  if (nFrames == this->GetNumberOfDecodedFramesCached())
+  {
+    return;
+  }
+
+  this->Internal->Consumer->SetMaxNumberOfDecodedFrames(nFrames);
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+int vtkLidarStream::GetNumberOfTrailingFrames()
+{
+  return this->Internal->Consumer->GetNumberOfTrailingFrames();
+}
+
+//----------------------------------------------------------------------------
+void vtkLidarStream::SetNumberOfTrailingFrames(int nFrames)
+{
+  if (nFrames == this->GetNumberOfTrailingFrames())
+  {
+    return;
+  }
+
+  this->Internal->Consumer->SetNumberOfTrailingFrames(nFrames);
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+int vtkLidarStream::GetNumberOfDecodingThreads()
+{
+  return this->Internal->Consumer->GetNumberOfDecodingThreads();
+}
+
+//----------------------------------------------------------------------------
+void vtkLidarStream::SetNumberOfDecodingThreads(int nThreads)
+{
+  if (nThreads == this->GetNumberOfDecodingThreads())
+  {
+    return;
+  }
+
+  this->Internal->Consumer->SetNumberOfDecodingThreads(nThreads);
+  this->Modified();
+}
+
 //-----------------------------------------------------------------------------
 void vtkLidarStream::UnloadFrames()
 {
@@ -270,7 +801,10 @@ int vtkLidarStream::RequestInformation(vtkInformation* request,
   this->Superclass::RequestInformation(request, inputVector, outputVector);
   vtkInformation* outInfo = outputVector->GetInformationObject(0);
 
-  std::vector<double> timesteps = this->Internal->Consumer->GetTimesteps();
+  this->Internal->Consumer->UpdateTimesteps(
+    this->Internal->Timesteps, this->Internal->FirstTimestepFrameId);
+  const std::vector<double> timesteps(
+    this->Internal->Timesteps.begin(), this->Internal->Timesteps.end());
   const size_t nTimesteps = timesteps.size();
   if (nTimesteps > 0)
   {
@@ -282,7 +816,12 @@ int vtkLidarStream::RequestInformation(vtkInformation* request,
     outInfo->Remove(vtkStreamingDemandDrivenPipeline::TIME_STEPS());
   }
 
-  double timeRange[2] = { 0.0, nTimesteps ? nTimesteps - 1.0 : 0.0 };
+  double timeRange[2] = { 0.0, 0.0 };
+  if (nTimesteps > 0)
+  {
+    timeRange[0] = timesteps.front();
+    timeRange[1] = timesteps.back();
+  }
   outInfo->Set(vtkStreamingDemandDrivenPipeline::TIME_RANGE(), timeRange, 2);
 
   return 1;
@@ -305,16 +844,8 @@ int vtkLidarStream::RequestData(vtkInformation* vtkNotUsed(request),
   {
     boost::lock_guard<boost::mutex> lock(this->Internal->Consumer->ConsumerMutex);
     double actualTime;
-    vtkSmartPointer<vtkPolyData> polyData(NULL);
-//  if (this->Internal->Consumer->GetNumberOfTrailingFrames() > 0)
-//  {
-//    polyData = this->Internal->Consumer->GetFramesForTime(
-//      timeRequest, actualTime, this->Internal->Consumer->GetNumberOfTrailingFrames());
-//  }
-//  else
-//  {
-    polyData = this->Internal->Consumer->GetFrameForTime(timeRequest, actualTime);
-//  }
+    vtkSmartPointer<vtkPolyData> polyData = this->Internal->Consumer->GetFrameForTime(
+      timeRequest, actualTime, this->Internal->Consumer->GetNumberOfTrailingFrames());
 
     if (polyData)
     {
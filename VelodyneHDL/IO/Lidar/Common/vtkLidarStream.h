@@ -38,12 +38,104 @@ public:
   int GetCacheSize();
   void SetCacheSize(int cacheSize);
 
+  /**
+   * @brief Memory in megabytes the cached frames are allowed to use, 0 for no limit.
+   * @copydetails PacketConsumer::SetMaxNumberOfBytes
+   */
+  int GetCacheMemoryLimit();
+  void SetCacheMemoryLimit(int megabytes);
+
+  /**
+   * @copydoc PacketConsumer::SetCacheMode
+   */
+  int GetCacheMode();
+  void SetCacheMode(int mode);
+
+  /**
+   * @copydoc PacketConsumer::SetMaxNumberOfDecodedFrames
+   */
+  int GetNumberOfDecodedFramesCached();
+  void SetNumberOfDecodedFramesCached(int nFrames);
+
+  /**
+   * @copydoc PacketConsumer::SetNumberOfTrailingFrames
+   */
+  int GetNumberOfTrailingFrames();
+  void SetNumberOfTrailingFrames(int nFrames);
+
+  /**
+   * @copydoc PacketConsumer::SetNumberOfDecodingThreads
+   */
+  int GetNumberOfDecodingThreads();
+  void SetNumberOfDecodingThreads(int nThreads);
+
   /**
    * @copydoc vtkLidarStreamInternal::OutputFileName
    */
   std::string GetOutputFile();
   void SetOutputFile(const std::string& filename);
 
+  /**
+   * @copydoc PacketFileWriter::RECORDING_MODE
+   * Takes effect at the next start of the recording.
+   */
+  int GetRecordingMode();
+  void SetRecordingMode(int mode);
+
+  /**
+   * @copydoc PacketFileWriter::SetCompressionLevel
+   */
+  int GetRecordingCompressionLevel();
+  void SetRecordingCompressionLevel(int level);
+
+  /**
+   * @brief Size in megabytes after which a Buffered recording continues in a new file,
+   * 0 for no limit
+   */
+  int GetRecordingSegmentSize();
+  void SetRecordingSegmentSize(int megabytes);
+
+  /**
+   * @brief Duration in seconds after which a Buffered recording continues in a new file,
+   * 0 for no limit
+   */
+  double GetRecordingSegmentDuration();
+  void SetRecordingSegmentDuration(double seconds);
+
+  /**
+   * @copydoc PacketFileSegmentWriter::SetUseDirectIO
+   */
+  bool GetRecordingDirectIO();
+  void SetRecordingDirectIO(bool value);
+
+  /**
+   * @copydoc PacketFileSegmentWriter::SetPreallocate
+   */
+  bool GetRecordingPreallocation();
+  void SetRecordingPreallocation(bool value);
+
+  /**
+   * @brief Name of the POSIX shared memory region the decoded frames are published in
+   * for other processes, see SharedFramePublisher. Empty to publish nothing.
+   * Takes effect at the next start of the stream, which creates a new region.
+   * The region is closed for its readers when the stream stops.
+   */
+  std::string GetSharedMemoryName();
+  void SetSharedMemoryName(const std::string& name);
+
+  /**
+   * @brief Number of frames kept in shared memory, a reader must use a frame within
+   * this many frame periods
+   */
+  int GetSharedMemoryNumberOfFrames();
+  void SetSharedMemoryNumberOfFrames(int nFrames);
+
+  /**
+   * @brief Size in megabytes of a frame in shared memory, larger frames are not published
+   */
+  int GetSharedMemoryFrameSize();
+  void SetSharedMemoryFrameSize(int megabytes);
+
   /**
    * @copydoc NetworkSource::LIDARPort
    */
@@ -88,6 +180,112 @@ public:
   bool GetIsCrashAnalysing();
   void SetIsCrashAnalysing(bool value);
 
+  /**
+   * @copydoc NetworkSource::SaveLastPackets
+   */
+  bool SaveLastPackets(const std::string& filename);
+
+  /**
+   * @copydoc NetworkSource::ReceiveBatchSize
+   */
+  int GetReceiveBatchSize();
+  void SetReceiveBatchSize(int value);
+
+  /**
+   * @copydoc NetworkSource::ReceiveBufferSize
+   */
+  int GetReceiveBufferSize();
+  void SetReceiveBufferSize(int value);
+
+  /**
+   * @copydoc PacketReceiver::TIMESTAMP_MODE
+   * Takes effect at the next start of the stream.
+   */
+  int GetTimestampMode();
+  void SetTimestampMode(int mode);
+
+  /**
+   * @brief AddSensor listen to a sensor in addition to the one of the LIDAR port, with
+   * the same interpreter. See MultiSensorConsumer::AddSensor for the parameters.
+   * Takes effect at the next start of the stream. The sensors can only be added or
+   * removed while the stream is stopped.
+   * @return index of the sensor, the one of the LIDAR port being 0. -1 on error.
+   */
+  int AddSensor(int port, const std::string& sourceAddress, const std::string& calibrationFile,
+    vtkTransform* extrinsics);
+  void RemoveAllSensors();
+  int GetNumberOfSensors();
+
+  /**
+   * @copydoc MultiSensorConsumer::SetMergeFrames
+   */
+  bool GetMergeSensors();
+  void SetMergeSensors(bool value);
+
+  /**
+   * @copydoc MultiSensorConsumer::SetMergeTolerance
+   */
+  double GetSensorMergeTolerance();
+  void SetSensorMergeTolerance(double seconds);
+
+  /**
+   * @brief GetSensorFrame shallow copy the last frame of a sensor
+   * @return the time of the frame, -1 if the sensor has no frame yet
+   */
+  double GetSensorFrame(int sensor, vtkPolyData* output);
+
+  /**
+   * @copydoc PacketReceiver::GetKernelDropCount
+   */
+  unsigned int GetKernelDropCount();
+
+  /**
+   * @brief Health and latency statistics of the live path, see StreamStatistics.
+   * The latency stages are the values of StreamStatistics::STAGE.
+   */
+  vtkIdType GetNumberOfPacketsReceived();
+  vtkIdType GetNumberOfPacketsDropped();
+  vtkIdType GetNumberOfPacketsNotForwarded();
+  vtkIdType GetNumberOfMalformedPackets();
+  vtkIdType GetNumberOfFramesDecoded();
+  vtkIdType GetNumberOfFramesPublished();
+
+  /**
+   * @copydoc PacketConsumer::GetPacketQueueSize
+   */
+  int GetPacketQueueSize();
+
+  /**
+   * @copydoc PacketConsumer::GetFrameQueueSize
+   */
+  int GetFrameQueueSize();
+
+  int GetNumberOfCachedFrames();
+
+  //! Memory in megabytes used by the cached frames
+  double GetCacheMemoryUsage();
+
+  double GetFramesPerSecond();
+
+  //! Latency of a stage in seconds, with the resolution of the histogram bins
+  double GetLatencyPercentile(int stage, double percentile);
+  double GetMeanLatency(int stage);
+
+  /**
+   * @brief GetLatencyHistograms replace the columns of histograms by the latency
+   * histograms, a column holding the upper bound of each bin in seconds and one
+   * column of counts per stage
+   */
+  void GetLatencyHistograms(vtkTable* histograms);
+
+  /**
+   * @brief GetStatisticsSummary return a one line summary of the statistics,
+   * as displayed in the status bar
+   */
+  std::string GetStatisticsSummary();
+
+  void ResetStatistics();
+
   /**
    * @brief GetNeedsUpdate
    * @return true if a new frame is ready
@@ -450,6 +450,11 @@ vtkVelodynePacketInterpreter::vtkVelodynePacketInterpreter()
   this->OutputPacketProcessingDebugInfo = false;
   this->SensorPowerMode = 0;
   this->CurrentFrameState = new FramingState;
+  this->PreProcessFrameState = new FramingState;
+  this->PreProcessIsEmptyFrame = true;
+  this->PreProcessNumberOfFiringPackets = 0;
+  this->PreProcessLastNumberOfFiringPackets = 0;
+  this->PreProcessFrameNumber = 0;
   this->LastTimestamp = std::numeric_limits<unsigned int>::max();
   this->TimeAdjust = std::numeric_limits<double>::quiet_NaN();
   this->FiringsSkip = 0;
@@ -476,6 +481,7 @@ vtkVelodynePacketInterpreter::~vtkVelodynePacketInterpreter()
     delete this->rollingCalibrationData;
   }
   delete this->CurrentFrameState;
+  delete this->PreProcessFrameState;
 }
 
 //-----------------------------------------------------------------------------
@@ -1381,6 +1387,11 @@ void vtkVelodynePacketInterpreter::ResetCurrentFrame()
 {
   std::fill(this->LastPointId, this->LastPointId + HDL_MAX_NUM_LASERS, -1);
   this->CurrentFrameState->reset();
+  this->PreProcessFrameState->reset();
+  this->PreProcessIsEmptyFrame = true;
+  this->PreProcessNumberOfFiringPackets = 0;
+  this->PreProcessLastNumberOfFiringPackets = 0;
+  this->PreProcessFrameNumber = 0;
   this->LastTimestamp = std::numeric_limits<unsigned int>::max();
   this->TimeAdjust = std::numeric_limits<double>::quiet_NaN();
 
@@ -1398,17 +1409,11 @@ void vtkVelodynePacketInterpreter::ResetCurrentFrame()
 void vtkVelodynePacketInterpreter::PreProcessPacket(unsigned char const * data, unsigned int dataLength, bool &isNewFrame, int &framePositionInPacket)
 {
   const HDLDataPacket* dataPacket = reinterpret_cast<const HDLDataPacket*>(data);
-  //! @todo don't use static value here this is ugly...
-  static bool isEmptyFrame = true;
-  static FramingState currentFrameState;
-  static int numberOfFiringPackets = 0;
-  static int lastnumberOfFiringPackets = 0;
-  static int frameNumber;
 
   isNewFrame = false;
   framePositionInPacket = 0;
 
-  numberOfFiringPackets++;
+  this->PreProcessNumberOfFiringPackets++;
 
   //! @todo this could be useful at a higher level
   if (this->ShouldCheckSensor)
@@ -1448,32 +1453,32 @@ void vtkVelodynePacketInterpreter::PreProcessPacket(unsigned char const * data,
       {
         if (firingData.laserReturns[laserID].distance != 0)
         {
-          isEmptyFrame = false;
+          this->PreProcessIsEmptyFrame = false;
           break;
         }
       }
     }
     else
     {
-      isEmptyFrame = false;
+      this->PreProcessIsEmptyFrame = false;
     }
 
-    if (currentFrameState.hasChangedWithValue(firingData))
+    if (this->PreProcessFrameState->hasChangedWithValue(firingData))
     {
       // Add file position if the frame is not empty
-      if (!isEmptyFrame || !this->IgnoreEmptyFrames)
+      if (!this->PreProcessIsEmptyFrame || !this->IgnoreEmptyFrames)
       {
         isNewFrame = true;
         framePositionInPacket = i;
-        frameNumber++;
+        this->PreProcessFrameNumber++;
         PacketProcessingDebugMacro(
-          << "\n\nEnd of frame #" << frameNumber
-          << ". #packets: " << numberOfFiringPackets - lastnumberOfFiringPackets << "\n\n"
+          << "\n\nEnd of frame #" << this->PreProcessFrameNumber
+          << ". #packets: " << this->PreProcessNumberOfFiringPackets - this->PreProcessLastNumberOfFiringPackets << "\n\n"
           << "RotationalPositions: ");
-        lastnumberOfFiringPackets = numberOfFiringPackets;
+        this->PreProcessLastNumberOfFiringPackets = this->PreProcessNumberOfFiringPackets;
       }
       // We start a new frame, reinitialize the boolean
-      isEmptyFrame = true;
+      this->PreProcessIsEmptyFrame = true;
     }
     PacketProcessingDebugMacro(<< firingData.rotationalPosition << ", ");
   }
@@ -1543,6 +1548,53 @@ std::string vtkVelodynePacketInterpreter::GetSensorInformation()
   return std::string(streamInfo.str());
 }
 
+//-----------------------------------------------------------------------------
+bool vtkVelodynePacketInterpreter::CopyConfiguration(vtkLidarPacketInterpreter* source)
+{
+  vtkVelodynePacketInterpreter* other = vtkVelodynePacketInterpreter::SafeDownCast(source);
+  if (!other)
+  {
+    return false;
+  }
+
+  this->CopyCommonConfiguration(other);
+
+  this->ShouldAddDualReturnArray = other->ShouldAddDualReturnArray;
+  this->SelectedDualReturn = other->SelectedDualReturn;
+  this->WantIntensityCorrection = other->WantIntensityCorrection;
+  this->FiringsSkip = other->FiringsSkip;
+  this->UseIntraFiringAdjustment = other->UseIntraFiringAdjustment;
+  this->DualReturnFilter = other->DualReturnFilter;
+  return this->CopyCalibration(other);
+}
+
+//-----------------------------------------------------------------------------
+bool vtkVelodynePacketInterpreter::CopyCalibration(vtkLidarPacketInterpreter* source)
+{
+  vtkVelodynePacketInterpreter* other = vtkVelodynePacketInterpreter::SafeDownCast(source);
+  if (!other)
+  {
+    return false;
+  }
+
+  // the fields set by LoadCalibration
+  this->CalibrationFileName = other->CalibrationFileName;
+  this->CalibrationReportedNumLasers = other->CalibrationReportedNumLasers;
+  this->IsCalibrated = other->IsCalibrated;
+  this->DistanceResolutionM = other->DistanceResolutionM;
+  this->IsCorrectionFromLiveStream = other->IsCorrectionFromLiveStream;
+
+  // the precomputed cos/sin are part of the corrections
+  std::copy(other->laser_corrections_, other->laser_corrections_ + HDL_MAX_NUM_LASERS,
+            this->laser_corrections_);
+  for (int i = 0; i < HDL_MAX_NUM_LASERS; ++i)
+  {
+    std::copy(other->XMLColorTable[i], other->XMLColorTable[i] + 3, this->XMLColorTable[i]);
+  }
+  this->Modified();
+  return true;
+}
+
 //-----------------------------------------------------------------------------
 void vtkVelodynePacketInterpreter::SetSelectedPointsWithDualReturn(double* data, int Npoints)
 {
@@ -48,6 +48,10 @@ public:
 
   std::string GetSensorInformation() override;
 
+  bool CopyConfiguration(vtkLidarPacketInterpreter* source) override;
+
+  bool CopyCalibration(vtkLidarPacketInterpreter* source) override;
+
   void SetSelectedPointsWithDualReturn(double* data, int Npoints);
 
   void GetXMLColorTable(double XMLColorTable[]);
@@ -156,6 +160,12 @@ protected:
   RPMCalculator* RpmCalculator_;
 
   FramingState* CurrentFrameState;
+  // Framing state of PreProcessPacket, which is independent of ProcessPacket
+  FramingState* PreProcessFrameState;
+  bool PreProcessIsEmptyFrame;
+  int PreProcessNumberOfFiringPackets;
+  int PreProcessLastNumberOfFiringPackets;
+  int PreProcessFrameNumber;
   unsigned int LastTimestamp;
   std::vector<double> RpmByFrames;
   double TimeAdjust;
@@ -28,18 +28,19 @@
 // .NAME PacketFileSender -
 // .SECTION Description
 // This program reads a pcap file and sends the packets using UDP.
-// The default playback speed is based on the timestamps specified in the pcap file
+// The default playback speed is based on the timestamps specified in the pcap file,
+// a speed of 0 sends the packets as fast as possible.
+// The packets are loaded in memory before being sent (see vvPacketReplayer), and a
+// report on the achieved packet rate and the timing accuracy is output after each replay.
 
-#include "vtkPacketFileReader.h"
-#include "vvPacketSender.h"
+#include "vvPacketReplayer.h"
 
 #include <cstdlib>
-#include <ctime>
+#include <iomanip>
 #include <iostream>
 #include <string>
-#include <chrono>
+#include <vector>
 
-#include <boost/thread/thread.hpp>
 #include <boost/program_options.hpp>
 namespace po = boost::program_options;
 
@@ -48,6 +49,7 @@ const int OUTPUT_WIDTH = 15; // width of the column (#packet, duration, ...) in
 int main(int argc, char* argv[])
 {
   bool loop = false;  // run the capture 1 time or in loop
+  bool keepPorts = false; // send the packets to the ports they were recorded with
 
   // parse the command line options
   po::options_description visible("Allowed options");
@@ -55,9 +57,13 @@ int main(int argc, char* argv[])
       ("help", "produce help message")
       ("ip", po::value<std::string>()->default_value("127.0.0.1"), "destination ip adress")
       ("loop", po::bool_switch(&loop), "run the capture in loop")
-      ("lidarPort", po::value<unsigned int>()->default_value(2368), "destination port for lidar packets")
-      ("GPSPort", po::value<unsigned int>()->default_value(8308), "destination port for GPS packets")
-      ("speed", po::value<double>()->default_value(1), "playback speed")
+      ("lidarPort", po::value<std::vector<int> >()->multitoken()->default_value(std::vector<int>(1, 2368), "2368"),
+       "destination ports for lidar packets, each packet being sent to all of them")
+      ("GPSPort", po::value<int>()->default_value(8308), "destination port for GPS packets")
+      ("keep-ports", po::bool_switch(&keepPorts), "send the packets to the ports they were recorded with")
+      ("speed", po::value<double>()->default_value(1), "playback speed, 0 to send as fast as possible")
+      ("batch-size", po::value<int>()->default_value(64), "maximum number of packets sent at once")
+      ("spin-us", po::value<double>()->default_value(200), "time spent spinning instead of sleeping before a packet is due, in us")
       ("display-frequency", po::value<unsigned int>()->default_value(1000), "print information after every interval of X sent packets")
       ;
 
@@ -77,9 +83,9 @@ int main(int argc, char* argv[])
             options(cmdline_options).positional(p).run(), vm);
   po::notify(vm);
 
-  if (vm.count("help") || argc < 2) {
-      cout << "Usage: PacketFileSender <pcap_file> [options]\n";
-      cout << visible << "\n";
+  if (vm.count("help") || !vm.count("input-file")) {
+      std::cout << "Usage: PacketFileSender <pcap_file> [options]\n";
+      std::cout << visible << "\n";
       return 1;
   }
 
@@ -87,74 +93,59 @@ int main(int argc, char* argv[])
   std::string filename = vm["input-file"].as<std::string>();
   double speed = vm["speed"].as<double>();
   std::string destinationIp = vm["ip"].as<std::string>();
-  unsigned int lidarPort =  vm["lidarPort"].as<unsigned int>();
-  unsigned int GPSPort = vm["GPSPort"].as<unsigned int>();
+  std::vector<int> lidarPorts = vm["lidarPort"].as<std::vector<int> >();
+  int GPSPort = vm["GPSPort"].as<int>();
   unsigned int display_frequency = vm["display-frequency"].as<unsigned int>();
 
-  const int microSecondsPerSecond = 1e6;
-
-  std::cout << "Start sending" << std::endl;
+  const double microSecondsPerSecond = 1e6;
 
   try
   {
+    std::cout << "Loading " << filename << std::endl;
+    vvPacketReplayer replayer(filename);
+    replayer.SetDestination(destinationIp, lidarPorts, GPSPort);
+    replayer.SetKeepRecordedPorts(keepPorts);
+    replayer.SetSpeed(speed);
+    replayer.SetBatchSize(vm["batch-size"].as<int>());
+    replayer.SetSpinDuration(vm["spin-us"].as<double>() / microSecondsPerSecond);
+    std::cout << replayer.GetNumberOfPackets() << " packets over "
+              << replayer.GetRecordingDuration() << " s" << std::endl;
+
+    std::cout << "Start sending" << std::endl;
     do
     {
-      auto replayStartTime = std::chrono::steady_clock::now();
-
       // output the column header for the displayed values
       std::cout << "----------------------------------------------------------------------------" << std::endl
                 << std::right << std::setw(OUTPUT_WIDTH) << "# packets"
                 << std::right << std::setw(OUTPUT_WIDTH) << "duration (s)"
                 << std::right << std::setw(OUTPUT_WIDTH) << "f (Hz)"
-                << std::right << std::setw(OUTPUT_WIDTH) << "delay (us)"
+                << std::right << std::setw(OUTPUT_WIDTH) << "late (us)"
+                << std::right << std::setw(OUTPUT_WIDTH) << "max late (us)"
                 << std::endl
                 << "----------------------------------------------------------------------------" << std::endl;
 
-      // Create a Packet Sender
-      vvPacketSender sender(filename, destinationIp, lidarPort, GPSPort);
+      // Display the user some information
+      auto display = [&](const vvPacketReplayer::Report& report) {
+        std::cout << std::fixed
+                  << std::right << std::setw(OUTPUT_WIDTH) << report.PacketCount
+                  << std::right << std::setw(OUTPUT_WIDTH) << report.Duration
+                  << std::right << std::setw(OUTPUT_WIDTH) << report.PacketRate
+                  << std::right << std::setw(OUTPUT_WIDTH) << report.MeanLateness * microSecondsPerSecond
+                  << std::right << std::setw(OUTPUT_WIDTH) << report.MaxLateness * microSecondsPerSecond
+                  << std::endl;
+      };
 
-      // Case starting time
-      double pcapStartTime = sender.pumpPacket();
+      vvPacketReplayer::Report report = replayer.Replay(display, display_frequency);
 
-      while (!sender.IsDone())
+      std::cout << "----------------------------------------------------------------------------" << std::endl
+                << "Sent " << report.PacketCount << " packets in " << report.Duration << " s ("
+                << report.PacketRate << " packets/s), " << report.SendErrors << " send errors" << std::endl;
+      if (speed > 0)
       {
-        // time from the pcap file
-        double pcapCurrentTime = sender.pumpPacket();
-        double pcapmicroSecondsSinceStart = (pcapCurrentTime - pcapStartTime) * microSecondsPerSecond;
-
-        // time from the wall clock
-        auto replayCurrentTime = std::chrono::steady_clock::now();
-        int replaymicroSecondsSinceStart =
-            std::chrono::duration_cast<std::chrono::microseconds>(replayCurrentTime - replayStartTime).count();
-
-        // check if the replay is to much in advance compared to the pcap time step
-        // if this is the case, we sleep the thread until the pcap catch up the replay
-        double time_delay = static_cast<double>(pcapmicroSecondsSinceStart) / speed  - replaymicroSecondsSinceStart;
-
-        if (time_delay > 0)
-        {
-        boost::this_thread::sleep(
-          boost::posix_time::microseconds(static_cast<int>(time_delay)));
-        }
-
-        // Display the user some information
-        if ((sender.GetPacketCount() % display_frequency) == 0)
-        {
-          // Compute nb of packets sended including the one from previous loops
-          int nbPacketSended = sender.GetPacketCount();
-
-          // Compute time since the replay began
-          double secondSinceStart = static_cast<double>(replaymicroSecondsSinceStart) / microSecondsPerSecond;
-
-          // Nice output
-          std::cout << std::fixed
-                    << std::right << std::setw(OUTPUT_WIDTH) << nbPacketSended
-                    << std::fixed << std::right << std::setw(OUTPUT_WIDTH) << secondSinceStart
-                    << std::right << std::setw(OUTPUT_WIDTH)
-                    << static_cast<double>(nbPacketSended) /  secondSinceStart
-                    << std::right << std::setw(OUTPUT_WIDTH) << time_delay
-                    << std::endl;
-        }
+        std::cout << "Lateness (us): mean " << report.MeanLateness * microSecondsPerSecond
+                  << ", median " << report.MedianLateness * microSecondsPerSecond
+                  << ", 99th percentile " << report.P99Lateness * microSecondsPerSecond
+                  << ", max " << report.MaxLateness * microSecondsPerSecond << std::endl;
       }
     } while (loop);
   }
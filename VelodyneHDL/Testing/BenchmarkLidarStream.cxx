@@ -0,0 +1,335 @@
+// Copyright 2018 Kitware SAS.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "StreamStatistics.h"
+#include "vtkLidarStream.h"
+#include "vvPacketReplayer.h"
+#include <vtkVelodynePacketInterpreter.h>
+
+#include <vtkNew.h>
+
+#include <boost/thread/thread.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+namespace
+{
+//! Minimum duration of the traffic sent at each rate, in seconds
+const double StepDuration = 2.0;
+
+//! Longest wait for the stream to decode the packets received, in seconds
+const double DrainTimeout = 10.0;
+
+//! Decoding stages reported, the others requiring frames to be requested
+const int ReportedStages[] = { StreamStatistics::ReceiveToDecode,
+  StreamStatistics::DecodeToSplit };
+
+//! Measures of the stream at a given packet rate
+struct Step
+{
+  double TargetRate;
+  double AchievedRate;
+  size_t PacketsSent;
+  size_t SendErrors;
+  double SenderLatenessP99;
+  vtkIdType PacketsReceived;
+  unsigned int KernelDrops;
+  vtkIdType PacketsLost;
+  vtkIdType MalformedPackets;
+  vtkIdType FramesDecoded;
+  double FramesPerSecond;
+  double LatencyMean[StreamStatistics::NumberOfStages];
+  double LatencyP50[StreamStatistics::NumberOfStages];
+  double LatencyP90[StreamStatistics::NumberOfStages];
+  double LatencyP99[StreamStatistics::NumberOfStages];
+};
+
+//-----------------------------------------------------------------------------
+/**
+ * @brief RunStep send at least StepDuration seconds of traffic to the stream at
+ * a given rate, then wait for the packets to be decoded and measure the stream
+ * @param packetRate packets per second, 0 to send as fast as possible
+ */
+Step RunStep(vtkLidarStream* stream, vvPacketReplayer& replayer, double packetRate)
+{
+  Step step;
+  step.TargetRate = packetRate;
+
+  // the capture is replayed as many times as needed
+  const double captureDuration = replayer.GetRecordingDuration();
+  const double captureRate =
+    captureDuration > 0 ? replayer.GetNumberOfPackets() / captureDuration : 0.0;
+  replayer.SetSpeed(packetRate > 0 && captureRate > 0 ? packetRate / captureRate : 0.0);
+  const size_t minimumPacketCount =
+    static_cast<size_t>(StepDuration * (packetRate > 0 ? packetRate : captureRate));
+
+  stream->ResetStatistics();
+  const unsigned int kernelDropsBefore = stream->GetKernelDropCount();
+
+  step.PacketsSent = 0;
+  step.SendErrors = 0;
+  step.SenderLatenessP99 = 0;
+  const auto startTime = std::chrono::steady_clock::now();
+  do
+  {
+    vvPacketReplayer::Report report = replayer.Replay();
+    step.PacketsSent += report.PacketCount;
+    step.SendErrors += report.SendErrors;
+    step.SenderLatenessP99 = std::max(step.SenderLatenessP99, report.P99Lateness);
+  } while (step.PacketsSent < minimumPacketCount);
+  const double elapsedTime =
+    std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+  step.AchievedRate = step.PacketsSent / elapsedTime;
+
+  // let the receiver drain its socket, then the consumer decode the packets received
+  boost::this_thread::sleep(boost::posix_time::milliseconds(200));
+  const auto drainStartTime = std::chrono::steady_clock::now();
+  while (stream->GetPacketQueueSize() > 0 &&
+    std::chrono::duration<double>(std::chrono::steady_clock::now() - drainStartTime).count() <
+      DrainTimeout)
+  {
+    boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+  }
+
+  step.PacketsReceived = stream->GetNumberOfPacketsReceived();
+  step.KernelDrops = stream->GetKernelDropCount() - kernelDropsBefore;
+  step.PacketsLost = static_cast<vtkIdType>(step.PacketsSent) - step.PacketsReceived;
+  step.MalformedPackets = stream->GetNumberOfMalformedPackets();
+  step.FramesDecoded = stream->GetNumberOfFramesDecoded();
+  step.FramesPerSecond = step.FramesDecoded / elapsedTime;
+  for (int stage : ReportedStages)
+  {
+    step.LatencyMean[stage] = stream->GetMeanLatency(stage);
+    step.LatencyP50[stage] = stream->GetLatencyPercentile(stage, 50);
+    step.LatencyP90[stage] = stream->GetLatencyPercentile(stage, 90);
+    step.LatencyP99[stage] = stream->GetLatencyPercentile(stage, 99);
+  }
+  return step;
+}
+
+//-----------------------------------------------------------------------------
+//! Escape the characters of a string that are not allowed in a JSON string
+std::string ToJSON(const std::string& value)
+{
+  std::ostringstream json;
+  json << '"';
+  for (char c : value)
+  {
+    if (c == '"' || c == '\\')
+    {
+      json << '\\' << c;
+    }
+    else if (static_cast<unsigned char>(c) < 0x20)
+    {
+      json << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c)
+           << std::dec << std::setfill(' ');
+    }
+    else
+    {
+      json << c;
+    }
+  }
+  json << '"';
+  return json.str();
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * @brief WriteReport write the measures as a JSON document, with the durations in seconds
+ * @param maxSustainedRate highest achieved rate at which no packet was lost, 0 if none
+ */
+bool WriteReport(const std::string& fileName, const std::string& pcapFileName,
+  const std::string& correctionFileName, int decodingThreads, size_t capturePackets,
+  double captureDuration, const std::vector<Step>& steps, double maxSustainedRate)
+{
+  std::ofstream report(fileName.c_str());
+  if (!report.is_open())
+  {
+    return false;
+  }
+  report << std::setprecision(9);
+  report << "{\n"
+         << "  \"benchmark\": \"LidarStream\",\n"
+         << "  \"pcap\": " << ToJSON(pcapFileName) << ",\n"
+         << "  \"calibration\": " << ToJSON(correctionFileName) << ",\n"
+         << "  \"decoding_threads\": " << decodingThreads << ",\n"
+         << "  \"capture_packets\": " << capturePackets << ",\n"
+         << "  \"capture_duration\": " << captureDuration << ",\n"
+         << "  \"max_sustained_rate\": " << maxSustainedRate << ",\n"
+         << "  \"steps\": [\n";
+  for (size_t i = 0; i < steps.size(); ++i)
+  {
+    const Step& step = steps[i];
+    report << "    {\n"
+           << "      \"target_rate\": " << step.TargetRate << ",\n"
+           << "      \"achieved_rate\": " << step.AchievedRate << ",\n"
+           << "      \"packets_sent\": " << step.PacketsSent << ",\n"
+           << "      \"send_errors\": " << step.SendErrors << ",\n"
+           << "      \"sender_lateness_p99\": " << step.SenderLatenessP99 << ",\n"
+           << "      \"packets_received\": " << step.PacketsReceived << ",\n"
+           << "      \"kernel_drops\": " << step.KernelDrops << ",\n"
+           << "      \"packets_lost\": " << step.PacketsLost << ",\n"
+           << "      \"malformed_packets\": " << step.MalformedPackets << ",\n"
+           << "      \"frames_decoded\": " << step.FramesDecoded << ",\n"
+           << "      \"frames_per_second\": " << step.FramesPerSecond << ",\n"
+           << "      \"latency\": {\n";
+    const size_t numberOfStages = sizeof(ReportedStages) / sizeof(ReportedStages[0]);
+    for (size_t j = 0; j < numberOfStages; ++j)
+    {
+      const int stage = ReportedStages[j];
+      report << "        " << ToJSON(StreamStatistics::GetStageName(stage)) << ": { "
+             << "\"mean\": " << step.LatencyMean[stage] << ", "
+             << "\"p50\": " << step.LatencyP50[stage] << ", "
+             << "\"p90\": " << step.LatencyP90[stage] << ", "
+             << "\"p99\": " << step.LatencyP99[stage] << " }"
+             << (j + 1 < numberOfStages ? "," : "") << "\n";
+    }
+    report << "      }\n"
+           << "    }" << (i + 1 < steps.size() ? "," : "") << "\n";
+  }
+  report << "  ]\n"
+         << "}\n";
+  return report.good();
+}
+}
+
+/**
+ * @brief Streams a pcap to a vtkLidarStream on the loopback interface at increasing
+ * packet rates, and reports for each rate the packets lost, the decoding latencies
+ * and the frame rate, to find the highest rate sustained without loss.
+ * The report is a JSON document, so that the nightly runs can track regressions.
+ * @param pcapFileName Input PCAP file
+ * @param correctionFileName The corrections to use
+ * @param reportFileName The JSON report to write
+ * @param packetRates The packet rates to benchmark, 0 to send as fast as possible
+ * @return 0 on success, 1 on failure
+ */
+int main(int argc, char* argv[])
+{
+  if (argc < 4)
+  {
+    std::cerr << "Wrong number of arguments. Usage: BenchmarkLidarStream <pcapFileName> <correctionFileName> <reportFileName> [packetRate...]" << std::endl;
+
+    return 1;
+  }
+
+  std::string pcapFileName = argv[1];
+  std::string correctionFileName = argv[2];
+  std::string reportFileName = argv[3];
+  std::vector<double> packetRates;
+  for (int i = 4; i < argc; ++i)
+  {
+    packetRates.push_back(std::atof(argv[i]));
+  }
+  if (packetRates.empty())
+  {
+    packetRates = { 5000, 10000, 20000, 40000, 80000, 0 };
+  }
+
+  const std::string destinationIp = "127.0.0.1";
+  const int dataPort = 2368;
+
+  std::unique_ptr<vvPacketReplayer> replayer;
+  try
+  {
+    replayer.reset(new vvPacketReplayer(pcapFileName));
+    replayer->SetDestination(destinationIp, std::vector<int>(1, dataPort), 8308);
+  }
+  catch (std::exception& e)
+  {
+    std::cout << "Caught Exception: " << e.what() << std::endl;
+    return 1;
+  }
+
+  vtkNew<vtkLidarStream> HDLsource;
+  auto interp = vtkSmartPointer<vtkVelodynePacketInterpreter>::New();
+  HDLsource->SetInterpreter(interp);
+  HDLsource->SetCalibrationFileName(correctionFileName);
+  HDLsource->SetCacheSize(100);
+  HDLsource->SetLIDARPort(dataPort);
+  HDLsource->SetIsForwarding(false);
+  HDLsource->Start();
+
+  std::cout << "-------------------------------------------------------------------------" << std::endl
+            << "Pcap :\t" << pcapFileName << std::endl
+            << "Corrections :\t" << correctionFileName << std::endl
+            << "Packets :\t" << replayer->GetNumberOfPackets() << " over "
+            << replayer->GetRecordingDuration() << "s" << std::endl
+            << "-------------------------------------------------------------------------" << std::endl;
+
+  const int OUTPUT_WIDTH = 12;
+  std::cout << std::right << std::setw(OUTPUT_WIDTH) << "target (Hz)"
+            << std::right << std::setw(OUTPUT_WIDTH) << "sent (Hz)"
+            << std::right << std::setw(OUTPUT_WIDTH) << "lost"
+            << std::right << std::setw(OUTPUT_WIDTH) << "kernel"
+            << std::right << std::setw(OUTPUT_WIDTH) << "fps"
+            << std::right << std::setw(OUTPUT_WIDTH) << "p50 (ms)"
+            << std::right << std::setw(OUTPUT_WIDTH) << "p99 (ms)"
+            << std::endl;
+
+  std::vector<Step> steps;
+  double maxSustainedRate = 0;
+  for (double packetRate : packetRates)
+  {
+    const Step step = RunStep(HDLsource.Get(), *replayer, packetRate);
+    steps.push_back(step);
+    if (step.PacketsLost == 0 && step.KernelDrops == 0)
+    {
+      maxSustainedRate = std::max(maxSustainedRate, step.AchievedRate);
+    }
+
+    const int stage = StreamStatistics::ReceiveToDecode;
+    std::cout << std::fixed << std::setprecision(1)
+              << std::right << std::setw(OUTPUT_WIDTH) << step.TargetRate
+              << std::right << std::setw(OUTPUT_WIDTH) << step.AchievedRate
+              << std::right << std::setw(OUTPUT_WIDTH) << step.PacketsLost
+              << std::right << std::setw(OUTPUT_WIDTH) << step.KernelDrops
+              << std::right << std::setw(OUTPUT_WIDTH) << step.FramesPerSecond
+              << std::setprecision(3)
+              << std::right << std::setw(OUTPUT_WIDTH) << 1e3 * step.LatencyP50[stage]
+              << std::right << std::setw(OUTPUT_WIDTH) << 1e3 * step.LatencyP99[stage]
+              << std::endl;
+  }
+  const int decodingThreads = HDLsource->GetNumberOfDecodingThreads();
+  HDLsource->Stop();
+
+  std::cout << "Highest rate sustained without loss: " << maxSustainedRate << " packets/s"
+            << std::endl;
+
+  int retVal = 0;
+  if (!WriteReport(reportFileName, pcapFileName, correctionFileName, decodingThreads,
+        replayer->GetNumberOfPackets(), replayer->GetRecordingDuration(), steps,
+        maxSustainedRate))
+  {
+    std::cerr << "Failed to write the report " << reportFileName << std::endl;
+    retVal++;
+  }
+
+  // the benchmark is only meaningful if the stream decodes the capture at all
+  if (steps.empty() || steps.front().FramesDecoded == 0)
+  {
+    std::cerr << "No frame was decoded" << std::endl;
+    retVal++;
+  }
+
+  return retVal;
+}
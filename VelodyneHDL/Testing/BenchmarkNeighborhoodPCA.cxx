@@ -0,0 +1,164 @@
+// Copyright 2018 Kitware SAS.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "NeighborhoodPCA.h"
+
+#include <Eigen/Dense>
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace
+{
+//! Number of neighborhoods fitted by each implementation
+const int NumberOfNeighborhoods = 200000;
+
+//! Neighborhood of a keypoint, as given by the kd-tree of the map
+struct Neighborhood
+{
+  std::vector<Eigen::Vector3d> Points;
+  size_t Size;
+};
+
+//-----------------------------------------------------------------------------
+/**
+ * @brief DynamicFit fits the neighborhood as the slam used to, with
+ * dynamic-size matrices and the iterative eigen solver
+ */
+void DynamicFit(const Neighborhood& neighborhood, Eigen::Vector3d& mean,
+                Eigen::Vector3d& eigenValues, Eigen::Matrix3d& eigenVectors)
+{
+  Eigen::MatrixXd data(neighborhood.Size, 3);
+  for (unsigned int k = 0; k < neighborhood.Size; k++)
+  {
+    data.row(k) = neighborhood.Points[k];
+  }
+
+  mean = data.colwise().mean();
+  Eigen::MatrixXd centered = data.rowwise() - mean.transpose();
+  Eigen::MatrixXd cov = centered.transpose() * centered;
+  Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eig(cov);
+
+  Eigen::MatrixXd D(1, 3);
+  Eigen::MatrixXd V(3, 3);
+  D = eig.eigenvalues();
+  V = eig.eigenvectors();
+  eigenValues = D;
+  eigenVectors = V;
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * @brief CheckFit compares the two fits of a neighborhood, the eigen vectors
+ * being compared up to their sign
+ * @return true if they agree
+ */
+bool CheckFit(const Eigen::Vector3d& mean, const Eigen::Vector3d& eigenValues,
+              const Eigen::Matrix3d& eigenVectors, const NeighborhoodPCA& pca)
+{
+  const double scale = std::max(1.0, eigenValues(2));
+  if ((mean - pca.Mean).norm() > 1e-9 ||
+      (eigenValues - pca.GetEigenValues()).norm() > 1e-6 * scale)
+  {
+    return false;
+  }
+  // the principal direction only is compared, the other ones
+  // being ill-defined when their eigen values are close
+  return std::abs(eigenVectors.col(2).dot(pca.GetEigenVectors().col(2))) > 1.0 - 1e-6;
+}
+}
+
+/**
+ * @brief Fits lines and planes to random keypoint neighborhoods with the
+ * dynamic-size PCA the slam used to run and with NeighborhoodPCA, and
+ * prints the time taken by each one.
+ * @return 0 on success, the number of neighborhoods fitted differently otherwise
+ */
+int main(int, char*[])
+{
+  // neighborhoods of 10 to 25 points, along a line or a plane,
+  // far from the origin as the keypoints of the map are
+  std::mt19937 generator(42);
+  std::uniform_real_distribution<double> position(-200.0, 200.0);
+  std::uniform_real_distribution<double> extent(-0.5, 0.5);
+  std::normal_distribution<double> noise(0.0, 0.01);
+  std::uniform_int_distribution<int> size(10, 25);
+
+  const int nDistinct = 1000;
+  std::vector<Neighborhood> neighborhoods(nDistinct);
+  for (int i = 0; i < nDistinct; ++i)
+  {
+    const Eigen::Vector3d center(position(generator), position(generator), position(generator));
+    const Eigen::Vector3d u = Eigen::Vector3d::Random().normalized();
+    const Eigen::Vector3d v = u.unitOrthogonal();
+    const bool isPlane = (i % 2 == 1);
+    neighborhoods[i].Size = size(generator);
+    neighborhoods[i].Points.resize(25);
+    for (size_t k = 0; k < neighborhoods[i].Size; ++k)
+    {
+      Eigen::Vector3d p = center + 2.0 * extent(generator) * u;
+      if (isPlane)
+      {
+        p += extent(generator) * v;
+      }
+      neighborhoods[i].Points[k] = p + Eigen::Vector3d(noise(generator), noise(generator), noise(generator));
+    }
+  }
+
+  int errors = 0;
+  Eigen::Vector3d mean, eigenValues;
+  Eigen::Matrix3d eigenVectors;
+  for (int i = 0; i < nDistinct; ++i)
+  {
+    DynamicFit(neighborhoods[i], mean, eigenValues, eigenVectors);
+    NeighborhoodPCA pca;
+    pca.Compute(neighborhoods[i].Points, neighborhoods[i].Size);
+    if (!CheckFit(mean, eigenValues, eigenVectors, pca))
+    {
+      std::cerr << "Neighborhood " << i << " fitted with eigen values "
+                << pca.GetEigenValues().transpose() << " instead of "
+                << eigenValues.transpose() << std::endl;
+      errors++;
+    }
+  }
+
+  // the sum of the results is printed so that the fits are not optimized out
+  double checksum = 0;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (int i = 0; i < NumberOfNeighborhoods; ++i)
+  {
+    DynamicFit(neighborhoods[i % nDistinct], mean, eigenValues, eigenVectors);
+    checksum += eigenValues(2);
+  }
+  const double dynamicTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < NumberOfNeighborhoods; ++i)
+  {
+    NeighborhoodPCA pca;
+    pca.Compute(neighborhoods[i % nDistinct].Points, neighborhoods[i % nDistinct].Size);
+    checksum -= pca.GetEigenValues()(2);
+  }
+  const double fixedTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  std::cout << NumberOfNeighborhoods << " neighborhoods fitted" << std::endl;
+  std::cout << "dynamic-size PCA : " << 1e9 * dynamicTime / NumberOfNeighborhoods << " ns per neighborhood" << std::endl;
+  std::cout << "NeighborhoodPCA  : " << 1e9 * fixedTime / NumberOfNeighborhoods << " ns per neighborhood" << std::endl;
+  std::cout << "speedup          : " << dynamicTime / fixedTime << std::endl;
+  std::cout << "checksum         : " << checksum << std::endl;
+  return errors;
+}
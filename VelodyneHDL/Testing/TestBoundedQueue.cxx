@@ -0,0 +1,98 @@
+// Copyright 2018 Kitware SAS.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "BoundedQueue.h"
+
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+/**
+ * @brief Runs a producer and a slower consumer through a BoundedQueue, as the
+ * front-end and the back-end of the slam do, and checks that the items are
+ * received in order, that the producer never gets ahead by more than the
+ * capacity of the queue, and that Join and Close release the threads.
+ * @return 0 on success, the number of errors otherwise
+ */
+int main(int, char*[])
+{
+  const int nItems = 1000;
+  const int capacity = 2;
+  int errors = 0;
+
+  BoundedQueue<int> queue(capacity);
+  boost::atomic<int> pushed(0), processed(0);
+  std::vector<int> received;
+  int maxAdvance = 0;
+
+  boost::thread consumer([&]() {
+    int item;
+    while (queue.Pop(item))
+    {
+      received.push_back(item);
+      if (item % 100 == 0)
+      {
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(5));
+      }
+      processed++;
+      queue.TaskDone();
+    }
+  });
+
+  for (int k = 0; k < nItems; ++k)
+  {
+    // an item popped but not processed yet is not in the
+    // queue anymore, the consumer holding one item at most
+    maxAdvance = std::max(maxAdvance, pushed - processed);
+    if (!queue.Push(k))
+    {
+      std::cerr << "Item " << k << " refused by the queue" << std::endl;
+      errors++;
+    }
+    pushed++;
+  }
+
+  queue.Join();
+  if (processed != nItems)
+  {
+    std::cerr << "Join returned with " << processed << " items processed instead of " << nItems << std::endl;
+    errors++;
+  }
+  if (maxAdvance > capacity + 1)
+  {
+    std::cerr << "The producer got " << maxAdvance << " items ahead of the consumer" << std::endl;
+    errors++;
+  }
+
+  queue.Close();
+  consumer.join();
+  for (int k = 0; k < static_cast<int>(received.size()); ++k)
+  {
+    if (received[k] != k)
+    {
+      std::cerr << "Item " << received[k] << " received in position " << k << std::endl;
+      errors++;
+      break;
+    }
+  }
+  if (queue.Push(nItems))
+  {
+    std::cerr << "Item pushed to a closed queue" << std::endl;
+    errors++;
+  }
+  return errors;
+}
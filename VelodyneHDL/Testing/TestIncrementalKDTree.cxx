@@ -0,0 +1,209 @@
+// Copyright 2018 Kitware SAS.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "IncrementalKDTree.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace
+{
+struct TestPoint
+{
+  float x, y, z;
+};
+
+//-----------------------------------------------------------------------------
+float SquaredDistance(const TestPoint& a, const TestPoint& b)
+{
+  return (a.x - b.x) * (a.x - b.x) + (a.y - b.y) * (a.y - b.y) + (a.z - b.z) * (a.z - b.z);
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * @brief CheckQueries compare the k nearest neighbors found by the index to the ones
+ * found by a linear search among the points expected in it, only among the searched
+ * ones if given
+ * @return the number of errors
+ */
+int CheckQueries(const IncrementalKDTree<TestPoint>& index, const std::map<int, TestPoint>& points,
+                 std::mt19937& generator, unsigned int k, const std::vector<char>* searched = nullptr)
+{
+  int errors = 0;
+  if (index.GetNumberOfPoints() != points.size())
+  {
+    std::cerr << "The index has " << index.GetNumberOfPoints() << " points instead of "
+              << points.size() << std::endl;
+    errors++;
+  }
+
+  std::uniform_real_distribution<float> coordinate(-60.f, 60.f);
+  std::vector<int> ids;
+  std::vector<float> distances;
+  for (int query = 0; query < 50; ++query)
+  {
+    const TestPoint q = { coordinate(generator), coordinate(generator), coordinate(generator) };
+    std::vector<std::pair<float, int> > expected;
+    for (std::map<int, TestPoint>::const_iterator it = points.begin(); it != points.end(); ++it)
+    {
+      if (searched && (static_cast<size_t>(it->first) >= searched->size() || !(*searched)[it->first]))
+      {
+        continue;
+      }
+      expected.push_back(std::make_pair(SquaredDistance(q, it->second), it->first));
+    }
+    std::sort(expected.begin(), expected.end());
+    expected.resize(std::min(static_cast<size_t>(k), expected.size()));
+
+    const int nFound = index.KNearestSearch(q, k, ids, distances, searched);
+    if (nFound != static_cast<int>(expected.size()) || ids.size() != expected.size())
+    {
+      std::cerr << "Found " << nFound << " neighbors instead of " << expected.size() << std::endl;
+      errors++;
+      continue;
+    }
+    for (size_t i = 0; i < expected.size(); ++i)
+    {
+      if (distances[i] != expected[i].first || ids[i] != expected[i].second ||
+        index.GetPoint(ids[i]).x != points.at(expected[i].second).x)
+      {
+        std::cerr << "Neighbor " << i << " is " << ids[i] << " at " << distances[i]
+                  << " instead of " << expected[i].second << " at " << expected[i].first << std::endl;
+        errors++;
+        break;
+      }
+    }
+  }
+  return errors;
+}
+}
+
+/**
+ * @brief Adds and removes points to an IncrementalKDTree, as the slam does with its
+ * local map, and checks that the neighbors found are the same as with a linear search.
+ * @return 0 on success, the number of errors otherwise
+ */
+int main(int, char*[])
+{
+  std::mt19937 generator(42);
+  std::uniform_real_distribution<float> coordinate(-50.f, 50.f);
+  auto randomPoint = [&]() {
+    TestPoint p = { coordinate(generator), coordinate(generator), coordinate(generator) };
+    return p;
+  };
+
+  IncrementalKDTree<TestPoint> index;
+  std::map<int, TestPoint> points;
+  int errors = CheckQueries(index, points, generator, 5);
+
+  for (int step = 0; step < 30; ++step)
+  {
+    // a batch of points, as a new frame
+    std::vector<TestPoint> batch(500);
+    std::generate(batch.begin(), batch.end(), randomPoint);
+    std::vector<int> ids;
+    index.Add(batch.begin(), batch.end(), &ids);
+    for (size_t i = 0; i < batch.size(); ++i)
+    {
+      points[ids[i]] = batch[i];
+    }
+
+    // a few points one by one, some staying in the buffer
+    for (int i = 0; i < 37; ++i)
+    {
+      const TestPoint p = randomPoint();
+      const int id = index.Add(p);
+      if (points.count(id))
+      {
+        std::cerr << "Id " << id << " given to two points" << std::endl;
+        errors++;
+      }
+      points[id] = p;
+    }
+
+    // remove the points of a slab, as a voxel leaving the grid,
+    // and some random ones, as points moved by the downsampling
+    const float slab = -50.f + 3.f * step;
+    std::vector<int> removed;
+    std::bernoulli_distribution isRemoved(0.1);
+    for (std::map<int, TestPoint>::iterator it = points.begin(); it != points.end(); ++it)
+    {
+      if ((it->second.x >= slab && it->second.x < slab + 3.f) || isRemoved(generator))
+      {
+        removed.push_back(it->first);
+      }
+    }
+    for (size_t i = 0; i < removed.size(); ++i)
+    {
+      index.Remove(removed[i]);
+      points.erase(removed[i]);
+    }
+    // removing twice has no effect
+    if (!removed.empty())
+    {
+      index.Remove(removed[0]);
+    }
+
+    errors += CheckQueries(index, points, generator, 1 + step % 20);
+
+    // only the points of a box around the origin, as the window of the map
+    // around the sensor, the last ids being left out of the mask
+    std::vector<char> searched(points.rbegin()->first);
+    for (std::map<int, TestPoint>::iterator it = points.begin(); it != points.end(); ++it)
+    {
+      if (static_cast<size_t>(it->first) < searched.size())
+      {
+        searched[it->first] = std::abs(it->second.x) < 20.f && std::abs(it->second.y) < 20.f;
+      }
+    }
+    errors += CheckQueries(index, points, generator, 1 + step % 20, &searched);
+  }
+
+  if (index.GetNumberOfTrees() > 2 * std::log2(index.GetNumberOfPoints()))
+  {
+    std::cerr << index.GetNumberOfTrees() << " trees for " << index.GetNumberOfPoints()
+              << " points" << std::endl;
+    errors++;
+  }
+
+  if (index.GetMemoryUsage() < index.GetNumberOfPoints() * (sizeof(TestPoint) + 4 * sizeof(float)))
+  {
+    std::cerr << index.GetMemoryUsage() << " bytes used for " << index.GetNumberOfPoints()
+              << " points" << std::endl;
+    errors++;
+  }
+
+  // everything removed
+  for (std::map<int, TestPoint>::iterator it = points.begin(); it != points.end(); ++it)
+  {
+    index.Remove(it->first);
+  }
+  points.clear();
+  errors += CheckQueries(index, points, generator, 5);
+  if (index.GetNumberOfTrees() != 0)
+  {
+    std::cerr << "Trees left in an empty index" << std::endl;
+    errors++;
+  }
+
+  index.Add(randomPoint());
+  index.Clear();
+  errors += CheckQueries(index, points, generator, 5);
+  return errors;
+}
@@ -0,0 +1,136 @@
+// Copyright 2018 Kitware SAS.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "TestHelpers.h"
+#include "vtkLidarStream.h"
+#include "vvPacketSender.h"
+#include <vtkVelodynePacketInterpreter.h>
+
+#include <vtkNew.h>
+
+#include <boost/thread/thread.hpp>
+
+#include <chrono>
+#include <cstdlib>
+
+/**
+ * @brief Replays a pcap on the loopback interface at a fixed packet rate, well above
+ * the real-time rate of the capture, and checks that the kernel did not drop any
+ * datagram on the stream socket.
+ * @param pcapFileName Input PCAP file
+ * @param correctionFileName The corrections to use
+ * @param packetRate The number of packets to send per second
+ * @return 0 on success, 1 on failure
+ */
+int main(int argc, char* argv[])
+{
+  if (argc < 4)
+  {
+    std::cerr << "Wrong number of arguments. Usage: TestLidarStreamKernelDrops <pcapFileName> <correctionFileName> <packetRate>" << std::endl;
+
+    return 1;
+  }
+
+  std::string pcapFileName = argv[1];
+  std::string correctionFileName = argv[2];
+  const double packetRate = std::atof(argv[3]);
+
+  // send at least two seconds worth of traffic, replaying the capture if needed
+  const size_t minimumPacketCount = static_cast<size_t>(2.0 * packetRate);
+
+  std::cout << "-------------------------------------------------------------------------" << std::endl
+            << "Pcap :\t" << pcapFileName << std::endl
+            << "Corrections :\t" << correctionFileName << std::endl
+            << "Rate :\t" << packetRate << " packets/s" << std::endl
+            << "-------------------------------------------------------------------------" << std::endl;
+
+  const std::string destinationIp = "127.0.0.1";
+  const int dataPort = 2368;
+
+  vtkNew<vtkLidarStream> HDLsource;
+  auto interp = vtkSmartPointer<vtkVelodynePacketInterpreter>::New();
+  HDLsource->SetInterpreter(interp);
+  HDLsource->SetCalibrationFileName(correctionFileName);
+  HDLsource->SetCacheSize(100);
+  HDLsource->SetLIDARPort(dataPort);
+  HDLsource->SetIsForwarding(false);
+  HDLsource->Start();
+
+  std::cout << "Sending data... " << std::endl;
+  size_t packetCount = 0;
+  const auto startTime = std::chrono::steady_clock::now();
+  try
+  {
+    while (packetCount < minimumPacketCount)
+    {
+      vvPacketSender sender(pcapFileName, destinationIp, dataPort);
+      while (!sender.IsDone())
+      {
+        sender.pumpPacket();
+        ++packetCount;
+
+        // sleep only when ahead of the schedule, so that the timer
+        // granularity results in small bursts rather than a lower rate
+        const double expectedElapsedTime = packetCount / packetRate;
+        const double elapsedTime =
+          std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+        const double delay = expectedElapsedTime - elapsedTime;
+        if (delay > 0.001)
+        {
+          boost::this_thread::sleep(boost::posix_time::microseconds(static_cast<int>(delay * 1e6)));
+        }
+      }
+    }
+  }
+  catch (std::exception& e)
+  {
+    std::cout << "Caught Exception: " << e.what() << std::endl;
+    return 1;
+  }
+
+  const double elapsedTime =
+    std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+  std::cout << packetCount << " packets sent in " << elapsedTime << "s ("
+            << packetCount / elapsedTime << " packets/s)" << std::endl;
+
+  // let the receiver drain its socket before reading the counter
+  boost::this_thread::sleep(boost::posix_time::milliseconds(500));
+  const unsigned int kernelDrops = HDLsource->GetKernelDropCount();
+  const vtkIdType packetsReceived = HDLsource->GetNumberOfPacketsReceived();
+  std::cout << HDLsource->GetStatisticsSummary() << std::endl;
+  HDLsource->Stop();
+
+  int retVal = 0;
+  std::cout << "Kernel drops: " << kernelDrops << std::endl;
+  if (kernelDrops != 0)
+  {
+    std::cerr << "The kernel dropped " << kernelDrops << " packets" << std::endl;
+    retVal++;
+  }
+
+  if (packetsReceived + kernelDrops != static_cast<vtkIdType>(packetCount))
+  {
+    std::cerr << "Received " << packetsReceived << " packets and the kernel dropped "
+              << kernelDrops << " while " << packetCount << " were sent" << std::endl;
+    retVal++;
+  }
+
+  if (GetNumberOfTimesteps(HDLsource.Get()) == 0)
+  {
+    std::cerr << "No frame was received" << std::endl;
+    retVal++;
+  }
+
+  return retVal;
+}
@@ -0,0 +1,175 @@
+// Copyright 2018 Kitware SAS.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "TestHelpers.h"
+#include "PacketFileSegmentWriter.h"
+#include "PacketFileWriter.h"
+#include "vtkLidarReader.h"
+#include "vtkLidarStream.h"
+#include "vvPacketSender.h"
+#include <vtkVelodynePacketInterpreter.h>
+
+#include <vtkInformation.h>
+#include <vtkNew.h>
+#include <vtkStreamingDemandDrivenPipeline.h>
+
+#include <boost/thread/thread.hpp>
+
+#include <cmath>
+#include <cstdio>
+
+namespace
+{
+//-----------------------------------------------------------------------------
+vtkSmartPointer<vtkLidarReader> OpenRecording(const std::string& fileName,
+  const std::string& correctionFileName)
+{
+  auto reader = vtkSmartPointer<vtkLidarReader>::New();
+  auto interp = vtkSmartPointer<vtkVelodynePacketInterpreter>::New();
+  reader->SetInterpreter(interp);
+  reader->SetCalibrationFileName(correctionFileName);
+  reader->SetFileName(fileName);
+  reader->Update();
+  return reader;
+}
+
+//-----------------------------------------------------------------------------
+std::vector<double> GetTimesteps(vtkLidarReader* reader)
+{
+  vtkInformation* outInfo = reader->GetExecutive()->GetOutputInformation(0);
+  double* timesteps = outInfo->Get(vtkStreamingDemandDrivenPipeline::TIME_STEPS());
+  const int nTimesteps = outInfo->Length(vtkStreamingDemandDrivenPipeline::TIME_STEPS());
+  return std::vector<double>(timesteps, timesteps + nTimesteps);
+}
+}
+
+/**
+ * @brief Records a live stream decoded by several threads, the recorder splitting the
+ * frames of its index at the same time as the stream splits the live frames, and checks
+ * that the recording opened with its index gives the same frames as when it is read entirely.
+ * @param pcapFileName Input PCAP file
+ * @param correctionFileName The corrections to use
+ * @param outputFileName Name of the recording
+ * @return 0 on success, the number of errors otherwise
+ */
+int main(int argc, char* argv[])
+{
+  if (argc < 4)
+  {
+    std::cerr << "Wrong number of arguments. Usage: TestLidarStreamRecording <pcapFileName> <correctionFileName> <outputFileName>" << std::endl;
+
+    return 1;
+  }
+
+  std::string pcapFileName = argv[1];
+  std::string correctionFileName = argv[2];
+  std::string outputFileName = argv[3];
+
+  std::cout << "-------------------------------------------------------------------------" << std::endl
+            << "Pcap :\t" << pcapFileName << std::endl
+            << "Corrections :\t" << correctionFileName << std::endl
+            << "Output :\t" << outputFileName << std::endl
+            << "-------------------------------------------------------------------------" << std::endl;
+
+  const std::string destinationIp = "127.0.0.1";
+  const int dataPort = 2368;
+  int retVal = 0;
+  std::string framingKey;
+
+  {
+    vtkNew<vtkLidarStream> HDLsource;
+    auto interp = vtkSmartPointer<vtkVelodynePacketInterpreter>::New();
+    HDLsource->SetInterpreter(interp);
+    HDLsource->SetCalibrationFileName(correctionFileName);
+    HDLsource->SetCacheSize(100);
+    HDLsource->SetLIDARPort(dataPort);
+    HDLsource->SetIsForwarding(false);
+    HDLsource->SetNumberOfDecodingThreads(4);
+    HDLsource->SetOutputFile(outputFileName);
+    HDLsource->SetRecordingMode(PacketFileWriter::Buffered);
+    // the recording is only indexed if the interpreter is calibrated when it starts
+    HDLsource->UpdateInformation();
+    HDLsource->Start();
+
+    std::cout << "Sending data... " << std::endl;
+    try
+    {
+      vvPacketSender sender(pcapFileName, destinationIp, dataPort);
+      while (!sender.IsDone())
+      {
+        sender.pumpPacket();
+        boost::this_thread::sleep(boost::posix_time::microseconds(100));
+      }
+    }
+    catch (std::exception& e)
+    {
+      std::cout << "Caught Exception: " << e.what() << std::endl;
+      return 1;
+    }
+
+    // let the receiver drain its socket
+    boost::this_thread::sleep(boost::posix_time::milliseconds(500));
+    HDLsource->Stop();
+
+    if (GetNumberOfTimesteps(HDLsource.Get()) == 0)
+    {
+      std::cerr << "No frame was received" << std::endl;
+      retVal++;
+    }
+    // the recording is closed, with its index, when the stream is destroyed
+    framingKey = interp->GetFramingKey();
+  }
+
+  std::vector<PacketFileSegmentWriter::IndexEntry> entries;
+  if (!PacketFileSegmentWriter::ReadIndex(outputFileName, framingKey, entries))
+  {
+    std::cerr << "No valid index for " << outputFileName << std::endl;
+    return retVal + 1;
+  }
+
+  vtkSmartPointer<vtkLidarReader> indexed = OpenRecording(outputFileName, correctionFileName);
+  std::vector<double> indexedTimesteps = GetTimesteps(indexed);
+
+  // without its index, the recording is read entirely
+  std::remove(PacketFileSegmentWriter::GetIndexFileName(outputFileName).c_str());
+  vtkSmartPointer<vtkLidarReader> scanned = OpenRecording(outputFileName, correctionFileName);
+  std::vector<double> scannedTimesteps = GetTimesteps(scanned);
+
+  retVal += TestFrameCount(indexed->GetNumberOfFrames(), scanned->GetNumberOfFrames());
+  if (indexedTimesteps.size() == scannedTimesteps.size())
+  {
+    for (size_t i = 0; i < indexedTimesteps.size(); ++i)
+    {
+      if (std::abs(indexedTimesteps[i] - scannedTimesteps[i]) > 1e-6)
+      {
+        std::cerr << "Wrong timestep " << i << ": " << indexedTimesteps[i]
+                  << " instead of " << scannedTimesteps[i] << std::endl;
+        retVal++;
+      }
+    }
+    indexed->Open();
+    scanned->Open();
+    for (int frame = 0; frame < indexed->GetNumberOfFrames(); ++frame)
+    {
+      vtkSmartPointer<vtkPolyData> indexedFrame = indexed->GetFrame(frame);
+      vtkSmartPointer<vtkPolyData> scannedFrame = scanned->GetFrame(frame);
+      retVal += TestPointCount(indexedFrame, scannedFrame);
+    }
+    indexed->Close();
+    scanned->Close();
+  }
+  std::remove(outputFileName.c_str());
+
+  return retVal;
+}
@@ -0,0 +1,167 @@
+// Copyright 2018 Kitware SAS.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "LinearTransformInterpolator.h"
+#include "vtkVelodyneTransformInterpolator.h"
+
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <vtkTransform.h>
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace
+{
+struct TestPoint
+{
+  float x, y, z, time;
+};
+
+//-----------------------------------------------------------------------------
+void SetTransform(vtkTransform* transform, const Eigen::Matrix3d& R, const Eigen::Vector3d& T)
+{
+  vtkNew<vtkMatrix4x4> M;
+  for (unsigned int i = 0; i < 3; ++i)
+  {
+    for (unsigned int j = 0; j < 3; ++j)
+    {
+      M->Element[i][j] = R(i, j);
+    }
+    M->Element[i][3] = T(i);
+    M->Element[3][i] = 0;
+  }
+  M->Element[3][3] = 1.0;
+  transform->SetMatrix(M.Get());
+  transform->Update();
+}
+
+//-----------------------------------------------------------------------------
+Eigen::Matrix3d RandomRotation(std::mt19937& generator, double maxAngle)
+{
+  std::uniform_real_distribution<double> angle(-maxAngle, maxAngle);
+  return Eigen::AngleAxisd(angle(generator), Eigen::Vector3d::Random().normalized()).toRotationMatrix();
+}
+}
+
+/**
+ * @brief Interpolates random pairs of poses with LinearTransformInterpolator
+ * and with vtkVelodyneTransformInterpolator, as the slam used to undistort
+ * the keypoints, and checks that the points are transformed the same way.
+ * @return 0 on success, the number of errors otherwise
+ */
+int main(int, char*[])
+{
+  std::mt19937 generator(42);
+  std::uniform_real_distribution<double> position(-100.0, 100.0);
+  std::uniform_real_distribution<double> time(-0.1, 1.1);
+  int errors = 0;
+
+  for (int test = 0; test < 200; ++test)
+  {
+    // small motions, as between two frames, then large ones
+    const double maxAngle = test < 100 ? 0.2 : 3.1;
+    const Eigen::Matrix3d R0 = RandomRotation(generator, 3.1);
+    const Eigen::Matrix3d R1 = (test % 10 == 0) ? R0 : Eigen::Matrix3d(R0 * RandomRotation(generator, maxAngle));
+    const Eigen::Vector3d T0(position(generator), position(generator), position(generator));
+    const Eigen::Vector3d T1 = T0 + 0.01 * Eigen::Vector3d(position(generator), position(generator), position(generator));
+
+    LinearTransformInterpolator interpolator;
+    interpolator.SetTransforms(R0, T0, R1, T1);
+
+    vtkNew<vtkTransform> transform0, transform1;
+    SetTransform(transform0.GetPointer(), R0, T0);
+    SetTransform(transform1.GetPointer(), R1, T1);
+    vtkNew<vtkVelodyneTransformInterpolator> reference;
+    reference->SetInterpolationTypeToLinear();
+    reference->AddTransform(0.0, transform0.GetPointer());
+    reference->AddTransform(1.0, transform1.GetPointer());
+    reference->Modified();
+
+    std::vector<TestPoint> points(20);
+    for (size_t k = 0; k < points.size(); ++k)
+    {
+      points[k].x = position(generator);
+      points[k].y = position(generator);
+      points[k].z = position(generator);
+      points[k].time = (k == 0) ? 0.f : (k == 1) ? 1.f : time(generator);
+    }
+    std::vector<TestPoint> transformed(points.size());
+    interpolator.TransformPoints(points.begin(), points.end(), transformed.begin());
+
+    for (size_t k = 0; k < points.size(); ++k)
+    {
+      vtkNew<vtkTransform> expectedTransform;
+      reference->InterpolateTransform(points[k].time, expectedTransform.GetPointer());
+      expectedTransform->Update();
+      double expected[3] = { points[k].x, points[k].y, points[k].z };
+      expectedTransform->InternalTransformPoint(expected, expected);
+
+      const Eigen::Vector3d Y(transformed[k].x, transformed[k].y, transformed[k].z);
+      if ((Y - Eigen::Vector3d(expected[0], expected[1], expected[2])).norm() > 1e-3 ||
+          transformed[k].time != points[k].time)
+      {
+        std::cerr << "Point " << k << " of test " << test << " at time " << points[k].time
+                  << " transformed to " << Y.transpose() << " instead of " << expected[0] << " "
+                  << expected[1] << " " << expected[2] << std::endl;
+        errors++;
+      }
+    }
+  }
+
+  // speed of the undistortion of a frame, for information
+  const int nPoints = 100000;
+  std::vector<TestPoint> frame(nPoints);
+  for (int k = 0; k < nPoints; ++k)
+  {
+    frame[k].x = position(generator);
+    frame[k].y = position(generator);
+    frame[k].z = position(generator);
+    frame[k].time = static_cast<float>(k) / nPoints;
+  }
+  const Eigen::Matrix3d R1 = RandomRotation(generator, 0.2);
+  const Eigen::Vector3d T1(1.0, 0.2, 0.0);
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  LinearTransformInterpolator interpolator;
+  interpolator.SetTransforms(Eigen::Matrix3d::Identity(), Eigen::Vector3d::Zero(), R1, T1);
+  std::vector<TestPoint> undistorted(nPoints);
+  interpolator.TransformPoints(frame.begin(), frame.end(), undistorted.begin());
+  const double duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  start = std::chrono::steady_clock::now();
+  vtkNew<vtkTransform> transform0, transform1;
+  SetTransform(transform0.GetPointer(), Eigen::Matrix3d::Identity(), Eigen::Vector3d::Zero());
+  SetTransform(transform1.GetPointer(), R1, T1);
+  vtkNew<vtkVelodyneTransformInterpolator> reference;
+  reference->SetInterpolationTypeToLinear();
+  reference->AddTransform(0.0, transform0.GetPointer());
+  reference->AddTransform(1.0, transform1.GetPointer());
+  reference->Modified();
+  for (int k = 0; k < nPoints; ++k)
+  {
+    vtkNew<vtkTransform> transform;
+    reference->InterpolateTransform(frame[k].time, transform.GetPointer());
+    transform->Update();
+    double pos[3] = { frame[k].x, frame[k].y, frame[k].z };
+    transform->InternalTransformPoint(pos, pos);
+  }
+  const double referenceDuration = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  std::cout << nPoints << " points undistorted in " << 1000.0 * duration << " ms, "
+            << 1000.0 * referenceDuration << " ms with vtkVelodyneTransformInterpolator" << std::endl;
+  return errors;
+}
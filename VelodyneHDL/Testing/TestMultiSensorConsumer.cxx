@@ -0,0 +1,189 @@
+// Copyright 2018 Kitware SAS.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "TestHelpers.h"
+#include "MultiSensorConsumer.h"
+#include "NetworkPacket.h"
+#include "PacketConsumer.h"
+#include "vtkPacketFileReader.h"
+#include <vtkVelodynePacketInterpreter.h>
+
+#include <vtkDataArray.h>
+#include <vtkPointData.h>
+#include <vtkPolyData.h>
+#include <vtkTransform.h>
+
+#include <boost/thread/thread.hpp>
+
+#include <cmath>
+
+namespace
+{
+const int NumberOfSensors = 3;
+//! translation along X of each additional sensor
+const double SensorOffset = 100.0;
+
+//-----------------------------------------------------------------------------
+/**
+ * @brief Decode a pcap as if each of its packets was received from several sensors
+ * on consecutive ports, the sensor i sending it i ms after the first one
+ * @return the frames handed over to the consumer
+ */
+std::vector<vtkSmartPointer<vtkPolyData> > DecodeAsSeveralSensors(
+  const std::string& pcapFileName, const std::string& correctionFileName, bool merge)
+{
+  auto interp = vtkSmartPointer<vtkVelodynePacketInterpreter>::New();
+  interp->LoadCalibration(correctionFileName);
+
+  std::shared_ptr<PacketConsumer> consumer(new PacketConsumer);
+  consumer->SetInterpreter(interp);
+  consumer->SetMaxNumberOfFrames(100000);
+
+  MultiSensorConsumer sensors;
+  sensors.SetConsumer(consumer);
+  sensors.SetInterpreter(interp);
+  sensors.SetMainPort(2368);
+  for (int i = 1; i < NumberOfSensors; ++i)
+  {
+    auto extrinsics = vtkSmartPointer<vtkTransform>::New();
+    extrinsics->Translate(i * SensorOffset, 0, 0);
+    sensors.AddSensor(2368 + i, "", "", extrinsics);
+  }
+  sensors.SetMergeFrames(merge);
+  sensors.SetNumberOfThreads(2);
+  std::vector<vtkSmartPointer<vtkPolyData> > frames;
+  if (!sensors.Start())
+  {
+    std::cerr << "Failed to start the decoding of several sensors" << std::endl;
+    return frames;
+  }
+
+  vtkPacketFileReader reader;
+  if (!reader.Open(pcapFileName))
+  {
+    std::cerr << "Failed to open " << pcapFileName << std::endl;
+    return frames;
+  }
+  const unsigned char* data = 0;
+  unsigned int dataLength = 0;
+  double time = 0;
+  while (reader.NextPacket(data, dataLength, time))
+  {
+    for (int i = 0; i < NumberOfSensors; ++i)
+    {
+      sensors.Enqueue(new NetworkPacket(reinterpret_cast<const char*>(data), dataLength, 0,
+        time + 1e-3 * i, 2368 + i));
+    }
+  }
+
+  // The packets being decoded when stopping are completed
+  while (sensors.GetPacketQueueSize() > 0)
+  {
+    boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+  }
+  sensors.Stop();
+
+  boost::lock_guard<boost::mutex> lock(consumer->ConsumerMutex);
+  for (double timestep : consumer->GetTimesteps())
+  {
+    double actualTime = 0;
+    frames.push_back(consumer->GetFrameForTime(timestep, actualTime));
+  }
+  return frames;
+}
+
+//-----------------------------------------------------------------------------
+//! Mean X of the points of a sensor in a merged frame
+double GetMeanX(vtkPolyData* frame, int sensor)
+{
+  vtkDataArray* sensorArray = frame->GetPointData()->GetArray("sensor");
+  double sum = 0;
+  vtkIdType count = 0;
+  for (vtkIdType i = 0; i < frame->GetNumberOfPoints(); ++i)
+  {
+    if (static_cast<int>(sensorArray->GetTuple1(i)) == sensor)
+    {
+      sum += frame->GetPoint(i)[0];
+      ++count;
+    }
+  }
+  return count > 0 ? sum / count : 0.0;
+}
+}
+
+/**
+ * @brief Decodes a pcap as if it was received from three sensors, and checks that
+ * the frames of the main sensor are kept, and that the merged frames hold the points
+ * of all the sensors with their extrinsics applied.
+ * @param pcapFileName Input PCAP file
+ * @param correctionFileName The corrections to use
+ * @return 0 on success, 1 on failure
+ */
+int main(int argc, char* argv[])
+{
+  if (argc < 3)
+  {
+    std::cerr << "Wrong number of arguments. Usage: TestMultiSensorConsumer <pcapFileName> <correctionFileName>" << std::endl;
+
+    return 1;
+  }
+
+  std::string pcapFileName = argv[1];
+  std::string correctionFileName = argv[2];
+
+  std::vector<vtkSmartPointer<vtkPolyData> > mainFrames =
+    DecodeAsSeveralSensors(pcapFileName, correctionFileName, false);
+  std::vector<vtkSmartPointer<vtkPolyData> > mergedFrames =
+    DecodeAsSeveralSensors(pcapFileName, correctionFileName, true);
+  std::cout << mainFrames.size() << " frames, " << mergedFrames.size() << " merged frames"
+            << std::endl;
+
+  int retVal = 0;
+  if (mainFrames.empty())
+  {
+    std::cerr << "No frame decoded" << std::endl;
+    retVal += 1;
+  }
+  retVal += TestFrameCount(mergedFrames.size(), mainFrames.size());
+  for (size_t frame = 0; frame < std::min(mainFrames.size(), mergedFrames.size()); ++frame)
+  {
+    vtkPolyData* merged = mergedFrames[frame];
+    if (merged->GetNumberOfPoints() != NumberOfSensors * mainFrames[frame]->GetNumberOfPoints())
+    {
+      std::cerr << "Wrong number of points in merged frame " << frame << ": "
+                << merged->GetNumberOfPoints() << " instead of "
+                << NumberOfSensors * mainFrames[frame]->GetNumberOfPoints() << std::endl;
+      retVal += 1;
+      continue;
+    }
+    if (!merged->GetPointData()->GetArray("sensor"))
+    {
+      std::cerr << "No sensor array in merged frame " << frame << std::endl;
+      retVal += 1;
+      continue;
+    }
+    for (int i = 1; i < NumberOfSensors; ++i)
+    {
+      const double offset = GetMeanX(merged, i) - GetMeanX(merged, 0);
+      if (std::abs(offset - i * SensorOffset) > 1e-3)
+      {
+        std::cerr << "Wrong extrinsics of sensor " << i << " in merged frame " << frame << ": "
+                  << offset << " instead of " << i * SensorOffset << std::endl;
+        retVal += 1;
+      }
+    }
+  }
+
+  return retVal;
+}
@@ -0,0 +1,323 @@
+// Copyright 2018 Kitware SAS.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "TestHelpers.h"
+#include "NetworkPacket.h"
+#include "PacketFileSegmentWriter.h"
+#include "PacketFileWriter.h"
+#include "vtkLidarReader.h"
+#include "vtkPacketFileReader.h"
+#include "vtkZstdSeekableFile.h"
+#include <vtkVelodynePacketInterpreter.h>
+
+#include <vtkInformation.h>
+#include <vtkStreamingDemandDrivenPipeline.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace
+{
+//-----------------------------------------------------------------------------
+vtkSmartPointer<vtkLidarReader> OpenSegment(const std::string& fileName,
+  const std::string& correctionFileName, bool showFirstAndLastFrame = false)
+{
+  auto reader = vtkSmartPointer<vtkLidarReader>::New();
+  auto interp = vtkSmartPointer<vtkVelodynePacketInterpreter>::New();
+  reader->SetInterpreter(interp);
+  reader->SetCalibrationFileName(correctionFileName);
+  reader->SetShowFirstAndLastFrame(showFirstAndLastFrame);
+  reader->SetFileName(fileName);
+  reader->Update();
+  return reader;
+}
+
+//-----------------------------------------------------------------------------
+std::vector<double> GetTimesteps(vtkLidarReader* reader)
+{
+  vtkInformation* outInfo = reader->GetExecutive()->GetOutputInformation(0);
+  double* timesteps = outInfo->Get(vtkStreamingDemandDrivenPipeline::TIME_STEPS());
+  const int nTimesteps = outInfo->Length(vtkStreamingDemandDrivenPipeline::TIME_STEPS());
+  return std::vector<double>(timesteps, timesteps + nTimesteps);
+}
+
+//-----------------------------------------------------------------------------
+int TestRecording(const std::string& pcapFileName, const std::string& correctionFileName,
+  const std::string& outputFileName, bool compress)
+{
+  // Interpreter whose configuration the recording splits the frames with
+  auto interp = vtkSmartPointer<vtkVelodynePacketInterpreter>::New();
+  interp->LoadCalibration(correctionFileName);
+
+  PacketFileWriter writer;
+  writer.SetRecordingMode(compress ? PacketFileWriter::Compressed : PacketFileWriter::Buffered);
+  writer.SetInterpreter(interp);
+  writer.GetSegmentWriter().SetMaxSegmentSize(1 << 20);
+  writer.GetSegmentWriter().SetPreallocate(true);
+  writer.Start(outputFileName);
+  if (!writer.IsOpen())
+  {
+    std::cerr << "Failed to open " << outputFileName << std::endl;
+    return 1;
+  }
+
+  vtkPacketFileReader input;
+  if (!input.Open(pcapFileName))
+  {
+    std::cerr << "Failed to open " << pcapFileName << std::endl;
+    return 1;
+  }
+  const unsigned char* data = 0;
+  unsigned int dataLength = 0;
+  double time = 0;
+  while (input.NextPacket(data, dataLength, time))
+  {
+    writer.Enqueue(new NetworkPacket(reinterpret_cast<const char*>(data), dataLength, 0, time, 0));
+  }
+
+  // wait for the packets to be written before closing the last segment
+  writer.Stop();
+  const int nSegments = writer.GetSegmentWriter().GetNumberOfSegments();
+  std::vector<std::string> segmentFileNames;
+  for (int i = 0; i < nSegments; ++i)
+  {
+    segmentFileNames.push_back(writer.GetSegmentWriter().GetSegmentFileName(i));
+  }
+  writer.Close();
+  std::cout << nSegments << (compress ? " compressed" : "") << " segments written" << std::endl;
+
+  int retVal = 0;
+  for (const std::string& segmentFileName : segmentFileNames)
+  {
+    std::vector<PacketFileSegmentWriter::IndexEntry> entries;
+    if (!PacketFileSegmentWriter::ReadIndex(segmentFileName, interp->GetFramingKey(), entries))
+    {
+      std::cerr << "No valid index for " << segmentFileName << std::endl;
+      retVal += 1;
+      continue;
+    }
+
+    // an interpreter splitting the frames differently does not use the index
+    std::vector<PacketFileSegmentWriter::IndexEntry> otherEntries;
+    interp->SetIgnoreEmptyFrames(!interp->GetIgnoreEmptyFrames());
+    if (PacketFileSegmentWriter::ReadIndex(segmentFileName, interp->GetFramingKey(), otherEntries))
+    {
+      std::cerr << "The index of " << segmentFileName << " is used by an interpreter"
+                << " with another framing configuration" << std::endl;
+      retVal += 1;
+    }
+    interp->SetIgnoreEmptyFrames(!interp->GetIgnoreEmptyFrames());
+
+    vtkSmartPointer<vtkLidarReader> indexed = OpenSegment(segmentFileName, correctionFileName);
+    std::vector<double> indexedTimesteps = GetTimesteps(indexed);
+
+    // without its index, the segment is read entirely
+    std::remove(PacketFileSegmentWriter::GetIndexFileName(segmentFileName).c_str());
+    vtkSmartPointer<vtkLidarReader> scanned = OpenSegment(segmentFileName, correctionFileName);
+    std::vector<double> scannedTimesteps = GetTimesteps(scanned);
+
+    // the index holds the frames found by a reader opening this segment alone,
+    // including the first and the last ones
+    vtkSmartPointer<vtkLidarReader> fresh = OpenSegment(segmentFileName, correctionFileName, true);
+    std::vector<double> freshTimesteps = GetTimesteps(fresh);
+    if (entries.size() != freshTimesteps.size())
+    {
+      std::cerr << entries.size() << " frames in the index of " << segmentFileName
+                << " instead of " << freshTimesteps.size() << std::endl;
+      retVal += 1;
+    }
+    for (size_t i = 0; i < std::min(entries.size(), freshTimesteps.size()); ++i)
+    {
+      if (std::abs(entries[i].Time - freshTimesteps[i]) > 1e-6)
+      {
+        std::cerr << "Wrong time of the frame " << i << " in the index of " << segmentFileName
+                  << ": " << entries[i].Time << " instead of " << freshTimesteps[i] << std::endl;
+        retVal += 1;
+        break;
+      }
+    }
+
+    retVal += TestFrameCount(indexed->GetNumberOfFrames(), scanned->GetNumberOfFrames());
+    if (indexedTimesteps.size() != scannedTimesteps.size())
+    {
+      continue;
+    }
+    for (size_t i = 0; i < indexedTimesteps.size(); ++i)
+    {
+      if (std::abs(indexedTimesteps[i] - scannedTimesteps[i]) > 1e-6)
+      {
+        std::cerr << "Wrong timestep " << i << " in " << segmentFileName << ": "
+                  << indexedTimesteps[i] << " instead of " << scannedTimesteps[i] << std::endl;
+        retVal += 1;
+      }
+    }
+    indexed->Open();
+    scanned->Open();
+    for (int frame = 0; frame < indexed->GetNumberOfFrames(); ++frame)
+    {
+      vtkSmartPointer<vtkPolyData> indexedFrame = indexed->GetFrame(frame);
+      vtkSmartPointer<vtkPolyData> scannedFrame = scanned->GetFrame(frame);
+      retVal += TestPointCount(indexedFrame, scannedFrame);
+    }
+    indexed->Close();
+    scanned->Close();
+    std::remove(segmentFileName.c_str());
+  }
+
+  return retVal;
+}
+
+//-----------------------------------------------------------------------------
+std::string ReadPackets(const std::string& fileName, std::vector<std::vector<unsigned char> >& packets,
+  std::vector<double>& times)
+{
+  vtkPacketFileReader reader;
+  if (!reader.Open(fileName))
+  {
+    return reader.GetLastError();
+  }
+  const unsigned char* data = 0;
+  unsigned int dataLength = 0;
+  double time = 0;
+  while (reader.NextPacket(data, dataLength, time))
+  {
+    packets.push_back(std::vector<unsigned char>(data, data + dataLength));
+    times.push_back(time);
+  }
+  return reader.GetLastError();
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * @brief Compresses the first records of a pcap in small frames without the seek table,
+ * as a recording interrupted before being closed, followed by a corrupted record and an
+ * incomplete frame, and checks that it gives the packets of the same records uncompressed
+ * @return the number of errors
+ */
+int TestInterruptedRecording(const std::string& pcapFileName, const std::string& outputFileName)
+{
+  std::ifstream input(pcapFileName.c_str(), std::ios::binary);
+  const std::vector<char> pcap((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+
+  // the first half of the records, up to 1 MB
+  const size_t globalHeaderSize = 24;
+  const size_t recordHeaderSize = 16;
+  size_t end = globalHeaderSize;
+  while (end + recordHeaderSize <= pcap.size() && end < std::min(pcap.size() / 2, static_cast<size_t>(1 << 20)))
+  {
+    uint32_t length = 0;
+    std::memcpy(&length, pcap.data() + end + 8, sizeof(length));
+    if (end + recordHeaderSize + length > pcap.size())
+    {
+      break;
+    }
+    end += recordHeaderSize + length;
+  }
+
+  const std::string plainFileName = outputFileName + ".plain.pcap";
+  std::ofstream plain(plainFileName.c_str(), std::ios::binary);
+  plain.write(pcap.data(), end);
+  plain.close();
+
+  // frames of 64 kB, then a record longer than any packet, then a frame cut in half
+  const size_t frameSize = 1 << 16;
+  vtkZstdSeekableWriter compressor;
+  std::vector<char> frame(vtkZstdSeekableWriter::GetFrameBound(frameSize));
+  const std::string interruptedFileName = outputFileName + ".interrupted.pcap";
+  std::ofstream interrupted(interruptedFileName.c_str(), std::ios::binary);
+  for (size_t offset = 0; offset < end; offset += frameSize)
+  {
+    const size_t size = std::min(frameSize, end - offset);
+    interrupted.write(frame.data(), compressor.CompressFrame(pcap.data() + offset, size, frame.data()));
+  }
+  std::vector<char> corrupted(recordHeaderSize + 64, 0);
+  const uint32_t corruptedLength = 1 << 30;
+  std::memcpy(corrupted.data() + 8, &corruptedLength, sizeof(corruptedLength));
+  interrupted.write(frame.data(), compressor.CompressFrame(corrupted.data(), corrupted.size(), frame.data()));
+  const size_t lastFrameSize = compressor.CompressFrame(pcap.data(), std::min(frameSize, end), frame.data());
+  interrupted.write(frame.data(), lastFrameSize / 2);
+  interrupted.close();
+
+  int errors = 0;
+  std::vector<std::vector<unsigned char> > expectedPackets, packets;
+  std::vector<double> expectedTimes, times;
+  ReadPackets(plainFileName, expectedPackets, expectedTimes);
+  const std::string error = ReadPackets(interruptedFileName, packets, times);
+  std::cout << packets.size() << " packets read from the interrupted recording, " << error << std::endl;
+  if (expectedPackets.empty())
+  {
+    std::cerr << "No packet in the first records of " << pcapFileName << std::endl;
+    errors++;
+  }
+  if (error.empty())
+  {
+    std::cerr << "The corrupted record was not reported" << std::endl;
+    errors++;
+  }
+  if (packets != expectedPackets || times != expectedTimes)
+  {
+    std::cerr << packets.size() << " packets read from the interrupted recording instead of "
+              << expectedPackets.size() << ", or different ones" << std::endl;
+    errors++;
+  }
+  std::remove(plainFileName.c_str());
+  std::remove(interruptedFileName.c_str());
+  return errors;
+}
+}
+
+/**
+ * @brief Records a pcap again with PacketFileWriter, in segments of 1 MB, and checks
+ * that the index of each segment holds the frames found when reading the segment alone,
+ * and that each segment opened with its index gives the same frames as when the
+ * segment is read entirely. The segments are also compressed if zstd is available,
+ * and a compressed recording interrupted before its seek table is read.
+ * @param pcapFileName Input PCAP file
+ * @param correctionFileName The corrections to use
+ * @param outputFileName Name of the recording, the segments are suffixed with their number
+ * @return 0 on success, 1 on failure
+ */
+int main(int argc, char* argv[])
+{
+  if (argc < 4)
+  {
+    std::cerr << "Wrong number of arguments. Usage: TestPacketFileSegmentWriter <pcapFileName> <correctionFileName> <outputFileName>" << std::endl;
+
+    return 1;
+  }
+
+  std::string pcapFileName = argv[1];
+  std::string correctionFileName = argv[2];
+  std::string outputFileName = argv[3];
+
+  std::cout << "-------------------------------------------------------------------------" << std::endl
+            << "Pcap :\t" << pcapFileName << std::endl
+            << "Corrections :\t" << correctionFileName << std::endl
+            << "Output :\t" << outputFileName << std::endl
+            << "-------------------------------------------------------------------------" << std::endl;
+
+  int retVal = TestRecording(pcapFileName, correctionFileName, outputFileName, false);
+  // the compressed segments must give the same frames, even without their seek table
+  if (vtkZstdSeekableWriter::IsAvailable())
+  {
+    retVal += TestRecording(pcapFileName, correctionFileName, outputFileName, true);
+    retVal += TestInterruptedRecording(pcapFileName, outputFileName);
+  }
+
+  return retVal;
+}
@@ -0,0 +1,195 @@
+// Copyright 2018 Kitware SAS.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "CeresCostFunctions.h"
+#include "PoseSolver.h"
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+
+namespace
+{
+typedef Eigen::Matrix<double, 6, 1> Vector6d;
+typedef CostFunctions::MahalanobisDistanceAnalyticResidual AnalyticResidual;
+
+//-----------------------------------------------------------------------------
+/**
+ * @brief CheckJacobian compares the analytic residual and jacobian with the
+ * value and central differences of the residual differentiated by ceres
+ * @return the number of errors
+ */
+template <typename AutoDiffResidual>
+int CheckJacobian(const AnalyticResidual& residual, const AutoDiffResidual& reference, const Vector6d& w)
+{
+  int errors = 0;
+  double J[6];
+  const double value = residual.Evaluate(CostFunctions::EulerAngleRotation(w.data()), w.data(), J);
+  double expected;
+  reference(w.data(), &expected);
+  if (std::abs(value - expected) > 1e-9 * std::max(1.0, expected))
+  {
+    std::cerr << "Residual " << value << " instead of " << expected << std::endl;
+    errors++;
+  }
+
+  for (int i = 0; i < 6; ++i)
+  {
+    Vector6d wPlus = w, wMinus = w;
+    wPlus(i) += 1e-6;
+    wMinus(i) -= 1e-6;
+    double valuePlus, valueMinus;
+    reference(wPlus.data(), &valuePlus);
+    reference(wMinus.data(), &valueMinus);
+    const double derivative = (valuePlus - valueMinus) / 2e-6;
+    if (std::abs(derivative - J[i]) > 1e-5 * std::max(1.0, std::abs(derivative)))
+    {
+      std::cerr << "Derivative " << i << " " << J[i] << " instead of " << derivative << std::endl;
+      errors++;
+    }
+  }
+  return errors;
+}
+}
+
+/**
+ * @brief Checks the analytic jacobians of the slam residuals, then registers
+ * synthetic keypoints matched to lines and planes, with outliers, with the
+ * built-in solver and with ceres, and compares the poses estimated.
+ * @return 0 on success, the number of errors otherwise
+ */
+int main(int, char*[])
+{
+  std::mt19937 generator(42);
+  std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+  int errors = 0;
+
+  for (int test = 0; test < 200; ++test)
+  {
+    Vector6d w;
+    w << uniform(generator), uniform(generator), uniform(generator),
+         10.0 * uniform(generator), 10.0 * uniform(generator), 10.0 * uniform(generator);
+    const Eigen::Vector3d n = Eigen::Vector3d::Random().normalized();
+    const Eigen::Matrix3d A = (test % 2) ? Eigen::Matrix3d(n * n.transpose())
+                                         : Eigen::Matrix3d(Eigen::Matrix3d::Identity() - n * n.transpose());
+    const Eigen::Vector3d C = 20.0 * Eigen::Vector3d::Random();
+    const Eigen::Vector3d X = 20.0 * Eigen::Vector3d::Random();
+    const Eigen::Vector3d T0 = Eigen::Vector3d::Random();
+    const double time = 0.5 * (uniform(generator) + 1.0);
+    const double lambda = 0.5 * (uniform(generator) + 1.0);
+
+    errors += CheckJacobian(AnalyticResidual(A, C, X, lambda),
+                            CostFunctions::MahalanobisDistanceAffineIsometryResidual(A, C, X, lambda), w);
+    errors += CheckJacobian(AnalyticResidual(A, C, X, T0, time, lambda),
+                            CostFunctions::MahalanobisDistanceLinearDistortionResidual(
+                              A, C, X, T0, Eigen::Matrix3d::Identity(), time, lambda), w);
+  }
+
+  // keypoints of a frame matched to planes and lines of the map,
+  // one match out of fifty being wrong
+  Vector6d truth;
+  truth << 0.05, -0.03, 0.1, 1.0, -0.5, 0.2;
+  const CostFunctions::EulerAngleRotation rotation(truth.data());
+  std::vector<AnalyticResidual> residuals;
+  for (int k = 0; k < 20000; ++k)
+  {
+    const Eigen::Vector3d X(30.0 * uniform(generator), 30.0 * uniform(generator), 3.0 * uniform(generator));
+    const Eigen::Vector3d Y = rotation.R * X + truth.tail<3>();
+    const Eigen::Vector3d n = Eigen::Vector3d(uniform(generator), uniform(generator), uniform(generator)).normalized();
+    const bool isPlane = (k % 3 != 0);
+    const Eigen::Matrix3d A = isPlane ? Eigen::Matrix3d(n * n.transpose())
+                                      : Eigen::Matrix3d(Eigen::Matrix3d::Identity() - n * n.transpose());
+    Eigen::Vector3d C = Y + uniform(generator) * (isPlane ? n.unitOrthogonal() : n);
+    if (k % 50 == 0)
+    {
+      C += 3.0 * Eigen::Vector3d(uniform(generator), uniform(generator), uniform(generator));
+    }
+    residuals.push_back(AnalyticResidual(A, C, X, 1.0));
+  }
+
+  // the built-in solver, whose result does not depend on the number of threads
+  Vector6d solution[2];
+  PoseSolver<AnalyticResidual> solver;
+  for (unsigned int thread = 0; thread < 2; ++thread)
+  {
+    ThreadPool pool(thread ? 3 : 0);
+    solver.Clear();
+    for (size_t k = 0; k < residuals.size(); ++k)
+    {
+      solver.AddResidual(residuals[k]);
+    }
+    solution[thread].setZero();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    PoseSolver<AnalyticResidual>::Summary summary = solver.Solve(solution[thread], 50, pool);
+    const double duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Built-in solver, " << pool.GetNumberOfThreads() << " thread(s): " << summary.Iterations
+              << " iterations, cost " << summary.InitialCost << " -> " << summary.FinalCost
+              << " in " << 1000.0 * duration << " ms" << std::endl;
+  }
+  if (solution[0] != solution[1])
+  {
+    std::cerr << "Solutions " << solution[0].transpose() << " and " << solution[1].transpose()
+              << " depend on the number of threads" << std::endl;
+    errors++;
+  }
+
+  // ceres, with the same residuals and loss
+  Vector6d ceresSolution = Vector6d::Zero();
+  ceres::Problem problem;
+  for (size_t k = 0; k < residuals.size(); ++k)
+  {
+    problem.AddResidualBlock(new CostFunctions::AnalyticCostFunction<AnalyticResidual>(residuals[k]),
+                             new ceres::ArctanLoss(2.0), ceresSolution.data());
+  }
+  ceres::Solver::Options options;
+  options.max_num_iterations = 50;
+  options.linear_solver_type = ceres::DENSE_QR;
+  ceres::Solver::Summary summary;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  ceres::Solve(options, &problem, &summary);
+  const double duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cout << summary.BriefReport() << " in " << 1000.0 * duration << " ms" << std::endl;
+
+  if ((solution[0] - ceresSolution).norm() > 1e-6)
+  {
+    std::cerr << "Built-in solution " << solution[0].transpose() << " instead of "
+              << ceresSolution.transpose() << std::endl;
+    errors++;
+  }
+  if ((solution[0] - truth).norm() > 1e-2)
+  {
+    std::cerr << "Solution " << solution[0].transpose() << " instead of " << truth.transpose() << std::endl;
+    errors++;
+  }
+
+  // the covariance, as the slam computes it with ceres at the solution
+  ceres::Covariance::Options covOptions;
+  covOptions.apply_loss_function = true;
+  covOptions.algorithm_type = ceres::CovarianceAlgorithmType::DENSE_SVD;
+  ceres::Covariance covariance(covOptions);
+  std::vector<std::pair<const double*, const double*> > blocks;
+  blocks.push_back(std::make_pair(ceresSolution.data(), ceresSolution.data()));
+  covariance.Compute(blocks, &problem);
+  Eigen::Matrix<double, 6, 6, Eigen::RowMajor> expectedCovariance;
+  covariance.GetCovarianceBlock(ceresSolution.data(), ceresSolution.data(), expectedCovariance.data());
+  const Eigen::Matrix<double, 6, 6> builtInCovariance = solver.GetCovariance();
+  if ((builtInCovariance - expectedCovariance).norm() > 1e-3 * expectedCovariance.norm())
+  {
+    std::cerr << "Covariance" << std::endl << builtInCovariance << std::endl
+              << "instead of" << std::endl << expectedCovariance << std::endl;
+    errors++;
+  }
+  return errors;
+}
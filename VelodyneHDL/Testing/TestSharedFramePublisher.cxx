@@ -0,0 +1,327 @@
+// Copyright 2018 Kitware SAS.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "SharedFramePublisher.h"
+#include "vvSharedFrameReader.h"
+
+#include <vtkDoubleArray.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+#include <vtkUnsignedCharArray.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace
+{
+const int NumberOfSlots = 4;
+const uint64_t SlotSize = 8 * 1024 * 1024;
+const vtkIdType NumberOfPoints = 100000;
+//! frames published to the reader process, at FrameRate
+const int NumberOfFrames = 200;
+//! five times the rate of a sensor spinning at 20 Hz
+const double FrameRate = 100.0;
+
+//-----------------------------------------------------------------------------
+/**
+ * @brief CreateFrame create a frame whose point j is (index, j, 0), with an
+ * "intensity" and a "timestamp" array computed from index and j
+ */
+vtkSmartPointer<vtkPolyData> CreateFrame(int index, vtkIdType nPoints)
+{
+  auto frame = vtkSmartPointer<vtkPolyData>::New();
+  auto points = vtkSmartPointer<vtkPoints>::New();
+  points->SetNumberOfPoints(nPoints);
+  auto intensity = vtkSmartPointer<vtkUnsignedCharArray>::New();
+  intensity->SetName("intensity");
+  intensity->SetNumberOfTuples(nPoints);
+  auto timestamp = vtkSmartPointer<vtkDoubleArray>::New();
+  timestamp->SetName("timestamp");
+  timestamp->SetNumberOfTuples(nPoints);
+  for (vtkIdType j = 0; j < nPoints; ++j)
+  {
+    points->SetPoint(j, index, static_cast<double>(j), 0.0);
+    intensity->SetValue(j, static_cast<unsigned char>((index + j) % 256));
+    timestamp->SetValue(j, index * 1000.0 + j);
+  }
+  frame->SetPoints(points);
+  frame->GetPointData()->AddArray(intensity);
+  frame->GetPointData()->AddArray(timestamp);
+  return frame;
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * @brief CheckFrame check the content of a frame made by CreateFrame
+ * @return an empty string if it is right, what is wrong otherwise
+ */
+std::string CheckFrame(const vvSharedFrameReader::Frame& frame, int index, vtkIdType nPoints)
+{
+  std::ostringstream error;
+  const vvSharedFrameReader::Array* points = frame.GetArray("Points");
+  const vvSharedFrameReader::Array* intensity = frame.GetArray("intensity");
+  const vvSharedFrameReader::Array* timestamp = frame.GetArray("timestamp");
+  if (frame.NumberOfPoints != static_cast<uint64_t>(nPoints) || frame.Arrays.size() != 3 ||
+    !points || points->DataType != vvSharedFrame::Float32 || points->NumberOfComponents != 3 ||
+    !intensity || intensity->DataType != vvSharedFrame::UInt8 ||
+    !timestamp || timestamp->DataType != vvSharedFrame::Float64)
+  {
+    error << "frame " << index << " does not have the expected arrays";
+    return error.str();
+  }
+  if (frame.Time != index || frame.SensorId != static_cast<uint32_t>(index % 3))
+  {
+    error << "frame " << index << " does not have the expected header";
+    return error.str();
+  }
+
+  const float* xyz = static_cast<const float*>(points->Data);
+  const unsigned char* intensities = static_cast<const unsigned char*>(intensity->Data);
+  const double* timestamps = static_cast<const double*>(timestamp->Data);
+  for (vtkIdType j = 0; j < nPoints; ++j)
+  {
+    if (xyz[3 * j] != index || xyz[3 * j + 1] != j ||
+      intensities[j] != static_cast<unsigned char>((index + j) % 256) ||
+      timestamps[j] != index * 1000.0 + j)
+    {
+      error << "point " << j << " of frame " << index << " is wrong";
+      return error.str();
+    }
+  }
+  return "";
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * @brief RunReader read all the frames of the ring until the writer closes it,
+ * as another process would do, using only vvSharedFrameReader
+ * @param ready pipe to write to once the ring is open
+ * @return the number of errors
+ */
+int RunReader(const std::string& name, int ready)
+{
+  vvSharedFrameReader reader;
+  if (!reader.Open(name))
+  {
+    std::cerr << "Reader: " << reader.GetLastError() << std::endl;
+    return 1;
+  }
+  const char byte = 1;
+  if (write(ready, &byte, 1) != 1)
+  {
+    return 1;
+  }
+
+  int errors = 0;
+  int nFrames = 0;
+  double maxLatency = 0;
+  vvSharedFrameReader::Frame frame;
+  while (reader.WaitForNextFrame(frame, 5.0))
+  {
+    const std::string error = CheckFrame(frame, static_cast<int>(frame.Index), NumberOfPoints);
+    if (!reader.IsValid(frame))
+    {
+      std::cerr << "Reader: frame " << frame.Index << " overwritten while being read" << std::endl;
+      errors++;
+    }
+    else if (!error.empty())
+    {
+      std::cerr << "Reader: " << error << std::endl;
+      errors++;
+    }
+    if (frame.Index != static_cast<uint64_t>(nFrames))
+    {
+      std::cerr << "Reader: got frame " << frame.Index << " instead of " << nFrames << std::endl;
+      errors++;
+    }
+    const double latency = std::chrono::duration<double>(
+      std::chrono::steady_clock::now().time_since_epoch()).count() - frame.PublicationTime;
+    maxLatency = std::max(maxLatency, latency);
+    nFrames++;
+  }
+
+  if (nFrames != NumberOfFrames || reader.GetNumberOfFramesLost() != 0)
+  {
+    std::cerr << "Reader: got " << nFrames << " frames out of " << NumberOfFrames << ", "
+              << reader.GetNumberOfFramesLost() << " lost" << std::endl;
+    errors++;
+  }
+  std::cout << "Reader: " << nFrames << " frames of " << NumberOfPoints
+            << " points read, largest delay after publication " << maxLatency * 1e3 << " ms"
+            << std::endl;
+  return errors;
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * @brief TestLateReader check that a reader late by more than the number of slots
+ * skips the frames overwritten, and that frames too large are dropped
+ * @return the number of errors
+ */
+int TestLateReader(const std::string& name)
+{
+  SharedFramePublisher publisher;
+  if (!publisher.Open(name, NumberOfSlots, SlotSize))
+  {
+    return 1;
+  }
+  vvSharedFrameReader reader;
+  if (!reader.Open(name))
+  {
+    std::cerr << reader.GetLastError() << std::endl;
+    return 1;
+  }
+
+  int errors = 0;
+  const vtkIdType nPoints = 1000;
+  for (int i = 0; i < 10; ++i)
+  {
+    vtkSmartPointer<vtkPolyData> frame = CreateFrame(i, nPoints);
+    publisher.Publish(frame, i % 3, i, i);
+  }
+  // too large for a slot, not published
+  vtkSmartPointer<vtkPolyData> largeFrame = CreateFrame(10, SlotSize / 8);
+  if (publisher.Publish(largeFrame, 0, 10, 10) || publisher.GetNumberOfFramesDropped() != 1)
+  {
+    std::cerr << "A frame larger than a slot has been published" << std::endl;
+    errors++;
+  }
+
+  // the oldest frame still available is the one of the slot following the last frame
+  vvSharedFrameReader::Frame frame;
+  int index = 10 - NumberOfSlots + 1;
+  while (reader.GetNextFrame(frame))
+  {
+    const std::string error = CheckFrame(frame, index, nPoints);
+    if (frame.Index != static_cast<uint64_t>(index) || !error.empty() || !reader.IsValid(frame))
+    {
+      std::cerr << "Wrong frame " << frame.Index << " read late: " << error << std::endl;
+      errors++;
+    }
+    index++;
+  }
+  if (index != 10 || reader.GetNumberOfFramesLost() != static_cast<uint64_t>(10 - NumberOfSlots + 1))
+  {
+    std::cerr << "Late reader: " << reader.GetNumberOfFramesLost() << " frames lost" << std::endl;
+    errors++;
+  }
+
+  // a frame is no longer valid once its slot is overwritten
+  vtkSmartPointer<vtkPolyData> nextFrame = CreateFrame(10, nPoints);
+  reader.GetNextFrame(frame);
+  for (int i = 0; i < NumberOfSlots; ++i)
+  {
+    publisher.Publish(nextFrame, 0, 10, 10);
+  }
+  if (reader.IsValid(frame))
+  {
+    std::cerr << "An overwritten frame is still valid" << std::endl;
+    errors++;
+  }
+
+  publisher.Close();
+  if (!reader.IsWriterClosed())
+  {
+    std::cerr << "The reader does not see the writer closing the ring" << std::endl;
+    errors++;
+  }
+  return errors;
+}
+}
+
+/**
+ * @brief Publishes frames in shared memory, and reads them from another process
+ * with vvSharedFrameReader, at a rate higher than the one of the sensors. Checks that
+ * the reader gets every frame, with the right content, and that a late reader skips
+ * the frames overwritten.
+ * @return 0 on success, the number of errors otherwise
+ */
+int main(int, char*[])
+{
+  std::ostringstream name;
+  name << "/TestSharedFramePublisher_" << getpid();
+
+  int retVal = TestLateReader(name.str());
+
+  SharedFramePublisher publisher;
+  if (!publisher.Open(name.str(), NumberOfSlots, SlotSize))
+  {
+    return retVal + 1;
+  }
+
+  int ready[2];
+  if (pipe(ready) != 0)
+  {
+    return retVal + 1;
+  }
+  pid_t reader = fork();
+  if (reader < 0)
+  {
+    return retVal + 1;
+  }
+  if (reader == 0)
+  {
+    close(ready[0]);
+    _exit(std::min(RunReader(name.str(), ready[1]), 100));
+  }
+  close(ready[1]);
+  char byte;
+  if (read(ready[0], &byte, 1) != 1)
+  {
+    std::cerr << "The reader process failed to open the ring" << std::endl;
+    waitpid(reader, nullptr, 0);
+    return retVal + 1;
+  }
+
+  // the frames are made beforehand, so that publishing sets the pace
+  std::vector<vtkSmartPointer<vtkPolyData> > frames;
+  for (int i = 0; i < NumberOfFrames; ++i)
+  {
+    frames.push_back(CreateFrame(i, NumberOfPoints));
+  }
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < NumberOfFrames; ++i)
+  {
+    std::this_thread::sleep_until(start +
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(i / FrameRate)));
+    if (!publisher.Publish(frames[i], i % 3, i, i))
+    {
+      std::cerr << "Failed to publish frame " << i << std::endl;
+      retVal++;
+    }
+  }
+  // give the reader the time to get the last frame before closing
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  publisher.Close();
+
+  int status = 0;
+  waitpid(reader, &status, 0);
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+  {
+    std::cerr << "The reader process failed" << std::endl;
+    retVal++;
+  }
+  return retVal;
+}
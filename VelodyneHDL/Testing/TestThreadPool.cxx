@@ -0,0 +1,88 @@
+// Copyright 2018 Kitware SAS.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ThreadPool.h"
+
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+//-----------------------------------------------------------------------------
+/**
+ * @brief Runs nLoops loops of nTasks tasks and checks that each task is called once
+ * @return the number of errors
+ */
+int RunLoops(ThreadPool& pool, int nLoops, size_t nTasks, const std::string& name)
+{
+  int errors = 0;
+  for (int loop = 0; loop < nLoops; ++loop)
+  {
+    std::vector<boost::atomic<int> > calls(nTasks);
+    for (auto& count : calls)
+    {
+      count = 0;
+    }
+    pool.ParallelFor(nTasks, [&calls](size_t k) { calls[k]++; });
+    for (size_t k = 0; k < nTasks; ++k)
+    {
+      if (calls[k] != 1)
+      {
+        std::cerr << name << ": task " << k << " of loop " << loop << " called " << calls[k] << " times" << std::endl;
+        errors++;
+      }
+    }
+  }
+  return errors;
+}
+}
+
+/**
+ * @brief Runs loops on a ThreadPool from two threads at the same time, as the
+ * front-end and the back-end of the slam do, and checks that each task is
+ * called once before ParallelFor returns, whatever the number of workers.
+ * @return 0 on success, the number of errors otherwise
+ */
+int main(int, char*[])
+{
+  int errors = 0;
+  for (unsigned int nWorkers : { 0, 1, 3 })
+  {
+    ThreadPool pool(nWorkers);
+    if (pool.GetNumberOfThreads() != nWorkers + 1)
+    {
+      std::cerr << pool.GetNumberOfThreads() << " threads instead of " << nWorkers + 1 << std::endl;
+      errors++;
+    }
+
+    int backEndErrors = 0;
+    boost::thread backEnd([&]() { backEndErrors = RunLoops(pool, 200, 7, "back-end"); });
+    errors += RunLoops(pool, 200, 64, "front-end");
+    backEnd.join();
+    errors += backEndErrors;
+    errors += RunLoops(pool, 10, 0, "empty");
+  }
+
+  // the workers can be changed between the loops
+  ThreadPool pool;
+  pool.SetNumberOfWorkers(2);
+  errors += RunLoops(pool, 10, 16, "resized");
+  pool.SetNumberOfWorkers(0);
+  errors += RunLoops(pool, 10, 16, "without workers");
+  return errors;
+}
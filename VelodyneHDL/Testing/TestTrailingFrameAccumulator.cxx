@@ -0,0 +1,222 @@
+// Copyright 2018 Kitware SAS.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "TrailingFrameAccumulator.h"
+
+#include <vtkCellArray.h>
+#include <vtkDataArray.h>
+#include <vtkDoubleArray.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+#include <vtkUnsignedCharArray.h>
+
+#include <algorithm>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+namespace
+{
+const size_t NumberOfFrames = 60;
+
+//-----------------------------------------------------------------------------
+//! Number of points of a frame, some frames being empty
+vtkIdType GetNumberOfPoints(size_t frameId)
+{
+  return frameId % 7 == 3 ? 0 : 50 + static_cast<vtkIdType>((frameId * 37) % 40);
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * @brief CreateFrame create a frame whose point j of frame i is (i, j, 0), with
+ * an "intensity" and a "timestamp" array computed from i and j
+ */
+vtkSmartPointer<vtkPolyData> CreateFrame(size_t frameId)
+{
+  const vtkIdType nPoints = GetNumberOfPoints(frameId);
+  if (frameId % 11 == 5)
+  {
+    return nullptr;
+  }
+  auto frame = vtkSmartPointer<vtkPolyData>::New();
+  auto points = vtkSmartPointer<vtkPoints>::New();
+  points->SetNumberOfPoints(nPoints);
+  auto intensity = vtkSmartPointer<vtkUnsignedCharArray>::New();
+  intensity->SetName("intensity");
+  intensity->SetNumberOfTuples(nPoints);
+  auto timestamp = vtkSmartPointer<vtkDoubleArray>::New();
+  timestamp->SetName("timestamp");
+  timestamp->SetNumberOfTuples(nPoints);
+  for (vtkIdType j = 0; j < nPoints; ++j)
+  {
+    points->SetPoint(j, static_cast<double>(frameId), static_cast<double>(j), 0.0);
+    intensity->SetComponent(j, 0, (frameId + j) % 256);
+    timestamp->SetComponent(j, 0, frameId * 1000.0 + j);
+  }
+  frame->SetPoints(points);
+  frame->GetPointData()->AddArray(intensity);
+  frame->GetPointData()->AddArray(timestamp);
+  return frame;
+}
+
+//-----------------------------------------------------------------------------
+//! (frame, point) of each point of a combined frame, sorted
+std::vector<std::pair<int, int> > GetPointIds(vtkPolyData* combined)
+{
+  std::vector<std::pair<int, int> > ids;
+  vtkDataArray* points = combined->GetPoints() ? combined->GetPoints()->GetData() : nullptr;
+  for (vtkIdType i = 0; i < combined->GetNumberOfPoints(); ++i)
+  {
+    ids.push_back(std::make_pair(static_cast<int>(points->GetComponent(i, 0)),
+      static_cast<int>(points->GetComponent(i, 1))));
+  }
+  std::sort(ids.begin(), ids.end());
+  return ids;
+}
+
+//-----------------------------------------------------------------------------
+/**
+ * @brief CheckWindow check that a combined frame holds all the points of the
+ * frames of a window, with their arrays
+ * @return the number of errors
+ */
+int CheckWindow(vtkPolyData* combined, size_t firstId, size_t endId)
+{
+  std::vector<std::pair<int, int> > expected;
+  for (size_t id = firstId; id < endId; ++id)
+  {
+    if (id % 11 == 5)
+    {
+      continue;
+    }
+    for (vtkIdType j = 0; j < GetNumberOfPoints(id); ++j)
+    {
+      expected.push_back(std::make_pair(static_cast<int>(id), static_cast<int>(j)));
+    }
+  }
+
+  if (GetPointIds(combined) != expected)
+  {
+    std::cerr << "Wrong points in the window [" << firstId << ", " << endId << "): "
+              << combined->GetNumberOfPoints() << " points instead of " << expected.size()
+              << std::endl;
+    return 1;
+  }
+  if (expected.empty())
+  {
+    return 0;
+  }
+
+  if (!combined->GetVerts() || combined->GetVerts()->GetNumberOfCells() != combined->GetNumberOfPoints())
+  {
+    std::cerr << "Wrong number of vertices in the window [" << firstId << ", " << endId << ")"
+              << std::endl;
+    return 1;
+  }
+
+  vtkDataArray* points = combined->GetPoints()->GetData();
+  vtkDataArray* intensity = combined->GetPointData()->GetArray("intensity");
+  vtkDataArray* timestamp = combined->GetPointData()->GetArray("timestamp");
+  if (!intensity || !timestamp)
+  {
+    std::cerr << "Missing point arrays in the window [" << firstId << ", " << endId << ")"
+              << std::endl;
+    return 1;
+  }
+  for (vtkIdType i = 0; i < combined->GetNumberOfPoints(); ++i)
+  {
+    const size_t id = static_cast<size_t>(points->GetComponent(i, 0));
+    const vtkIdType j = static_cast<vtkIdType>(points->GetComponent(i, 1));
+    if (intensity->GetComponent(i, 0) != (id + j) % 256 ||
+      timestamp->GetComponent(i, 0) != id * 1000.0 + j)
+    {
+      std::cerr << "Point arrays not matching point " << j << " of frame " << id
+                << " in the window [" << firstId << ", " << endId << ")" << std::endl;
+      return 1;
+    }
+  }
+  return 0;
+}
+}
+
+/**
+ * @brief Moves a window of trailing frames forward and backward, with and without
+ * keeping the previous results, and checks that the combined frames hold the points
+ * of the frames of the window, that only the frames entering the window are copied
+ * when it slides, and that the results kept are not modified afterwards.
+ * @return 0 on success, the number of errors otherwise
+ */
+int main(int, char*[])
+{
+  std::vector<vtkSmartPointer<vtkPolyData> > frames;
+  for (size_t id = 0; id < NumberOfFrames; ++id)
+  {
+    frames.push_back(CreateFrame(id));
+  }
+  auto getFrame = [&frames](size_t id) { return frames[id]; };
+
+  int retVal = 0;
+  TrailingFrameAccumulator accumulator;
+  const size_t windowSize = 8;
+
+  // slide the window one frame at a time, the results being released
+  for (size_t end = 1; end <= NumberOfFrames; ++end)
+  {
+    const size_t first = end - std::min(end, windowSize);
+    vtkSmartPointer<vtkPolyData> combined = accumulator.Update(first, end, getFrame);
+    retVal += CheckWindow(combined, first, end);
+    if (end > 2 && accumulator.GetNumberOfFramesCopied() > 1)
+    {
+      std::cerr << accumulator.GetNumberOfFramesCopied() << " frames copied to slide the window"
+                << " to [" << first << ", " << end << ")" << std::endl;
+      retVal++;
+    }
+  }
+
+  // keep the last results, as a pipeline does until its next update
+  std::vector<std::pair<vtkSmartPointer<vtkPolyData>, std::vector<std::pair<int, int> > > > kept;
+  for (size_t end = NumberOfFrames; end > windowSize; --end)
+  {
+    const size_t first = end - windowSize;
+    vtkSmartPointer<vtkPolyData> combined = accumulator.Update(first, end, getFrame);
+    retVal += CheckWindow(combined, first, end);
+    kept.push_back(std::make_pair(combined, GetPointIds(combined)));
+    if (kept.size() > 2)
+    {
+      kept.erase(kept.begin());
+    }
+  }
+  for (const auto& result : kept)
+  {
+    if (GetPointIds(result.first) != result.second)
+    {
+      std::cerr << "A combined frame has been modified while in use" << std::endl;
+      retVal++;
+    }
+  }
+  kept.clear();
+
+  // jump around and change the size of the window
+  const size_t windows[][2] = { { 40, 41 }, { 3, 30 }, { 4, 31 }, { 20, 20 }, { 0, 60 },
+    { 10, 12 }, { 11, 14 }, { 0, 1 } };
+  for (const auto& window : windows)
+  {
+    vtkSmartPointer<vtkPolyData> combined = accumulator.Update(window[0], window[1], getFrame);
+    retVal += CheckWindow(combined, window[0], window[1]);
+  }
+
+  return retVal;
+}
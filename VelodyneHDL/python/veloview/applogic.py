@@ -92,6 +92,11 @@ class AppLogic(object):
         self.statusLabel = QtGui.QLabel()
         self.sensorInformationLabel = QtGui.QLabel()
         self.positionPacketInfoLabel = QtGui.QLabel()
+        self.streamStatisticsLabel = QtGui.QLabel()
+
+        # refresh the statistics of the live stream once per second
+        self.streamStatisticsTimer = QtCore.QTimer()
+        self.streamStatisticsTimer.setInterval(1000)
 
 
 class GridProperties:
@@ -419,6 +424,7 @@ def openSensor():
     app.colorByInitialized = False
     app.filenameLabel.setText('Live sensor stream (Port:'+str(LIDARPort)+')' )
     app.positionPacketInfoLabel.setText('')
+    app.streamStatisticsTimer.start()
     enableSaveActions()
 
     onCropReturns(False) # Dont show the dialog just restore settings
@@ -1122,6 +1128,15 @@ def onAbout():
     aboutDialog.showDialog(getMainWindow())
 
 
+def updateStreamStatistics():
+    sensor = getSensor()
+    if sensor is None:
+        app.streamStatisticsTimer.stop()
+        app.streamStatisticsLabel.setText('')
+        return
+    app.streamStatisticsLabel.setText(sensor.GetClientSideObject().GetStatisticsSummary())
+
+
 def close():
     # Save grid properties for this session
     app.gridProperties.Normal = app.grid.Normal
@@ -1145,6 +1160,8 @@ def close():
     resetCameraToForwardView()
     app.filenameLabel.setText('')
     app.statusLabel.setText('')
+    app.streamStatisticsTimer.stop()
+    app.streamStatisticsLabel.setText('')
     disableSaveActions()
     app.actions['actionRecord'].setChecked(False)
     app.actions['actionDualReturnModeDual'].setChecked(True)
@@ -1545,6 +1562,8 @@ def setupStatusBar():
     statusBar.addWidget(app.statusLabel)
     statusBar.addWidget(app.sensorInformationLabel)
     statusBar.addWidget(app.positionPacketInfoLabel)
+    statusBar.addWidget(app.streamStatisticsLabel)
+    app.streamStatisticsTimer.connect('timeout()', updateStreamStatistics)
 
 
 def onGridProperties():